@@ -23,6 +23,9 @@ DEFINES += QT_DEPRECATED_WARNINGS
 #DEFINES += QT_DISABLE_DEPRECATED_BEFORE=0x060000    # disables all the APIs deprecated before Qt 6.0.0
 
 
+# Frame format shared with the Raspberry Pi streamer (peh_test)
+INCLUDEPATH += ../../evk_service_linux_armv7l_xc111_r4a_xr111-3_r1c_a111_r2c/source
+
 SOURCES += \
         main.cpp \
         mainwindow.cpp \
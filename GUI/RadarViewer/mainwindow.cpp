@@ -2,6 +2,9 @@
 #include "ui_mainwindow.h"
 #include <QDebug>
 #include <QNetworkInterface>
+#include <cstring>
+
+#include "peh_frame.h"
 
 
 void processEventQueueSleep(int msec)
@@ -61,31 +64,110 @@ MainWindow::~MainWindow()
 
 
 
-void MainWindow::updateGraph()
+QCPGraph *MainWindow::graphForSensor(int sensor_id)
+{
+  static const Qt::GlobalColor colors[] = { Qt::blue, Qt::red, Qt::darkGreen, Qt::magenta };
+
+  if (sensor_id < 1 || sensor_id > NO_OF_GRAPHS)
+  {
+    return NULL;
+  }
+
+  // Graph n-1 belongs to sensor n, graph 0 exists from the start
+  while (ui->customPlot->graphCount() < sensor_id)
+  {
+    QCPGraph *graph = ui->customPlot->addGraph();
+    graph->setPen(QPen(colors[(ui->customPlot->graphCount() - 1) % 4]));
+  }
+
+  return ui->customPlot->graph(sensor_id - 1);
+}
+
+
+void MainWindow::plotEnvelope(int offset)
 {
-#define VECTOR_LENGTH 2048
+  peh_frame_header_t header;
+
+  memcpy(&header, m_vecData.constData() + offset, sizeof(header));
+
+  QCPGraph *graph = graphForSensor(header.sensor_id);
+
+  if (graph == NULL)
+  {
+    qWarning() << "No graph for sensor" << header.sensor_id;
+    return;
+  }
+
   QVector<double> data;
   QVector<double> x;
-  data.clear();
-  x.clear();
+  data.reserve(header.data_length);
+  x.reserve(header.data_length);
 
+  const uint8_t *bins = (const uint8_t *)m_vecData.constData() + offset + header.header_length;
+  double step_m = (header.data_length > 1) ? header.length_m / (header.data_length - 1) : 0.0;
 
-
-  for (int i = 0; i < VECTOR_LENGTH; i+=2)
+  for (int i = 0; i < header.data_length; i++)
   {
-    uint8_t low = m_vecData.at(i);
-    uint8_t high = m_vecData.at(i+1);
+    uint8_t low = bins[2 * i];
+    uint8_t high = bins[2 * i + 1];
 
     double dd =256*high+low;
 
     data.append(dd);
-    x.append(i);
+    x.append(header.start_m + i * step_m);
   }
 
-  ui->customPlot->graph(0)->setData(x,data);
-  ui->customPlot->rescaleAxes();
-  ui->customPlot->yAxis->setRange(0,10000);
-  ui->customPlot->replot();
+  graph->setData(x,data);
+}
+
+
+// Sets the graph data from the datagram in m_vecData, returns false if it had no envelope to plot
+bool MainWindow::plotDatagram()
+{
+  peh_frame_header_t header;
+  int offset = 0;
+  QMap<int, int> envelope_offsets;  // sensor id -> offset of its newest envelope frame
+
+  // A datagram may carry several frames, plot the newest envelope of every sensor
+  while (offset < m_vecData.size())
+  {
+    if (m_vecData.size() - offset < (int)sizeof(header))
+    {
+      qWarning() << "Datagram too short for a frame header:" << m_vecData.size() - offset;
+      break;
+    }
+
+    memcpy(&header, m_vecData.constData() + offset, sizeof(header));
+
+    if (header.magic != PEH_FRAME_MAGIC || header.version != PEH_FRAME_VERSION)
+    {
+      qWarning() << "Unknown frame, magic" << header.magic << "version" << header.version
+                 << "expected version" << PEH_FRAME_VERSION;
+      break;
+    }
+
+    int frame_size = header.header_length + header.data_length * header.item_size;
+
+    if (header.header_length < sizeof(header) || m_vecData.size() - offset < frame_size)
+    {
+      qWarning() << "Truncated frame" << header.sequence_number;
+      break;
+    }
+
+    if (header.type == PEH_FRAME_TYPE_ENVELOPE && header.item_size == 2)
+    {
+      envelope_offsets[header.sensor_id] = offset;
+    }
+
+    offset += frame_size;
+  }
+
+  foreach (int envelope_offset, envelope_offsets)
+  {
+    plotEnvelope(envelope_offset);
+  }
+
+  return !envelope_offsets.isEmpty();
 }
 
 
@@ -95,17 +177,29 @@ void MainWindow::readUDPSocket()
 {
   qDebug() << "In readUDP";
 
+  bool plotted = false;
 
-  m_vecData.resize(m_pUDPSocket->pendingDatagramSize());
+  // All pending datagrams are parsed first, the plot is redrawn once with the newest envelopes
+  while (m_pUDPSocket->hasPendingDatagrams())
+  {
+    m_vecData.resize(m_pUDPSocket->pendingDatagramSize());
 
-  QHostAddress sender;
-  quint16 senderPort;
+    QHostAddress sender;
+    quint16 senderPort;
 
-  m_pUDPSocket->readDatagram(m_vecData.data(), m_vecData.size(), &sender, &senderPort);
+    m_pUDPSocket->readDatagram(m_vecData.data(), m_vecData.size(), &sender, &senderPort);
 
-  updateGraph();
+    plotted = plotDatagram() || plotted;
+  }
   //qCritical() << m_vecData.length();
 
+  if (plotted)
+  {
+    ui->customPlot->rescaleAxes();
+    ui->customPlot->yAxis->setRange(0,10000);
+    ui->customPlot->replot();
+  }
+
 }
 
 
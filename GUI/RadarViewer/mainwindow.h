@@ -4,6 +4,8 @@
 #include <QMainWindow>
 #include <QUdpSocket>
 
+class QCPGraph;
+
 
 namespace Ui {
 class MainWindow;
@@ -24,9 +26,12 @@ private:
     QByteArray m_vecData;
     QString m_ownIPAddr;
 
+    QCPGraph *graphForSensor(int sensor_id);
+    void plotEnvelope(int offset);
+    bool plotDatagram();
+
 
 private slots:
-  void updateGraph();
   void readUDPSocket();
   void enterIPAddr();
 
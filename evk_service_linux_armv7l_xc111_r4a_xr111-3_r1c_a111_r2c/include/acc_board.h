@@ -27,12 +27,23 @@ extern "C" {
 #define ACC_BOARD_DEFAULT_SPI_SPEED	5000000
 
 
+/**
+ * @brief Address in acc_device_memory of the SPI speeds measured with peh_spi_calibrate
+ *
+ * With ACC_BOARD_FLAG_SPI_CALIBRATION, acc_board_init() uses the speed recorded for a bus
+ * instead of the speed of the board. The address is above the threshold cache of peh_test.
+ */
+#define ACC_BOARD_SPI_CALIBRATION_ADDRESS	0x00200000
+
+
 /**
  * @brief Board flags for special behaviour
  */
 typedef enum {
 	ACC_BOARD_FLAG_GPIO_NO_INIT,		// configure GPIOs but do not set direction and level at startup
 	ACC_BOARD_FLAG_GPIO_NO_GPIO,		// report zero GPIOs on the board
+	ACC_BOARD_FLAG_GPIO_CHARDEV,		// use the GPIO character device instead of sysfs
+	ACC_BOARD_FLAG_SPI_CALIBRATION,		// use the SPI speeds recorded in acc_device_memory by peh_spi_calibrate
 	ACC_BOARD_FLAG_MAX			// marker for highest flag number
 } acc_board_flag_t;
 
@@ -169,6 +180,19 @@ extern acc_status_t acc_board_gpio_output(uint_fast8_t gpio, uint_fast8_t level)
 extern acc_status_t acc_board_gpio_read(uint_fast8_t gpio, uint_fast8_t *level);
 
 
+/**
+ * @brief Wait for a sensor to raise its interrupt line
+ *
+ * Returns at once if the line is already high. The thread sleeps until the interrupt or
+ * the timeout, the line is not polled.
+ *
+ * @param[in] sensor The sensor to wait for
+ * @param[in] timeout_ms Longest time to wait
+ * @return Status, ACC_STATUS_TIMEOUT if the line stayed low
+ */
+extern acc_status_t acc_board_wait_for_sensor_interrupt(acc_sensor_t sensor, uint32_t timeout_ms);
+
+
 /**
  * @brief Retrieves the number of sensors connected to the device
  *
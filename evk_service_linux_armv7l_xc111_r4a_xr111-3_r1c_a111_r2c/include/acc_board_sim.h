@@ -0,0 +1,32 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_BOARD_SIM_H_
+#define ACC_BOARD_SIM_H_
+
+#include <stdint.h>
+
+#include "acc_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Drive the interrupt line (GPIO5) of a simulated sensor
+ *
+ * A rising level wakes acc_board_wait_for_sensor_interrupt() for the sensor. Only available
+ * with the simulated board, acc_board_sim_xc111_r4a_xr111-3_r1c.c.
+ *
+ * @param[in] sensor The sensor, 1 to acc_board_get_sensor_count()
+ * @param[in] level 0 or 1
+ * @return Status
+ */
+extern acc_status_t acc_board_sim_set_sensor_interrupt(acc_sensor_t sensor, uint_fast8_t level);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -14,12 +14,24 @@ extern "C" {
 #endif
 
 
+/**
+ * @brief Edges to wait for
+ */
+typedef enum {
+	ACC_DEVICE_GPIO_EDGE_RISING,
+	ACC_DEVICE_GPIO_EDGE_FALLING,
+	ACC_DEVICE_GPIO_EDGE_BOTH
+} acc_device_gpio_edge_enum_t;
+typedef uint32_t acc_device_gpio_edge_t;
+
+
 // These functions are to be used by drivers only, do not use them directly
 extern acc_status_t	(*acc_device_gpio_init_func)(void);
 extern acc_status_t	(*acc_device_gpio_set_initial_pull_func)(uint_fast8_t pin, uint_fast8_t level);
 extern acc_status_t	(*acc_device_gpio_input_func)(uint_fast8_t pin);
 extern acc_status_t	(*acc_device_gpio_read_func)(uint_fast8_t pin, uint_fast8_t *level);
 extern acc_status_t	(*acc_device_gpio_write_func)(uint_fast8_t pin, uint_fast8_t level);
+extern acc_status_t	(*acc_device_gpio_wait_edge_func)(uint_fast8_t pin, acc_device_gpio_edge_t edge, uint32_t timeout_ms, uint_fast8_t *level);
 
 
 /**
@@ -81,6 +93,24 @@ extern acc_status_t acc_device_gpio_read(uint_fast8_t pin, uint_fast8_t *level);
  */
 extern acc_status_t acc_device_gpio_write(uint_fast8_t pin, uint_fast8_t level);
 
+
+/**
+ * @brief Wait for an edge on a GPIO input
+ *
+ * The pin must already be set to input. The calling thread sleeps until the edge, it does not
+ * poll the level. Edges are detected from the first wait for an edge type on a pin, and an edge
+ * that came after the previous wait on the pin returns at once.
+ *
+ * The GPIO pin numbering is decided by the GPIO driver
+ *
+ * @param pin Pin to wait on
+ * @param edge Edges to wait for
+ * @param timeout_ms Longest time to wait
+ * @param[out] level The level after the edge, may be NULL
+ * @return Status, ACC_STATUS_TIMEOUT if there was no edge, ACC_STATUS_UNSUPPORTED if the driver cannot wait
+ */
+extern acc_status_t acc_device_gpio_wait_edge(uint_fast8_t pin, acc_device_gpio_edge_t edge, uint32_t timeout_ms, uint_fast8_t *level);
+
 #ifdef __cplusplus
 }
 #endif
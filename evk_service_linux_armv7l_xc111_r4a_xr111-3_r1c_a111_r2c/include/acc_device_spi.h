@@ -17,10 +17,29 @@ extern "C" {
 #define ACC_DEVICE_SPI_BUS_MAX	2
 
 
+/**
+ * @brief One segment of a vectored SPI transfer
+ *
+ * @param buffer The data to be transferred, received data replaces it
+ * @param buffer_size The size of the buffer in bytes
+ * @param delay_us Time to wait after the segment, before chip select changes
+ * @param cs_deselect Deselect the chip between this segment and the next, the chip is always
+ *        deselected after the last segment
+ */
+typedef struct {
+	uint8_t		*buffer;
+	size_t		buffer_size;
+	uint16_t	delay_us;
+	uint8_t		cs_deselect;
+} acc_device_spi_segment_t;
+
+
 // These functions are to be used by drivers only, do not use them directly
 extern acc_status_t	(*acc_device_spi_init_func)(void);
 extern size_t		(*acc_device_spi_get_max_transfer_size_func)(void);
 extern acc_status_t	(*acc_device_spi_transfer_func)(uint_fast8_t bus, uint_fast8_t device, uint32_t speed, uint8_t *buffer, size_t buffer_size);
+extern acc_status_t	(*acc_device_spi_transfer_segments_func)(uint_fast8_t bus, uint_fast8_t device, uint32_t speed,
+			                                          const acc_device_spi_segment_t *segments, size_t segment_count);
 
 
 /**
@@ -76,6 +95,33 @@ extern acc_status_t acc_device_spi_transfer(
 		uint8_t		*buffer,
 		size_t		buffer_size);
 
+
+/**
+ * @brief Vectored data transfer (SPI)
+ *
+ * The segments are transferred in order, with as few system calls as the driver allows.
+ * Each segment is limited to acc_device_spi_get_max_transfer_size() bytes. The chip stays
+ * selected between segments that do not set cs_deselect. If the driver cannot keep it
+ * selected, ACC_STATUS_BAD_PARAM is returned and nothing is transferred. With spidev, the
+ * segments between two deselects must fit in one message, at most
+ * acc_device_spi_get_max_transfer_size() bytes and 64 segments together. Drivers without
+ * vectored transfers get one acc_device_spi_transfer() per segment, so every segment but
+ * the last must set cs_deselect.
+ *
+ * @param bus The SPI bus to transfer to/from
+ * @param device The SPI device to transfer to/from
+ * @param speed SPI transfer speed in bps
+ * @param segments The segments to transfer
+ * @param segment_count Number of segments
+ * @return Status
+ */
+extern acc_status_t acc_device_spi_transfer_segments(
+		uint_fast8_t				bus,
+		uint_fast8_t				device,
+		uint32_t				speed,
+		const acc_device_spi_segment_t		*segments,
+		size_t					segment_count);
+
 #ifdef __cplusplus
 }
 #endif
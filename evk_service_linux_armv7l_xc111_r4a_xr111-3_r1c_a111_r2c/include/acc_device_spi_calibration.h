@@ -0,0 +1,77 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DEVICE_SPI_CALIBRATION_H_
+#define ACC_DEVICE_SPI_CALIBRATION_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acc_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Size in the non-volatile memory of the speed recorded for one bus
+ *
+ * The speed of bus n is stored at the given address + n * ACC_DEVICE_SPI_CALIBRATION_RECORD_SIZE.
+ */
+#define ACC_DEVICE_SPI_CALIBRATION_RECORD_SIZE	16
+
+
+/**
+ * @brief Find the highest SPI speed that transfers data without errors
+ *
+ * Speeds are tried in the given order, which should be ascending, until one fails. At each
+ * speed transfer_count transfers of a pseudo-random pattern are made and what is read back
+ * is compared with what was sent by CRC-32. This needs MISO looped back to MOSI, it does not
+ * work with a sensor on the chip select.
+ *
+ * @param bus The SPI bus
+ * @param device The SPI device on the bus
+ * @param speeds The speeds to try in Hz
+ * @param speed_count Number of speeds
+ * @param transfer_count Number of transfers at each speed
+ * @param transfer_size Bytes in each transfer, at most acc_device_spi_get_max_transfer_size()
+ * @param[out] best_speed The highest speed where all transfers, at that and lower speeds, passed
+ * @return ACC_STATUS_FAILURE if even the first speed failed
+ */
+extern acc_status_t acc_device_spi_calibration_run(
+		uint_fast8_t	bus,
+		uint_fast8_t	device,
+		const uint32_t	*speeds,
+		size_t		speed_count,
+		uint32_t	transfer_count,
+		size_t		transfer_size,
+		uint32_t	*best_speed);
+
+
+/**
+ * @brief Record the speed of a bus in the non-volatile memory
+ *
+ * @param address Address in acc_device_memory of the records, see ACC_DEVICE_SPI_CALIBRATION_RECORD_SIZE
+ * @param bus The SPI bus
+ * @param speed The speed in Hz
+ * @return Status
+ */
+extern acc_status_t acc_device_spi_calibration_store(uint32_t address, uint_fast8_t bus, uint32_t speed);
+
+
+/**
+ * @brief Read the speed recorded for a bus
+ *
+ * @param address Address in acc_device_memory of the records
+ * @param bus The SPI bus
+ * @param[out] speed The recorded speed in Hz
+ * @return ACC_STATUS_FAILURE if no valid speed is recorded for the bus
+ */
+extern acc_status_t acc_device_spi_calibration_load(uint32_t address, uint_fast8_t bus, uint32_t *speed);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,81 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DRIVER_GPIO_LINUX_CHARDEV_H_
+#define ACC_DRIVER_GPIO_LINUX_CHARDEV_H_
+
+#include <stdint.h>
+
+#include "acc_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Maximum number of groups of lines written together
+ */
+#define ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX		4
+
+/**
+ * @brief Maximum number of lines in a group
+ */
+#define ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX_PINS	8
+
+
+/**
+ * @brief System calls used by the driver to reach the GPIO chip
+ *
+ * Replaced by an in-memory chip to run the driver without GPIO hardware, see
+ * acc_driver_gpio_linux_chardev_fake.h.
+ *
+ * Line events are waited for with poll() and read() directly, so line event requests must
+ * return real file descriptors.
+ */
+typedef struct {
+	int	(*open)(const char *path, int flags);
+	int	(*close)(int fd);
+	int	(*ioctl)(int fd, unsigned long request, void *arg);
+} acc_driver_gpio_linux_chardev_ops_t;
+
+
+/**
+ * @brief Request driver to register with appropriate device(s)
+ *
+ * Pins are line offsets of the chip, which are the BCM numbers for gpiochip0 on Raspberry Pi.
+ *
+ * @param path Path of the GPIO chip, for example "/dev/gpiochip0"
+ * @param chip_ops System calls to use, NULL for the real ones
+ */
+extern void acc_driver_gpio_linux_chardev_register(const char *path, const acc_driver_gpio_linux_chardev_ops_t *chip_ops);
+
+
+/**
+ * @brief Make a set of pins outputs that can be written with a single system call
+ *
+ * The pins stay outputs while the driver is loaded. Writing one of them through
+ * acc_device_gpio_write() still works, setting them to input does not.
+ *
+ * @param pins The pins in the group
+ * @param pin_count Number of pins, at most ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX_PINS
+ * @param[out] group Identifies the group in acc_driver_gpio_linux_chardev_group_write()
+ * @return Status
+ */
+extern acc_status_t acc_driver_gpio_linux_chardev_group_create(const uint_fast8_t *pins, uint_fast8_t pin_count, uint_fast8_t *group);
+
+
+/**
+ * @brief Set the levels of all pins in a group at the same time
+ *
+ * @param group The group
+ * @param levels One level per pin, in the order the pins were given when the group was created
+ * @return Status
+ */
+extern acc_status_t acc_driver_gpio_linux_chardev_group_write(uint_fast8_t group, const uint_fast8_t *levels);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
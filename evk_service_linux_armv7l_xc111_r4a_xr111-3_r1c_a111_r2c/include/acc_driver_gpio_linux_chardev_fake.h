@@ -0,0 +1,72 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_H_
+#define ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acc_driver_gpio_linux_chardev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Maximum number of lines of the fake chip
+ */
+#define ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES	64
+
+
+/**
+ * @brief In-memory GPIO chip, to be given to acc_driver_gpio_linux_chardev_register()
+ *
+ * Implements the line handle ioctls of the GPIO character device, including the check
+ * that a line is only requested once. Any chip path can be opened.
+ */
+extern const acc_driver_gpio_linux_chardev_ops_t acc_driver_gpio_linux_chardev_fake_ops;
+
+
+/**
+ * @brief Release all lines and set the size of the fake chip
+ *
+ * @param line_count Number of lines, at most ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES
+ */
+extern void acc_driver_gpio_linux_chardev_fake_reset(uint_fast16_t line_count);
+
+
+/**
+ * @brief Set the level an input line reads
+ *
+ * A line requested for events gets an event when the level changes to a requested edge.
+ *
+ * @param line The line
+ * @param level 0 or 1
+ */
+extern void acc_driver_gpio_linux_chardev_fake_set_input(uint_fast8_t line, uint_fast8_t level);
+
+
+/**
+ * @brief Get the level driven on a line
+ *
+ * @param line The line
+ * @param[out] level 0 or 1
+ * @return False if the line is not requested as output
+ */
+extern bool acc_driver_gpio_linux_chardev_fake_get_output(uint_fast8_t line, uint_fast8_t *level);
+
+
+/**
+ * @brief Get the number of ioctl calls made since the last reset
+ *
+ * @return Number of ioctl calls
+ */
+extern uint32_t acc_driver_gpio_linux_chardev_fake_get_ioctl_count(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -6,6 +6,8 @@
 
 #include <stdint.h>
 
+#include "acc_types.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -18,6 +20,32 @@ extern "C" {
  */
 extern void acc_driver_gpio_linux_sysfs_register(uint_fast16_t pin_count);
 
+
+/**
+ * @brief Set the directory of the GPIO sysfs files
+ *
+ * Must be called before the GPIOs are used. A directory other than "/sys/class/gpio" is
+ * mostly useful for testing, with something creating gpio# directories on export.
+ *
+ * @param root The directory
+ * @return Status
+ */
+extern acc_status_t acc_driver_gpio_linux_sysfs_set_root(const char *root);
+
+
+/**
+ * @brief Export and open several GPIO pins at once
+ *
+ * All pins are exported before waiting for any of them, so the time until their files can
+ * be opened overlaps. Pins are otherwise opened one at a time as they are first used.
+ *
+ * @param pins GPIO pins
+ * @param pin_count Number of pins
+ * @param[out] ready_us Time from export until each pin could be opened, 0 for pins already open, may be NULL
+ * @return Status
+ */
+extern acc_status_t acc_driver_gpio_linux_sysfs_open(const uint_fast8_t *pins, uint_fast8_t pin_count, uint32_t *ready_us);
+
 #ifdef __cplusplus
 }
 #endif
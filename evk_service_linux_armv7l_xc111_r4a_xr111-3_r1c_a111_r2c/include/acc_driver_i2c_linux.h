@@ -4,16 +4,76 @@
 #ifndef ACC_DRIVER_I2C_LINUX_H_
 #define ACC_DRIVER_I2C_LINUX_H_
 
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include "acc_types.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/**
+ * @brief System calls used by the driver to reach i2c-dev
+ *
+ * Replaced by an in-memory bus to run the driver without I2C hardware, see
+ * acc_driver_i2c_linux_fake.h. I2C_SLAVE takes the address itself as argument.
+ */
+typedef struct {
+	int	(*open)(const char *path, int flags);
+	int	(*close)(int fd);
+	int	(*ioctl)(int fd, unsigned long request, void *arg);
+	ssize_t	(*read)(int fd, void *buffer, size_t size);
+	ssize_t	(*write)(int fd, const void *buffer, size_t size);
+} acc_driver_i2c_linux_ops_t;
+
+
+/**
+ * @brief One register read of acc_driver_i2c_linux_read_registers()
+ *
+ * @param address The address to start reading from
+ * @param address_size Number of bytes of address data, 1 or 2
+ * @param buffer The result of the read is stored here
+ * @param buffer_size The size of the buffer
+ */
+typedef struct {
+	uint16_t	address;
+	uint_fast8_t	address_size;
+	uint8_t		*buffer;
+	size_t		buffer_size;
+} acc_driver_i2c_linux_register_read_t;
+
+
 /**
  * @brief Request driver to register with appropriate device(s)
  */
 extern void acc_driver_i2c_linux_register(void);
 
+
+/**
+ * @brief Request driver to register with appropriate device(s), using other system calls
+ *
+ * @param i2c_ops System calls to use, NULL for the real ones
+ */
+extern void acc_driver_i2c_linux_register_with_ops(const acc_driver_i2c_linux_ops_t *i2c_ops);
+
+
+/**
+ * @brief Read several registers of a device
+ *
+ * The reads are sent as combined transfers of up to 21 reads, each read being the address
+ * followed by a repeated START and the data. No other transaction with the device comes
+ * in between. The driver must be initialized with acc_device_i2c_init().
+ *
+ * @param device_id The ID of the device to read from
+ * @param reads The registers to read
+ * @param read_count Number of reads
+ * @return Status
+ */
+extern acc_status_t acc_driver_i2c_linux_read_registers(uint8_t device_id, const acc_driver_i2c_linux_register_read_t *reads, size_t read_count);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,99 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DRIVER_I2C_LINUX_FAKE_H_
+#define ACC_DRIVER_I2C_LINUX_FAKE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "acc_driver_i2c_linux.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Maximum number of devices on the fake bus
+ */
+#define ACC_DRIVER_I2C_LINUX_FAKE_MAX_DEVICES	8
+
+/**
+ * @brief Number of registers of a fake device, addresses wrap around
+ */
+#define ACC_DRIVER_I2C_LINUX_FAKE_REGISTER_COUNT	256
+
+
+/**
+ * @brief System calls the driver made since the last reset
+ */
+typedef struct {
+	uint32_t	ioctl_count;
+	uint32_t	read_count;
+	uint32_t	write_count;
+} acc_driver_i2c_linux_fake_stats_t;
+
+
+/**
+ * @brief In-memory i2c-dev, to be given to acc_driver_i2c_linux_register_with_ops()
+ *
+ * Devices are register files with an address pointer that is set by the first bytes of a
+ * write and increments with every byte. Transfers to a device that has not been added fail
+ * with ENXIO, as an unanswered address does.
+ */
+extern const acc_driver_i2c_linux_ops_t acc_driver_i2c_linux_fake_ops;
+
+
+/**
+ * @brief Remove all devices and clear the statistics
+ *
+ * The slave selected with I2C_SLAVE is kept, as it belongs to the open file.
+ *
+ * @param rdwr True if the bus takes combined transfers with I2C_RDWR
+ */
+extern void acc_driver_i2c_linux_fake_reset(bool rdwr);
+
+
+/**
+ * @brief Add a device to the bus
+ *
+ * @param device_id The 7-bit ID of the device
+ * @param address_size Number of bytes of register address, 1 or 2
+ * @return False if the bus is full
+ */
+extern bool acc_driver_i2c_linux_fake_add_device(uint8_t device_id, uint_fast8_t address_size);
+
+
+/**
+ * @brief Set a register of a device
+ *
+ * @param device_id The ID of the device
+ * @param address The register
+ * @param value The value
+ */
+extern void acc_driver_i2c_linux_fake_set_register(uint8_t device_id, uint16_t address, uint8_t value);
+
+
+/**
+ * @brief Get a register of a device
+ *
+ * @param device_id The ID of the device
+ * @param address The register
+ * @return The value, 0 for a device that has not been added
+ */
+extern uint8_t acc_driver_i2c_linux_fake_get_register(uint8_t device_id, uint16_t address);
+
+
+/**
+ * @brief Get the system calls made since the last reset
+ *
+ * @param[out] stats The statistics
+ */
+extern void acc_driver_i2c_linux_fake_get_stats(acc_driver_i2c_linux_fake_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
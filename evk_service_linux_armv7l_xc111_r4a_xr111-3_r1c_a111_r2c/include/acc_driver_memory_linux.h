@@ -4,6 +4,10 @@
 #ifndef ACC_DRIVER_MEMORY_LINUX_H_
 #define ACC_DRIVER_MEMORY_LINUX_H_
 
+#include <stdint.h>
+
+#include "acc_types.h"
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -11,9 +15,30 @@ extern "C" {
 
 /**
  * @brief Request driver to register with appropriate device(s)
+ *
+ * The memory is memory.bin in the working directory, mapped into the process and at least
+ * 4 MiB. Writes are kept in RAM and committed together, through memory.journal so that a
+ * power cut leaves either all or none of the writes of a commit. Data is committed every
+ * second, on acc_driver_memory_linux_commit() and at exit.
  */
 extern void acc_driver_memory_linux_register(void);
 
+
+/**
+ * @brief Make all data written so far persistent
+ *
+ * @return Status
+ */
+extern acc_status_t acc_driver_memory_linux_commit(void);
+
+
+/**
+ * @brief Set how often written data is committed
+ *
+ * @param interval_ms Time between commits, 0 to only commit explicitly and at exit
+ */
+extern void acc_driver_memory_linux_set_commit_interval(uint32_t interval_ms);
+
 #ifdef __cplusplus
 }
 #endif
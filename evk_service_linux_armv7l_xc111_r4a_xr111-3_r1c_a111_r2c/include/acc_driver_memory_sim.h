@@ -0,0 +1,37 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DRIVER_MEMORY_SIM_H_
+#define ACC_DRIVER_MEMORY_SIM_H_
+
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Size of the simulated memory
+ */
+#define ACC_DRIVER_MEMORY_SIM_SIZE	(4 * 1024 * 1024)
+
+
+/**
+ * @brief Request driver to register with appropriate device(s)
+ *
+ * The memory is held in RAM and starts out erased (0xff), nothing is kept between runs.
+ */
+extern void acc_driver_memory_sim_register(void);
+
+
+/**
+ * @brief Erase the whole memory
+ */
+extern void acc_driver_memory_sim_erase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -2,18 +2,53 @@
 // All rights reserved
 
 #ifndef ACC_DRIVER_SPI_LINUX_SPIDEV_H_
-#define ACC_DRIVER_SPI_LINUX_SPiDEV_H_
+#define ACC_DRIVER_SPI_LINUX_SPIDEV_H_
+
+#include <stddef.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
 
+/**
+ * @brief Number of SPI buses and chip selects per bus the driver handles
+ */
+/**@{*/
+#define ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_MAX		2
+#define ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_DEVICE_MAX	2
+/**@}*/
+
+
+/**
+ * @brief System calls used by the driver to reach spidev
+ *
+ * Replaced by an in-memory device to run the driver without SPI hardware, see
+ * acc_driver_spi_linux_spidev_fake.h.
+ *
+ * @param get_bufsiz Largest number of bytes spidev accepts in one message, 0 if unknown
+ */
+typedef struct {
+	int	(*open)(const char *path, int flags);
+	int	(*close)(int fd);
+	int	(*ioctl)(int fd, unsigned long request, void *arg);
+	size_t	(*get_bufsiz)(void);
+} acc_driver_spi_linux_spidev_ops_t;
+
+
 /**
  * @brief Request driver to register with appropriate device(s)
  */
 extern void acc_driver_spi_linux_spidev_register(void);
 
+
+/**
+ * @brief Request driver to register with appropriate device(s), using other system calls
+ *
+ * @param spidev_ops System calls to use, NULL for the real ones
+ */
+extern void acc_driver_spi_linux_spidev_register_with_ops(const acc_driver_spi_linux_spidev_ops_t *spidev_ops);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,154 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DRIVER_SPI_LINUX_SPIDEV_ASYNC_H_
+#define ACC_DRIVER_SPI_LINUX_SPIDEV_ASYNC_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acc_driver_spi_linux_spidev.h"
+#include "acc_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Maximum number of transfer buffers of the engine
+ */
+#define ACC_DRIVER_SPI_LINUX_SPIDEV_ASYNC_BUFFER_MAX	8
+
+
+/**
+ * @brief A finished transfer, handed back by acc_driver_spi_linux_spidev_async_wait()
+ *
+ * @param buffer The buffer given to acc_driver_spi_linux_spidev_async_submit(), now holding received data
+ * @param buffer_size Number of bytes transferred
+ * @param status Status of the transfer
+ * @param user_data Pointer given when the transfer was submitted
+ */
+typedef struct {
+	uint8_t		*buffer;
+	size_t		buffer_size;
+	acc_status_t	status;
+	void		*user_data;
+} acc_driver_spi_linux_spidev_async_completion_t;
+
+
+/**
+ * @brief Transfer counters of one chip select
+ *
+ * @param transfer_count Number of finished transfers
+ * @param error_count Number of those that failed
+ * @param byte_count Number of bytes transferred
+ * @param busy_us Time spent in the transfers, byte_count / busy_us is the throughput
+ * @param latency_total_us Sum of the time from submission to completion
+ * @param latency_max_us Longest time from submission to completion
+ */
+typedef struct {
+	uint32_t	transfer_count;
+	uint32_t	error_count;
+	uint64_t	byte_count;
+	uint64_t	busy_us;
+	uint64_t	latency_total_us;
+	uint32_t	latency_max_us;
+} acc_driver_spi_linux_spidev_async_stats_t;
+
+
+/**
+ * @brief Allocate the transfer buffers and start the worker thread
+ *
+ * Transfers are made through acc_device_spi, so any registered SPI driver can be used.
+ * Buffers are page aligned and may be larger than acc_device_spi_get_max_transfer_size().
+ * A transfer is then split into segments of that size, and chip select is released between
+ * them, every bufsiz bytes with the spidev driver. A transfer that must be made with chip
+ * select held throughout must not be larger than acc_device_spi_get_max_transfer_size().
+ *
+ * @param buffer_count Number of buffers, 2 to ACC_DRIVER_SPI_LINUX_SPIDEV_ASYNC_BUFFER_MAX
+ * @param buffer_size Size of each buffer in bytes
+ * @return Status
+ */
+extern acc_status_t acc_driver_spi_linux_spidev_async_start(uint_fast8_t buffer_count, size_t buffer_size);
+
+
+/**
+ * @brief Finish the submitted transfers, stop the worker thread and free the buffers
+ *
+ * Completions not waited for are discarded.
+ */
+extern void acc_driver_spi_linux_spidev_async_stop(void);
+
+
+/**
+ * @brief Get a buffer to fill with data to transfer
+ *
+ * Blocks until a buffer has been released if all are in use.
+ *
+ * @return The buffer, NULL if the engine is not started
+ */
+extern uint8_t *acc_driver_spi_linux_spidev_async_acquire(void);
+
+
+/**
+ * @brief Queue a transfer of an acquired buffer
+ *
+ * The caller must not touch the buffer until it has been handed back as a completion.
+ * Transfers are made in submission order. The bus is locked during each transfer, selecting
+ * the sensor is up to the caller.
+ *
+ * @param bus The SPI bus to transfer to/from
+ * @param device The SPI device to transfer to/from
+ * @param speed SPI transfer speed in bps
+ * @param buffer A buffer from acc_driver_spi_linux_spidev_async_acquire()
+ * @param buffer_size Number of bytes to transfer, at most the buffer size given at start
+ * @param user_data Returned with the completion
+ * @return Status
+ */
+extern acc_status_t acc_driver_spi_linux_spidev_async_submit(
+		uint_fast8_t	bus,
+		uint_fast8_t	device,
+		uint32_t	speed,
+		uint8_t		*buffer,
+		size_t		buffer_size,
+		void		*user_data);
+
+
+/**
+ * @brief Wait for the oldest submitted transfer to finish
+ *
+ * The buffer of the completion belongs to the caller until it is released.
+ *
+ * @param[out] completion The finished transfer
+ * @param timeout_ms Maximum time to wait, 0 to wait forever
+ * @return ACC_STATUS_TIMEOUT if nothing finished in time, ACC_STATUS_FAILURE if nothing was submitted
+ */
+extern acc_status_t acc_driver_spi_linux_spidev_async_wait(acc_driver_spi_linux_spidev_async_completion_t *completion, uint_fast32_t timeout_ms);
+
+
+/**
+ * @brief Give a buffer back to the engine
+ *
+ * @param buffer A buffer from acc_driver_spi_linux_spidev_async_acquire() or a completion
+ */
+extern void acc_driver_spi_linux_spidev_async_release(uint8_t *buffer);
+
+
+/**
+ * @brief Read the counters of one chip select
+ *
+ * The counters are kept from start to the next start.
+ *
+ * @param bus The SPI bus
+ * @param device The SPI device on the bus
+ * @param[out] stats The counters are copied here
+ * @return Status
+ */
+extern acc_status_t acc_driver_spi_linux_spidev_async_get_stats(uint_fast8_t bus, uint_fast8_t device, acc_driver_spi_linux_spidev_async_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
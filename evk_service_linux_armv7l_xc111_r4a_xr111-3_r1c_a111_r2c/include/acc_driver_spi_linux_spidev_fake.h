@@ -0,0 +1,88 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_DRIVER_SPI_LINUX_SPIDEV_FAKE_H_
+#define ACC_DRIVER_SPI_LINUX_SPIDEV_FAKE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acc_driver_spi_linux_spidev.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief What the fake device has done since the last reset
+ *
+ * @param ioctl_count Number of ioctl calls
+ * @param message_count Number of SPI_IOC_MESSAGE ioctls that succeeded
+ * @param transfer_count Number of transfers in those messages
+ * @param byte_count Number of bytes in those transfers
+ * @param cs_deselect_count Number of times chip select was released within a message
+ * @param bus_time_us Time the transfers would have taken on the bus, including delays
+ */
+typedef struct {
+	uint32_t	ioctl_count;
+	uint32_t	message_count;
+	uint32_t	transfer_count;
+	uint64_t	byte_count;
+	uint32_t	cs_deselect_count;
+	uint64_t	bus_time_us;
+} acc_driver_spi_linux_spidev_fake_stats_t;
+
+
+/**
+ * @brief In-memory spidev, to be given to acc_driver_spi_linux_spidev_register_with_ops()
+ *
+ * Every device is a loopback, what is sent is read back. Messages larger than bufsiz are
+ * refused with EMSGSIZE, as spidev does. Any device path can be opened.
+ */
+extern const acc_driver_spi_linux_spidev_ops_t acc_driver_spi_linux_spidev_fake_ops;
+
+
+/**
+ * @brief Clear the statistics and set the size of the message buffer
+ *
+ * Call before registering the driver, which reads bufsiz once.
+ *
+ * @param bufsiz Largest message in bytes, 0 to act as if bufsiz could not be read
+ */
+extern void acc_driver_spi_linux_spidev_fake_reset(size_t bufsiz);
+
+
+/**
+ * @brief Make messages take as long as they would on the bus
+ *
+ * Off by default, messages then return at once.
+ *
+ * @param enable True to sleep for the bus time of each message
+ */
+extern void acc_driver_spi_linux_spidev_fake_set_bus_sleep(bool enable);
+
+
+/**
+ * @brief Make transfers faster than a speed read back corrupted data
+ *
+ * One bit of every such transfer is flipped, as a bus wired for a lower speed would do.
+ *
+ * @param speed_hz Highest speed that transfers cleanly, 0 for no errors at any speed
+ */
+extern void acc_driver_spi_linux_spidev_fake_set_max_speed(uint32_t speed_hz);
+
+
+/**
+ * @brief Get what the fake device has done since the last reset
+ *
+ * @param[out] stats The statistics
+ */
+extern void acc_driver_spi_linux_spidev_fake_get_stats(acc_driver_spi_linux_spidev_fake_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -23,7 +23,12 @@ typedef enum {
 typedef uint32_t acc_log_level_t;
 
 
+// With ACC_LOG_ASYNC defined, messages are formatted and written by a background thread, see acc_log_async.h
+#if defined(ACC_LOG_ASYNC)
+#define ACC_LOG(level, ...)	acc_log_async(level, MODULE, __VA_ARGS__)
+#else
 #define ACC_LOG(level, ...)	acc_log(level, MODULE, __VA_ARGS__)
+#endif
 
 #define ACC_LOG_FATAL(...)	ACC_LOG(ACC_LOG_LEVEL_FATAL, __VA_ARGS__)
 #define ACC_LOG_ERROR(...)	ACC_LOG(ACC_LOG_LEVEL_ERROR, __VA_ARGS__)
@@ -45,4 +50,8 @@ extern void acc_log(acc_log_level_t level, char *module, char *format, ...);
 }
 #endif
 
+#if defined(ACC_LOG_ASYNC)
+#include "acc_log_async.h"
+#endif
+
 #endif
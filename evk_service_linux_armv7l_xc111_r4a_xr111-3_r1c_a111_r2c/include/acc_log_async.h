@@ -0,0 +1,93 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_LOG_ASYNC_H_
+#define ACC_LOG_ASYNC_H_
+
+#include <stdint.h>
+
+#include "acc_log.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Counts of the asynchronous log backend
+ *
+ * @param thread_count Threads with a log ring
+ * @param written_count Messages handed to acc_log()
+ * @param dropped_count Messages dropped because the ring of their thread was full
+ */
+typedef struct {
+	uint32_t	thread_count;
+	uint64_t	written_count;
+	uint64_t	dropped_count;
+} acc_log_async_stats_t;
+
+
+/**
+ * @brief Log a message through the asynchronous backend
+ *
+ * The ACC_LOG_* macros call this instead of acc_log() when ACC_LOG_ASYNC is defined. The
+ * calling thread only stores the format pointer, a monotonic timestamp and the arguments in a
+ * ring of its own, without locks or system calls. A background thread formats the messages
+ * in time order and passes them to acc_log(). A message is dropped and counted when the ring
+ * of its thread is full. The background thread sleeps while nothing is queued, and the first
+ * message after that wakes it with one system call.
+ *
+ * The format and module strings are used after the call returns, so they must be string
+ * literals, as with the ACC_LOG_* macros. String arguments are copied. Messages with
+ * conversions that cannot be stored, such as %n or %Lf, are formatted by the calling thread
+ * and then queued as text. Fatal messages are logged directly.
+ *
+ * @param level The level of the message
+ * @param module The module name
+ * @param format printf style format string
+ */
+extern void acc_log_async(acc_log_level_t level, char *module, char *format, ...);
+
+
+/**
+ * @brief Start the background thread of the asynchronous backend
+ *
+ * Done by the first call to acc_log_async() otherwise. The thread is created with normal
+ * scheduling, whatever profile acc_os_thread_create() applies.
+ */
+extern void acc_log_async_start(void);
+
+
+/**
+ * @brief Log what is queued and stop the background thread
+ *
+ * Messages are logged directly from the calling thread afterwards. Started backends are also
+ * stopped by an exit handler, so messages queued before exit(), including the exit() of the
+ * SIGINT handler of acc_os, are logged.
+ */
+extern void acc_log_async_stop(void);
+
+
+/**
+ * @brief Set the level of messages queued by acc_log_async(), and of acc_log()
+ *
+ * Messages above the level are discarded before they are queued, the default is
+ * ACC_LOG_LEVEL_INFO. Calling acc_log_set_level() alone does not let more messages through.
+ *
+ * @param level The highest level logged
+ */
+extern void acc_log_async_set_level(acc_log_level_t level);
+
+
+/**
+ * @brief Get the counts of the asynchronous backend
+ *
+ * @param[out] stats The counts
+ */
+extern void acc_log_async_get_stats(acc_log_async_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,6 +4,7 @@
 #ifndef ACC_OS_H_
 #define ACC_OS_H_
 
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <time.h>
@@ -36,6 +37,20 @@ typedef uint32_t	acc_os_net_address_t;
 typedef uint16_t	acc_os_net_port_t;
 
 
+/**
+ * @brief A monotonic time and the wall clock time read at the same moment
+ *
+ * @param monotonic_ns Monotonic time in nanoseconds, see acc_os_monotonic_ns()
+ * @param realtime_ns Wall clock time in nanoseconds since the epoch
+ * @param uncertainty_ns Largest difference between the moments the two were read
+ */
+typedef struct {
+	uint64_t	monotonic_ns;
+	uint64_t	realtime_ns;
+	uint32_t	uncertainty_ns;
+} acc_os_time_pair_t;
+
+
 /**
  * @brief Perform any os specific initialization
  */
@@ -63,6 +78,36 @@ extern size_t acc_os_stack_get_usage(size_t stack_size);
  */
 extern void acc_os_sleep_us(uint32_t time_usec);
 
+/**
+ * @brief Start a periodic timer
+ *
+ * The deadlines are a whole number of periods from the start, so a loop waiting on the timer
+ * keeps its rate however long each round takes, unlike one sleeping a fixed time per round.
+ *
+ * @param timer The timer
+ * @param period_us Period in microseconds, the first deadline is one period from now
+ */
+extern void acc_os_timer_start(acc_os_timer_t *timer, uint32_t period_us);
+
+/**
+ * @brief Sleep until the next deadline of a periodic timer
+ *
+ * Returns at once if the deadline has passed. Deadlines that passed more than a period ago are
+ * skipped and counted as overruns, so a late caller is not followed by a burst of short waits.
+ *
+ * @param timer The timer
+ * @return Number of deadlines skipped
+ */
+extern uint32_t acc_os_timer_wait(acc_os_timer_t *timer);
+
+/**
+ * @brief Get the number of deadlines skipped since the timer was started
+ *
+ * @param timer The timer
+ * @return Number of deadlines skipped
+ */
+extern uint32_t acc_os_timer_get_overrun_count(const acc_os_timer_t *timer);
+
 /**
  * @brief Allocate dynamic memory
  *
@@ -102,6 +147,27 @@ extern acc_os_thread_id_t acc_os_get_thread_id(void);
  */
 extern void acc_os_localtime(struct tm *time_tm, uint32_t *time_usec);
 
+/**
+ * @brief Get a monotonic time in nanoseconds
+ *
+ * The time never jumps when the wall clock is set, so it suits timestamps that are compared
+ * with each other, and is cheap enough to stamp every sweep. The starting point is unspecified.
+ *
+ * @return Monotonic time in nanoseconds
+ */
+extern uint64_t acc_os_monotonic_ns(void);
+
+/**
+ * @brief Read the monotonic time and the wall clock time at the same moment
+ *
+ * Wall clock times of monotonic timestamps are found by adding realtime_ns - monotonic_ns of a
+ * recent pair, so sweeps are stamped with one clock read and times from several sensors or
+ * hosts can still be lined up.
+ *
+ * @param[out] pair The times
+ */
+extern void acc_os_time_pair_capture(acc_os_time_pair_t *pair);
+
 /**
  * @brief Initialize a mutex
  *
@@ -131,6 +197,32 @@ extern void acc_os_mutex_lock(acc_os_mutex_t *mutex);
  */
 extern void acc_os_mutex_unlock(acc_os_mutex_t *mutex);
 
+/**
+ * @brief Initialize a counting semaphore
+ *
+ * @param semaphore The semaphore
+ * @param count Posts available from the start
+ */
+extern void acc_os_semaphore_init(acc_os_semaphore_t *semaphore, uint32_t count);
+
+/**
+ * @brief Post a semaphore, waking a thread waiting for it
+ *
+ * Does not block and makes a system call only when a thread is waiting.
+ *
+ * @param semaphore The semaphore
+ */
+extern void acc_os_semaphore_post(acc_os_semaphore_t *semaphore);
+
+/**
+ * @brief Take a post of a semaphore, sleeping until there is one
+ *
+ * @param semaphore The semaphore
+ * @param timeout_us Microseconds to wait at most, 0 to wait until posted
+ * @return True if a post was taken, false on timeout
+ */
+extern bool acc_os_semaphore_wait(acc_os_semaphore_t *semaphore, uint32_t timeout_us);
+
 /**
  * @brief Create new thread
  *
@@ -5,6 +5,13 @@
 #define ACC_OS_LINUX_H_
 
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+
+#include "acc_types.h"
 
 #ifdef __cplusplus
 extern "C" {
@@ -14,14 +21,284 @@ extern "C" {
 #define ACC_OS_INVALID_SOCKET	(-1)
 
 
+/**
+ * @brief Mutex of acc_os_mutex_init(), a zeroed mutex is unlocked
+ *
+ * The union keeps the size of the pthread mutex the type used to hold, which libacconeer is
+ * built with.
+ *
+ * @param state 0 unlocked, 1 locked, 2 locked with threads parked on it
+ * @param spin_estimate Average spins before a contended lock was taken, sets how long the next
+ *        contended lock spins before it parks
+ * @param stats_index Entry of the contention statistics plus one, 0 if it has none
+ */
 typedef struct {
 	uint_fast8_t		is_initialized;
-	pthread_mutex_t		mutex;
+	union {
+		pthread_mutex_t	reserved;
+		struct {
+			uint32_t	state;
+			uint16_t	spin_estimate;
+			uint16_t	stats_index;
+		} futex;
+	} u;
 } acc_os_mutex_t;
 
 typedef int		acc_os_socket_t;
 typedef pthread_t	acc_os_thread_handle_t;
 
+/**
+ * @brief Semaphore of acc_os_semaphore_init()
+ *
+ * @param count Posts not taken yet
+ * @param waiter_count Threads in acc_os_semaphore_wait() that may sleep
+ */
+typedef struct {
+	uint32_t	count;
+	uint32_t	waiter_count;
+} acc_os_semaphore_t;
+
+typedef struct {
+	struct timespec	deadline;
+	uint64_t	period_ns;
+	uint32_t	overrun_count;
+} acc_os_timer_t;
+
+
+/**
+ * @brief Scheduling applied to threads created with acc_os_thread_create()
+ *
+ * @param priority SCHED_FIFO priority 1-99, 0 for normal scheduling
+ * @param cpu CPU the thread is pinned to, -1 to run on any CPU
+ * @param stack_prefault Bytes of stack the thread touches before running its function, so
+ *        the first sweeps do not take page faults, 0 to skip
+ */
+typedef struct {
+	int	priority;
+	int	cpu;
+	size_t	stack_prefault;
+} acc_os_linux_thread_profile_t;
+
+
+/**
+ * @brief Set the profile of threads created from now on
+ *
+ * The service threads of RSS are created with acc_os_thread_create() when a service is
+ * activated, so setting a profile before acc_service_activate() and restoring the default
+ * afterwards gives only the acquisition threads real-time scheduling.
+ *
+ * Real-time priority needs CAP_SYS_NICE or an rtprio limit, e.g. "pi - rtprio 90" in
+ * /etc/security/limits.conf. When it is not permitted the thread is created with normal
+ * scheduling and a warning is logged.
+ *
+ * @param profile The profile to use, NULL to restore normal scheduling on any CPU
+ */
+extern void acc_os_linux_thread_profile_set(const acc_os_linux_thread_profile_t *profile);
+
+
+/**
+ * @brief Lock all current and future memory of the process in RAM
+ *
+ * Keeps sweep buffers and thread stacks from being paged out or faulted in lazily. Also
+ * stops malloc from returning memory to the system, so buffers freed and allocated again
+ * stay resident. Needs CAP_IPC_LOCK or a memlock limit large enough for the process.
+ *
+ * @return Status
+ */
+extern acc_status_t acc_os_linux_memory_lock(void);
+
+
+/**
+ * @brief Number of size classes of acc_os_mem_alloc(), blocks of 32 bytes to 64 KiB
+ *
+ * Each block holds a 16 byte header, larger allocations go to malloc.
+ */
+#define ACC_OS_LINUX_MEM_CLASS_COUNT	12
+
+
+/**
+ * @brief Where acc_os_mem_alloc() takes memory from
+ *
+ * ACC_OS_LINUX_MEM_MODE_POOL keeps a free list per size class, with a cache of blocks per
+ * thread in front of it. Blocks are carved from 64 KiB slabs that are never given back, so
+ * allocation takes the same short time after the first service has been created.
+ *
+ * ACC_OS_LINUX_MEM_MODE_ARENA is the pool mode, and also serves the allocations of a thread
+ * from an arena while it has one entered, see acc_os_linux_mem_arena_enter().
+ */
+typedef enum {
+	ACC_OS_LINUX_MEM_MODE_MALLOC,
+	ACC_OS_LINUX_MEM_MODE_POOL,
+	ACC_OS_LINUX_MEM_MODE_ARENA
+} acc_os_linux_mem_mode_t;
+
+
+/**
+ * @brief Allocation counts of one size class
+ *
+ * @param block_size Size of the blocks of the class, header included, 0 for the allocations
+ *        larger than every class
+ * @param alloc_count Number of allocations
+ * @param free_count Number of frees
+ * @param live_count Allocations not yet freed
+ * @param pool_count Blocks in the free lists and thread caches
+ */
+typedef struct {
+	size_t		block_size;
+	uint32_t	alloc_count;
+	uint32_t	free_count;
+	uint32_t	live_count;
+	uint32_t	pool_count;
+} acc_os_linux_mem_class_stats_t;
+
+
+/**
+ * @brief Memory use through acc_os_mem_alloc()
+ *
+ * @param mode The mode in use
+ * @param live_bytes Bytes requested and not yet freed
+ * @param peak_bytes Highest live_bytes since start or acc_os_linux_mem_reset_peak()
+ * @param slab_bytes Bytes taken from the system for the pools
+ * @param arena_bytes Bytes taken from the system for arenas that still exist
+ * @param classes Counts of each size class, the last entry is for larger allocations
+ */
+typedef struct {
+	acc_os_linux_mem_mode_t		mode;
+	size_t				live_bytes;
+	size_t				peak_bytes;
+	size_t				slab_bytes;
+	size_t				arena_bytes;
+	acc_os_linux_mem_class_stats_t	classes[ACC_OS_LINUX_MEM_CLASS_COUNT + 1];
+} acc_os_linux_mem_stats_t;
+
+
+/**
+ * @brief A region that allocations are taken from until it is destroyed, see acc_os_linux_mem_arena_create()
+ */
+typedef struct acc_os_linux_mem_arena acc_os_linux_mem_arena_t;
+
+
+/**
+ * @brief Select where acc_os_mem_alloc() takes memory from
+ *
+ * Without a call, acc_os_init() selects the mode named by the ACC_OS_MEM environment variable,
+ * "malloc", "pool" or "arena", and malloc if it is not set. The mode may be changed at any
+ * time, memory is always freed to where it came from.
+ *
+ * @param mode The mode
+ */
+extern void acc_os_linux_mem_mode_set(acc_os_linux_mem_mode_t mode);
+
+
+/**
+ * @brief Get the memory use through acc_os_mem_alloc()
+ *
+ * @param[out] stats The memory use
+ */
+extern void acc_os_linux_mem_get_stats(acc_os_linux_mem_stats_t *stats);
+
+
+/**
+ * @brief Restart the peak at the current live bytes
+ */
+extern void acc_os_linux_mem_reset_peak(void);
+
+
+/**
+ * @brief Create an arena
+ *
+ * An arena suits memory with one lifetime, such as what a service allocates while it is
+ * created: enter the arena, create the service, leave the arena, and destroy the arena after
+ * the service. Freeing arena memory does nothing, all of it is released with the arena.
+ *
+ * @param chunk_size Bytes taken from the system each time the arena runs out
+ * @return The arena, NULL if out of memory
+ */
+extern acc_os_linux_mem_arena_t *acc_os_linux_mem_arena_create(size_t chunk_size);
+
+
+/**
+ * @brief Take the allocations of the calling thread from an arena
+ *
+ * Only has an effect in ACC_OS_LINUX_MEM_MODE_ARENA, so programs may use arenas in every mode.
+ *
+ * @param arena The arena, NULL to leave the arena entered
+ */
+extern void acc_os_linux_mem_arena_enter(acc_os_linux_mem_arena_t *arena);
+
+
+/**
+ * @brief Destroy an arena and everything allocated from it
+ *
+ * No thread may have the arena entered.
+ *
+ * @param arena The arena
+ */
+extern void acc_os_linux_mem_arena_destroy(acc_os_linux_mem_arena_t *arena);
+
+
+/**
+ * @brief Contention counts of one mutex, see acc_os_linux_mutex_stats_enable()
+ *
+ * @param mutex The mutex
+ * @param name Name given with acc_os_linux_mutex_set_name(), NULL if none
+ * @param lock_count Number of times the mutex was locked
+ * @param contended_count Locks that found the mutex held
+ * @param wait_ns Time spent waiting in contended locks
+ * @param max_wait_ns Longest wait of a lock
+ * @param max_hold_ns Longest time the mutex was held
+ */
+typedef struct {
+	const acc_os_mutex_t	*mutex;
+	const char		*name;
+	uint64_t		lock_count;
+	uint64_t		contended_count;
+	uint64_t		wait_ns;
+	uint64_t		max_wait_ns;
+	uint64_t		max_hold_ns;
+} acc_os_linux_mutex_stats_t;
+
+
+/**
+ * @brief Count contention of the mutexes of acc_os_mutex_init()
+ *
+ * Without a call, acc_os_init() enables the counts if the ACC_OS_MUTEX_STATS environment
+ * variable is set. Counting reads the clock on every lock and unlock, so it is off by default.
+ * The first 128 mutexes initialized are counted.
+ *
+ * @param enable True to count, false to stop counting and keep the counts so far
+ */
+extern void acc_os_linux_mutex_stats_enable(bool enable);
+
+
+/**
+ * @brief Name a mutex in the contention counts
+ *
+ * @param mutex A mutex initialized with acc_os_mutex_init()
+ * @param name The name, must stay valid, e.g. a string literal
+ */
+extern void acc_os_linux_mutex_set_name(acc_os_mutex_t *mutex, const char *name);
+
+
+/**
+ * @brief Get the contention counts of the mutexes, most waited for first
+ *
+ * The counts are read while the mutexes are in use, so they may be off by a lock.
+ *
+ * @param[out] stats Array for the counts
+ * @param max_count Number of entries in the array
+ * @return Number of entries filled in
+ */
+extern uint32_t acc_os_linux_mutex_get_stats(acc_os_linux_mutex_stats_t *stats, uint32_t max_count);
+
+
+/**
+ * @brief Print the contention counts of the mutexes that have been locked, most waited for first
+ *
+ * @param file Where to print, e.g. stderr
+ */
+extern void acc_os_linux_mutex_stats_dump(FILE *file);
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,107 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef ACC_SIM_SERVICE_ENVELOPE_H_
+#define ACC_SIM_SERVICE_ENVELOPE_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Synthetic envelope service for host builds
+ *
+ * source/acc_sim_service_envelope.c implements acc_service.h, acc_service_envelope.h,
+ * acc_sweep_configuration.h and acc_rss.h without a sensor, in place of the armv7l only
+ * libacc_service.a and libacc_envelope.a. Each sweep is computed from the scene and the sweep
+ * sequence number alone, so a scene gives the same envelopes on every run, however fast or
+ * slow the application reads them. Sweeps are produced at the streaming frequency of the
+ * sweep configuration, and sweeps the application is too late for are skipped, as with the
+ * sensor.
+ *
+ * acc_rss_activate() reads the scene from the environment:
+ *
+ * - ACC_SIM_TARGETS, comma separated targets as distance_m:amplitude[:speed_mps],
+ *   e.g. "0.5:2000,1.2:800:0.1"
+ * - ACC_SIM_NOISE, largest noise amplitude
+ * - ACC_SIM_SEED, seed of the noise
+ * - ACC_SIM_SWEEP_RATE, sweep frequency in Hz replacing the configured one, 0 for sweeps as
+ *   fast as the application takes them
+ */
+
+
+/**
+ * @brief Largest number of targets in a scene
+ */
+#define ACC_SIM_SERVICE_ENVELOPE_TARGET_MAX	8
+
+
+/**
+ * @brief A reflecting object in front of the sensor
+ *
+ * @param distance_m Distance at sweep 0
+ * @param amplitude Peak amplitude of the reflection
+ * @param speed_mps Speed away from the sensor, the target turns at the ends of the range
+ */
+typedef struct {
+	float		distance_m;
+	uint16_t	amplitude;
+	float		speed_mps;
+} acc_sim_service_envelope_target_t;
+
+
+/**
+ * @brief What every simulated sensor sees
+ *
+ * @param targets The targets
+ * @param target_count Number of targets
+ * @param background Level of an envelope without targets or noise
+ * @param noise_amplitude Largest noise added to each point
+ * @param seed Seed of the noise, combined with the sensor id and the sweep sequence number
+ * @param sweep_rate_hz Sweep frequency used instead of the configured one when above 0
+ * @param unthrottled Produce sweeps as fast as they are taken, ignores all sweep frequencies
+ */
+typedef struct {
+	acc_sim_service_envelope_target_t	targets[ACC_SIM_SERVICE_ENVELOPE_TARGET_MAX];
+	uint_fast8_t				target_count;
+	uint16_t				background;
+	uint16_t				noise_amplitude;
+	uint32_t				seed;
+	float					sweep_rate_hz;
+	bool					unthrottled;
+} acc_sim_service_envelope_scene_t;
+
+
+/**
+ * @brief Get the scene used when none is set, two still targets with some noise
+ *
+ * @param[out] scene The default scene
+ */
+extern void acc_sim_service_envelope_scene_default(acc_sim_service_envelope_scene_t *scene);
+
+
+/**
+ * @brief Change the default scene as the ACC_SIM_* environment variables say
+ *
+ * @param[in,out] scene The scene to change
+ * @return False if a variable could not be parsed, the scene is then unchanged
+ */
+extern bool acc_sim_service_envelope_scene_from_environment(acc_sim_service_envelope_scene_t *scene);
+
+
+/**
+ * @brief Set the scene of services created after the call
+ *
+ * @param[in] scene The scene
+ */
+extern void acc_sim_service_envelope_scene_set(const acc_sim_service_envelope_scene_t *scene);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
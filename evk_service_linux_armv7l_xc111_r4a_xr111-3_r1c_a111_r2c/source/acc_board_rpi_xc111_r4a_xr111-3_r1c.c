@@ -7,8 +7,12 @@
 
 #include "acc_board.h"
 #include "acc_device_gpio.h"
+#include "acc_device_memory.h"
+#include "acc_device_spi_calibration.h"
+#include "acc_driver_gpio_linux_chardev.h"
 #include "acc_driver_gpio_linux_sysfs.h"
 #include "acc_driver_i2c_linux.h"
+#include "acc_driver_memory_linux.h"
 #include "acc_driver_spi_linux_spidev.h"
 #include "acc_log.h"
 #include "acc_os.h"
@@ -75,6 +79,11 @@ static char *supported_hardware[] = {"RPI XC111_R4A XR111-3_R1C A111_R2C", NULL
 #define CE_B_PIN	19
 /**@}*/
 
+/**
+ * @brief GPIO chip holding the host GPIOs, used with ACC_BOARD_FLAG_GPIO_CHARDEV
+ */
+#define GPIO_CHIP_PATH	"/dev/gpiochip0"
+
 /**
  * @brief The reference frequency used by this board
  *
@@ -87,6 +96,16 @@ static char *supported_hardware[] = {"RPI XC111_R4A XR111-3_R1C A111_R2C", NULL
  */
 #define ACC_BOARD_SPI_SPEED	15000000
 
+/**
+ * @brief Highest SPI speed of the sensor, calibrated speeds above it are not used
+ */
+#define ACC_BOARD_SPI_SPEED_MAX	50000000
+
+/**
+ * @brief Number of SPI buses a speed is kept for
+ */
+#define SPI_BUS_COUNT		ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_MAX
+
 /**
  * @brief Host GPIO indices
  */
@@ -155,12 +174,25 @@ static uint_fast8_t sensor_spi_bus_cs[SENSOR_COUNT][2] = {
 							 };
 
 
+/**
+ * @brief SPI speed of each bus, calibrated or ACC_BOARD_SPI_SPEED
+ */
+static uint32_t spi_speed[SPI_BUS_COUNT];
+
+
 /**
  * @brief Set of acc_board_flag_t flags currently being set
  */
 static uint32_t acc_board_flags;
 
 
+/**
+ * @brief GPIO group holding CE_A and CE_B, so a sensor is selected with one write
+ */
+static uint_fast8_t	chip_select_group;
+static bool		chip_select_group_created;
+
+
 /**
  * @brief Set special flag, and depending on the flag it must be done before calling any init function
  *
@@ -216,6 +248,32 @@ static acc_status_t acc_board_gpio_init(void)
 		return ACC_STATUS_SUCCESS;
 	}
 
+	// Export all host GPIOs together instead of one at a time as they are first used
+	if (!(acc_board_flags & 1 << ACC_BOARD_FLAG_GPIO_CHARDEV)) {
+		uint_fast8_t	pins[HOST_GPIO_MAX];
+		uint32_t	ready_us[HOST_GPIO_MAX];
+		uint_fast8_t	slowest = 0;
+
+		for (uint_fast8_t index = 0; index < HOST_GPIO_MAX; index++) {
+			pins[index] = acc_board_host_gpios[index].pin;
+		}
+
+		status = acc_driver_gpio_linux_sysfs_open(pins, HOST_GPIO_MAX, ready_us);
+		if (status != ACC_STATUS_SUCCESS) {
+			ACC_LOG_ERROR("%s failed with %s", __func__, acc_log_status_name(status));
+			return status;
+		}
+
+		for (uint_fast8_t index = 0; index < HOST_GPIO_MAX; index++) {
+			ACC_LOG_VERBOSE("%s ready after %u us", acc_board_host_gpio_names[index], (unsigned int)ready_us[index]);
+			if (ready_us[index] > ready_us[slowest]) {
+				slowest = index;
+			}
+		}
+
+		ACC_LOG_INFO("Host GPIOs ready after %u us, slowest %s", (unsigned int)ready_us[slowest], acc_board_host_gpio_names[slowest]);
+	}
+
 	for (uint_fast8_t index = 0; index < HOST_GPIO_MAX; index++) {
 		acc_device_gpio_set_initial_pull(acc_board_host_gpios[index].pin, acc_board_host_gpios[index].pull);
 	}
@@ -236,10 +294,54 @@ static acc_status_t acc_board_gpio_init(void)
 		return status;
 	}
 
+	if (acc_board_flags & 1 << ACC_BOARD_FLAG_GPIO_CHARDEV) {
+		uint_fast8_t pins[] = { acc_board_host_gpios[HOST_GPIO_CE_A].pin, acc_board_host_gpios[HOST_GPIO_CE_B].pin };
+
+		status = acc_driver_gpio_linux_chardev_group_create(pins, 2, &chip_select_group);
+		if (status != ACC_STATUS_SUCCESS) {
+			ACC_LOG_ERROR("%s failed with %s", __func__, acc_log_status_name(status));
+			return status;
+		}
+		chip_select_group_created = true;
+	}
+
 	return ACC_STATUS_SUCCESS;
 }
 
 
+/**
+ * @brief Use the SPI speeds recorded by peh_spi_calibrate if ACC_BOARD_FLAG_SPI_CALIBRATION is set,
+ *        ACC_BOARD_SPI_SPEED where none is
+ */
+static void acc_board_spi_speed_init(void)
+{
+	bool memory_ok = false;
+
+	// The memory device creates its backing store when initialized, so only programs that ask for it touch it
+	if (acc_board_flags & 1 << ACC_BOARD_FLAG_SPI_CALIBRATION) {
+		memory_ok = (acc_device_memory_init() == ACC_STATUS_SUCCESS);
+	}
+
+	for (uint_fast8_t bus = 0; bus < SPI_BUS_COUNT; bus++) {
+		uint32_t speed;
+
+		spi_speed[bus] = ACC_BOARD_SPI_SPEED;
+
+		if (!memory_ok ||
+		    acc_device_spi_calibration_load(ACC_BOARD_SPI_CALIBRATION_ADDRESS, bus, &speed) != ACC_STATUS_SUCCESS) {
+			continue;
+		}
+
+		if (speed > ACC_BOARD_SPI_SPEED_MAX) {
+			speed = ACC_BOARD_SPI_SPEED_MAX;
+		}
+
+		ACC_LOG_INFO("SPI bus %u calibrated to %u Hz", (unsigned int)bus, (unsigned int)speed);
+		spi_speed[bus] = speed;
+	}
+}
+
+
 /**
  * @brief Initialize board
  *
@@ -257,6 +359,7 @@ acc_status_t acc_board_init(void)
 
 	acc_os_init();
 	acc_os_mutex_init(&init_mutex);
+	acc_os_linux_mutex_set_name(&init_mutex, "board_init");
 
 	acc_os_mutex_lock(&init_mutex);
 	if (init_done) {
@@ -264,9 +367,16 @@ acc_status_t acc_board_init(void)
 		return ACC_STATUS_SUCCESS;
 	}
 
-	acc_driver_gpio_linux_sysfs_register(28);
+	if (acc_board_flags & 1 << ACC_BOARD_FLAG_GPIO_CHARDEV) {
+		acc_driver_gpio_linux_chardev_register(GPIO_CHIP_PATH, NULL);
+	} else {
+		acc_driver_gpio_linux_sysfs_register(28);
+	}
 	acc_driver_i2c_linux_register();
 	acc_driver_spi_linux_spidev_register();
+	acc_driver_memory_linux_register();
+
+	acc_board_spi_speed_init();
 
 	if ((status = acc_board_gpio_init())) {
 		acc_os_mutex_unlock(&init_mutex);
@@ -446,6 +556,16 @@ acc_status_t acc_board_chip_select(acc_sensor_t sensor, uint_fast8_t cs_assert)
 		uint_fast8_t cea_val = (sensor == 1 || sensor == 2) ? 0 : 1;
 		uint_fast8_t ceb_val = (sensor == 1 || sensor == 3) ? 0 : 1;
 
+		if (chip_select_group_created) {
+			uint_fast8_t levels[] = { cea_val, ceb_val };
+
+			status = acc_driver_gpio_linux_chardev_group_write(chip_select_group, levels);
+			if (status != ACC_STATUS_SUCCESS) {
+				ACC_LOG_ERROR("%s failed with %s", __func__, acc_log_status_name(status));
+			}
+			return status;
+		}
+
 		if (
 			(status = acc_board_gpio_output(HOST_GPIO_CE_A, cea_val)) ||
 			(status = acc_board_gpio_output(HOST_GPIO_CE_B, ceb_val))
@@ -541,6 +661,61 @@ acc_status_t acc_board_gpio_read(uint_fast8_t gpio, uint_fast8_t *level)
 }
 
 
+/**
+ * @brief Wait for a sensor to raise its interrupt line
+ *
+ * The interrupt is GPIO5 of the sensor, connected to host GPIO0-3.
+ *
+ * @param[in] sensor The sensor to wait for
+ * @param[in] timeout_ms Longest time to wait
+ * @return Status
+ */
+acc_status_t acc_board_wait_for_sensor_interrupt(acc_sensor_t sensor, uint32_t timeout_ms)
+{
+	acc_status_t	status;
+	uint_fast8_t	gpio;
+	uint_fast8_t	level;
+	uint64_t	deadline_ns = acc_os_monotonic_ns() + (uint64_t)timeout_ms * 1000000;
+
+	if ((sensor <= 0) || (sensor > SENSOR_COUNT)) {
+		ACC_LOG_ERROR("Sensor %u is not a valid sensor", sensor);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	gpio = HOST_GPIO_GPIO0 + sensor - 1;
+
+	status = acc_board_gpio_read(gpio, &level);
+	if (status != ACC_STATUS_SUCCESS || level) {
+		return status;
+	}
+
+	/*
+	 * An edge is only trusted when the line is still high after it. Edges of earlier interrupts
+	 * that were not waited for, because the line was already high, stay queued in the driver and
+	 * are consumed here. The first wait configures edge detection, which misses an edge just
+	 * before it, so the level is read after a timeout too.
+	 */
+	for (;;) {
+		uint64_t	now_ns = acc_os_monotonic_ns();
+		uint32_t	remaining_ms = (now_ns < deadline_ns) ? (deadline_ns - now_ns + 999999) / 1000000 : 0;
+
+		status = acc_device_gpio_wait_edge(acc_board_host_gpios[gpio].pin, ACC_DEVICE_GPIO_EDGE_RISING, remaining_ms, NULL);
+		if (status != ACC_STATUS_SUCCESS && status != ACC_STATUS_TIMEOUT) {
+			ACC_LOG_ERROR("%s failed with %s", __func__, acc_log_status_name(status));
+			return status;
+		}
+
+		if (acc_board_gpio_read(gpio, &level) == ACC_STATUS_SUCCESS && level) {
+			return ACC_STATUS_SUCCESS;
+		}
+
+		if (status == ACC_STATUS_TIMEOUT) {
+			return status;
+		}
+	}
+}
+
+
 /**
  * @brief Retrieves the number of sensors connected to the device
  *
@@ -586,9 +761,11 @@ float acc_board_get_ref_freq(void)
  */
 uint32_t acc_board_get_spi_speed(uint_fast8_t bus)
 {
-	ACC_UNUSED(bus);
+	if (bus >= SPI_BUS_COUNT || spi_speed[bus] == 0) {
+		return ACC_BOARD_SPI_SPEED;
+	}
 
-	return ACC_BOARD_SPI_SPEED;
+	return spi_speed[bus];
 }
 
 
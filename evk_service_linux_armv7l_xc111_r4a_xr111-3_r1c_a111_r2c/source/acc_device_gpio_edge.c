@@ -0,0 +1,28 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acc_device_gpio.h"
+#include "acc_types.h"
+
+
+/**
+ * @brief Set by drivers that can wait for edges, the other acc_device_gpio functions are in libacconeer
+ */
+acc_status_t (*acc_device_gpio_wait_edge_func)(uint_fast8_t pin, acc_device_gpio_edge_t edge, uint32_t timeout_ms, uint_fast8_t *level) = NULL;
+
+
+acc_status_t acc_device_gpio_wait_edge(uint_fast8_t pin, acc_device_gpio_edge_t edge, uint32_t timeout_ms, uint_fast8_t *level)
+{
+	if (acc_device_gpio_wait_edge_func == NULL) {
+		return ACC_STATUS_UNSUPPORTED;
+	}
+
+	if (edge > ACC_DEVICE_GPIO_EDGE_BOTH) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	return acc_device_gpio_wait_edge_func(pin, edge, timeout_ms, level);
+}
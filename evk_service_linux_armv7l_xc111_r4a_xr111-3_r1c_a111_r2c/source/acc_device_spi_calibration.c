@@ -0,0 +1,179 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acc_device_memory.h"
+#include "acc_device_spi.h"
+#include "acc_device_spi_calibration.h"
+#include "acc_log.h"
+#include "acc_types.h"
+
+
+/**
+ * @brief The module name
+ */
+#define MODULE		"device_spi_calibration"
+
+#define RECORD_MAGIC	0x43495053	// "SPIC" in memory
+#define RECORD_VERSION	1
+
+
+/**
+ * @brief Speed of one bus, as stored in memory
+ *
+ * @param magic RECORD_MAGIC when a speed is recorded
+ * @param version RECORD_VERSION
+ * @param speed Speed in Hz
+ * @param crc CRC-32 of the fields above
+ */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	speed;
+	uint32_t	crc;
+} calibration_record_t;
+
+
+static uint32_t crc32(const uint8_t *data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (uint_fast8_t bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+
+/**
+ * @brief Fill a buffer with a pattern that differs between transfers
+ */
+static void fill_pattern(uint8_t *buffer, size_t size, uint32_t seed)
+{
+	uint32_t state = seed * 2654435761u + 1;
+
+	for (size_t i = 0; i < size; i++) {
+		state = state * 1664525 + 1013904223;
+		buffer[i] = state >> 24;
+	}
+}
+
+
+/**
+ * @brief Make transfer_count loopback transfers at one speed
+ *
+ * @return Number of transfers that did not read back what was sent, or transfer_count if the driver failed
+ */
+static uint32_t check_speed(uint_fast8_t bus, uint_fast8_t device, uint32_t speed, uint32_t transfer_count, uint8_t *buffer, size_t size)
+{
+	uint32_t errors = 0;
+
+	for (uint32_t transfer = 0; transfer < transfer_count; transfer++) {
+		fill_pattern(buffer, size, speed ^ transfer);
+
+		uint32_t sent_crc = crc32(buffer, size);
+
+		acc_device_spi_lock(bus);
+		acc_status_t status = acc_device_spi_transfer(bus, device, speed, buffer, size);
+		acc_device_spi_unlock(bus);
+
+		if (status != ACC_STATUS_SUCCESS) {
+			return transfer_count;
+		}
+
+		if (crc32(buffer, size) != sent_crc) {
+			errors++;
+		}
+	}
+
+	return errors;
+}
+
+
+acc_status_t acc_device_spi_calibration_run(
+		uint_fast8_t	bus,
+		uint_fast8_t	device,
+		const uint32_t	*speeds,
+		size_t		speed_count,
+		uint32_t	transfer_count,
+		size_t		transfer_size,
+		uint32_t	*best_speed)
+{
+	acc_status_t	status = ACC_STATUS_FAILURE;
+	uint8_t		*buffer;
+
+	if (speed_count == 0 || transfer_count == 0 || transfer_size == 0) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	buffer = malloc(transfer_size);
+	if (buffer == NULL) {
+		return ACC_STATUS_OUT_OF_MEMORY;
+	}
+
+	for (size_t index = 0; index < speed_count; index++) {
+		uint32_t errors = check_speed(bus, device, speeds[index], transfer_count, buffer, transfer_size);
+
+		ACC_LOG_VERBOSE("Bus %u at %u Hz: %u of %u transfers failed", (unsigned int)bus, (unsigned int)speeds[index],
+		                (unsigned int)errors, (unsigned int)transfer_count);
+
+		if (errors > 0) {
+			break;
+		}
+
+		*best_speed	= speeds[index];
+		status		= ACC_STATUS_SUCCESS;
+	}
+
+	free(buffer);
+
+	if (status != ACC_STATUS_SUCCESS) {
+		ACC_LOG_ERROR("Bus %u failed already at %u Hz, is MISO looped back to MOSI?", (unsigned int)bus, (unsigned int)speeds[0]);
+	}
+
+	return status;
+}
+
+
+acc_status_t acc_device_spi_calibration_store(uint32_t address, uint_fast8_t bus, uint32_t speed)
+{
+	calibration_record_t record = {
+		.magic		= RECORD_MAGIC,
+		.version	= RECORD_VERSION,
+		.speed		= speed
+	};
+
+	record.crc = crc32((const uint8_t *)&record, offsetof(calibration_record_t, crc));
+
+	return acc_device_memory_write(address + bus * ACC_DEVICE_SPI_CALIBRATION_RECORD_SIZE, &record, sizeof(record));
+}
+
+
+acc_status_t acc_device_spi_calibration_load(uint32_t address, uint_fast8_t bus, uint32_t *speed)
+{
+	calibration_record_t	record;
+	acc_status_t		status;
+
+	status = acc_device_memory_read(address + bus * ACC_DEVICE_SPI_CALIBRATION_RECORD_SIZE, &record, sizeof(record));
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	if (record.magic != RECORD_MAGIC || record.version != RECORD_VERSION || record.speed == 0 ||
+	    record.crc != crc32((const uint8_t *)&record, offsetof(calibration_record_t, crc))) {
+		return ACC_STATUS_FAILURE;
+	}
+
+	*speed = record.speed;
+
+	return ACC_STATUS_SUCCESS;
+}
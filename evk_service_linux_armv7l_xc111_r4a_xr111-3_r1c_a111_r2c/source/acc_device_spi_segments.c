@@ -0,0 +1,56 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acc_device_spi.h"
+#include "acc_log.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+/**
+ * @brief The module name
+ */
+#define MODULE		"device_spi_segments"
+
+
+/**
+ * @brief Set by drivers with vectored transfers, the other acc_device_spi functions are in libacconeer
+ */
+acc_status_t (*acc_device_spi_transfer_segments_func)(uint_fast8_t bus, uint_fast8_t device, uint32_t speed,
+                                                      const acc_device_spi_segment_t *segments, size_t segment_count) = NULL;
+
+
+acc_status_t acc_device_spi_transfer_segments(
+		uint_fast8_t				bus,
+		uint_fast8_t				device,
+		uint32_t				speed,
+		const acc_device_spi_segment_t		*segments,
+		size_t					segment_count)
+{
+	acc_status_t status = ACC_STATUS_SUCCESS;
+
+	if (acc_device_spi_transfer_segments_func != NULL) {
+		return acc_device_spi_transfer_segments_func(bus, device, speed, segments, segment_count);
+	}
+
+	// Chip select is released after every transfer, so segments held on one chip select cannot be kept
+	for (size_t index = 0; index + 1 < segment_count; index++) {
+		if (!segments[index].cs_deselect) {
+			ACC_LOG_ERROR("SPI driver without vectored transfers cannot keep the chip selected between segments");
+			return ACC_STATUS_BAD_PARAM;
+		}
+	}
+
+	for (size_t index = 0; index < segment_count && status == ACC_STATUS_SUCCESS; index++) {
+		status = acc_device_spi_transfer(bus, device, speed, segments[index].buffer, segments[index].buffer_size);
+
+		if (status == ACC_STATUS_SUCCESS && segments[index].delay_us > 0) {
+			acc_os_sleep_us(segments[index].delay_us);
+		}
+	}
+
+	return status;
+}
@@ -0,0 +1,701 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/gpio.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+#include "acc_driver_gpio_linux_chardev.h"
+#include "acc_device_gpio.h"
+#include "acc_log.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+/**
+ * @brief The module name
+ */
+#define MODULE		"driver_gpio_linux_chardev"
+
+/**
+ * @brief Consumer label shown for the requested lines, for example by gpioinfo
+ */
+#define CONSUMER_LABEL	"acconeer"
+
+/**
+ * @brief GPIO pin direction
+ */
+typedef enum {
+	GPIO_DIR_IN,
+	GPIO_DIR_OUT,
+	GPIO_DIR_UNKNOWN
+} gpio_dir_enum_t;
+typedef uint32_t gpio_dir_t;
+
+/**
+ * @brief No edge detection, the line is requested with a line handle
+ */
+#define GPIO_EDGE_NONE	((acc_device_gpio_edge_t)-1)
+
+/**
+ * @brief GPIO pin information
+ *
+ * A pin in a group is written through the line handle of the group, other pins have
+ * a line handle of their own that is requested again when the direction changes.
+ * An input waited on for edges is requested as a line event instead, which can be
+ * read like a line handle.
+ */
+typedef struct {
+	int			handle_fd;
+	gpio_dir_t		dir;
+	uint_fast8_t		value;
+	uint_fast8_t		pull;
+	int_fast8_t		group;
+	acc_device_gpio_edge_t	edge;
+} gpio_t;
+
+/**
+ * @brief Lines requested together
+ */
+typedef struct {
+	int		handle_fd;
+	uint_fast8_t	pin_count;
+	uint_fast8_t	pins[ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX_PINS];
+} gpio_group_t;
+
+
+static int system_open(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+
+static int system_ioctl(int fd, unsigned long request, void *arg)
+{
+	return ioctl(fd, request, arg);
+}
+
+
+/**
+ * @brief The system calls used when no others are registered
+ */
+static const acc_driver_gpio_linux_chardev_ops_t system_ops = {
+	.open	= system_open,
+	.close	= close,
+	.ioctl	= system_ioctl
+};
+
+
+static const acc_driver_gpio_linux_chardev_ops_t	*ops = &system_ops;
+static const char					*chip_path;
+static int						chip_fd = -1;
+
+/**
+ * @brief Array with information on GPIOs, allocated at runtime
+ */
+static gpio_t		*gpios;
+
+/**
+ * @brief Number of lines of the chip
+ */
+static uint_fast16_t	gpio_count;
+
+static gpio_group_t	groups[ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX];
+static uint_fast8_t	group_count;
+
+
+/**
+ * @brief Request a line handle for one or more lines
+ *
+ * @param pins The lines
+ * @param values Output levels, not used for inputs
+ * @param count Number of lines
+ * @param dir Direction of all lines
+ * @param[out] handle_fd The line handle
+ * @return Status
+ */
+static acc_status_t internal_request_lines(const uint_fast8_t *pins, const uint_fast8_t *values, uint_fast8_t count,
+                                           gpio_dir_t dir, int *handle_fd)
+{
+	struct gpiohandle_request request;
+
+	memset(&request, 0, sizeof(request));
+	for (uint_fast8_t index = 0; index < count; index++) {
+		request.lineoffsets[index] = pins[index];
+		if (dir == GPIO_DIR_OUT) {
+			request.default_values[index] = values[index];
+		}
+	}
+	request.lines = count;
+	request.flags = (dir == GPIO_DIR_IN) ? GPIOHANDLE_REQUEST_INPUT : GPIOHANDLE_REQUEST_OUTPUT;
+	strncpy(request.consumer_label, CONSUMER_LABEL, sizeof(request.consumer_label) - 1);
+
+	if (ops->ioctl(chip_fd, GPIO_GET_LINEHANDLE_IOCTL, &request) < 0) {
+		ACC_LOG_ERROR("Unable to request gpio%u on %s: %s", pins[0], chip_path, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	*handle_fd = request.fd;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Release the line handle of a pin that is not in a group
+ *
+ * @param gpio GPIO information
+ */
+static void internal_gpio_release(gpio_t *gpio)
+{
+	if (gpio->handle_fd >= 0) {
+		ops->close(gpio->handle_fd);
+		gpio->handle_fd = -1;
+	}
+	gpio->dir  = GPIO_DIR_UNKNOWN;
+	gpio->edge = GPIO_EDGE_NONE;
+}
+
+
+/**
+ * @brief Internal GPIO set direction
+ *
+ * The line is requested again with the new direction. If 'dir' is GPIO_DIR_IN, 'value' is not used.
+ *
+ * @param pin GPIO pin
+ * @param dir The direction to be set
+ * @param value The value to be written
+ * @return Status
+ */
+static acc_status_t internal_gpio_set_dir(uint_fast8_t pin, gpio_dir_t dir, uint_fast8_t value)
+{
+	gpio_t		*gpio = &gpios[pin];
+	acc_status_t	status;
+
+	internal_gpio_release(gpio);
+
+	status = internal_request_lines(&pin, &value, 1, dir, &gpio->handle_fd);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	gpio->dir   = dir;
+	gpio->value = value;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Request a line event for an input, replacing its line handle
+ *
+ * @param pin GPIO pin
+ * @param edge The edges to report
+ * @return Status
+ */
+static acc_status_t internal_gpio_request_event(uint_fast8_t pin, acc_device_gpio_edge_t edge)
+{
+	static const uint32_t		event_flags[] = {
+		GPIOEVENT_REQUEST_RISING_EDGE,
+		GPIOEVENT_REQUEST_FALLING_EDGE,
+		GPIOEVENT_REQUEST_BOTH_EDGES
+	};
+	gpio_t				*gpio = &gpios[pin];
+	struct gpioevent_request	request;
+
+	internal_gpio_release(gpio);
+
+	memset(&request, 0, sizeof(request));
+	request.lineoffset	= pin;
+	request.handleflags	= GPIOHANDLE_REQUEST_INPUT;
+	request.eventflags	= event_flags[edge];
+	strncpy(request.consumer_label, CONSUMER_LABEL, sizeof(request.consumer_label) - 1);
+
+	if (ops->ioctl(chip_fd, GPIO_GET_LINEEVENT_IOCTL, &request) < 0) {
+		ACC_LOG_ERROR("Unable to request events for gpio%u on %s: %s", pin, chip_path, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	gpio->handle_fd	= request.fd;
+	gpio->dir	= GPIO_DIR_IN;
+	gpio->edge	= edge;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Write the current values of all pins in a group
+ *
+ * @param group The group
+ * @return Status
+ */
+static acc_status_t internal_group_set_values(const gpio_group_t *group)
+{
+	struct gpiohandle_data data;
+
+	memset(&data, 0, sizeof(data));
+	for (uint_fast8_t index = 0; index < group->pin_count; index++) {
+		data.values[index] = gpios[group->pins[index]].value;
+	}
+
+	if (ops->ioctl(group->handle_fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0) {
+		ACC_LOG_ERROR("Could not write gpio%u group: %s", group->pins[0], strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Internal GPIO check of a pin number
+ *
+ * @param pin GPIO pin
+ * @return Status
+ */
+static acc_status_t internal_gpio_check(uint_fast8_t pin)
+{
+	if (gpios == NULL) {
+		ACC_LOG_ERROR("Driver is not initialized");
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (pin >= gpio_count) {
+		ACC_LOG_ERROR("GPIO %u is not a valid GPIO pin", pin);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Internal GPIO close all gpios
+ *
+ * Outputs are set to their pull level before the line handles are released.
+ */
+static void internal_gpio_close_all(void)
+{
+	for (uint_fast8_t index = 0; index < group_count; index++) {
+		gpio_group_t *group = &groups[index];
+
+		for (uint_fast8_t pin = 0; pin < group->pin_count; pin++) {
+			gpios[group->pins[pin]].value = gpios[group->pins[pin]].pull;
+		}
+		internal_group_set_values(group);
+		ops->close(group->handle_fd);
+		group->handle_fd = -1;
+	}
+	group_count = 0;
+
+	for (uint_fast16_t pin = 0; pin < gpio_count; pin++) {
+		gpio_t *gpio = &gpios[pin];
+
+		if (gpio->group < 0 && gpio->dir == GPIO_DIR_OUT) {
+			struct gpiohandle_data data;
+
+			memset(&data, 0, sizeof(data));
+			data.values[0] = gpio->pull;
+			ops->ioctl(gpio->handle_fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data);
+		}
+		internal_gpio_release(gpio);
+		gpio->group = -1;
+	}
+
+	if (chip_fd >= 0) {
+		ops->close(chip_fd);
+		chip_fd = -1;
+	}
+
+	// Forbidden due to race condition between gpio_close_all and gpio_input/output.
+//	acc_os_mem_free(gpios);
+}
+
+
+/**
+ * @brief Initialize GPIO driver
+ *
+ * @return Status
+ */
+static acc_status_t acc_driver_gpio_linux_chardev_init(void)
+{
+	static acc_os_mutex_t	init_mutex;
+	static bool		init_done;
+	struct gpiochip_info	info;
+
+	if (init_done)
+		return ACC_STATUS_SUCCESS;
+
+	acc_os_init();
+	acc_os_mutex_init(&init_mutex);
+	acc_os_linux_mutex_set_name(&init_mutex, "gpio_chardev_init");
+
+	acc_os_mutex_lock(&init_mutex);
+	if (init_done) {
+		acc_os_mutex_unlock(&init_mutex);
+		return ACC_STATUS_SUCCESS;
+	}
+
+	chip_fd = ops->open(chip_path, O_RDWR);
+	if (chip_fd < 0) {
+		ACC_LOG_FATAL("Unable to open %s: %s", chip_path, strerror(errno));
+		acc_os_mutex_unlock(&init_mutex);
+		return ACC_STATUS_FAILURE;
+	}
+
+	memset(&info, 0, sizeof(info));
+	if (ops->ioctl(chip_fd, GPIO_GET_CHIPINFO_IOCTL, &info) < 0) {
+		ACC_LOG_ERROR("Unable to get chip info of %s: %s", chip_path, strerror(errno));
+		ops->close(chip_fd);
+		chip_fd = -1;
+		acc_os_mutex_unlock(&init_mutex);
+		return ACC_STATUS_FAILURE;
+	}
+
+	gpio_count = info.lines;
+	gpios = acc_os_mem_alloc(sizeof(gpio_t) * gpio_count);
+	if (!gpios) {
+		ACC_LOG_ERROR("Out of memory");
+		ops->close(chip_fd);
+		chip_fd = -1;
+		acc_os_mutex_unlock(&init_mutex);
+		return ACC_STATUS_OUT_OF_MEMORY;
+	}
+
+	memset(gpios, 0, sizeof(gpio_t) * gpio_count);
+	for (uint_fast16_t pin = 0; pin < gpio_count; pin++) {
+		gpios[pin].handle_fd	= -1;
+		gpios[pin].dir		= GPIO_DIR_UNKNOWN;
+		gpios[pin].group	= -1;
+		gpios[pin].edge		= GPIO_EDGE_NONE;
+	}
+
+	if (atexit(internal_gpio_close_all)) {
+		ACC_LOG_ERROR("Unable to set exit function 'internal_gpio_close_all()'");
+		internal_gpio_close_all();
+		acc_os_mutex_unlock(&init_mutex);
+		return ACC_STATUS_FAILURE;
+	}
+
+	ACC_LOG_VERBOSE("%s has %u lines", chip_path, (unsigned int)gpio_count);
+
+	init_done = true;
+	acc_os_mutex_unlock(&init_mutex);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Inform the driver of the pull up/down level for a GPIO pin after reset
+ *
+ * This does not change the pull level, but only informs the driver what pull level
+ * the pin is configured to have.
+ *
+ * @param pin Pin number
+ * @param level The pull level 0 or 1
+ * @return Status
+ */
+static acc_status_t acc_driver_gpio_linux_chardev_set_initial_pull(uint_fast8_t pin, uint_fast8_t level)
+{
+	acc_status_t status;
+
+	status = internal_gpio_check(pin);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	gpios[pin].pull = level ? 1 : 0;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Set GPIO to input
+ *
+ * @param pin GPIO pin to be set to input
+ * @return Status
+ */
+static acc_status_t acc_driver_gpio_linux_chardev_input(uint_fast8_t pin)
+{
+	acc_status_t	status;
+	gpio_t		*gpio;
+
+	status = internal_gpio_check(pin);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+	gpio = &gpios[pin];
+
+	if (gpio->group >= 0) {
+		ACC_LOG_ERROR("GPIO %u is in an output group and cannot be input", pin);
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (gpio->dir == GPIO_DIR_IN)
+		return ACC_STATUS_SUCCESS;
+
+	return internal_gpio_set_dir(pin, GPIO_DIR_IN, 0);
+}
+
+
+/**
+ * @brief Read from GPIO
+ *
+ * @param pin GPIO pin to read
+ * @param value The value which has been read
+ * @return Status
+ */
+static acc_status_t acc_driver_gpio_linux_chardev_read(uint_fast8_t pin, uint_fast8_t *value)
+{
+	acc_status_t		status;
+	gpio_t			*gpio;
+	struct gpiohandle_data	data;
+
+	status = internal_gpio_check(pin);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+	gpio = &gpios[pin];
+
+	if (gpio->dir != GPIO_DIR_IN) {
+		ACC_LOG_ERROR("Cannot read GPIO %u as it is output/unknown", pin);
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (ops->ioctl(gpio->handle_fd, GPIOHANDLE_GET_LINE_VALUES_IOCTL, &data) < 0) {
+		ACC_LOG_ERROR("Unable to read from GPIO %u: (%u) %s", pin, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	*value = data.values[0] ? 1 : 0;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Set GPIO output level
+ *
+ * This function sets a GPIO to output and the level to low or high.
+ *
+ * @param pin GPIO pin to be set
+ * @param level 0 to 1 to set pin low or high
+ * @return Status
+ */
+static acc_status_t acc_driver_gpio_linux_chardev_write(uint_fast8_t pin, uint_fast8_t level)
+{
+	acc_status_t		status;
+	gpio_t			*gpio;
+	struct gpiohandle_data	data;
+
+	status = internal_gpio_check(pin);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+	gpio = &gpios[pin];
+
+	if (level > 1)
+		level = 1;
+
+	if (gpio->group >= 0) {
+		if (gpio->value == level)
+			return ACC_STATUS_SUCCESS;
+
+		gpio->value = level;
+		return internal_group_set_values(&groups[gpio->group]);
+	}
+
+	if (gpio->dir != GPIO_DIR_OUT) {
+		return internal_gpio_set_dir(pin, GPIO_DIR_OUT, level);
+	}
+
+	if (gpio->value == level)
+		return ACC_STATUS_SUCCESS;
+
+	memset(&data, 0, sizeof(data));
+	data.values[0] = level;
+	if (ops->ioctl(gpio->handle_fd, GPIOHANDLE_SET_LINE_VALUES_IOCTL, &data) < 0) {
+		ACC_LOG_ERROR("Could not write to gpio%u value: %s", pin, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	gpio->value = level;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Wait for an edge on a GPIO input
+ *
+ * @param pin GPIO pin to wait on
+ * @param edge Edges to wait for
+ * @param timeout_ms Longest time to wait
+ * @param[out] level The level after the edge, may be NULL
+ * @return Status
+ */
+static acc_status_t acc_driver_gpio_linux_chardev_wait_edge(uint_fast8_t pin, acc_device_gpio_edge_t edge, uint32_t timeout_ms, uint_fast8_t *level)
+{
+	acc_status_t		status;
+	gpio_t			*gpio;
+	struct gpioevent_data	event;
+	int			result;
+
+	status = internal_gpio_check(pin);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+	gpio = &gpios[pin];
+
+	if (gpio->dir != GPIO_DIR_IN) {
+		ACC_LOG_ERROR("Cannot wait on GPIO %u as it is output/unknown", pin);
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (gpio->edge != edge) {
+		status = internal_gpio_request_event(pin, edge);
+		if (status != ACC_STATUS_SUCCESS) {
+			return status;
+		}
+	}
+
+	struct pollfd fd = { .fd = gpio->handle_fd, .events = POLLIN };
+
+	do {
+		result = poll(&fd, 1, timeout_ms);
+	} while (result < 0 && errno == EINTR);
+
+	if (result < 0) {
+		ACC_LOG_ERROR("Unable to poll GPIO %u: (%u) %s", pin, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (result == 0) {
+		return ACC_STATUS_TIMEOUT;
+	}
+
+	// One event per edge, they queue up in the kernel if edges come faster than they are waited for
+	if (read(gpio->handle_fd, &event, sizeof(event)) != sizeof(event)) {
+		ACC_LOG_ERROR("Unable to read event of GPIO %u: (%u) %s", pin, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (level != NULL) {
+		*level = (event.id == GPIOEVENT_EVENT_RISING_EDGE) ? 1 : 0;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_driver_gpio_linux_chardev_group_create(const uint_fast8_t *pins, uint_fast8_t pin_count, uint_fast8_t *group)
+{
+	acc_status_t	status;
+	uint_fast8_t	values[ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX_PINS];
+	gpio_group_t	*new_group;
+
+	if (pin_count == 0 || pin_count > ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX_PINS) {
+		ACC_LOG_ERROR("A group must have 1 to %u pins", ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX_PINS);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (group_count >= ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX) {
+		ACC_LOG_ERROR("No more than %u groups are supported", ACC_DRIVER_GPIO_LINUX_CHARDEV_GROUP_MAX);
+		return ACC_STATUS_FAILURE;
+	}
+
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		status = internal_gpio_check(pins[index]);
+		if (status != ACC_STATUS_SUCCESS) {
+			return status;
+		}
+
+		if (gpios[pins[index]].group >= 0) {
+			ACC_LOG_ERROR("GPIO %u is already in a group", pins[index]);
+			return ACC_STATUS_BAD_PARAM;
+		}
+	}
+
+	// A line can only be requested once, so the single line handles are released first.
+	// Outputs keep their level, other pins start at their pull level.
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		gpio_t *gpio = &gpios[pins[index]];
+
+		values[index] = (gpio->dir == GPIO_DIR_OUT) ? gpio->value : gpio->pull;
+		internal_gpio_release(gpio);
+	}
+
+	new_group = &groups[group_count];
+
+	status = internal_request_lines(pins, values, pin_count, GPIO_DIR_OUT, &new_group->handle_fd);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	new_group->pin_count = pin_count;
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		gpio_t *gpio = &gpios[pins[index]];
+
+		new_group->pins[index]	= pins[index];
+		gpio->dir		= GPIO_DIR_OUT;
+		gpio->value		= values[index];
+		gpio->group		= group_count;
+	}
+
+	*group = group_count++;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_driver_gpio_linux_chardev_group_write(uint_fast8_t group, const uint_fast8_t *levels)
+{
+	gpio_group_t	*write_group;
+	bool		changed = false;
+
+	if (group >= group_count) {
+		ACC_LOG_ERROR("GPIO group %u does not exist", group);
+		return ACC_STATUS_BAD_PARAM;
+	}
+	write_group = &groups[group];
+
+	for (uint_fast8_t index = 0; index < write_group->pin_count; index++) {
+		gpio_t		*gpio = &gpios[write_group->pins[index]];
+		uint_fast8_t	level = levels[index] ? 1 : 0;
+
+		if (gpio->value != level) {
+			gpio->value = level;
+			changed = true;
+		}
+	}
+
+	if (!changed)
+		return ACC_STATUS_SUCCESS;
+
+	return internal_group_set_values(write_group);
+}
+
+
+void acc_driver_gpio_linux_chardev_register(const char *path, const acc_driver_gpio_linux_chardev_ops_t *chip_ops)
+{
+	chip_path	= path;
+	ops		= (chip_ops != NULL) ? chip_ops : &system_ops;
+
+	acc_device_gpio_init_func		= acc_driver_gpio_linux_chardev_init;
+	acc_device_gpio_set_initial_pull_func	= acc_driver_gpio_linux_chardev_set_initial_pull;
+	acc_device_gpio_input_func		= acc_driver_gpio_linux_chardev_input;
+	acc_device_gpio_read_func		= acc_driver_gpio_linux_chardev_read;
+	acc_device_gpio_write_func		= acc_driver_gpio_linux_chardev_write;
+	acc_device_gpio_wait_edge_func		= acc_driver_gpio_linux_chardev_wait_edge;
+}
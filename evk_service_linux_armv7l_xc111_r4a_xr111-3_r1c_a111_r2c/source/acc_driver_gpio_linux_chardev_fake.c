@@ -0,0 +1,337 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <errno.h>
+#include <linux/gpio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acc_driver_gpio_linux_chardev.h"
+#include "acc_driver_gpio_linux_chardev_fake.h"
+#include "acc_os.h"
+
+
+/**
+ * @brief File descriptors handed out by the fake chip, well above what the process uses
+ */
+/**@{*/
+#define CHIP_FD		1000
+#define HANDLE_FD_BASE	1001
+/**@}*/
+
+#define MAX_HANDLES	ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES
+
+
+/**
+ * @brief State of one line
+ *
+ * @param handle One more than the index of the handle holding the line, 0 when free
+ * @param output True if requested as output
+ * @param level Level driven when output, level read when input
+ */
+typedef struct {
+	int_fast16_t	handle;
+	bool		output;
+	uint_fast8_t	level;
+} fake_line_t;
+
+/**
+ * @brief Lines requested together, or one line requested for events
+ *
+ * Events are written to a pipe, the driver gets its read end as the line event.
+ */
+typedef struct {
+	bool		in_use;
+	uint32_t	line_count;
+	uint32_t	lines[GPIOHANDLES_MAX];
+	uint32_t	event_flags;
+	int		event_fds[2];
+} fake_handle_t;
+
+
+static fake_line_t	lines[ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES];
+static fake_handle_t	handles[MAX_HANDLES];
+static uint_fast16_t	line_count = ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES;
+static uint32_t		ioctl_count;
+
+
+static fake_handle_t *get_handle(int fd)
+{
+	if (fd >= HANDLE_FD_BASE && fd < HANDLE_FD_BASE + MAX_HANDLES && handles[fd - HANDLE_FD_BASE].in_use) {
+		return &handles[fd - HANDLE_FD_BASE];
+	}
+
+	for (uint_fast16_t index = 0; index < MAX_HANDLES; index++) {
+		if (handles[index].in_use && handles[index].event_flags != 0 && handles[index].event_fds[0] == fd) {
+			return &handles[index];
+		}
+	}
+
+	return NULL;
+}
+
+
+static int_fast16_t allocate_handle(const uint32_t *offsets, uint32_t count)
+{
+	int_fast16_t index;
+
+	if (count == 0 || count > GPIOHANDLES_MAX) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (uint32_t line = 0; line < count; line++) {
+		if (offsets[line] >= line_count) {
+			errno = EINVAL;
+			return -1;
+		}
+		if (lines[offsets[line]].handle != 0) {
+			errno = EBUSY;
+			return -1;
+		}
+	}
+
+	for (index = 0; index < MAX_HANDLES && handles[index].in_use; index++) {
+	}
+
+	if (index == MAX_HANDLES) {
+		errno = EMFILE;
+		return -1;
+	}
+
+	memset(&handles[index], 0, sizeof(handles[index]));
+	handles[index].in_use		= true;
+	handles[index].line_count	= count;
+
+	for (uint32_t line = 0; line < count; line++) {
+		handles[index].lines[line]	= offsets[line];
+		lines[offsets[line]].handle	= index + 1;
+	}
+
+	return index;
+}
+
+
+static int request_event(struct gpioevent_request *request)
+{
+	int_fast16_t index = allocate_handle(&request->lineoffset, 1);
+
+	if (index < 0) {
+		return -1;
+	}
+
+	if (pipe(handles[index].event_fds) < 0) {
+		lines[request->lineoffset].handle	= 0;
+		handles[index].in_use			= false;
+		return -1;
+	}
+
+	handles[index].event_flags		= request->eventflags;
+	lines[request->lineoffset].output	= false;
+	request->fd				= handles[index].event_fds[0];
+
+	return 0;
+}
+
+
+static int request_handle(struct gpiohandle_request *request)
+{
+	int_fast16_t index = allocate_handle(request->lineoffsets, request->lines);
+
+	if (index < 0) {
+		return -1;
+	}
+
+	for (uint32_t line = 0; line < request->lines; line++) {
+		fake_line_t *fake_line = &lines[request->lineoffsets[line]];
+
+		fake_line->output = (request->flags & GPIOHANDLE_REQUEST_OUTPUT) != 0;
+		if (fake_line->output) {
+			fake_line->level = request->default_values[line] ? 1 : 0;
+		}
+	}
+
+	request->fd = HANDLE_FD_BASE + index;
+
+	return 0;
+}
+
+
+static int fake_open(const char *path, int flags)
+{
+	(void)path;
+	(void)flags;
+
+	return CHIP_FD;
+}
+
+
+static int fake_close(int fd)
+{
+	fake_handle_t *handle = get_handle(fd);
+
+	if (fd == CHIP_FD) {
+		return 0;
+	}
+
+	if (handle == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+
+	for (uint32_t line = 0; line < handle->line_count; line++) {
+		lines[handle->lines[line]].handle = 0;
+		lines[handle->lines[line]].output = false;
+	}
+	if (handle->event_flags != 0) {
+		close(handle->event_fds[0]);
+		close(handle->event_fds[1]);
+	}
+	handle->in_use = false;
+
+	return 0;
+}
+
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+	fake_handle_t *handle = get_handle(fd);
+
+	ioctl_count++;
+
+	if (fd == CHIP_FD) {
+		switch (request) {
+			case GPIO_GET_CHIPINFO_IOCTL: {
+				struct gpiochip_info *info = arg;
+
+				memset(info, 0, sizeof(*info));
+				strncpy(info->name, "gpiochip-fake", sizeof(info->name) - 1);
+				strncpy(info->label, "fake", sizeof(info->label) - 1);
+				info->lines = line_count;
+				return 0;
+			}
+			case GPIO_GET_LINEHANDLE_IOCTL:
+				return request_handle(arg);
+			case GPIO_GET_LINEEVENT_IOCTL:
+				return request_event(arg);
+			default:
+				errno = ENOTTY;
+				return -1;
+		}
+	}
+
+	if (handle == NULL) {
+		errno = EBADF;
+		return -1;
+	}
+
+	struct gpiohandle_data *data = arg;
+
+	switch (request) {
+		case GPIOHANDLE_GET_LINE_VALUES_IOCTL:
+			for (uint32_t line = 0; line < handle->line_count; line++) {
+				data->values[line] = lines[handle->lines[line]].level;
+			}
+			return 0;
+		case GPIOHANDLE_SET_LINE_VALUES_IOCTL:
+			for (uint32_t line = 0; line < handle->line_count; line++) {
+				if (!lines[handle->lines[line]].output) {
+					errno = EPERM;
+					return -1;
+				}
+			}
+			for (uint32_t line = 0; line < handle->line_count; line++) {
+				lines[handle->lines[line]].level = data->values[line] ? 1 : 0;
+			}
+			return 0;
+		default:
+			errno = ENOTTY;
+			return -1;
+	}
+}
+
+
+const acc_driver_gpio_linux_chardev_ops_t acc_driver_gpio_linux_chardev_fake_ops = {
+	.open	= fake_open,
+	.close	= fake_close,
+	.ioctl	= fake_ioctl
+};
+
+
+void acc_driver_gpio_linux_chardev_fake_reset(uint_fast16_t count)
+{
+	if (count > ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES) {
+		count = ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES;
+	}
+
+	for (uint_fast16_t index = 0; index < MAX_HANDLES; index++) {
+		if (handles[index].in_use && handles[index].event_flags != 0) {
+			close(handles[index].event_fds[0]);
+			close(handles[index].event_fds[1]);
+		}
+	}
+
+	memset(handles, 0, sizeof(handles));
+	for (uint_fast16_t line = 0; line < ACC_DRIVER_GPIO_LINUX_CHARDEV_FAKE_MAX_LINES; line++) {
+		lines[line].handle	= 0;
+		lines[line].output	= false;
+		lines[line].level	= 0;
+	}
+
+	line_count	= count;
+	ioctl_count	= 0;
+}
+
+
+void acc_driver_gpio_linux_chardev_fake_set_input(uint_fast8_t line, uint_fast8_t level)
+{
+	fake_handle_t		*handle;
+	struct gpioevent_data	event;
+	uint32_t		wanted;
+
+	level = level ? 1 : 0;
+
+	if (line >= line_count || lines[line].output || lines[line].level == level) {
+		return;
+	}
+
+	lines[line].level = level;
+
+	if (lines[line].handle == 0) {
+		return;
+	}
+
+	handle = &handles[lines[line].handle - 1];
+	wanted = level ? GPIOEVENT_REQUEST_RISING_EDGE : GPIOEVENT_REQUEST_FALLING_EDGE;
+
+	if ((handle->event_flags & wanted) == 0) {
+		return;
+	}
+
+	event.timestamp	= acc_os_monotonic_ns();
+	event.id	= level ? GPIOEVENT_EVENT_RISING_EDGE : GPIOEVENT_EVENT_FALLING_EDGE;
+
+	// A full pipe drops the event, as a full kernel event queue does
+	ssize_t written = write(handle->event_fds[1], &event, sizeof(event));
+	(void)written;
+}
+
+
+bool acc_driver_gpio_linux_chardev_fake_get_output(uint_fast8_t line, uint_fast8_t *level)
+{
+	if (line >= line_count || lines[line].handle == 0 || !lines[line].output) {
+		return false;
+	}
+
+	*level = lines[line].level;
+
+	return true;
+}
+
+
+uint32_t acc_driver_gpio_linux_chardev_fake_get_ioctl_count(void)
+{
+	return ioctl_count;
+}
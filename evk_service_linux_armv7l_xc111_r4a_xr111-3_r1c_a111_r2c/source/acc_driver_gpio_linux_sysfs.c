@@ -3,10 +3,13 @@
 
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <sys/inotify.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
@@ -24,15 +27,37 @@
 #define MODULE		"driver_gpio_linux_sysfs"
 
 /**
- * @brief Paths to the GPIO sysfs files
+ * @brief Default directory of the GPIO sysfs files
+ */
+#define GPIO_ROOT_DEFAULT		"/sys/class/gpio"
+
+/**
+ * @brief Maximum length of the directory of the GPIO sysfs files, including the terminator
+ */
+#define GPIO_ROOT_MAX			128
+
+/**
+ * @brief Paths to the GPIO sysfs files, relative to the root directory
  */
 /**@{*/
-#define GPIO_EXPORT_PATH		"/sys/class/gpio/export"
-#define GPIO_UNEXPORT_PATH		"/sys/class/gpio/unexport"
-#define GPIO_DIRECTION_PATH		"/sys/class/gpio/gpio%u/direction"
-#define GPIO_VALUE_PATH			"/sys/class/gpio/gpio%u/value"
+#define GPIO_EXPORT_PATH		"%s/export"
+#define GPIO_UNEXPORT_PATH		"%s/unexport"
+#define GPIO_PIN_PATH			"%s/gpio%u"
+#define GPIO_DIRECTION_PATH		"%s/gpio%u/direction"
+#define GPIO_VALUE_PATH			"%s/gpio%u/value"
+#define GPIO_EDGE_PATH			"%s/gpio%u/edge"
 /**@}*/
 
+/**
+ * @brief Time to wait for the files of exported GPIOs
+ */
+#define GPIO_OPEN_TIMEOUT_US		1000000
+
+/**
+ * @brief Interval to retry opening GPIO files between inotify events
+ */
+#define GPIO_OPEN_RETRY_MS		5
+
 /**
  * @brief GPIO pin direction
  */
@@ -43,17 +68,24 @@ typedef enum {
 } gpio_dir_enum_t;
 typedef uint32_t gpio_dir_t;
 
+/**
+ * @brief Value of the edge file when no edges are detected
+ */
+#define GPIO_EDGE_NONE			((acc_device_gpio_edge_t)-1)
+
 /**
  * @brief GPIO pin information
  */
 typedef struct {
-	uint_fast8_t	is_open;
-	uint_fast8_t	pin;
-	int		dir_fd;
-	int		value_fd;
-	gpio_dir_t	dir;
-	int_fast8_t	value;
-	uint_fast8_t	pull;
+	uint_fast8_t		is_open;
+	uint_fast8_t		pin;
+	int			dir_fd;
+	int			value_fd;
+	gpio_dir_t		dir;
+	int_fast8_t		value;
+	uint_fast8_t		pull;
+	acc_device_gpio_edge_t	edge;
+	int			open_errno;
 } gpio_t;
 
 
@@ -67,45 +99,39 @@ static gpio_t	*gpios;
  */
 static uint_fast16_t	gpio_count;
 
+/**
+ * @brief Directory of the GPIO sysfs files
+ */
+static char		gpio_root[GPIO_ROOT_MAX] = GPIO_ROOT_DEFAULT;
+
 
 /**
- * @brief Internal GPIO open
+ * @brief Internal GPIO export
  *
- * Export GPIO to create /sys/class/gpio/gpio#
- * Create /sys/class/gpio/gpio#/value and /sys/class/gpio/gpio#/direction.
+ * Unexport any earlier export of the pin, then export it to create gpio#.
  *
  * @param pin GPIO pin
  * @return Status
  */
-static acc_status_t internal_gpio_open(uint_fast8_t pin)
+static acc_status_t internal_gpio_export(uint_fast8_t pin)
 {
 	int	unexport_fd;
 	int	export_fd;
 	char	gpio_x[5];
 	ssize_t	gpio_x_len;
 	ssize_t	bytes_written;
-	char	dir_path[sizeof(GPIO_DIRECTION_PATH) + 10];
-	char	value_path[sizeof(GPIO_VALUE_PATH) + 10];
-
-	if (pin >= gpio_count) {
-		ACC_LOG_ERROR("GPIO %u is not a valid GPIO pin", pin);
-		return ACC_STATUS_BAD_PARAM;
-	}
-	gpio_t *gpio = &gpios[pin];
-
-	if (gpio->is_open)
-		return ACC_STATUS_SUCCESS;
+	char	path[GPIO_ROOT_MAX + sizeof(GPIO_UNEXPORT_PATH)];
 
 	gpio_x_len = snprintf(gpio_x, sizeof(gpio_x), "%u", pin);
-	snprintf(dir_path, sizeof(dir_path), GPIO_DIRECTION_PATH, pin);
-	snprintf(value_path, sizeof(value_path), GPIO_VALUE_PATH, pin);
 
 	// Clean-up of gpio
-	unexport_fd = open(GPIO_UNEXPORT_PATH, O_WRONLY);
+	snprintf(path, sizeof(path), GPIO_UNEXPORT_PATH, gpio_root);
+	unexport_fd = open(path, O_WRONLY);
 	bytes_written = write(unexport_fd, gpio_x, gpio_x_len);
 	close(unexport_fd);
 
-	export_fd = open(GPIO_EXPORT_PATH, O_WRONLY);
+	snprintf(path, sizeof(path), GPIO_EXPORT_PATH, gpio_root);
+	export_fd = open(path, O_WRONLY);
 	if (export_fd < 0) {
 		ACC_LOG_FATAL("Unable to open gpio export: %s", strerror(errno));
 		return ACC_STATUS_FAILURE;
@@ -126,47 +152,283 @@ static acc_status_t internal_gpio_open(uint_fast8_t pin)
 
 	close(export_fd);
 
-	gpio->dir_fd	= -1;
-	gpio->value_fd	= -1;
-	gpio->dir	= GPIO_DIR_UNKNOWN;
-	gpio->value	= 0;
-	gpio->pull	= 0;
+	return ACC_STATUS_SUCCESS;
+}
+
 
-	// Wait a maximum of one second for each gpio to open
-	for (uint_fast16_t loop_count = 0; loop_count < 100; loop_count++) {
-		gpio->dir_fd = open(dir_path, O_RDWR);
+/**
+ * @brief Try to open the direction and value files of an exported GPIO
+ *
+ * The files may not exist yet, or not be writable until udev has changed their permissions.
+ * The errno of a failed open is kept in open_errno.
+ *
+ * @param gpio GPIO information
+ * @return True when both files are open
+ */
+static bool internal_gpio_try_open_files(gpio_t *gpio)
+{
+	char path[GPIO_ROOT_MAX + sizeof(GPIO_DIRECTION_PATH) + 10];
+
+	if (gpio->dir_fd < 0) {
+		snprintf(path, sizeof(path), GPIO_DIRECTION_PATH, gpio_root, gpio->pin);
+		gpio->dir_fd = open(path, O_RDWR);
 		if (gpio->dir_fd < 0) {
-			acc_os_sleep_us(10000);
+			gpio->open_errno = errno;
 		}
-		else {
-			ACC_LOG_VERBOSE("Waited %u ms on gpio open direction", loop_count * 10);
-			break;
+	}
+
+	if (gpio->dir_fd >= 0 && gpio->value_fd < 0) {
+		snprintf(path, sizeof(path), GPIO_VALUE_PATH, gpio_root, gpio->pin);
+		gpio->value_fd = open(path, O_RDWR);
+		if (gpio->value_fd < 0) {
+			gpio->open_errno = errno;
 		}
 	}
 
-	if (gpio->dir_fd < 0) {
-		ACC_LOG_ERROR("Unable to open gpio%u direction: %s", pin, strerror(errno));
-		return ACC_STATUS_FAILURE;
+	return gpio->dir_fd >= 0 && gpio->value_fd >= 0;
+}
+
+
+/**
+ * @brief Internal GPIO open of several pins
+ *
+ * All pins are exported first, then their files are waited for together. The wait is woken by
+ * inotify when a gpio# directory is created or its files change permissions. sysfs does not
+ * report every file the kernel creates, so the files are also retried every GPIO_OPEN_RETRY_MS.
+ *
+ * @param pins GPIO pins, pins that are already open are skipped
+ * @param pin_count Number of pins
+ * @param[out] ready_us Time from export until each pin could be opened, may be NULL
+ * @return Status
+ */
+static acc_status_t internal_gpio_open_pins(const uint_fast8_t *pins, uint_fast8_t pin_count, uint32_t *ready_us)
+{
+	acc_status_t	status = ACC_STATUS_SUCCESS;
+	uint_fast8_t	pending[pin_count];
+	bool		watched[pin_count];
+	uint_fast8_t	pending_count = 0;
+	int		inotify_fd;
+	uint64_t	start_us = acc_os_monotonic_ns() / 1000;
+
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		uint_fast8_t pin = pins[index];
+
+		if (ready_us != NULL) {
+			ready_us[index] = 0;
+		}
+
+		if (pin >= gpio_count) {
+			ACC_LOG_ERROR("GPIO %u is not a valid GPIO pin", pin);
+			return ACC_STATUS_BAD_PARAM;
+		}
 	}
 
-	// Wait a maximum of one second for each gpio to open
-	for (uint_fast16_t loop_count = 0; loop_count < 100; loop_count++) {
-		gpio->value_fd = open(value_path, O_RDWR);
-		if (gpio->value_fd < 0) {
-			acc_os_sleep_us(10000);
+	inotify_fd = inotify_init1(IN_NONBLOCK);
+	if (inotify_fd < 0) {
+		ACC_LOG_WARNING("inotify not available, GPIO files are polled: %s", strerror(errno));
+	} else {
+		inotify_add_watch(inotify_fd, gpio_root, IN_CREATE);
+	}
+
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		gpio_t *gpio = &gpios[pins[index]];
+
+		if (gpio->is_open) {
+			continue;
 		}
-		else {
-			ACC_LOG_VERBOSE("Waited %u ms on gpio open value", loop_count * 10);
+
+		status = internal_gpio_export(gpio->pin);
+		if (status != ACC_STATUS_SUCCESS) {
 			break;
 		}
+
+		gpio->dir_fd	= -1;
+		gpio->value_fd	= -1;
+		gpio->dir	= GPIO_DIR_UNKNOWN;
+		gpio->value	= 0;
+		gpio->pull	= 0;
+		gpio->edge	= GPIO_EDGE_NONE;
+		gpio->open_errno	= 0;
+
+		watched[pending_count]	= false;
+		pending[pending_count++]	= index;
+	}
+
+	while (status == ACC_STATUS_SUCCESS && pending_count > 0) {
+		uint_fast8_t	still_pending = 0;
+		uint64_t	elapsed_us;
+
+		for (uint_fast8_t wait = 0; wait < pending_count; wait++) {
+			uint_fast8_t	index = pending[wait];
+			gpio_t		*gpio = &gpios[pins[index]];
+
+			if (inotify_fd >= 0 && !watched[wait]) {
+				char path[GPIO_ROOT_MAX + sizeof(GPIO_PIN_PATH) + 10];
+
+				snprintf(path, sizeof(path), GPIO_PIN_PATH, gpio_root, gpio->pin);
+				watched[wait] = inotify_add_watch(inotify_fd, path, IN_CREATE | IN_ATTRIB) >= 0;
+			}
+
+			if (internal_gpio_try_open_files(gpio)) {
+				uint32_t pin_ready_us = acc_os_monotonic_ns() / 1000 - start_us;
+
+				ACC_LOG_VERBOSE("gpio%u ready after %u us", gpio->pin, (unsigned int)pin_ready_us);
+				if (ready_us != NULL) {
+					ready_us[index] = pin_ready_us;
+				}
+				gpio->is_open = 1;
+				continue;
+			}
+
+			watched[still_pending]	= watched[wait];
+			pending[still_pending++]	= index;
+		}
+		pending_count = still_pending;
+
+		if (pending_count == 0) {
+			break;
+		}
+
+		elapsed_us = acc_os_monotonic_ns() / 1000 - start_us;
+		if (elapsed_us >= GPIO_OPEN_TIMEOUT_US) {
+			for (uint_fast8_t wait = 0; wait < pending_count; wait++) {
+				gpio_t *gpio = &gpios[pins[pending[wait]]];
+
+				ACC_LOG_ERROR("Unable to open gpio%u %s: %s", gpio->pin, (gpio->dir_fd < 0) ? "direction" : "value",
+				              strerror(gpio->open_errno));
+			}
+			status = ACC_STATUS_FAILURE;
+			break;
+		}
+
+		if (inotify_fd >= 0) {
+			struct pollfd	fd = { .fd = inotify_fd, .events = POLLIN };
+			char		events[sizeof(struct inotify_event) * 16 + NAME_MAX + 1];
+			uint64_t	timeout_ms = (GPIO_OPEN_TIMEOUT_US - elapsed_us + 999) / 1000;
+
+			if (timeout_ms > GPIO_OPEN_RETRY_MS) {
+				timeout_ms = GPIO_OPEN_RETRY_MS;
+			}
+
+			// Which file changed does not matter, all pending pins are tried again
+			if (poll(&fd, 1, timeout_ms) > 0) {
+				while (read(inotify_fd, events, sizeof(events)) > 0) {
+				}
+			}
+		} else {
+			acc_os_sleep_us(GPIO_OPEN_RETRY_MS * 1000);
+		}
+	}
+
+	if (inotify_fd >= 0) {
+		close(inotify_fd);
+	}
+
+	return status;
+}
+
+
+/**
+ * @brief Internal GPIO open
+ *
+ * Export GPIO to create gpio#, then open gpio#/value and gpio#/direction.
+ *
+ * @param pin GPIO pin
+ * @return Status
+ */
+static acc_status_t internal_gpio_open(uint_fast8_t pin)
+{
+	if (pin >= gpio_count) {
+		ACC_LOG_ERROR("GPIO %u is not a valid GPIO pin", pin);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (gpios[pin].is_open)
+		return ACC_STATUS_SUCCESS;
+
+	return internal_gpio_open_pins(&pin, 1, NULL);
+}
+
+
+/**
+ * @brief Internal GPIO set edge
+ *
+ * Write 'edge' to /sys/class/gpio/gpio#/edge, which makes value pollable for that edge.
+ *
+ * @param gpio GPIO information
+ * @param edge The edge to detect, GPIO_EDGE_NONE to detect none
+ * @return Status
+ */
+static acc_status_t internal_gpio_set_edge(gpio_t *gpio, acc_device_gpio_edge_t edge)
+{
+	static const char	*edge_names[] = { "rising", "falling", "both" };
+	const char		*edge_str     = (edge == GPIO_EDGE_NONE) ? "none" : edge_names[edge];
+	size_t			edge_str_len  = strlen(edge_str);
+	char			path[GPIO_ROOT_MAX + sizeof(GPIO_EDGE_PATH) + 10];
+	int			edge_fd;
+	ssize_t			bytes_written;
+
+	if (gpio->edge == edge)
+		return ACC_STATUS_SUCCESS;
+
+	snprintf(path, sizeof(path), GPIO_EDGE_PATH, gpio_root, gpio->pin);
+	edge_fd = open(path, O_WRONLY);
+	if (edge_fd < 0) {
+		ACC_LOG_ERROR("Unable to open gpio%u edge: %s", gpio->pin, strerror(errno));
+		return ACC_STATUS_FAILURE;
 	}
 
-	if (gpio->value_fd < 0) {
-		ACC_LOG_ERROR("Unable to open gpio%u value: %s", pin, strerror(errno));
+	bytes_written = write(edge_fd, edge_str, edge_str_len);
+	close(edge_fd);
+
+	if (bytes_written != (ssize_t)edge_str_len) {
+		ACC_LOG_ERROR("Could not write to gpio%u edge: %s", gpio->pin, strerror(errno));
 		return ACC_STATUS_FAILURE;
 	}
 
-	gpio->is_open = 1;
+	gpio->edge = edge;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Internal GPIO read of the value file
+ *
+ * Reading also acknowledges edges reported by poll() on the value file.
+ *
+ * @param gpio GPIO information
+ * @param[out] value The value which has been read
+ * @return Status
+ */
+static acc_status_t internal_gpio_read_value(gpio_t *gpio, uint_fast8_t *value)
+{
+	char	value_str[10];
+	ssize_t	bytes_read;
+
+	// position file pointer at beginning of value file
+	off_t offset = lseek(gpio->value_fd, 0, SEEK_SET);
+	if (offset < 0) {
+		ACC_LOG_ERROR("Unable to lseek() GPIO %u: (%u) %s", gpio->pin, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+	if (offset > 0) {
+		ACC_LOG_ERROR("lseek() GPIO %u returned %u", gpio->pin, offset);
+		return ACC_STATUS_FAILURE;
+	}
+
+	// read GPIO input value
+	bytes_read = read(gpio->value_fd, value_str, sizeof(value_str));
+	if (bytes_read < 0) {
+		ACC_LOG_ERROR("Unable to read from GPIO %u: (%u) %s", gpio->pin, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+	if (bytes_read == 0) {
+		ACC_LOG_ERROR("Zero bytes read for GPIO %u", gpio->pin);
+		return ACC_STATUS_FAILURE;
+	}
+
+	*value = (value_str[0] != '0') ? 1 : 0;
 
 	return ACC_STATUS_SUCCESS;
 }
@@ -248,8 +510,10 @@ static void internal_gpio_close_all(void)
 	ssize_t	gpio_x_len;
 	ssize_t	bytes_written;
 	gpio_t	*gpio;
+	char	path[GPIO_ROOT_MAX + sizeof(GPIO_UNEXPORT_PATH)];
 
-	unexport_fd = open(GPIO_UNEXPORT_PATH, O_WRONLY);
+	snprintf(path, sizeof(path), GPIO_UNEXPORT_PATH, gpio_root);
+	unexport_fd = open(path, O_WRONLY);
 	if (unexport_fd < 0) {
 		ACC_LOG_ERROR("Unable to open gpio unexport: %s", strerror(errno));
 		return;
@@ -304,6 +568,7 @@ static acc_status_t acc_driver_gpio_linux_sysfs_init(void)
 
 	acc_os_init();
 	acc_os_mutex_init(&init_mutex);
+	acc_os_linux_mutex_set_name(&init_mutex, "gpio_sysfs_init");
 
 	acc_os_mutex_lock(&init_mutex);
 	if (init_done) {
@@ -431,34 +696,71 @@ acc_status_t acc_driver_gpio_linux_sysfs_read(uint_fast8_t pin, uint_fast8_t *va
 		return ACC_STATUS_FAILURE;
 	}
 
-	char	value_str[10];
-	ssize_t	bytes_read;
+	return internal_gpio_read_value(gpio, value);
+}
 
-	// position file pointer at beginning of value file
-	off_t offset = lseek(gpio->value_fd, 0, SEEK_SET);
-	if (offset < 0) {
-		ACC_LOG_ERROR("Unable to lseek() GPIO %u: (%u) %s", pin, errno, strerror(errno));
-		return ACC_STATUS_FAILURE;
+
+/**
+ * @brief Wait for an edge on a GPIO input
+ *
+ * @param pin GPIO pin to wait on
+ * @param edge Edges to wait for
+ * @param timeout_ms Longest time to wait
+ * @param[out] level The level after the edge, may be NULL
+ * @return Status
+ */
+acc_status_t acc_driver_gpio_linux_sysfs_wait_edge(uint_fast8_t pin, acc_device_gpio_edge_t edge, uint32_t timeout_ms, uint_fast8_t *level)
+{
+	acc_status_t	status;
+	gpio_t		*gpio;
+	uint_fast8_t	value;
+	int		result;
+
+	status = internal_gpio_open(pin);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
 	}
-	if (offset > 0) {
-		ACC_LOG_ERROR("lseek() GPIO %u returned %u", pin, offset);
+	gpio = &gpios[pin];
+
+	if (gpio->dir != GPIO_DIR_IN) {
+		ACC_LOG_ERROR("Cannot wait on GPIO %u as it is output/unknown", pin);
 		return ACC_STATUS_FAILURE;
 	}
 
-	// read GPIO input value
-	bytes_read = read(gpio->value_fd, value_str, sizeof(value_str));
-	if (bytes_read < 0) {
-		ACC_LOG_ERROR("Unable to read from GPIO %u: (%u) %s", pin, errno, strerror(errno));
-		return ACC_STATUS_FAILURE;
+	if (gpio->edge != edge) {
+		status = internal_gpio_set_edge(gpio, edge);
+		if (status != ACC_STATUS_SUCCESS) {
+			return status;
+		}
+
+		// Acknowledge what was pending before the edge was configured
+		status = internal_gpio_read_value(gpio, &value);
+		if (status != ACC_STATUS_SUCCESS) {
+			return status;
+		}
 	}
-	if (bytes_read == 0) {
-		ACC_LOG_ERROR("Zero bytes read for GPIO %u", pin);
+
+	struct pollfd fd = { .fd = gpio->value_fd, .events = POLLPRI | POLLERR };
+
+	do {
+		result = poll(&fd, 1, timeout_ms);
+	} while (result < 0 && errno == EINTR);
+
+	if (result < 0) {
+		ACC_LOG_ERROR("Unable to poll GPIO %u: (%u) %s", pin, errno, strerror(errno));
 		return ACC_STATUS_FAILURE;
 	}
 
-	*value = (value_str[0] != '0') ? 1 : 0;
+	if (result == 0) {
+		return ACC_STATUS_TIMEOUT;
+	}
 
-	return ACC_STATUS_SUCCESS;
+	status = internal_gpio_read_value(gpio, &value);
+	if (status == ACC_STATUS_SUCCESS && level != NULL) {
+		*level = value;
+	}
+
+	return status;
 }
 
 
@@ -488,6 +790,14 @@ acc_status_t acc_driver_gpio_linux_sysfs_write(uint_fast8_t pin, uint_fast8_t le
 			return status;
 		}
 	} else {
+		// The kernel does not allow an output with edge detection
+		if (gpio->edge != GPIO_EDGE_NONE) {
+			status = internal_gpio_set_edge(gpio, GPIO_EDGE_NONE);
+			if (status != ACC_STATUS_SUCCESS) {
+				return status;
+			}
+		}
+
 		status = internal_gpio_set_dir(gpio, GPIO_DIR_OUT, level);
 		if (status != ACC_STATUS_SUCCESS) {
 			return status;
@@ -498,6 +808,46 @@ acc_status_t acc_driver_gpio_linux_sysfs_write(uint_fast8_t pin, uint_fast8_t le
 }
 
 
+/**
+ * @brief Export and open several GPIO pins at once
+ *
+ * @param pins GPIO pins
+ * @param pin_count Number of pins
+ * @param[out] ready_us Time from export until each pin could be opened, 0 for pins already open, may be NULL
+ * @return Status
+ */
+acc_status_t acc_driver_gpio_linux_sysfs_open(const uint_fast8_t *pins, uint_fast8_t pin_count, uint32_t *ready_us)
+{
+	acc_status_t status;
+
+	status = acc_driver_gpio_linux_sysfs_init();
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	return internal_gpio_open_pins(pins, pin_count, ready_us);
+}
+
+
+/**
+ * @brief Set the directory of the GPIO sysfs files
+ *
+ * @param root The directory, "/sys/class/gpio" unless set
+ * @return Status
+ */
+acc_status_t acc_driver_gpio_linux_sysfs_set_root(const char *root)
+{
+	if (strlen(root) >= sizeof(gpio_root)) {
+		ACC_LOG_ERROR("GPIO root %s is too long", root);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	strcpy(gpio_root, root);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
 /**
  * @brief Request driver to register with appropriate device(s)
  *
@@ -512,4 +862,5 @@ void acc_driver_gpio_linux_sysfs_register(uint_fast16_t pin_count)
 	acc_device_gpio_input_func		= acc_driver_gpio_linux_sysfs_input;
 	acc_device_gpio_read_func		= acc_driver_gpio_linux_sysfs_read;
 	acc_device_gpio_write_func		= acc_driver_gpio_linux_sysfs_write;
+	acc_device_gpio_wait_edge_func		= acc_driver_gpio_linux_sysfs_wait_edge;
 }
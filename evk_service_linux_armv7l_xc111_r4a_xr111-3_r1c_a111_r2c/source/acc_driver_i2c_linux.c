@@ -1,8 +1,10 @@
-// Copyright (c) Acconeer AB, 2016-2017
+// Copyright (c) Acconeer AB, 2016-2018
 // All rights reserved
 
 #include <errno.h>
 #include <fcntl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
 #include <pthread.h>
 #include <stdbool.h>
 #include <stdint.h>
@@ -15,6 +17,7 @@
 #include "acc_driver_i2c_linux.h"
 #include "acc_device_i2c.h"
 #include "acc_log.h"
+#include "acc_os.h"
 #include "acc_types.h"
 
 
@@ -28,6 +31,43 @@
  */
 #define I2C_PATH	"/dev/i2c-1"
 
+/**
+ * @brief Number of 7-bit device IDs, each has its own lock
+ */
+#define I2C_DEVICE_ID_COUNT	128
+
+/**
+ * @brief No slave address selected on i2c_fd yet
+ */
+#define I2C_NO_SLAVE		-1
+
+
+static int system_open(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+
+static int system_ioctl(int fd, unsigned long request, void *arg)
+{
+	return ioctl(fd, request, arg);
+}
+
+
+/**
+ * @brief The system calls used when no others are registered
+ */
+static const acc_driver_i2c_linux_ops_t system_ops = {
+	.open	= system_open,
+	.close	= close,
+	.ioctl	= system_ioctl,
+	.read	= read,
+	.write	= write
+};
+
+
+static const acc_driver_i2c_linux_ops_t *ops = &system_ops;
+
 
 /**
  * @brief File descriptor of I2C device file to Kernel
@@ -35,9 +75,74 @@
 static int		i2c_fd = -1;
 
 /**
- * @brief Mutex to protect I2C transfers
+ * @brief True if the adapter takes combined transfers with I2C_RDWR
+ */
+static bool		i2c_rdwr;
+
+/**
+ * @brief Mutex to protect the slave address selected on i2c_fd, only used without I2C_RDWR
+ */
+static acc_os_mutex_t	i2c_mutex;
+
+/**
+ * @brief Slave address last selected with I2C_SLAVE, protected by i2c_mutex
+ */
+static int		i2c_slave = I2C_NO_SLAVE;
+
+/**
+ * @brief One lock per device, keeps the transactions of a device in order without stopping other devices
+ */
+static acc_os_mutex_t	device_mutex[I2C_DEVICE_ID_COUNT];
+
+
+/**
+ * @brief Lock that serializes transactions with a device
+ *
+ * Without I2C_RDWR the slave address is state of the file descriptor, so all devices share one lock.
+ * The lock of a device is initialized when it is first used, so only the devices on the bus take
+ * an entry of the mutex contention counts.
+ */
+static acc_os_mutex_t *internal_lock(uint8_t device_id)
+{
+	if (!i2c_rdwr) {
+		return &i2c_mutex;
+	}
+
+	acc_os_mutex_t *mutex = &device_mutex[device_id & (I2C_DEVICE_ID_COUNT - 1)];
+
+	if (!__atomic_load_n(&mutex->is_initialized, __ATOMIC_ACQUIRE)) {
+		acc_os_mutex_init(mutex);
+		acc_os_linux_mutex_set_name(mutex, "i2c_device");
+	}
+
+	return mutex;
+}
+
+
+/**
+ * @brief Select the slave of read() and write(), skipped if it is already selected
+ *
+ * The caller holds i2c_mutex.
+ *
+ * @param device_id The ID of the device
+ * @return Status
  */
-static pthread_mutex_t	i2c_mutex = PTHREAD_MUTEX_INITIALIZER;
+static acc_status_t internal_select_slave(uint8_t device_id)
+{
+	if (i2c_slave == device_id) {
+		return ACC_STATUS_SUCCESS;
+	}
+
+	if (ops->ioctl(i2c_fd, I2C_SLAVE, (void *)(uintptr_t)device_id) < 0) {
+		ACC_LOG_ERROR("Could not set i2c slave device ID %u: (%u) %s", device_id, errno, strerror(errno));
+		i2c_slave = I2C_NO_SLAVE;
+		return ACC_STATUS_FAILURE;
+	}
+
+	i2c_slave = device_id;
+
+	return ACC_STATUS_SUCCESS;
+}
 
 
 /**
@@ -52,12 +157,12 @@ static pthread_mutex_t	i2c_mutex = PTHREAD_MUTEX_INITIALIZER;
 static acc_status_t internal_read(uint8_t *buffer, size_t buffer_size)
 {
 	ssize_t bytes_read;
-	if ((bytes_read = read(i2c_fd, buffer, buffer_size)) < 0) {
+	if ((bytes_read = ops->read(i2c_fd, buffer, buffer_size)) < 0) {
 		ACC_LOG_ERROR("Could not read from i2c device: (%u) %s", errno, strerror(errno));
 		return ACC_STATUS_FAILURE;
 	}
 	if ((size_t)bytes_read != buffer_size) {
-		ACC_LOG_ERROR("Number of bytes read was %u, but should be %u", bytes_read, buffer_size);
+		ACC_LOG_ERROR("Number of bytes read was %u, but should be %u", (unsigned int)bytes_read, (unsigned int)buffer_size);
 		return ACC_STATUS_FAILURE;
 	}
 
@@ -65,6 +170,76 @@ static acc_status_t internal_read(uint8_t *buffer, size_t buffer_size)
 }
 
 
+/**
+ * @brief Internal I2C write
+ *
+ * Does a write() on i2c_fd. Assumes that a device ID has already been set.
+ *
+ * @param device_id The ID of the device, for logging
+ * @param buffer The data to be written
+ * @param buffer_size The size of the buffer
+ * @return Status
+ */
+static acc_status_t internal_write(uint8_t device_id, const uint8_t *buffer, size_t buffer_size)
+{
+	ssize_t bytes_written;
+	if ((bytes_written = ops->write(i2c_fd, buffer, buffer_size)) < 0) {
+		ACC_LOG_ERROR("Could not write to i2c device %u: (%u) %s", device_id, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+	if ((size_t)bytes_written != buffer_size) {
+		ACC_LOG_ERROR("Number of bytes written was %u, but should be %u", (unsigned int)bytes_written, (unsigned int)buffer_size);
+		return ACC_STATUS_FAILURE;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Send messages as one combined transfer, with repeated starts and one STOP at the end
+ *
+ * @param device_id The ID of the device, for logging
+ * @param messages The messages
+ * @param message_count Number of messages, at most I2C_RDWR_IOCTL_MAX_MSGS
+ * @return Status
+ */
+static acc_status_t internal_rdwr(uint8_t device_id, struct i2c_msg *messages, size_t message_count)
+{
+	struct i2c_rdwr_ioctl_data transfer = {
+		.msgs	= messages,
+		.nmsgs	= message_count
+	};
+
+	if (ops->ioctl(i2c_fd, I2C_RDWR, &transfer) < 0) {
+		ACC_LOG_ERROR("Could not transfer with i2c device %u: (%u) %s", device_id, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+/**
+ * @brief Put a register address in the byte order of the bus
+ *
+ * @return Status
+ */
+static acc_status_t internal_encode_address(uint16_t address, uint_fast8_t address_size, uint8_t *data)
+{
+	if (address_size == 1) {
+		data[0] = address;
+	} else if (address_size == 2) {
+		data[0] = (address >> 8) & 0xff;
+		data[1] = address & 0xff;
+	} else {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
 /**
  * @brief Initialize I2C driver
  *
@@ -74,6 +249,7 @@ static acc_status_t acc_driver_i2c_linux_init(void)
 {
 	static pthread_mutex_t	init_mutex = PTHREAD_MUTEX_INITIALIZER;
 	static bool		init_done;
+	unsigned long		functionality = 0;
 
 	pthread_mutex_lock(&init_mutex);
 	if (init_done) {
@@ -81,12 +257,20 @@ static acc_status_t acc_driver_i2c_linux_init(void)
 		return ACC_STATUS_SUCCESS;
 	}
 
-	if ((i2c_fd = open(I2C_PATH, O_RDWR)) < 0) {
+	if ((i2c_fd = ops->open(I2C_PATH, O_RDWR)) < 0) {
 		ACC_LOG_FATAL("Unable to open i2c connection: %s", strerror(errno));
 		pthread_mutex_unlock(&init_mutex);
 		return ACC_STATUS_FAILURE;
 	}
 
+	acc_os_mutex_init(&i2c_mutex);
+	acc_os_linux_mutex_set_name(&i2c_mutex, "i2c");
+
+	i2c_rdwr = (ops->ioctl(i2c_fd, I2C_FUNCS, &functionality) == 0) && (functionality & I2C_FUNC_I2C);
+	if (!i2c_rdwr) {
+		ACC_LOG_WARNING("No combined transfers on %s, using read() and write()", I2C_PATH);
+	}
+
 	init_done = true;
 	pthread_mutex_unlock(&init_mutex);
 
@@ -109,41 +293,36 @@ static acc_status_t acc_driver_i2c_linux_init(void)
  */
 static acc_status_t acc_driver_i2c_linux_write_to_address_internal(uint8_t device_id, uint16_t address, uint_fast8_t address_size, const uint8_t *buffer, size_t buffer_size)
 {
-	uint8_t write_data[address_size + buffer_size];
-	ssize_t bytes_written;
+	uint8_t		write_data[address_size + buffer_size];
+	acc_os_mutex_t	*mutex = internal_lock(device_id);
+	acc_status_t	status;
 
-	if (address_size == 1) {
-		write_data[0] = address;
-	} else if (address_size == 2) {
-		write_data[0] = (address >> 8) & 0xff;
-		write_data[1] = address & 0xff;
-	} else {
+	if (internal_encode_address(address, address_size, write_data) != ACC_STATUS_SUCCESS) {
 		return ACC_STATUS_BAD_PARAM;
 	}
 	memcpy(&write_data[address_size], buffer, buffer_size);
 
-	pthread_mutex_lock(&i2c_mutex);
+	acc_os_mutex_lock(mutex);
 
-	if (ioctl(i2c_fd, 0x0703, device_id) < 0) {
-		ACC_LOG_ERROR("Could not set i2c slave device ID %u", device_id);
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
-	}
+	if (i2c_rdwr) {
+		struct i2c_msg message = {
+			.addr	= device_id,
+			.flags	= 0,
+			.len	= sizeof(write_data),
+			.buf	= write_data
+		};
 
-	if ((bytes_written = write(i2c_fd, write_data, sizeof(write_data))) < 0) {
-		ACC_LOG_ERROR("Could not write to i2c device %u: (%u) %s", device_id, errno, strerror(errno));
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
-	}
-	if ((size_t)bytes_written != sizeof(write_data)) {
-		ACC_LOG_ERROR("Number of bytes written was %u, but should be %u", (unsigned int)bytes_written, (unsigned int)sizeof(write_data));
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
+		status = internal_rdwr(device_id, &message, 1);
+	} else {
+		status = internal_select_slave(device_id);
+		if (status == ACC_STATUS_SUCCESS) {
+			status = internal_write(device_id, write_data, sizeof(write_data));
+		}
 	}
 
-	pthread_mutex_unlock(&i2c_mutex);
+	acc_os_mutex_unlock(mutex);
 
-	return ACC_STATUS_SUCCESS;
+	return status;
 }
 
 
@@ -187,7 +366,8 @@ static acc_status_t acc_driver_i2c_linux_write_to_address_16(uint8_t device_id,
  * @brief I2C read from specified address
  *
  * Read from specific device ID from specific address.
- * Transfer including START and STOP.
+ * With I2C_RDWR the address is written and the data read with a repeated START in between,
+ * otherwise with a STOP and a START.
  *
  * @param[in] device_id The ID of the device to read from
  * @param[in] address The address to start reading from
@@ -198,47 +378,14 @@ static acc_status_t acc_driver_i2c_linux_write_to_address_16(uint8_t device_id,
  */
 static acc_status_t acc_driver_i2c_linux_read_from_address_internal(uint8_t device_id, uint16_t address, uint_fast8_t address_size, uint8_t *buffer , size_t buffer_size)
 {
-	acc_status_t	status;
-	uint8_t		write_data[address_size];
-	ssize_t		bytes_written;
-
-	if (address_size == 1) {
-		write_data[0] = address;
-	} else if (address_size == 2) {
-		write_data[0] = (address >> 8) & 0xff;
-		write_data[1] = address & 0xff;
-	} else {
-		return ACC_STATUS_BAD_PARAM;
-	}
-
-	pthread_mutex_lock(&i2c_mutex);
-
-	if (ioctl(i2c_fd, 0x0703, device_id) < 0) {
-		ACC_LOG_ERROR("Could not set i2c slave device ID %u", device_id);
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
-	}
-
-	if ((bytes_written = write(i2c_fd, write_data, address_size)) < 0) {
-		ACC_LOG_ERROR("Could not write to i2c device %u: (%u) %s", device_id, errno, strerror(errno));
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
-	}
-	if (bytes_written != address_size) {
-		ACC_LOG_ERROR("Number of bytes written was %u, but should be %u", (unsigned int)bytes_written, (unsigned int)address_size);
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
-	}
-
-	status = internal_read(buffer, buffer_size);
-	if (status != ACC_STATUS_SUCCESS) {
-		pthread_mutex_unlock(&i2c_mutex);
-		return status;
-	}
-
-	pthread_mutex_unlock(&i2c_mutex);
-
-	return ACC_STATUS_SUCCESS;
+	acc_driver_i2c_linux_register_read_t read = {
+		.address	= address,
+		.address_size	= address_size,
+		.buffer		= buffer,
+		.buffer_size	= buffer_size
+	};
+
+	return acc_driver_i2c_linux_read_registers(device_id, &read, 1);
 }
 
 
@@ -292,25 +439,86 @@ static acc_status_t acc_driver_i2c_linux_read_from_address_16(uint8_t device_id,
  */
 static acc_status_t acc_driver_i2c_linux_read(uint8_t device_id, uint8_t *buffer, size_t buffer_size)
 {
-	pthread_mutex_lock(&i2c_mutex);
+	acc_os_mutex_t	*mutex = internal_lock(device_id);
+	acc_status_t	status;
 
-	acc_status_t status;
+	acc_os_mutex_lock(mutex);
 
-	if (ioctl(i2c_fd, 0x0703, device_id) < 0) {
-		ACC_LOG_ERROR("Could not set i2c device ID %u: (%u) %s", device_id, errno, strerror(errno));
-		pthread_mutex_unlock(&i2c_mutex);
-		return ACC_STATUS_FAILURE;
+	if (i2c_rdwr) {
+		struct i2c_msg message = {
+			.addr	= device_id,
+			.flags	= I2C_M_RD,
+			.len	= buffer_size,
+			.buf	= buffer
+		};
+
+		status = internal_rdwr(device_id, &message, 1);
+	} else {
+		status = internal_select_slave(device_id);
+		if (status == ACC_STATUS_SUCCESS) {
+			status = internal_read(buffer, buffer_size);
+		}
+	}
+
+	acc_os_mutex_unlock(mutex);
+
+	return status;
+}
+
+
+acc_status_t acc_driver_i2c_linux_read_registers(uint8_t device_id, const acc_driver_i2c_linux_register_read_t *reads, size_t read_count)
+{
+	// Two messages per read, the address and the data
+	struct i2c_msg	messages[I2C_RDWR_IOCTL_MAX_MSGS];
+	uint8_t		addresses[I2C_RDWR_IOCTL_MAX_MSGS / 2][2];
+	size_t		batch_max = I2C_RDWR_IOCTL_MAX_MSGS / 2;
+	acc_os_mutex_t	*mutex = internal_lock(device_id);
+	acc_status_t	status = ACC_STATUS_SUCCESS;
+
+	for (size_t index = 0; index < read_count; index++) {
+		if (reads[index].address_size < 1 || reads[index].address_size > 2 || reads[index].buffer_size == 0) {
+			return ACC_STATUS_BAD_PARAM;
+		}
 	}
 
-	status = internal_read(buffer, buffer_size);
-	if (status != ACC_STATUS_SUCCESS) {
-		pthread_mutex_unlock(&i2c_mutex);
-		return status;
+	acc_os_mutex_lock(mutex);
+
+	for (size_t first = 0; first < read_count && status == ACC_STATUS_SUCCESS; first += batch_max) {
+		size_t batch_count = (read_count - first < batch_max) ? read_count - first : batch_max;
+
+		for (size_t index = 0; index < batch_count && status == ACC_STATUS_SUCCESS; index++) {
+			const acc_driver_i2c_linux_register_read_t *read = &reads[first + index];
+
+			internal_encode_address(read->address, read->address_size, addresses[index]);
+
+			if (i2c_rdwr) {
+				messages[2 * index].addr	= device_id;
+				messages[2 * index].flags	= 0;
+				messages[2 * index].len		= read->address_size;
+				messages[2 * index].buf		= addresses[index];
+				messages[2 * index + 1].addr	= device_id;
+				messages[2 * index + 1].flags	= I2C_M_RD;
+				messages[2 * index + 1].len	= read->buffer_size;
+				messages[2 * index + 1].buf	= read->buffer;
+			} else {
+				status = internal_select_slave(device_id);
+				if (status == ACC_STATUS_SUCCESS) {
+					status = internal_write(device_id, addresses[index], read->address_size);
+				}
+				if (status == ACC_STATUS_SUCCESS) {
+					status = internal_read(read->buffer, read->buffer_size);
+				}
+			}
+		}
+
+		if (i2c_rdwr) {
+			status = internal_rdwr(device_id, messages, 2 * batch_count);
+		}
 	}
 
-	pthread_mutex_unlock(&i2c_mutex);
+	acc_os_mutex_unlock(mutex);
 
-	return ACC_STATUS_SUCCESS;
+	return status;
 }
 
 
@@ -319,6 +527,19 @@ static acc_status_t acc_driver_i2c_linux_read(uint8_t device_id, uint8_t *buffer
  */
 void acc_driver_i2c_linux_register(void)
 {
+	acc_driver_i2c_linux_register_with_ops(NULL);
+}
+
+
+/**
+ * @brief Request driver to register with appropriate device(s), using other system calls
+ *
+ * @param i2c_ops System calls to use, NULL for the real ones
+ */
+void acc_driver_i2c_linux_register_with_ops(const acc_driver_i2c_linux_ops_t *i2c_ops)
+{
+	ops = (i2c_ops != NULL) ? i2c_ops : &system_ops;
+
 	acc_device_i2c_init_func			= acc_driver_i2c_linux_init;
 	acc_device_i2c_write_to_address_8_func		= acc_driver_i2c_linux_write_to_address_8;
 	acc_device_i2c_write_to_address_16_func		= acc_driver_i2c_linux_write_to_address_16;
@@ -0,0 +1,258 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <errno.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/types.h>
+
+#include "acc_driver_i2c_linux.h"
+#include "acc_driver_i2c_linux_fake.h"
+
+
+/**
+ * @brief File descriptor handed out for the bus, well above what the process uses
+ */
+#define BUS_FD		1200
+
+#define NO_SLAVE	-1
+
+
+/**
+ * @brief One device on the bus
+ *
+ * @param pointer Register the next byte is read from or written to
+ */
+typedef struct {
+	bool		present;
+	uint8_t		device_id;
+	uint_fast8_t	address_size;
+	uint16_t	pointer;
+	uint8_t		registers[ACC_DRIVER_I2C_LINUX_FAKE_REGISTER_COUNT];
+} fake_device_t;
+
+
+static fake_device_t				devices[ACC_DRIVER_I2C_LINUX_FAKE_MAX_DEVICES];
+static bool					rdwr_supported = true;
+static int					slave = NO_SLAVE;
+static acc_driver_i2c_linux_fake_stats_t	stats;
+
+
+static fake_device_t *get_device(int device_id)
+{
+	for (uint_fast8_t index = 0; index < ACC_DRIVER_I2C_LINUX_FAKE_MAX_DEVICES; index++) {
+		if (devices[index].present && devices[index].device_id == device_id) {
+			return &devices[index];
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * @brief A write to a device, the first bytes set the register pointer
+ */
+static void device_write(fake_device_t *device, const uint8_t *data, size_t size)
+{
+	size_t index = 0;
+
+	if (size >= device->address_size) {
+		device->pointer = (device->address_size == 2) ? (data[0] << 8) | data[1] : data[0];
+		index = device->address_size;
+	}
+
+	for (; index < size; index++) {
+		device->registers[device->pointer++ % ACC_DRIVER_I2C_LINUX_FAKE_REGISTER_COUNT] = data[index];
+	}
+}
+
+
+static void device_read(fake_device_t *device, uint8_t *data, size_t size)
+{
+	for (size_t index = 0; index < size; index++) {
+		data[index] = device->registers[device->pointer++ % ACC_DRIVER_I2C_LINUX_FAKE_REGISTER_COUNT];
+	}
+}
+
+
+static int fake_rdwr(struct i2c_rdwr_ioctl_data *transfer)
+{
+	if (!rdwr_supported) {
+		errno = EOPNOTSUPP;
+		return -1;
+	}
+
+	if (transfer->nmsgs == 0 || transfer->nmsgs > I2C_RDWR_IOCTL_MAX_MSGS) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	for (uint32_t index = 0; index < transfer->nmsgs; index++) {
+		struct i2c_msg	*message = &transfer->msgs[index];
+		fake_device_t	*device = get_device(message->addr);
+
+		if (device == NULL) {
+			errno = ENXIO;
+			return -1;
+		}
+
+		if (message->flags & I2C_M_RD) {
+			device_read(device, message->buf, message->len);
+		} else {
+			device_write(device, message->buf, message->len);
+		}
+	}
+
+	return transfer->nmsgs;
+}
+
+
+static int fake_open(const char *path, int flags)
+{
+	(void)path;
+	(void)flags;
+
+	return BUS_FD;
+}
+
+
+static int fake_close(int fd)
+{
+	if (fd != BUS_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+	stats.ioctl_count++;
+
+	if (fd != BUS_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	switch (request) {
+		case I2C_FUNCS:
+			*(unsigned long *)arg = rdwr_supported ? I2C_FUNC_I2C : 0;
+			return 0;
+		case I2C_SLAVE:
+			slave = (int)(uintptr_t)arg;
+			return 0;
+		case I2C_RDWR:
+			return fake_rdwr(arg);
+		default:
+			errno = ENOTTY;
+			return -1;
+	}
+}
+
+
+static ssize_t fake_read(int fd, void *buffer, size_t size)
+{
+	fake_device_t *device = get_device(slave);
+
+	stats.read_count++;
+
+	if (fd != BUS_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (device == NULL) {
+		errno = ENXIO;
+		return -1;
+	}
+
+	device_read(device, buffer, size);
+
+	return size;
+}
+
+
+static ssize_t fake_write(int fd, const void *buffer, size_t size)
+{
+	fake_device_t *device = get_device(slave);
+
+	stats.write_count++;
+
+	if (fd != BUS_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (device == NULL) {
+		errno = ENXIO;
+		return -1;
+	}
+
+	device_write(device, buffer, size);
+
+	return size;
+}
+
+
+const acc_driver_i2c_linux_ops_t acc_driver_i2c_linux_fake_ops = {
+	.open	= fake_open,
+	.close	= fake_close,
+	.ioctl	= fake_ioctl,
+	.read	= fake_read,
+	.write	= fake_write
+};
+
+
+void acc_driver_i2c_linux_fake_reset(bool rdwr)
+{
+	memset(devices, 0, sizeof(devices));
+	memset(&stats, 0, sizeof(stats));
+	rdwr_supported = rdwr;
+}
+
+
+bool acc_driver_i2c_linux_fake_add_device(uint8_t device_id, uint_fast8_t address_size)
+{
+	for (uint_fast8_t index = 0; index < ACC_DRIVER_I2C_LINUX_FAKE_MAX_DEVICES; index++) {
+		if (!devices[index].present) {
+			memset(&devices[index], 0, sizeof(devices[index]));
+			devices[index].present		= true;
+			devices[index].device_id	= device_id;
+			devices[index].address_size	= address_size;
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+void acc_driver_i2c_linux_fake_set_register(uint8_t device_id, uint16_t address, uint8_t value)
+{
+	fake_device_t *device = get_device(device_id);
+
+	if (device != NULL) {
+		device->registers[address % ACC_DRIVER_I2C_LINUX_FAKE_REGISTER_COUNT] = value;
+	}
+}
+
+
+uint8_t acc_driver_i2c_linux_fake_get_register(uint8_t device_id, uint16_t address)
+{
+	fake_device_t *device = get_device(device_id);
+
+	return (device != NULL) ? device->registers[address % ACC_DRIVER_I2C_LINUX_FAKE_REGISTER_COUNT] : 0;
+}
+
+
+void acc_driver_i2c_linux_fake_get_stats(acc_driver_i2c_linux_fake_stats_t *fake_stats)
+{
+	*fake_stats = stats;
+}
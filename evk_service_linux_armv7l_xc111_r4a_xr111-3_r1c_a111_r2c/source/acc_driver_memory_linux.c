@@ -1,13 +1,22 @@
-// Copyright (c) Acconeer AB, 2017
+// Copyright (c) Acconeer AB, 2017-2018
 // All rights reserved
 
-/* Makes sure the function fseeko will be exposed in stdio.h and fsync in unistd.h. Must be defined before including stdio.h and unistd.h. */
-#define _POSIX_C_SOURCE 200112L
+/* Makes sure pread, pwrite, ftruncate and fdatasync are exposed. Must be defined before including any header. */
+#define _POSIX_C_SOURCE 200809L
 
 #include <errno.h>
+#include <fcntl.h>
 #include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <time.h>
 #include <unistd.h>
 
 #include "acc_device_memory.h"
@@ -17,52 +26,477 @@
 
 #define MODULE "driver_memory_linux"
 
-#define MEMORY_FILE_NAME "memory.bin"
+#define MEMORY_FILE_NAME	"memory.bin"
+#define JOURNAL_FILE_NAME	"memory.journal"
 
-static FILE	*file = NULL;
-static int	file_desc;
+/**
+ * @brief Smallest size of the memory, the file is extended sparsely to this
+ */
+#define MEMORY_SIZE		(4 * 1024 * 1024)
 
+/**
+ * @brief Limits of what is kept in RAM before it is committed
+ */
+/**@{*/
+#define DIRTY_RANGE_MAX		32
+#define DIRTY_BYTES_MAX		(1024 * 1024)
+/**@}*/
 
-static acc_status_t acc_driver_memory_linux_init(void)
+#define DEFAULT_COMMIT_INTERVAL_MS	1000
+
+/**
+ * @brief Longest wait of the exit hook for a commit or write in another thread to finish
+ */
+#define EXIT_COMMIT_WAIT_MS		200
+
+#define JOURNAL_MAGIC		0x4c4e524a	// "JRNL" in memory
+#define JOURNAL_VERSION		1
+
+
+/**
+ * @brief Written data not yet committed to the memory file
+ */
+typedef struct {
+	uint32_t	address;
+	uint32_t	size;
+	uint8_t		*data;
+} dirty_range_t;
+
+
+/**
+ * @brief Start of the journal file, followed by body_size bytes of ranges
+ *
+ * Each range is its address and size as two uint32_t followed by the data.
+ *
+ * @param crc CRC-32 of the body
+ */
+typedef struct {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	range_count;
+	uint32_t	body_size;
+	uint32_t	crc;
+} journal_header_t;
+
+
+static pthread_mutex_t	memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	interval_cond;
+
+static int		memory_fd = -1;
+static int		journal_fd = -1;
+static uint8_t		*memory_map;
+static size_t		memory_size;
+static long		page_size;
+
+static dirty_range_t	dirty_ranges[DIRTY_RANGE_MAX];
+static uint_fast8_t	dirty_range_count;
+static size_t		dirty_bytes;
+
+static uint32_t		commit_interval_ms = DEFAULT_COMMIT_INTERVAL_MS;
+
+
+static uint32_t crc32(const uint8_t *data, size_t size)
 {
-	file = fopen(MEMORY_FILE_NAME, "r+");
-	if (file == NULL) {
-		file = fopen(MEMORY_FILE_NAME, "w+");
-		if (file == NULL) {
-			ACC_LOG_ERROR("Failed to open %s. (%u) %s", MEMORY_FILE_NAME, errno, strerror(errno));
-			return ACC_STATUS_FAILURE;
+	uint32_t crc = 0xffffffff;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (uint_fast8_t bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+
+/**
+ * @brief Write a part of the memory map back to the file
+ */
+static bool internal_sync_range(size_t address, size_t size)
+{
+	size_t start = address - address % page_size;
+
+	if (msync(memory_map + start, address + size - start, MS_SYNC) < 0) {
+		ACC_LOG_ERROR("msync failed. (%u) %s", errno, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool internal_journal_clear(void)
+{
+	if (ftruncate(journal_fd, 0) < 0 || fdatasync(journal_fd) < 0) {
+		ACC_LOG_ERROR("Failed to clear %s. (%u) %s", JOURNAL_FILE_NAME, errno, strerror(errno));
+		return false;
+	}
+
+	return true;
+}
+
+
+/**
+ * @brief Copy the ranges of a complete journal into the memory, what a power cut interrupted
+ */
+static void internal_journal_replay(void)
+{
+	journal_header_t	header;
+	uint8_t			*body;
+	struct stat		journal_stat;
+
+	if (fstat(journal_fd, &journal_stat) < 0 || journal_stat.st_size == 0) {
+		return;
+	}
+
+	if (pread(journal_fd, &header, sizeof(header), 0) != sizeof(header) ||
+	    header.magic != JOURNAL_MAGIC || header.version != JOURNAL_VERSION ||
+	    (off_t)(sizeof(header) + header.body_size) > journal_stat.st_size) {
+		ACC_LOG_WARNING("Discarding incomplete %s", JOURNAL_FILE_NAME);
+		internal_journal_clear();
+		return;
+	}
+
+	body = malloc(header.body_size);
+	if (body == NULL) {
+		return;
+	}
+
+	if (pread(journal_fd, body, header.body_size, sizeof(header)) != (ssize_t)header.body_size ||
+	    crc32(body, header.body_size) != header.crc) {
+		ACC_LOG_WARNING("Discarding incomplete %s", JOURNAL_FILE_NAME);
+		free(body);
+		internal_journal_clear();
+		return;
+	}
+
+	size_t offset = 0;
+
+	for (uint32_t range = 0; range < header.range_count && offset + 2 * sizeof(uint32_t) <= header.body_size; range++) {
+		uint32_t address;
+		uint32_t size;
+
+		memcpy(&address, body + offset, sizeof(address));
+		memcpy(&size, body + offset + sizeof(address), sizeof(size));
+		offset += 2 * sizeof(uint32_t);
+
+		// Written without sums that can wrap, a 32-bit size_t would let a corrupt range through
+		if (size > header.body_size - offset || size > memory_size || address > memory_size - size) {
+			break;
 		}
+
+		memcpy(memory_map + address, body + offset, size);
+		offset += size;
+	}
+
+	free(body);
+
+	ACC_LOG_INFO("Replayed %u writes from %s", (unsigned int)header.range_count, JOURNAL_FILE_NAME);
+
+	if (internal_sync_range(0, memory_size)) {
+		internal_journal_clear();
 	}
+}
+
+
+/**
+ * @brief Make all written data persistent, memory_mutex must be held
+ *
+ * The data is first made persistent in the journal and then copied into the memory map.
+ * A power cut before the journal is complete leaves the old data, after that the journal
+ * is replayed at the next init. No record is ever left half written.
+ */
+static acc_status_t internal_commit(void)
+{
+	journal_header_t	header;
+	uint8_t			*journal;
+	size_t			offset = sizeof(header);
+
+	if (dirty_range_count == 0) {
+		return ACC_STATUS_SUCCESS;
+	}
+
+	journal = malloc(sizeof(header) + dirty_range_count * 2 * sizeof(uint32_t) + dirty_bytes);
+	if (journal == NULL) {
+		return ACC_STATUS_OUT_OF_MEMORY;
+	}
+
+	for (uint_fast8_t index = 0; index < dirty_range_count; index++) {
+		dirty_range_t *range = &dirty_ranges[index];
+
+		memcpy(journal + offset, &range->address, sizeof(range->address));
+		memcpy(journal + offset + sizeof(range->address), &range->size, sizeof(range->size));
+		offset += 2 * sizeof(uint32_t);
+		memcpy(journal + offset, range->data, range->size);
+		offset += range->size;
+	}
+
+	header.magic		= JOURNAL_MAGIC;
+	header.version		= JOURNAL_VERSION;
+	header.range_count	= dirty_range_count;
+	header.body_size	= offset - sizeof(header);
+	header.crc		= crc32(journal + sizeof(header), header.body_size);
+	memcpy(journal, &header, sizeof(header));
+
+	if (pwrite(journal_fd, journal, offset, 0) != (ssize_t)offset || fdatasync(journal_fd) < 0) {
+		ACC_LOG_ERROR("Failed to write %s. (%u) %s", JOURNAL_FILE_NAME, errno, strerror(errno));
+		free(journal);
+		return ACC_STATUS_FAILURE;
+	}
+
+	free(journal);
 
-	file_desc = fileno(file);
+	bool synced = true;
+
+	for (uint_fast8_t index = 0; index < dirty_range_count; index++) {
+		dirty_range_t *range = &dirty_ranges[index];
+
+		memcpy(memory_map + range->address, range->data, range->size);
+		synced = internal_sync_range(range->address, range->size) && synced;
+		free(range->data);
+	}
+
+	dirty_range_count	= 0;
+	dirty_bytes		= 0;
+
+	// Keep the journal if the memory could not be synced, init replays it
+	if (!synced || !internal_journal_clear()) {
+		return ACC_STATUS_FAILURE;
+	}
 
 	return ACC_STATUS_SUCCESS;
 }
 
 
-static acc_status_t acc_driver_memory_linux_write(uint32_t address, const void *buffer, size_t size)
+/**
+ * @brief Commit written data every commit_interval_ms
+ */
+static void *internal_commit_thread(void *param)
 {
-	if (buffer == NULL) {
+	(void)param;
+
+	pthread_mutex_lock(&memory_mutex);
+
+	while (true) {
+		if (commit_interval_ms == 0) {
+			pthread_cond_wait(&interval_cond, &memory_mutex);
+			continue;
+		}
+
+		struct timespec deadline;
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		deadline.tv_sec		+= commit_interval_ms / 1000;
+		deadline.tv_nsec	+= (long)(commit_interval_ms % 1000) * 1000000;
+		if (deadline.tv_nsec >= 1000000000) {
+			deadline.tv_sec++;
+			deadline.tv_nsec -= 1000000000;
+		}
+
+		if (pthread_cond_timedwait(&interval_cond, &memory_mutex, &deadline) == ETIMEDOUT) {
+			internal_commit();
+		}
+	}
+
+	return NULL;
+}
+
+
+/**
+ * @brief Commit what is written when the process exits
+ *
+ * The SIGINT handler of acc_os calls exit() from whatever thread the signal lands on, which may
+ * hold memory_mutex. The lock is therefore only waited for a while, and the commit skipped if it
+ * is not taken. Data committed earlier is intact, a commit cut short is finished from the journal
+ * at the next init.
+ */
+static void internal_commit_at_exit(void)
+{
+	struct timespec deadline;
+
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_nsec += (long)EXIT_COMMIT_WAIT_MS * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	if (pthread_mutex_timedlock(&memory_mutex, &deadline) != 0) {
+		fprintf(stderr, "%s not committed at exit, the memory was in use\n", MEMORY_FILE_NAME);
+		return;
+	}
+
+	if (memory_map != NULL) {
+		internal_commit();
+	}
+
+	pthread_mutex_unlock(&memory_mutex);
+}
+
+
+static acc_status_t acc_driver_memory_linux_init(void)
+{
+	struct stat		memory_stat;
+	pthread_condattr_t	attr;
+	pthread_t		thread;
+
+	pthread_mutex_lock(&memory_mutex);
+
+	if (memory_map != NULL) {
+		pthread_mutex_unlock(&memory_mutex);
+		return ACC_STATUS_SUCCESS;
+	}
+
+	page_size	= sysconf(_SC_PAGESIZE);
+	memory_fd	= open(MEMORY_FILE_NAME, O_RDWR | O_CREAT, 0644);
+	journal_fd	= open(JOURNAL_FILE_NAME, O_RDWR | O_CREAT, 0644);
+
+	if (memory_fd < 0 || journal_fd < 0 || fstat(memory_fd, &memory_stat) < 0) {
+		ACC_LOG_ERROR("Failed to open %s. (%u) %s", MEMORY_FILE_NAME, errno, strerror(errno));
+		goto error;
+	}
+
+	memory_size = (memory_stat.st_size > MEMORY_SIZE) ? (size_t)memory_stat.st_size : MEMORY_SIZE;
+
+	if ((size_t)memory_stat.st_size < memory_size && ftruncate(memory_fd, memory_size) < 0) {
+		ACC_LOG_ERROR("Failed to extend %s. (%u) %s", MEMORY_FILE_NAME, errno, strerror(errno));
+		goto error;
+	}
+
+	memory_map = mmap(NULL, memory_size, PROT_READ | PROT_WRITE, MAP_SHARED, memory_fd, 0);
+	if (memory_map == MAP_FAILED) {
+		ACC_LOG_ERROR("Failed to map %s. (%u) %s", MEMORY_FILE_NAME, errno, strerror(errno));
+		memory_map = NULL;
+		goto error;
+	}
+
+	internal_journal_replay();
+
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&interval_cond, &attr);
+	pthread_condattr_destroy(&attr);
+
+	if (pthread_create(&thread, NULL, internal_commit_thread, NULL) != 0) {
+		ACC_LOG_WARNING("No commit thread, data is committed on acc_driver_memory_linux_commit() and at exit");
+	} else {
+		pthread_detach(thread);
+	}
+
+	atexit(internal_commit_at_exit);
+
+	pthread_mutex_unlock(&memory_mutex);
+
+	return ACC_STATUS_SUCCESS;
+
+error:
+	if (memory_fd >= 0) {
+		close(memory_fd);
+		memory_fd = -1;
+	}
+	if (journal_fd >= 0) {
+		close(journal_fd);
+		journal_fd = -1;
+	}
+	pthread_mutex_unlock(&memory_mutex);
+
+	return ACC_STATUS_FAILURE;
+}
+
+
+static acc_status_t acc_driver_memory_linux_get_size(size_t *size)
+{
+	if (size == NULL) {
 		return ACC_STATUS_BAD_PARAM;
 	}
 
-	if (file == NULL) {
+	if (memory_map == NULL) {
 		ACC_LOG_ERROR("Driver is not initialized");
 		return ACC_STATUS_FAILURE;
 	}
 
-	if (fseeko(file, address, SEEK_SET) != 0) {
-		ACC_LOG_ERROR("Failed to seek to address %u in file %s", (unsigned int)address, MEMORY_FILE_NAME);
-		return ACC_STATUS_FAILURE;
+	*size = memory_size;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+static acc_status_t acc_driver_memory_linux_write(uint32_t address, const void *buffer, size_t size)
+{
+	uint32_t	start = address;
+	uint32_t	end;
+	uint8_t		*data;
+	acc_status_t	status;
+
+	if (buffer == NULL || size == 0) {
+		return ACC_STATUS_BAD_PARAM;
 	}
 
-	if (fwrite(buffer, 1, size, file) != size) {
-		ACC_LOG_ERROR("Failed to write to file %s", MEMORY_FILE_NAME);
+	pthread_mutex_lock(&memory_mutex);
+
+	if (memory_map == NULL) {
+		pthread_mutex_unlock(&memory_mutex);
+		ACC_LOG_ERROR("Driver is not initialized");
 		return ACC_STATUS_FAILURE;
 	}
 
-	fflush(file);
-	fsync(file_desc);
+	// address + size wraps with a 32-bit size_t, so it is only formed once it is known to fit
+	if (size > memory_size || address > memory_size - size) {
+		pthread_mutex_unlock(&memory_mutex);
+		ACC_LOG_ERROR("Write of %u bytes at %u is outside the memory", (unsigned int)size, (unsigned int)address);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	end = address + size;
+
+	// Merge with every range the write touches, the result is one contiguous range
+	for (uint_fast8_t index = 0; index < dirty_range_count; index++) {
+		dirty_range_t *range = &dirty_ranges[index];
+
+		if (range->address <= end && start <= range->address + range->size) {
+			start	= (range->address < start) ? range->address : start;
+			end	= (range->address + range->size > end) ? range->address + range->size : end;
+		}
+	}
+
+	if (dirty_bytes + (end - start) > DIRTY_BYTES_MAX || dirty_range_count == DIRTY_RANGE_MAX) {
+		status = internal_commit();
+		if (status != ACC_STATUS_SUCCESS) {
+			pthread_mutex_unlock(&memory_mutex);
+			return status;
+		}
+		start	= address;
+		end	= address + size;
+	}
+
+	data = malloc(end - start);
+	if (data == NULL) {
+		pthread_mutex_unlock(&memory_mutex);
+		return ACC_STATUS_OUT_OF_MEMORY;
+	}
+
+	for (uint_fast8_t index = 0; index < dirty_range_count;) {
+		dirty_range_t *range = &dirty_ranges[index];
+
+		if (range->address >= start && range->address + range->size <= end) {
+			memcpy(data + (range->address - start), range->data, range->size);
+			dirty_bytes -= range->size;
+			free(range->data);
+			*range = dirty_ranges[--dirty_range_count];
+		} else {
+			index++;
+		}
+	}
+	memcpy(data + (address - start), buffer, size);
+
+	dirty_ranges[dirty_range_count].address	= start;
+	dirty_ranges[dirty_range_count].size	= end - start;
+	dirty_ranges[dirty_range_count].data	= data;
+	dirty_range_count++;
+	dirty_bytes += end - start;
+
+	pthread_mutex_unlock(&memory_mutex);
 
 	return ACC_STATUS_SUCCESS;
 }
@@ -70,41 +504,75 @@ static acc_status_t acc_driver_memory_linux_write(uint32_t address, const void *
 
 static acc_status_t acc_driver_memory_linux_read(uint32_t address, void *buffer, size_t size)
 {
-	size_t items_read;
+	uint32_t end;
 
 	if (buffer == NULL) {
 		return ACC_STATUS_BAD_PARAM;
 	}
 
-	if (file == NULL) {
+	pthread_mutex_lock(&memory_mutex);
+
+	if (memory_map == NULL) {
+		pthread_mutex_unlock(&memory_mutex);
 		ACC_LOG_ERROR("Driver is not initialized");
 		return ACC_STATUS_FAILURE;
 	}
 
-	if (fseeko(file, address, SEEK_SET) != 0) {
-		ACC_LOG_ERROR("Failed to seek to address %u in file %s", (unsigned int)address, MEMORY_FILE_NAME);
-		return ACC_STATUS_FAILURE;
+	if (size > memory_size || address > memory_size - size) {
+		pthread_mutex_unlock(&memory_mutex);
+		ACC_LOG_ERROR("Read of %u bytes at %u is outside the memory", (unsigned int)size, (unsigned int)address);
+		return ACC_STATUS_BAD_PARAM;
 	}
 
-	items_read = fread(buffer, 1, size, file);
-	if (items_read != size) {
-		if (feof(file) != 0) {
-			size_t pad_size = size - items_read;
-			memset((char*)buffer + items_read, 0, pad_size);
-		}
-		else {
-			ACC_LOG_ERROR("Failed to read from file %s", MEMORY_FILE_NAME);
-			return ACC_STATUS_FAILURE;
+	end = address + size;
+
+	memcpy(buffer, memory_map + address, size);
+
+	// Data written but not yet committed replaces what is in the file
+	for (uint_fast8_t index = 0; index < dirty_range_count; index++) {
+		dirty_range_t	*range = &dirty_ranges[index];
+		uint32_t	overlap_start = (range->address > address) ? range->address : address;
+		uint32_t	overlap_end = (range->address + range->size < end) ? range->address + range->size : end;
+
+		if (overlap_start < overlap_end) {
+			memcpy((uint8_t *)buffer + (overlap_start - address), range->data + (overlap_start - range->address),
+			       overlap_end - overlap_start);
 		}
 	}
 
+	pthread_mutex_unlock(&memory_mutex);
+
 	return ACC_STATUS_SUCCESS;
 }
 
 
+acc_status_t acc_driver_memory_linux_commit(void)
+{
+	acc_status_t status;
+
+	pthread_mutex_lock(&memory_mutex);
+	status = (memory_map != NULL) ? internal_commit() : ACC_STATUS_SUCCESS;
+	pthread_mutex_unlock(&memory_mutex);
+
+	return status;
+}
+
+
+void acc_driver_memory_linux_set_commit_interval(uint32_t interval_ms)
+{
+	pthread_mutex_lock(&memory_mutex);
+	commit_interval_ms = interval_ms;
+	if (memory_map != NULL) {
+		pthread_cond_signal(&interval_cond);
+	}
+	pthread_mutex_unlock(&memory_mutex);
+}
+
+
 void acc_driver_memory_linux_register(void)
 {
 	acc_device_memory_init_func = acc_driver_memory_linux_init;
+	acc_device_memory_get_size_func = acc_driver_memory_linux_get_size;
 	acc_device_memory_write_func = acc_driver_memory_linux_write;
 	acc_device_memory_read_func = acc_driver_memory_linux_read;
 }
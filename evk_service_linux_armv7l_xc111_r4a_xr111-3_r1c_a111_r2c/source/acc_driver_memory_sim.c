@@ -0,0 +1,116 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "acc_device_memory.h"
+#include "acc_driver_memory_sim.h"
+#include "acc_log.h"
+#include "acc_types.h"
+
+#define MODULE "driver_memory_sim"
+
+
+static uint8_t		memory[ACC_DRIVER_MEMORY_SIM_SIZE];
+static bool		memory_initialized;
+static pthread_mutex_t	memory_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+
+static acc_status_t acc_driver_memory_sim_init(void)
+{
+	pthread_mutex_lock(&memory_mutex);
+	if (!memory_initialized) {
+		memset(memory, 0xff, sizeof(memory));
+		memory_initialized = true;
+	}
+	pthread_mutex_unlock(&memory_mutex);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+static acc_status_t acc_driver_memory_sim_get_size(size_t *size)
+{
+	if (size == NULL) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	*size = sizeof(memory);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+static acc_status_t acc_driver_memory_sim_write(uint32_t address, const void *buffer, size_t size)
+{
+	if (buffer == NULL || size == 0) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if ((size_t)address + size > sizeof(memory)) {
+		ACC_LOG_ERROR("Write of %u bytes at %u is outside the memory", (unsigned int)size, (unsigned int)address);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	pthread_mutex_lock(&memory_mutex);
+
+	if (!memory_initialized) {
+		pthread_mutex_unlock(&memory_mutex);
+		ACC_LOG_ERROR("Driver is not initialized");
+		return ACC_STATUS_FAILURE;
+	}
+
+	memcpy(memory + address, buffer, size);
+
+	pthread_mutex_unlock(&memory_mutex);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+static acc_status_t acc_driver_memory_sim_read(uint32_t address, void *buffer, size_t size)
+{
+	if (buffer == NULL) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if ((size_t)address + size > sizeof(memory)) {
+		ACC_LOG_ERROR("Read of %u bytes at %u is outside the memory", (unsigned int)size, (unsigned int)address);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	pthread_mutex_lock(&memory_mutex);
+
+	if (!memory_initialized) {
+		pthread_mutex_unlock(&memory_mutex);
+		ACC_LOG_ERROR("Driver is not initialized");
+		return ACC_STATUS_FAILURE;
+	}
+
+	memcpy(buffer, memory + address, size);
+
+	pthread_mutex_unlock(&memory_mutex);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+void acc_driver_memory_sim_erase(void)
+{
+	pthread_mutex_lock(&memory_mutex);
+	memset(memory, 0xff, sizeof(memory));
+	pthread_mutex_unlock(&memory_mutex);
+}
+
+
+void acc_driver_memory_sim_register(void)
+{
+	acc_device_memory_init_func = acc_driver_memory_sim_init;
+	acc_device_memory_get_size_func = acc_driver_memory_sim_get_size;
+	acc_device_memory_write_func = acc_driver_memory_sim_write;
+	acc_device_memory_read_func = acc_driver_memory_sim_read;
+}
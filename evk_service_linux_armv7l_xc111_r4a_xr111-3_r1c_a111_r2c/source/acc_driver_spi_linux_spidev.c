@@ -30,32 +30,96 @@
 					((A)*(sizeof(spidev_transfer_t))) : 0)
 
 #define SPIDEV_PATH 			"/dev/spidev%u.%u"
+#define SPIDEV_BUFSIZ_PATH		"/sys/module/spidev/parameters/bufsiz"
 
-#define SPI_BUS_MAX			2
-#define SPI_BUS_DEVICE_MAX		2
+/**
+ * @brief Size of the spidev message buffer when it cannot be read, the default of the kernel
+ */
+#define SPIDEV_DEFAULT_BUFSIZ		4096
+
+/**
+ * @brief Maximum number of segments sent in one message
+ */
+#define SPI_MESSAGE_MAX_SEGMENTS	64
+
+#define SPI_BUS_MAX			ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_MAX
+#define SPI_BUS_DEVICE_MAX		ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_DEVICE_MAX
 
 
 /**
- * @brief SPI transfer information
+ * @brief SPI transfer information, laid out as struct spi_ioc_transfer
  */
 typedef struct {
 	uint64_t	tx;
 	uint64_t	rx;
 	uint32_t	length;
 	uint32_t	speed;
-	uint32_t	pad;
 	uint16_t	delay;
 	uint8_t		bits_per_word;
 	uint8_t		cs_deselect;
+	uint8_t		tx_nbits;
+	uint8_t		rx_nbits;
+	uint16_t	pad;
 } spidev_transfer_t;
 
 
+static int system_open(const char *path, int flags)
+{
+	return open(path, flags);
+}
+
+
+static int system_ioctl(int fd, unsigned long request, void *arg)
+{
+	return ioctl(fd, request, arg);
+}
+
+
+static size_t system_get_bufsiz(void)
+{
+	FILE		*file = fopen(SPIDEV_BUFSIZ_PATH, "r");
+	unsigned long	bufsiz;
+
+	if (file == NULL) {
+		return 0;
+	}
+
+	if (fscanf(file, "%lu", &bufsiz) != 1) {
+		bufsiz = 0;
+	}
+
+	fclose(file);
+
+	return bufsiz;
+}
+
+
+/**
+ * @brief The system calls used when no others are registered
+ */
+static const acc_driver_spi_linux_spidev_ops_t system_ops = {
+	.open		= system_open,
+	.close		= close,
+	.ioctl		= system_ioctl,
+	.get_bufsiz	= system_get_bufsiz
+};
+
+
+static const acc_driver_spi_linux_spidev_ops_t *ops = &system_ops;
+
+
 /**
  * File descriptors for all open SPI device files
  */
 static int spidev_fd[SPI_BUS_MAX][SPI_BUS_DEVICE_MAX];
 
 
+/**
+ * @brief Largest number of bytes in one message, read from spidev
+ */
+static size_t max_transfer_size;
+
+
 /**
  * @brief Internal SPI open
  *
@@ -68,19 +132,19 @@ static int spidev_fd[SPI_BUS_MAX][SPI_BUS_DEVICE_MAX];
 static acc_status_t internal_spi_open(uint_fast8_t bus, uint_fast8_t device)
 {
 	uint32_t	mode = 0;
-	char		spidev[sizeof(SPIDEV_PATH) + 1];
+	char		spidev[sizeof(SPIDEV_PATH) + 2 * 3];	// bus and chip select of up to 3 digits
 
 	snprintf(spidev, sizeof(spidev), SPIDEV_PATH, bus, device);
 
-	if ((spidev_fd[bus][device] = open(spidev, O_RDWR)) < 0) {
+	if ((spidev_fd[bus][device] = ops->open(spidev, O_RDWR)) < 0) {
 		ACC_LOG_FATAL("Unable to open SPI (%u, %u): %s", bus, device, strerror(errno));
 		return ACC_STATUS_FAILURE;
 	}
 
-	if (ioctl(spidev_fd[bus][device], _IOR('k', 1, uint8_t), &mode) < 0) {
+	if (ops->ioctl(spidev_fd[bus][device], _IOR('k', 1, uint8_t), &mode) < 0) {
 		ACC_LOG_WARNING("Could not set SPI (read) mode %u", mode);
 	}
-	if (ioctl(spidev_fd[bus][device], _IOW('k', 1, uint8_t), &mode) < 0) {
+	if (ops->ioctl(spidev_fd[bus][device], _IOW('k', 1, uint8_t), &mode) < 0) {
 		ACC_LOG_WARNING("Could not set SPI (write) mode %u", mode);
 	}
 
@@ -88,6 +152,41 @@ static acc_status_t internal_spi_open(uint_fast8_t bus, uint_fast8_t device)
 }
 
 
+/**
+ * @brief Internal SPI message
+ *
+ * Send several transfers with one ioctl, chip select stays asserted between them unless
+ * a transfer asks for it to be deselected.
+ *
+ * @param bus SPI bus
+ * @param device SPI device on bus
+ * @param transfers The transfers
+ * @param transfer_count Number of transfers
+ * @return Status
+ */
+static acc_status_t internal_spi_message(uint_fast8_t bus, uint_fast8_t device, spidev_transfer_t *transfers, size_t transfer_count)
+{
+	if ((bus >= SPI_BUS_MAX) || (device >= SPI_BUS_DEVICE_MAX)) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (spidev_fd[bus][device] < 0) {
+		internal_spi_open(bus, device);
+	}
+	if (spidev_fd[bus][device] < 0) {
+		return ACC_STATUS_FAILURE;
+	}
+
+	int ret_val = ops->ioctl(spidev_fd[bus][device], _IOW('k', 0, char[ACC_SPI_TRANSFER_SIZE(transfer_count)]), transfers);
+	if (ret_val < 0) {
+		ACC_LOG_ERROR("SPI transfer failure: %s", strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
 /**
  * @brief Initialize SPI driver
  *
@@ -108,11 +207,22 @@ static acc_status_t acc_driver_spi_linux_spidev_init(void)
 /**
  * @brief Return maximum allowed size of one SPI transfer
  *
+ * This is the bufsiz parameter of the spidev module, which limits the total size of a message.
+ *
  * @return Maximum allowed transfer size in bytes, or zero if unknown
  */
 static size_t acc_driver_spi_linux_spidev_get_max_transfer_size(void)
 {
-	return 4095;
+	if (max_transfer_size == 0) {
+		max_transfer_size = ops->get_bufsiz();
+
+		if (max_transfer_size == 0) {
+			ACC_LOG_WARNING("Could not read spidev bufsiz, assuming %u bytes", SPIDEV_DEFAULT_BUFSIZ);
+			max_transfer_size = SPIDEV_DEFAULT_BUFSIZ;
+		}
+	}
+
+	return max_transfer_size;
 }
 
 
@@ -133,17 +243,6 @@ static acc_status_t acc_driver_spi_linux_spidev_transfer(
 		uint8_t		*buffer,
 		size_t		buffer_size)
 {
-	if ((bus >= SPI_BUS_MAX) || (device >= SPI_BUS_DEVICE_MAX)) {
-		return ACC_STATUS_BAD_PARAM;
-	}
-
-	if (spidev_fd[bus][device] < 0) {
-		internal_spi_open(bus, device);
-	}
-	if (spidev_fd[bus][device] < 0) {
-		return ACC_STATUS_FAILURE;
-	}
-
 	spidev_transfer_t spi_transfer = {
 		.tx		= (uintptr_t)buffer,
 		.rx		= (uintptr_t)buffer,
@@ -155,13 +254,113 @@ static acc_status_t acc_driver_spi_linux_spidev_transfer(
 		.pad		= 0,
 	};
 
-	int ret_val = ioctl(spidev_fd[bus][device], _IOW('k', 0, char[ACC_SPI_TRANSFER_SIZE(1)]), &spi_transfer);
-	if (ret_val < 0) {
-		ACC_LOG_ERROR("SPI transfer failure: %s", strerror(errno));
-		return ACC_STATUS_FAILURE;
+	return internal_spi_message(bus, device, &spi_transfer, 1);
+}
+
+
+/**
+ * @brief Vectored data transfer (SPI)
+ *
+ * Segments are packed into SPI_IOC_MESSAGE ioctls of up to SPI_MESSAGE_MAX_SEGMENTS segments
+ * and the spidev bufsiz bytes. Chip select is released between ioctls, so they are only split
+ * after a segment that asks for it to be deselected. Segments held on one chip select that do
+ * not fit in one ioctl are rejected.
+ *
+ * @param bus The SPI bus to transfer to/from
+ * @param device The SPI device to transfer to/from
+ * @param speed SPI transfer speed in bps
+ * @param segments The segments to transfer
+ * @param segment_count Number of segments
+ * @return Status
+ */
+static acc_status_t acc_driver_spi_linux_spidev_transfer_segments(
+		uint_fast8_t				bus,
+		uint_fast8_t				device,
+		uint32_t				speed,
+		const acc_device_spi_segment_t		*segments,
+		size_t					segment_count)
+{
+	spidev_transfer_t	transfers[SPI_MESSAGE_MAX_SEGMENTS];
+	size_t			transfer_count = 0;
+	size_t			message_size   = 0;
+	size_t			run_start      = 0;	// first transfer after the last deselect in the message
+	size_t			run_size       = 0;
+	size_t			run_count      = 0;
+	size_t			max_size       = acc_driver_spi_linux_spidev_get_max_transfer_size();
+	acc_status_t		status;
+
+	// Checked before anything is sent, so a rejected transfer leaves the bus untouched
+	for (size_t index = 0; index < segment_count; index++) {
+		const acc_device_spi_segment_t *segment = &segments[index];
+
+		if (segment->buffer_size == 0 || segment->buffer_size > max_size) {
+			ACC_LOG_ERROR("SPI segment of %u bytes, must be 1-%u", (unsigned int)segment->buffer_size, (unsigned int)max_size);
+			return ACC_STATUS_BAD_PARAM;
+		}
+
+		run_size += segment->buffer_size;
+		run_count++;
+
+		if (run_size > max_size || run_count > SPI_MESSAGE_MAX_SEGMENTS) {
+			ACC_LOG_ERROR("SPI segments on one chip select need more than %u bytes or %u segments",
+			              (unsigned int)max_size, (unsigned int)SPI_MESSAGE_MAX_SEGMENTS);
+			return ACC_STATUS_BAD_PARAM;
+		}
+
+		if (segment->cs_deselect) {
+			run_size	= 0;
+			run_count	= 0;
+		}
 	}
 
-	return ACC_STATUS_SUCCESS;
+	run_size = 0;
+
+	for (size_t index = 0; index < segment_count; index++) {
+		const acc_device_spi_segment_t *segment = &segments[index];
+
+		if (transfer_count == SPI_MESSAGE_MAX_SEGMENTS || message_size + segment->buffer_size > max_size) {
+			// Sent up to the last deselect, which the check above guarantees is in the message.
+			// cs_change on the last transfer would keep the chip selected after the message.
+			transfers[run_start - 1].cs_deselect = 0;
+
+			status = internal_spi_message(bus, device, transfers, run_start);
+			if (status != ACC_STATUS_SUCCESS) {
+				return status;
+			}
+
+			memmove(transfers, &transfers[run_start], (transfer_count - run_start) * sizeof(transfers[0]));
+			transfer_count	-= run_start;
+			message_size	= run_size;
+			run_start	= 0;
+		}
+
+		spidev_transfer_t *transfer = &transfers[transfer_count++];
+
+		memset(transfer, 0, sizeof(*transfer));
+		transfer->tx		= (uintptr_t)segment->buffer;
+		transfer->rx		= (uintptr_t)segment->buffer;
+		transfer->length	= segment->buffer_size;
+		transfer->speed		= speed;
+		transfer->delay		= segment->delay_us;
+		transfer->bits_per_word	= 8;
+		transfer->cs_deselect	= segment->cs_deselect ? 1 : 0;
+
+		message_size	+= segment->buffer_size;
+		run_size	+= segment->buffer_size;
+
+		if (segment->cs_deselect) {
+			run_start	= transfer_count;
+			run_size	= 0;
+		}
+	}
+
+	if (transfer_count == 0) {
+		return ACC_STATUS_SUCCESS;
+	}
+
+	transfers[transfer_count - 1].cs_deselect = 0;
+
+	return internal_spi_message(bus, device, transfers, transfer_count);
 }
 
 
@@ -170,7 +369,22 @@ static acc_status_t acc_driver_spi_linux_spidev_transfer(
  */
 void acc_driver_spi_linux_spidev_register(void)
 {
+	acc_driver_spi_linux_spidev_register_with_ops(NULL);
+}
+
+
+/**
+ * @brief Request driver to register with appropriate device(s), using other system calls
+ *
+ * @param spidev_ops System calls to use, NULL for the real ones
+ */
+void acc_driver_spi_linux_spidev_register_with_ops(const acc_driver_spi_linux_spidev_ops_t *spidev_ops)
+{
+	ops			= (spidev_ops != NULL) ? spidev_ops : &system_ops;
+	max_transfer_size	= 0;
+
 	acc_device_spi_init_func			= acc_driver_spi_linux_spidev_init;
 	acc_device_spi_get_max_transfer_size_func	= acc_driver_spi_linux_spidev_get_max_transfer_size;
 	acc_device_spi_transfer_func			= acc_driver_spi_linux_spidev_transfer;
+	acc_device_spi_transfer_segments_func		= acc_driver_spi_linux_spidev_transfer_segments;
 }
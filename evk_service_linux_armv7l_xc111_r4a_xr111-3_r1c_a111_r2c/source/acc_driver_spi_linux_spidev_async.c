@@ -0,0 +1,488 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// needed for clock_gettime
+// needed for posix_memalign
+// needed for pthread_condattr_setclock
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "acc_device_spi.h"
+#include "acc_driver_spi_linux_spidev.h"
+#include "acc_driver_spi_linux_spidev_async.h"
+#include "acc_log.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+/**
+ * @brief The module name
+ */
+#define MODULE		"driver_spi_linux_spidev_async"
+
+#define BUFFER_MAX	ACC_DRIVER_SPI_LINUX_SPIDEV_ASYNC_BUFFER_MAX
+#define SPI_BUS_MAX	ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_MAX
+#define SPI_DEVICE_MAX	ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_DEVICE_MAX
+
+
+/**
+ * @brief Where a buffer is, it moves through the states in order
+ */
+typedef enum {
+	BUFFER_FREE,
+	BUFFER_ACQUIRED,
+	BUFFER_SUBMITTED,
+	BUFFER_COMPLETED,
+	BUFFER_WAITED
+} buffer_state_t;
+
+
+/**
+ * @brief A transfer buffer and the transfer it is used for
+ */
+typedef struct {
+	uint8_t		*data;
+	buffer_state_t	state;
+	uint_fast8_t	bus;
+	uint_fast8_t	device;
+	uint32_t	speed;
+	size_t		size;
+	void		*user_data;
+	uint64_t	submit_us;
+	acc_status_t	status;
+} buffer_t;
+
+
+/**
+ * @brief Queue of buffer indices, submission and completion queues hold at most all buffers
+ */
+typedef struct {
+	uint_fast8_t	index[BUFFER_MAX];
+	uint_fast8_t	head;
+	uint_fast8_t	count;
+} buffer_queue_t;
+
+
+static pthread_mutex_t	engine_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t	submitted_cond;
+static pthread_cond_t	completed_cond;
+static pthread_cond_t	released_cond;
+
+static bool		started;
+static bool		stopping;
+static acc_os_thread_handle_t	worker_handle;
+
+static buffer_t		buffers[BUFFER_MAX];
+static uint_fast8_t	buffer_count;
+static size_t		buffer_size;
+static buffer_queue_t	submission_queue;
+static buffer_queue_t	completion_queue;
+
+/**
+ * @brief Segments a transfer is split into, only used by the worker
+ */
+static acc_device_spi_segment_t	*segments;
+
+static acc_driver_spi_linux_spidev_async_stats_t	stats[SPI_BUS_MAX][SPI_DEVICE_MAX];
+
+
+static void internal_queue_push(buffer_queue_t *queue, uint_fast8_t index)
+{
+	queue->index[(queue->head + queue->count) % BUFFER_MAX] = index;
+	queue->count++;
+}
+
+
+static uint_fast8_t internal_queue_pop(buffer_queue_t *queue)
+{
+	uint_fast8_t index = queue->index[queue->head];
+
+	queue->head = (queue->head + 1) % BUFFER_MAX;
+	queue->count--;
+
+	return index;
+}
+
+
+/**
+ * @brief Find the buffer a pointer belongs to
+ *
+ * @return Index of the buffer, buffer_count if not found
+ */
+static uint_fast8_t internal_find_buffer(const uint8_t *data)
+{
+	uint_fast8_t index;
+
+	for (index = 0; index < buffer_count && buffers[index].data != data; index++) {
+	}
+
+	return index;
+}
+
+
+/**
+ * @brief Transfer a buffer, split into segments no larger than the driver allows
+ *
+ * The segments ask for chip select to be released between them, see
+ * acc_driver_spi_linux_spidev_async_submit().
+ */
+static acc_status_t internal_transfer(buffer_t *buffer)
+{
+	size_t		max_size = acc_device_spi_get_max_transfer_size();
+	size_t		segment_count = 0;
+	acc_status_t	status;
+
+	if (max_size == 0) {
+		max_size = buffer->size;
+	}
+
+	for (size_t offset = 0; offset < buffer->size; offset += max_size) {
+		acc_device_spi_segment_t *segment = &segments[segment_count++];
+
+		segment->buffer		= buffer->data + offset;
+		segment->buffer_size	= (buffer->size - offset < max_size) ? buffer->size - offset : max_size;
+		segment->delay_us	= 0;
+		segment->cs_deselect	= (offset + max_size < buffer->size) ? 1 : 0;
+	}
+
+	status = acc_device_spi_lock(buffer->bus);
+	if (status != ACC_STATUS_SUCCESS) {
+		return status;
+	}
+
+	status = acc_device_spi_transfer_segments(buffer->bus, buffer->device, buffer->speed, segments, segment_count);
+
+	acc_device_spi_unlock(buffer->bus);
+
+	return status;
+}
+
+
+static void worker_thread(void *param)
+{
+	(void)param;
+
+	pthread_mutex_lock(&engine_mutex);
+
+	while (true) {
+		while (submission_queue.count == 0 && !stopping) {
+			pthread_cond_wait(&submitted_cond, &engine_mutex);
+		}
+
+		if (submission_queue.count == 0) {
+			break;
+		}
+
+		buffer_t *buffer = &buffers[internal_queue_pop(&submission_queue)];
+
+		pthread_mutex_unlock(&engine_mutex);
+
+		uint64_t start_us = acc_os_monotonic_ns() / 1000;
+		acc_status_t status = internal_transfer(buffer);
+		uint64_t end_us = acc_os_monotonic_ns() / 1000;
+
+		pthread_mutex_lock(&engine_mutex);
+
+		acc_driver_spi_linux_spidev_async_stats_t *device_stats = &stats[buffer->bus][buffer->device];
+		uint32_t latency_us = end_us - buffer->submit_us;
+
+		device_stats->transfer_count++;
+		device_stats->busy_us		+= end_us - start_us;
+		device_stats->latency_total_us	+= latency_us;
+		if (latency_us > device_stats->latency_max_us) {
+			device_stats->latency_max_us = latency_us;
+		}
+		if (status == ACC_STATUS_SUCCESS) {
+			device_stats->byte_count += buffer->size;
+		} else {
+			device_stats->error_count++;
+		}
+
+		buffer->status	= status;
+		buffer->state	= BUFFER_COMPLETED;
+		internal_queue_push(&completion_queue, buffer - buffers);
+		pthread_cond_signal(&completed_cond);
+	}
+
+	pthread_mutex_unlock(&engine_mutex);
+}
+
+
+static void internal_free_buffers(void)
+{
+	for (uint_fast8_t index = 0; index < BUFFER_MAX; index++) {
+		free(buffers[index].data);
+		buffers[index].data = NULL;
+	}
+
+	free(segments);
+	segments = NULL;
+}
+
+
+acc_status_t acc_driver_spi_linux_spidev_async_start(uint_fast8_t count, size_t size)
+{
+	static bool		conds_initialized;
+	long			page_size = sysconf(_SC_PAGESIZE);
+	size_t			max_size = acc_device_spi_get_max_transfer_size();
+
+	if (count < 2 || count > BUFFER_MAX || size == 0) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (max_size == 0) {
+		max_size = size;
+	}
+
+	pthread_mutex_lock(&engine_mutex);
+
+	if (started) {
+		pthread_mutex_unlock(&engine_mutex);
+		ACC_LOG_ERROR("%s: already started", __func__);
+		return ACC_STATUS_FAILURE;
+	}
+
+	if (!conds_initialized) {
+		pthread_condattr_t attr;
+
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&submitted_cond, &attr);
+		pthread_cond_init(&completed_cond, &attr);
+		pthread_cond_init(&released_cond, &attr);
+		pthread_condattr_destroy(&attr);
+		conds_initialized = true;
+	}
+
+	memset(buffers, 0, sizeof(buffers));
+	memset(stats, 0, sizeof(stats));
+	memset(&submission_queue, 0, sizeof(submission_queue));
+	memset(&completion_queue, 0, sizeof(completion_queue));
+
+	segments = calloc((size + max_size - 1) / max_size, sizeof(*segments));
+	if (segments == NULL) {
+		pthread_mutex_unlock(&engine_mutex);
+		return ACC_STATUS_OUT_OF_MEMORY;
+	}
+
+	// Page aligned so the kernel can map the buffers for DMA without bounce copies
+	for (uint_fast8_t index = 0; index < count; index++) {
+		void *data;
+
+		if (posix_memalign(&data, page_size > 0 ? (size_t)page_size : 4096, size) != 0) {
+			internal_free_buffers();
+			pthread_mutex_unlock(&engine_mutex);
+			return ACC_STATUS_OUT_OF_MEMORY;
+		}
+
+		memset(data, 0, size);
+		buffers[index].data	= data;
+		buffers[index].state	= BUFFER_FREE;
+	}
+
+	buffer_count	= count;
+	buffer_size	= size;
+	stopping	= false;
+
+	if (acc_os_thread_create(worker_thread, NULL, &worker_handle) != ACC_STATUS_SUCCESS) {
+		internal_free_buffers();
+		pthread_mutex_unlock(&engine_mutex);
+		return ACC_STATUS_FAILURE;
+	}
+
+	started = true;
+
+	pthread_mutex_unlock(&engine_mutex);
+
+	ACC_LOG_VERBOSE("%s: %u buffers of %u bytes", __func__, (unsigned int)count, (unsigned int)size);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+void acc_driver_spi_linux_spidev_async_stop(void)
+{
+	pthread_mutex_lock(&engine_mutex);
+
+	if (!started) {
+		pthread_mutex_unlock(&engine_mutex);
+		return;
+	}
+
+	stopping = true;
+	pthread_cond_broadcast(&submitted_cond);
+
+	pthread_mutex_unlock(&engine_mutex);
+
+	acc_os_thread_cleanup(worker_handle);
+
+	pthread_mutex_lock(&engine_mutex);
+
+	internal_free_buffers();
+	memset(&completion_queue, 0, sizeof(completion_queue));
+	buffer_count	= 0;
+	started		= false;
+
+	// Wake callers blocked in acquire or wait, they find the engine stopped
+	pthread_cond_broadcast(&completed_cond);
+	pthread_cond_broadcast(&released_cond);
+
+	pthread_mutex_unlock(&engine_mutex);
+}
+
+
+uint8_t *acc_driver_spi_linux_spidev_async_acquire(void)
+{
+	uint8_t *data = NULL;
+
+	pthread_mutex_lock(&engine_mutex);
+
+	while (started && !stopping) {
+		uint_fast8_t index;
+
+		for (index = 0; index < buffer_count && buffers[index].state != BUFFER_FREE; index++) {
+		}
+
+		if (index < buffer_count) {
+			buffers[index].state	= BUFFER_ACQUIRED;
+			data			= buffers[index].data;
+			break;
+		}
+
+		pthread_cond_wait(&released_cond, &engine_mutex);
+	}
+
+	pthread_mutex_unlock(&engine_mutex);
+
+	return data;
+}
+
+
+acc_status_t acc_driver_spi_linux_spidev_async_submit(
+		uint_fast8_t	bus,
+		uint_fast8_t	device,
+		uint32_t	speed,
+		uint8_t		*buffer,
+		size_t		size,
+		void		*user_data)
+{
+	if (bus >= SPI_BUS_MAX || device >= SPI_DEVICE_MAX || size == 0) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	pthread_mutex_lock(&engine_mutex);
+
+	uint_fast8_t index = internal_find_buffer(buffer);
+
+	if (!started || stopping || index == buffer_count || buffers[index].state != BUFFER_ACQUIRED || size > buffer_size) {
+		pthread_mutex_unlock(&engine_mutex);
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	buffers[index].state		= BUFFER_SUBMITTED;
+	buffers[index].bus		= bus;
+	buffers[index].device		= device;
+	buffers[index].speed		= speed;
+	buffers[index].size		= size;
+	buffers[index].user_data	= user_data;
+	buffers[index].submit_us	= acc_os_monotonic_ns() / 1000;
+
+	internal_queue_push(&submission_queue, index);
+	pthread_cond_signal(&submitted_cond);
+
+	pthread_mutex_unlock(&engine_mutex);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_driver_spi_linux_spidev_async_wait(acc_driver_spi_linux_spidev_async_completion_t *completion, uint_fast32_t timeout_ms)
+{
+	struct timespec	deadline;
+	acc_status_t	status = ACC_STATUS_SUCCESS;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	deadline.tv_sec		+= timeout_ms / 1000;
+	deadline.tv_nsec	+= (long)(timeout_ms % 1000) * 1000000;
+	if (deadline.tv_nsec >= 1000000000) {
+		deadline.tv_sec++;
+		deadline.tv_nsec -= 1000000000;
+	}
+
+	pthread_mutex_lock(&engine_mutex);
+
+	while (status == ACC_STATUS_SUCCESS && completion_queue.count == 0) {
+		if (!started || submission_queue.count == 0) {
+			// Nothing queued and the worker holds at most one transfer, check that one
+			bool in_flight = false;
+
+			for (uint_fast8_t index = 0; index < buffer_count; index++) {
+				in_flight |= (buffers[index].state == BUFFER_SUBMITTED);
+			}
+			if (!in_flight) {
+				status = ACC_STATUS_FAILURE;
+				break;
+			}
+		}
+
+		if (timeout_ms == 0) {
+			pthread_cond_wait(&completed_cond, &engine_mutex);
+		} else if (pthread_cond_timedwait(&completed_cond, &engine_mutex, &deadline) == ETIMEDOUT) {
+			status = (completion_queue.count > 0) ? ACC_STATUS_SUCCESS : ACC_STATUS_TIMEOUT;
+		}
+	}
+
+	if (status == ACC_STATUS_SUCCESS) {
+		buffer_t *buffer = &buffers[internal_queue_pop(&completion_queue)];
+
+		buffer->state		= BUFFER_WAITED;
+		completion->buffer	= buffer->data;
+		completion->buffer_size	= buffer->size;
+		completion->status	= buffer->status;
+		completion->user_data	= buffer->user_data;
+	}
+
+	pthread_mutex_unlock(&engine_mutex);
+
+	return status;
+}
+
+
+void acc_driver_spi_linux_spidev_async_release(uint8_t *buffer)
+{
+	pthread_mutex_lock(&engine_mutex);
+
+	uint_fast8_t index = internal_find_buffer(buffer);
+
+	if (index < buffer_count && (buffers[index].state == BUFFER_ACQUIRED || buffers[index].state == BUFFER_WAITED)) {
+		buffers[index].state = BUFFER_FREE;
+		pthread_cond_signal(&released_cond);
+	} else {
+		ACC_LOG_ERROR("%s: buffer not held by the caller", __func__);
+	}
+
+	pthread_mutex_unlock(&engine_mutex);
+}
+
+
+acc_status_t acc_driver_spi_linux_spidev_async_get_stats(uint_fast8_t bus, uint_fast8_t device, acc_driver_spi_linux_spidev_async_stats_t *device_stats)
+{
+	if (bus >= SPI_BUS_MAX || device >= SPI_DEVICE_MAX) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	pthread_mutex_lock(&engine_mutex);
+	*device_stats = stats[bus][device];
+	pthread_mutex_unlock(&engine_mutex);
+
+	return ACC_STATUS_SUCCESS;
+}
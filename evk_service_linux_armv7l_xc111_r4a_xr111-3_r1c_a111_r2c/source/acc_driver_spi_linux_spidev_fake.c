@@ -0,0 +1,182 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// needed for nanosleep
+#define _POSIX_C_SOURCE 199309L
+
+#include <errno.h>
+#include <linux/spi/spidev.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+
+#include "acc_driver_spi_linux_spidev.h"
+#include "acc_driver_spi_linux_spidev_fake.h"
+
+
+/**
+ * @brief File descriptor handed out for every device, well above what the process uses
+ */
+#define DEVICE_FD	1100
+
+/**
+ * @brief Message buffer size when bufsiz is reported as unknown, the default of spidev
+ */
+#define DEFAULT_BUFSIZ	4096
+
+
+static size_t					bufsiz;
+static bool					bus_sleep;
+static uint32_t					max_speed;
+static acc_driver_spi_linux_spidev_fake_stats_t	stats;
+
+
+static int fake_message(struct spi_ioc_transfer *transfers, size_t transfer_count)
+{
+	size_t		total = 0;
+	uint64_t	bus_time_us = 0;
+	uint32_t	cs_deselect_count = 0;
+
+	for (size_t index = 0; index < transfer_count; index++) {
+		total += transfers[index].len;
+
+		if (transfers[index].speed_hz == 0) {
+			errno = EINVAL;
+			return -1;
+		}
+	}
+
+	if (total > (bufsiz != 0 ? bufsiz : DEFAULT_BUFSIZ)) {
+		errno = EMSGSIZE;
+		return -1;
+	}
+
+	for (size_t index = 0; index < transfer_count; index++) {
+		struct spi_ioc_transfer *transfer = &transfers[index];
+
+		if (transfer->rx_buf != 0 && transfer->rx_buf != transfer->tx_buf) {
+			if (transfer->tx_buf != 0) {
+				memcpy((void *)(uintptr_t)transfer->rx_buf, (const void *)(uintptr_t)transfer->tx_buf, transfer->len);
+			} else {
+				memset((void *)(uintptr_t)transfer->rx_buf, 0, transfer->len);
+			}
+		}
+
+		if (max_speed != 0 && transfer->speed_hz > max_speed && transfer->rx_buf != 0 && transfer->len > 0) {
+			uint8_t *rx = (uint8_t *)(uintptr_t)transfer->rx_buf;
+
+			rx[stats.transfer_count % transfer->len] ^= 1 << (index % 8);
+		}
+
+		bus_time_us += (uint64_t)transfer->len * 8 * 1000000 / transfer->speed_hz + transfer->delay_usecs;
+
+		if (transfer->cs_change && index + 1 < transfer_count) {
+			cs_deselect_count++;
+		}
+	}
+
+	if (bus_sleep) {
+		struct timespec ts = { .tv_sec = bus_time_us / 1000000, .tv_nsec = (bus_time_us % 1000000) * 1000 };
+
+		nanosleep(&ts, NULL);
+	}
+
+	stats.message_count++;
+	stats.transfer_count	+= transfer_count;
+	stats.byte_count	+= total;
+	stats.cs_deselect_count	+= cs_deselect_count;
+	stats.bus_time_us	+= bus_time_us;
+
+	return 0;
+}
+
+
+static int fake_open(const char *path, int flags)
+{
+	(void)path;
+	(void)flags;
+
+	return DEVICE_FD;
+}
+
+
+static int fake_close(int fd)
+{
+	if (fd != DEVICE_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	return 0;
+}
+
+
+static int fake_ioctl(int fd, unsigned long request, void *arg)
+{
+	stats.ioctl_count++;
+
+	if (fd != DEVICE_FD) {
+		errno = EBADF;
+		return -1;
+	}
+
+	if (request == SPI_IOC_RD_MODE || request == SPI_IOC_WR_MODE) {
+		return 0;
+	}
+
+	if (_IOC_TYPE(request) == SPI_IOC_MAGIC && _IOC_NR(request) == 0 && _IOC_DIR(request) == _IOC_WRITE) {
+		size_t size = _IOC_SIZE(request);
+
+		if (size == 0 || size % sizeof(struct spi_ioc_transfer) != 0) {
+			errno = EINVAL;
+			return -1;
+		}
+
+		return fake_message(arg, size / sizeof(struct spi_ioc_transfer));
+	}
+
+	errno = ENOTTY;
+	return -1;
+}
+
+
+static size_t fake_get_bufsiz(void)
+{
+	return bufsiz;
+}
+
+
+const acc_driver_spi_linux_spidev_ops_t acc_driver_spi_linux_spidev_fake_ops = {
+	.open		= fake_open,
+	.close		= fake_close,
+	.ioctl		= fake_ioctl,
+	.get_bufsiz	= fake_get_bufsiz
+};
+
+
+void acc_driver_spi_linux_spidev_fake_reset(size_t size)
+{
+	bufsiz = size;
+	memset(&stats, 0, sizeof(stats));
+}
+
+
+void acc_driver_spi_linux_spidev_fake_set_bus_sleep(bool enable)
+{
+	bus_sleep = enable;
+}
+
+
+void acc_driver_spi_linux_spidev_fake_set_max_speed(uint32_t speed_hz)
+{
+	max_speed = speed_hz;
+}
+
+
+void acc_driver_spi_linux_spidev_fake_get_stats(acc_driver_spi_linux_spidev_fake_stats_t *fake_stats)
+{
+	*fake_stats = stats;
+}
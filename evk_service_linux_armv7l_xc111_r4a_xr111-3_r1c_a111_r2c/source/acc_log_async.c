@@ -0,0 +1,926 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Asynchronous backend of the ACC_LOG_* macros, see acc_log_async.h
+//
+// Each logging thread has a ring of its own, written only by that thread and read only by
+// the background thread, so queuing a message takes no lock. A record holds the format and
+// module pointers, the time and the arguments in 8 byte slots, in the order the format
+// string consumes them. The background thread replays each conversion of the format with
+// snprintf(). When every ring is empty the background thread sleeps until a thread logs.
+
+// needed for localtime_r and strnlen
+#if !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <errno.h>
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "acc_log.h"
+#include "acc_log_async.h"
+#include "acc_os.h"
+
+
+#define MODULE	"log_async"
+
+
+/**
+ * @brief Bytes of the ring of each thread, a power of two
+ */
+#define RING_SIZE		(16 * 1024)
+
+/**
+ * @brief Largest record, header included
+ */
+#define RECORD_MAX_SIZE		512
+
+/**
+ * @brief Longest formatted message, terminator included
+ */
+#define TEXT_MAX_SIZE		256
+
+/**
+ * @brief Longest conversion specification, terminator included
+ */
+#define SPEC_MAX_SIZE		32
+
+/**
+ * @brief Time between the rings being emptied while messages are logged
+ */
+#define DRAIN_PERIOD_US		10000
+
+#define RECORD_PADDING		0x1
+
+#define ALIGN8(size)		(((size) + 7) & ~(size_t)7)
+
+
+/**
+ * @brief Type of the argument of a conversion
+ */
+typedef enum {
+	ARG_NONE,
+	ARG_INT,
+	ARG_LONG,
+	ARG_LLONG,
+	ARG_SIZE,
+	ARG_INTMAX,
+	ARG_PTRDIFF,
+	ARG_DOUBLE,
+	ARG_STRING,
+	ARG_POINTER,
+	ARG_UNSUPPORTED
+} arg_type_t;
+
+
+/**
+ * @brief A conversion of a format string
+ *
+ * @param start The '%'
+ * @param end Just after the conversion character
+ * @param star_count Number of int arguments given for width and precision
+ * @param precision Precision given in the format, -1 if none or given as an argument
+ * @param precision_star True if the last int argument is the precision
+ */
+typedef struct {
+	const char	*start;
+	const char	*end;
+	arg_type_t	type;
+	uint_fast8_t	star_count;
+	int		precision;
+	bool		precision_star;
+} conversion_t;
+
+
+/**
+ * @brief Header of a record, followed by the arguments
+ *
+ * @param size Bytes of the record, a multiple of 8
+ */
+typedef struct {
+	uint32_t	size;
+	uint16_t	level;
+	uint16_t	flags;
+	const char	*module;
+	const char	*format;
+	uint64_t	time_ns;
+} record_t;
+
+#define RECORD_HEADER_SIZE	ALIGN8(sizeof(record_t))
+
+
+/**
+ * @brief The ring of a thread
+ *
+ * @param head Bytes written, only written by the thread
+ * @param tail Bytes read, only written by the background thread
+ * @param dropped Messages dropped because the ring was full
+ * @param reported_dropped Dropped messages already reported by the background thread
+ * @param closed Set when the thread has exited
+ */
+typedef struct log_ring {
+	struct log_ring		*next;
+	uint32_t		head;
+	uint32_t		tail;
+	uint32_t		dropped;
+	uint32_t		reported_dropped;
+	bool			closed;
+	acc_os_thread_id_t	thread_id;
+	uint64_t		data[RING_SIZE / sizeof(uint64_t)];
+} log_ring_t;
+
+
+static pthread_once_t		start_once = PTHREAD_ONCE_INIT;
+static pthread_key_t		ring_key;
+static pthread_t		drain_handle;
+static bool			running;
+static bool			drain_idle;
+static sem_t			wake_sem;
+static acc_log_level_t		queued_level = ACC_LOG_LEVEL_INFO;
+
+// The list is added to by the logging threads and only unlinked from by the background thread
+static pthread_mutex_t		rings_mutex = PTHREAD_MUTEX_INITIALIZER;
+static log_ring_t		*rings;
+static uint32_t			thread_count;
+static uint64_t			written_count;
+static uint64_t			closed_dropped_count;
+
+static __thread log_ring_t	*thread_ring;
+
+
+/**
+ * @brief Find the next conversion of a format string
+ *
+ * @param format The format string, from the previous conversion on
+ * @param[out] conversion The conversion found
+ * @return False if there are no more conversions
+ */
+static bool next_conversion(const char *format, conversion_t *conversion)
+{
+	const char	*p = strchr(format, '%');
+	arg_type_t	int_type = ARG_INT;
+	bool		long_double = false;
+
+	if (p == NULL) {
+		return false;
+	}
+
+	conversion->start		= p++;
+	conversion->star_count		= 0;
+	conversion->precision		= -1;
+	conversion->precision_star	= false;
+
+	if (*p == '%') {
+		conversion->end		= p + 1;
+		conversion->type	= ARG_NONE;
+		return true;
+	}
+
+	while (*p != '\0' && strchr("-+ #0'", *p) != NULL) {
+		p++;
+	}
+
+	if (*p == '*') {
+		conversion->star_count++;
+		p++;
+	}
+	while (*p >= '0' && *p <= '9') {
+		p++;
+	}
+
+	if (*p == '.') {
+		p++;
+		if (*p == '*') {
+			conversion->star_count++;
+			conversion->precision_star = true;
+			p++;
+		} else {
+			conversion->precision = 0;
+			while (*p >= '0' && *p <= '9') {
+				conversion->precision = conversion->precision * 10 + (*p++ - '0');
+			}
+		}
+	}
+
+	switch (*p) {
+		case 'h':
+			p += (p[1] == 'h') ? 2 : 1;
+			break;
+		case 'l':
+			int_type = (p[1] == 'l') ? ARG_LLONG : ARG_LONG;
+			p += (p[1] == 'l') ? 2 : 1;
+			break;
+		case 'z':
+			int_type = ARG_SIZE;
+			p++;
+			break;
+		case 'j':
+			int_type = ARG_INTMAX;
+			p++;
+			break;
+		case 't':
+			int_type = ARG_PTRDIFF;
+			p++;
+			break;
+		case 'L':
+			long_double = true;
+			p++;
+			break;
+		default:
+			break;
+	}
+
+	switch (*p) {
+		case 'd':
+		case 'i':
+		case 'u':
+		case 'o':
+		case 'x':
+		case 'X':
+			conversion->type = long_double ? ARG_UNSUPPORTED : int_type;
+			break;
+		case 'c':
+		case 's':
+			// Wide characters are not supported
+			if (int_type != ARG_INT || long_double) {
+				conversion->type = ARG_UNSUPPORTED;
+			} else {
+				conversion->type = (*p == 'c') ? ARG_INT : ARG_STRING;
+			}
+			break;
+		case 'f':
+		case 'F':
+		case 'e':
+		case 'E':
+		case 'g':
+		case 'G':
+		case 'a':
+		case 'A':
+			conversion->type = long_double ? ARG_UNSUPPORTED : ARG_DOUBLE;
+			break;
+		case 'p':
+			conversion->type = ARG_POINTER;
+			break;
+		default:
+			conversion->type = ARG_UNSUPPORTED;
+			break;
+	}
+
+	conversion->end = (*p != '\0') ? p + 1 : p;
+
+	if ((size_t)(conversion->end - conversion->start) >= SPEC_MAX_SIZE) {
+		conversion->type = ARG_UNSUPPORTED;
+	}
+
+	return true;
+}
+
+
+static bool put_arg(uint8_t *args, size_t args_size, size_t *used, const void *value, size_t size)
+{
+	if (*used + ALIGN8(size) > args_size) {
+		return false;
+	}
+
+	memcpy(args + *used, value, size);
+	*used += ALIGN8(size);
+
+	return true;
+}
+
+
+/**
+ * @brief Store a string with its terminator, after its length
+ */
+static bool put_string(uint8_t *args, size_t args_size, size_t *used, const char *value, int precision)
+{
+	size_t		max_length = TEXT_MAX_SIZE - 1;
+	uint64_t	length;
+
+	if (value == NULL) {
+		value = "(null)";
+	}
+	if (precision >= 0 && (size_t)precision < max_length) {
+		max_length = precision;
+	}
+
+	length = strnlen(value, max_length);
+	if (!put_arg(args, args_size, used, &length, sizeof(length)) || *used + length + 1 > args_size) {
+		return false;
+	}
+
+	memcpy(args + *used, value, length);
+	args[*used + length]	= '\0';
+	*used			+= ALIGN8(length + 1);
+
+	return true;
+}
+
+
+/**
+ * @brief Store the arguments of a message
+ *
+ * @param[out] used Bytes used
+ * @return False if there was no room or a conversion is not supported
+ */
+static bool encode_args(const char *format, va_list *ap, uint8_t *args, size_t args_size, size_t *used)
+{
+	conversion_t	conversion;
+	bool		success = true;
+
+	*used = 0;
+
+	while (success && next_conversion(format, &conversion)) {
+		int precision = conversion.precision;
+
+		for (uint_fast8_t star = 0; star < conversion.star_count && success; star++) {
+			int value = va_arg(*ap, int);
+
+			if (conversion.precision_star && star + 1 == conversion.star_count) {
+				precision = value;
+			}
+			success = put_arg(args, args_size, used, &value, sizeof(value));
+		}
+
+		switch (conversion.type) {
+			case ARG_NONE:
+				break;
+			case ARG_INT: {
+				int value = va_arg(*ap, int);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_LONG: {
+				long value = va_arg(*ap, long);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_LLONG: {
+				long long value = va_arg(*ap, long long);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_SIZE: {
+				size_t value = va_arg(*ap, size_t);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_INTMAX: {
+				intmax_t value = va_arg(*ap, intmax_t);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_PTRDIFF: {
+				ptrdiff_t value = va_arg(*ap, ptrdiff_t);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_DOUBLE: {
+				double value = va_arg(*ap, double);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_POINTER: {
+				void *value = va_arg(*ap, void *);
+				success = success && put_arg(args, args_size, used, &value, sizeof(value));
+				break;
+			}
+			case ARG_STRING: {
+				const char *value = va_arg(*ap, const char *);
+				success = success && put_string(args, args_size, used, value, precision);
+				break;
+			}
+			default:
+				success = false;
+				break;
+		}
+
+		format = conversion.end;
+	}
+
+	return success;
+}
+
+
+static const void *take_arg(const uint8_t **args, size_t size)
+{
+	const void *value = *args;
+
+	*args += ALIGN8(size);
+
+	return value;
+}
+
+
+/**
+ * @brief Format one conversion with its stored arguments
+ *
+ * @return What snprintf() returns
+ */
+static int format_conversion(char *text, size_t text_size, const conversion_t *conversion, const uint8_t **args)
+{
+	char	spec[SPEC_MAX_SIZE];
+	int	stars[2] = { 0, 0 };
+	size_t	spec_length = conversion->end - conversion->start;
+
+	if (conversion->type == ARG_NONE) {
+		return snprintf(text, text_size, "%%");
+	}
+
+	memcpy(spec, conversion->start, spec_length);
+	spec[spec_length] = '\0';
+
+	for (uint_fast8_t star = 0; star < conversion->star_count && star < 2; star++) {
+		memcpy(&stars[star], take_arg(args, sizeof(int)), sizeof(int));
+	}
+
+#define FORMAT_VALUE(value) \
+	do { \
+		switch (conversion->star_count) { \
+			case 0: \
+				return snprintf(text, text_size, spec, value); \
+			case 1: \
+				return snprintf(text, text_size, spec, stars[0], value); \
+			default: \
+				return snprintf(text, text_size, spec, stars[0], stars[1], value); \
+		} \
+	} while (0)
+
+#define FORMAT_ARG(type) \
+	do { \
+		type value; \
+		\
+		memcpy(&value, take_arg(args, sizeof(value)), sizeof(value)); \
+		FORMAT_VALUE(value); \
+	} while (0)
+
+	switch (conversion->type) {
+		case ARG_INT:
+			FORMAT_ARG(int);
+		case ARG_LONG:
+			FORMAT_ARG(long);
+		case ARG_LLONG:
+			FORMAT_ARG(long long);
+		case ARG_SIZE:
+			FORMAT_ARG(size_t);
+		case ARG_INTMAX:
+			FORMAT_ARG(intmax_t);
+		case ARG_PTRDIFF:
+			FORMAT_ARG(ptrdiff_t);
+		case ARG_DOUBLE:
+			FORMAT_ARG(double);
+		case ARG_POINTER:
+			FORMAT_ARG(void *);
+		case ARG_STRING: {
+			uint64_t	length;
+			const char	*value;
+
+			memcpy(&length, take_arg(args, sizeof(length)), sizeof(length));
+			value = take_arg(args, length + 1);
+			FORMAT_VALUE(value);
+		}
+		default:
+			return 0;
+	}
+
+#undef FORMAT_ARG
+#undef FORMAT_VALUE
+}
+
+
+static void append(size_t text_size, size_t *length, int written)
+{
+	if (written > 0) {
+		*length = (*length + written < text_size) ? *length + written : text_size - 1;
+	}
+}
+
+
+static void format_record(const record_t *record, char *text, size_t text_size)
+{
+	const uint8_t	*args = (const uint8_t *)record + RECORD_HEADER_SIZE;
+	const char	*format = record->format;
+	size_t		length = 0;
+	conversion_t	conversion;
+
+	text[0] = '\0';
+
+	while (length + 1 < text_size && next_conversion(format, &conversion)) {
+		append(text_size, &length, snprintf(text + length, text_size - length, "%.*s",
+		                                    (int)(conversion.start - format), format));
+		append(text_size, &length, format_conversion(text + length, text_size - length, &conversion, &args));
+		format = conversion.end;
+	}
+
+	append(text_size, &length, snprintf(text + length, text_size - length, "%s", format));
+}
+
+
+static bool ring_push(log_ring_t *ring, const record_t *record)
+{
+	uint8_t		*data = (uint8_t *)ring->data;
+	uint32_t	head = ring->head;
+	uint32_t	tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+	uint32_t	offset = head & (RING_SIZE - 1);
+	uint32_t	padding = (offset + record->size > RING_SIZE) ? RING_SIZE - offset : 0;
+
+	if (RING_SIZE - (head - tail) < padding + record->size) {
+		return false;
+	}
+
+	// Records do not wrap, the end of the ring is skipped instead
+	if (padding > 0) {
+		record_t *pad = (record_t *)(data + offset);
+
+		pad->size	= padding;
+		pad->flags	= RECORD_PADDING;
+		head		+= padding;
+		offset		= 0;
+	}
+
+	memcpy(data + offset, record, record->size);
+	__atomic_store_n(&ring->head, head + record->size, __ATOMIC_RELEASE);
+
+	return true;
+}
+
+
+static const record_t *ring_peek(log_ring_t *ring)
+{
+	uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+
+	while (ring->tail != head) {
+		const record_t *record = (const record_t *)((uint8_t *)ring->data + (ring->tail & (RING_SIZE - 1)));
+
+		if (!(record->flags & RECORD_PADDING)) {
+			return record;
+		}
+		__atomic_store_n(&ring->tail, ring->tail + record->size, __ATOMIC_RELEASE);
+	}
+
+	return NULL;
+}
+
+
+static void ring_pop(log_ring_t *ring, const record_t *record)
+{
+	__atomic_store_n(&ring->tail, ring->tail + record->size, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Mark the ring of an exiting thread, the background thread frees it once it is empty
+ */
+static void ring_close(void *param)
+{
+	log_ring_t *ring = param;
+
+	__atomic_store_n(&ring->closed, true, __ATOMIC_RELEASE);
+}
+
+
+static log_ring_t *ring_register(void)
+{
+	log_ring_t *ring = malloc(sizeof(*ring));
+
+	if (ring == NULL) {
+		return NULL;
+	}
+
+	ring->head		= 0;
+	ring->tail		= 0;
+	ring->dropped		= 0;
+	ring->reported_dropped	= 0;
+	ring->closed		= false;
+	ring->thread_id		= acc_os_get_thread_id();
+
+	pthread_setspecific(ring_key, ring);
+
+	pthread_mutex_lock(&rings_mutex);
+	ring->next = rings;
+	__atomic_store_n(&rings, ring, __ATOMIC_RELEASE);
+	thread_count++;
+	pthread_mutex_unlock(&rings_mutex);
+
+	thread_ring = ring;
+
+	return ring;
+}
+
+
+static void write_record(const log_ring_t *ring, const record_t *record, int64_t wall_clock_offset_ns)
+{
+	char		text[TEXT_MAX_SIZE];
+	struct tm	time_tm;
+	uint64_t	realtime_ns = record->time_ns + wall_clock_offset_ns;
+	time_t		seconds = realtime_ns / 1000000000;
+
+	format_record(record, text, sizeof(text));
+	localtime_r(&seconds, &time_tm);
+
+	acc_log(record->level, (char *)record->module, "%s (thread %u at %02d:%02d:%02d.%06u)", text,
+	        (unsigned int)ring->thread_id, time_tm.tm_hour, time_tm.tm_min, time_tm.tm_sec,
+	        (unsigned int)(realtime_ns % 1000000000 / 1000));
+
+	__atomic_fetch_add(&written_count, 1, __ATOMIC_RELAXED);
+}
+
+
+/**
+ * @brief Write the queued messages of all threads, oldest first
+ *
+ * @param free_closed Free the rings of threads that have exited, takes rings_mutex
+ * @return True if a message was written
+ */
+static bool drain(bool free_closed)
+{
+	bool			written = false;
+	acc_os_time_pair_t	pair;
+	int64_t			wall_clock_offset_ns;
+	log_ring_t		*first = __atomic_load_n(&rings, __ATOMIC_ACQUIRE);
+
+	acc_os_time_pair_capture(&pair);
+	wall_clock_offset_ns = (int64_t)pair.realtime_ns - (int64_t)pair.monotonic_ns;
+
+	while (true) {
+		log_ring_t	*oldest_ring = NULL;
+		const record_t	*oldest = NULL;
+
+		for (log_ring_t *ring = first; ring != NULL; ring = ring->next) {
+			const record_t *record = ring_peek(ring);
+
+			if (record != NULL && (oldest == NULL || record->time_ns < oldest->time_ns)) {
+				oldest		= record;
+				oldest_ring	= ring;
+			}
+		}
+
+		if (oldest == NULL) {
+			break;
+		}
+
+		write_record(oldest_ring, oldest, wall_clock_offset_ns);
+		ring_pop(oldest_ring, oldest);
+		written = true;
+	}
+
+	for (log_ring_t *ring = first; ring != NULL; ring = ring->next) {
+		uint32_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+
+		if (dropped != ring->reported_dropped) {
+			// Not through ACC_LOG, this thread does not queue messages
+			acc_log(ACC_LOG_LEVEL_WARNING, MODULE, "%u messages of thread %u dropped, its log ring was full",
+			        (unsigned int)(dropped - ring->reported_dropped), (unsigned int)ring->thread_id);
+			ring->reported_dropped = dropped;
+		}
+	}
+
+	if (!free_closed) {
+		return written;
+	}
+
+	// Only this thread unlinks, the lock keeps out threads adding their rings
+	pthread_mutex_lock(&rings_mutex);
+	for (log_ring_t **link = &rings; *link != NULL;) {
+		log_ring_t *ring = *link;
+
+		if (__atomic_load_n(&ring->closed, __ATOMIC_ACQUIRE) && ring_peek(ring) == NULL) {
+			*link			= ring->next;
+			closed_dropped_count	+= ring->dropped;
+			thread_count--;
+			free(ring);
+		} else {
+			link = &ring->next;
+		}
+	}
+	pthread_mutex_unlock(&rings_mutex);
+
+	return written;
+}
+
+
+static bool rings_empty(void)
+{
+	for (log_ring_t *ring = __atomic_load_n(&rings, __ATOMIC_ACQUIRE); ring != NULL; ring = ring->next) {
+		if (__atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) != ring->tail) {
+			return false;
+		}
+	}
+
+	return true;
+}
+
+
+/**
+ * @brief Sleep until a thread logs or the backend is stopped
+ *
+ * drain_idle is set before the rings are checked and read by acc_log_async() after its record is
+ * stored, with a full fence on both sides, so either the logging thread sees it and posts
+ * wake_sem, or the record is seen here. The one that clears drain_idle owns the post.
+ */
+static void idle_wait(void)
+{
+	__atomic_store_n(&drain_idle, true, __ATOMIC_SEQ_CST);
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+	if ((!rings_empty() || !__atomic_load_n(&running, __ATOMIC_SEQ_CST)) &&
+	    __atomic_exchange_n(&drain_idle, false, __ATOMIC_ACQ_REL)) {
+		return;
+	}
+
+	while (sem_wait(&wake_sem) != 0 && errno == EINTR) {
+	}
+}
+
+
+static void wake_drain_thread(void)
+{
+	if (__atomic_load_n(&drain_idle, __ATOMIC_RELAXED) && __atomic_exchange_n(&drain_idle, false, __ATOMIC_ACQ_REL)) {
+		sem_post(&wake_sem);
+	}
+}
+
+
+static void *drain_thread(void *param)
+{
+	acc_os_timer_t timer;
+
+	ACC_UNUSED(param);
+
+	acc_os_timer_start(&timer, DRAIN_PERIOD_US);
+
+	while (__atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+		acc_os_timer_wait(&timer);
+
+		if (!drain(true) && __atomic_load_n(&running, __ATOMIC_ACQUIRE)) {
+			idle_wait();
+			// Messages logged right after the wake-up are written together, without catching up
+			acc_os_timer_start(&timer, DRAIN_PERIOD_US);
+		}
+	}
+
+	// rings_mutex is not taken, the process may be exiting from a thread that holds it
+	drain(false);
+
+	return NULL;
+}
+
+
+/**
+ * @brief Write what is queued when the process exits, also after the exit() of the SIGINT handler of acc_os
+ */
+static void drain_at_exit(void)
+{
+	// The signal may have landed on the background thread itself, which cannot be joined
+	if (pthread_equal(pthread_self(), drain_handle)) {
+		__atomic_store_n(&running, false, __ATOMIC_SEQ_CST);
+		drain(false);
+		return;
+	}
+
+	acc_log_async_stop();
+}
+
+
+static void start(void)
+{
+	if (pthread_key_create(&ring_key, ring_close) != 0) {
+		return;
+	}
+
+	if (sem_init(&wake_sem, 0, 0) != 0) {
+		return;
+	}
+
+	__atomic_store_n(&running, true, __ATOMIC_RELEASE);
+
+	// Created directly, so the profile of acc_os_thread_create() does not apply
+	if (pthread_create(&drain_handle, NULL, drain_thread, NULL) != 0) {
+		__atomic_store_n(&running, false, __ATOMIC_RELEASE);
+		return;
+	}
+
+	atexit(drain_at_exit);
+}
+
+
+static void log_now(acc_log_level_t level, char *module, char *format, va_list ap)
+{
+	char text[TEXT_MAX_SIZE];
+
+	vsnprintf(text, sizeof(text), format, ap);
+	acc_log(level, module, "%s", text);
+}
+
+
+void acc_log_async(acc_log_level_t level, char *module, char *format, ...)
+{
+	union {
+		record_t	header;
+		uint8_t		bytes[RECORD_MAX_SIZE];
+	}		record;
+	log_ring_t	*ring = thread_ring;
+	size_t		args_size;
+	bool		encoded;
+	va_list		ap;
+	va_list		ap_copy;
+
+	if (level > __atomic_load_n(&queued_level, __ATOMIC_RELAXED)) {
+		return;
+	}
+
+	pthread_once(&start_once, start);
+
+	va_start(ap, format);
+
+	// Fatal messages are followed by the end of the process, they are not queued
+	if (level == ACC_LOG_LEVEL_FATAL || !__atomic_load_n(&running, __ATOMIC_ACQUIRE) ||
+	    (ring == NULL && (ring = ring_register()) == NULL)) {
+		log_now(level, module, format, ap);
+		va_end(ap);
+		return;
+	}
+
+	record.header.level	= level;
+	record.header.flags	= 0;
+	record.header.module	= module;
+	record.header.format	= format;
+	record.header.time_ns	= acc_os_monotonic_ns();
+
+	va_copy(ap_copy, ap);
+	encoded = encode_args(format, &ap_copy, record.bytes + RECORD_HEADER_SIZE, RECORD_MAX_SIZE - RECORD_HEADER_SIZE, &args_size);
+	va_end(ap_copy);
+
+	if (!encoded) {
+		// Formatted here and queued as text
+		char text[TEXT_MAX_SIZE];
+
+		vsnprintf(text, sizeof(text), format, ap);
+		record.header.format	= "%s";
+		args_size		= 0;
+		put_string(record.bytes + RECORD_HEADER_SIZE, RECORD_MAX_SIZE - RECORD_HEADER_SIZE, &args_size, text, -1);
+	}
+
+	va_end(ap);
+
+	record.header.size = RECORD_HEADER_SIZE + args_size;
+
+	if (!ring_push(ring, &record.header)) {
+		__atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+		return;
+	}
+
+	// Pairs with the fence in idle_wait(), costs a system call only for the first message after idling
+	__atomic_thread_fence(__ATOMIC_SEQ_CST);
+	wake_drain_thread();
+}
+
+
+void acc_log_async_start(void)
+{
+	pthread_once(&start_once, start);
+}
+
+
+void acc_log_async_stop(void)
+{
+	pthread_once(&start_once, start);
+
+	if (__atomic_exchange_n(&running, false, __ATOMIC_SEQ_CST)) {
+		__atomic_thread_fence(__ATOMIC_SEQ_CST);
+		wake_drain_thread();
+		pthread_join(drain_handle, NULL);
+	}
+}
+
+
+void acc_log_async_set_level(acc_log_level_t level)
+{
+	__atomic_store_n(&queued_level, level, __ATOMIC_RELAXED);
+	acc_log_set_level(level, NULL);
+}
+
+
+void acc_log_async_get_stats(acc_log_async_stats_t *stats)
+{
+	pthread_mutex_lock(&rings_mutex);
+
+	stats->thread_count	= thread_count;
+	stats->written_count	= __atomic_load_n(&written_count, __ATOMIC_RELAXED);
+	stats->dropped_count	= closed_dropped_count;
+
+	for (log_ring_t *ring = rings; ring != NULL; ring = ring->next) {
+		stats->dropped_count += __atomic_load_n(&ring->dropped, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&rings_mutex);
+}
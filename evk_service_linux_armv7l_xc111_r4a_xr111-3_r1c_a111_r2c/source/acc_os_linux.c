@@ -5,6 +5,7 @@
 #define _POSIX_SOURCE
 
 // needed for nanosleep
+// needed for clock_nanosleep
 // needed for sigaction
 // needed for siginfo_t
 #define _POSIX_C_SOURCE 199309L
@@ -17,8 +18,10 @@
 #include <dlfcn.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <malloc.h>
 #include <netdb.h>
 #include <pthread.h>
+#include <sched.h>
 #include <stddef.h>
 #include <signal.h>
 #include <stdbool.h>
@@ -28,11 +31,13 @@
 #include <string.h>
 #include <time.h>
 #include <unistd.h>
+#include <sys/mman.h>
 #include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
 
 #include <arpa/inet.h>
+#include <linux/futex.h>
 #include <netinet/in.h>
 #include <netinet/tcp.h>
 #include <sys/socket.h>
@@ -45,7 +50,7 @@
 
 
 /**
- * @brief Mutex to protect concurrent init of mutexes
+ * @brief Mutex to protect the thread profile
  */
 static pthread_mutex_t	acc_os_mutex = PTHREAD_MUTEX_INITIALIZER;
 
@@ -54,6 +59,24 @@ static pthread_mutex_t	acc_os_mutex = PTHREAD_MUTEX_INITIALIZER;
  */
 static uint_fast8_t acc_os_stack_setup_done = 0;
 
+/**
+ * @brief Profile applied by acc_os_thread_create(), set with acc_os_linux_thread_profile_set()
+ */
+static acc_os_linux_thread_profile_t acc_os_thread_profile = { .priority = 0, .cpu = -1, .stack_prefault = 0 };
+
+/**
+ * @brief Start parameters handed to thread_start()
+ */
+typedef struct {
+	void	(*func)(void *param);
+	void	*param;
+	size_t	stack_prefault;
+} thread_start_t;
+
+
+static void mem_mode_init(void);
+static void mutex_stats_init(void);
+
 
 /**
  * @brief General signal handler registered by os_init()
@@ -92,6 +115,9 @@ void acc_os_init(void)
 		fprintf(stderr, "Failed to setup signal handler for SIGINT, %s\n", strerror(errno));
 	}
 
+	mem_mode_init();
+	mutex_stats_init();
+
 	init_done = true;
 }
 
@@ -161,6 +187,401 @@ void acc_os_sleep_us(uint32_t time_usec)
 }
 
 
+static uint64_t timespec_to_ns(const struct timespec *time)
+{
+	return (uint64_t)time->tv_sec * 1000000000 + time->tv_nsec;
+}
+
+
+static void timespec_add_ns(struct timespec *time, uint64_t ns)
+{
+	ns		+= time->tv_nsec;
+	time->tv_sec	+= ns / 1000000000;
+	time->tv_nsec	= ns % 1000000000;
+}
+
+
+/**
+ * @brief Start a periodic timer
+ *
+ * @param timer The timer
+ * @param period_us Period in microseconds, the first deadline is one period from now
+ */
+void acc_os_timer_start(acc_os_timer_t *timer, uint32_t period_us)
+{
+	if (period_us == 0) {
+		period_us = 1;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &timer->deadline);
+	timer->period_ns	= (uint64_t)period_us * 1000;
+	timer->overrun_count	= 0;
+	timespec_add_ns(&timer->deadline, timer->period_ns);
+}
+
+
+/**
+ * @brief Sleep until the next deadline of a periodic timer
+ *
+ * @param timer The timer
+ * @return Number of deadlines skipped
+ */
+uint32_t acc_os_timer_wait(acc_os_timer_t *timer)
+{
+	struct timespec	now;
+	uint64_t	now_ns;
+	uint64_t	deadline_ns = timespec_to_ns(&timer->deadline);
+	uint32_t	overruns = 0;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	now_ns = timespec_to_ns(&now);
+
+	if (now_ns >= deadline_ns + timer->period_ns) {
+		overruns = (now_ns - deadline_ns) / timer->period_ns;
+		timespec_add_ns(&timer->deadline, overruns * timer->period_ns);
+		timer->overrun_count += overruns;
+	}
+
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &timer->deadline, NULL) == EINTR) {
+	}
+
+	timespec_add_ns(&timer->deadline, timer->period_ns);
+
+	return overruns;
+}
+
+
+/**
+ * @brief Get the number of deadlines skipped since the timer was started
+ *
+ * @param timer The timer
+ * @return Number of deadlines skipped
+ */
+uint32_t acc_os_timer_get_overrun_count(const acc_os_timer_t *timer)
+{
+	return timer->overrun_count;
+}
+
+
+/**
+ * @brief Size of the header in front of every block from acc_os_mem_alloc(), keeps the blocks aligned
+ */
+#define MEM_HEADER_SIZE		16
+
+/**
+ * @brief Block size of the smallest class, as a shift
+ */
+#define MEM_CLASS_MIN_SHIFT	5
+
+/**
+ * @brief Index used for allocations larger than every class
+ */
+#define MEM_CLASS_LARGE		ACC_OS_LINUX_MEM_CLASS_COUNT
+
+/**
+ * @brief Blocks are carved from slabs of this size, or of one block if it is larger
+ */
+#define MEM_SLAB_SIZE		(64 * 1024)
+
+/**
+ * @brief Bytes of each class a thread keeps in its cache, at least two blocks
+ */
+#define MEM_CACHE_BYTES		(64 * 1024)
+
+#define MEM_MAGIC		0xacc0
+
+
+/**
+ * @brief Who a block is freed to
+ */
+typedef enum {
+	MEM_OWNER_MALLOC,
+	MEM_OWNER_POOL,
+	MEM_OWNER_ARENA
+} mem_owner_t;
+
+
+/**
+ * @brief Header in front of every block, MEM_HEADER_SIZE bytes
+ *
+ * @param size Bytes requested
+ * @param size_class Class the allocation is counted in, MEM_CLASS_LARGE if none
+ */
+typedef union {
+	struct {
+		uint32_t	size;
+		uint16_t	magic;
+		uint8_t		owner;
+		uint8_t		size_class;
+	} info;
+	uint8_t		padding[MEM_HEADER_SIZE];
+} mem_header_t;
+
+
+/**
+ * @brief Free blocks of a size class shared by all threads
+ */
+typedef struct {
+	pthread_mutex_t	mutex;
+	void		*head;
+	uint32_t	count;
+} mem_pool_t;
+
+
+/**
+ * @brief Free blocks of each size class kept by a thread
+ */
+typedef struct {
+	void		*head[ACC_OS_LINUX_MEM_CLASS_COUNT];
+	uint32_t	count[ACC_OS_LINUX_MEM_CLASS_COUNT];
+	bool		registered;
+} mem_cache_t;
+
+
+/**
+ * @brief Counts of a size class, updated atomically
+ */
+typedef struct {
+	uint32_t	alloc_count;
+	uint32_t	free_count;
+	uint32_t	cached_count;
+} mem_class_counts_t;
+
+
+/**
+ * @brief Memory taken from the system by an arena
+ */
+typedef struct mem_arena_chunk {
+	struct mem_arena_chunk	*next;
+	size_t			size;
+	size_t			used;
+} mem_arena_chunk_t;
+
+struct acc_os_linux_mem_arena {
+	pthread_mutex_t		mutex;
+	mem_arena_chunk_t	*chunks;
+	size_t			chunk_size;
+};
+
+
+static acc_os_linux_mem_mode_t	mem_mode = ACC_OS_LINUX_MEM_MODE_MALLOC;
+static bool			mem_mode_selected;
+static mem_pool_t		mem_pools[ACC_OS_LINUX_MEM_CLASS_COUNT];
+static mem_class_counts_t	mem_counts[ACC_OS_LINUX_MEM_CLASS_COUNT + 1];
+static size_t			mem_live_bytes;
+static size_t			mem_peak_bytes;
+static size_t			mem_slab_bytes;
+static size_t			mem_arena_bytes;
+static pthread_once_t		mem_once = PTHREAD_ONCE_INIT;
+static pthread_key_t		mem_cache_key;
+
+static __thread mem_cache_t			mem_cache;
+static __thread acc_os_linux_mem_arena_t	*mem_thread_arena;
+
+
+static size_t mem_block_size(uint_fast8_t size_class)
+{
+	return (size_t)1 << (size_class + MEM_CLASS_MIN_SHIFT);
+}
+
+
+static uint32_t mem_cache_max(uint_fast8_t size_class)
+{
+	size_t blocks = MEM_CACHE_BYTES / mem_block_size(size_class);
+
+	return (blocks < 2) ? 2 : blocks;
+}
+
+
+static uint_fast8_t mem_class_of(size_t total_size)
+{
+	if (total_size <= mem_block_size(0)) {
+		return 0;
+	}
+
+	uint_fast8_t shift = sizeof(unsigned long) * 8 - __builtin_clzl(total_size - 1);
+
+	return (shift - MEM_CLASS_MIN_SHIFT < ACC_OS_LINUX_MEM_CLASS_COUNT) ? shift - MEM_CLASS_MIN_SHIFT : MEM_CLASS_LARGE;
+}
+
+
+/**
+ * @brief Move count blocks, or all if fewer, from a list to a pool
+ */
+static void mem_pool_put(uint_fast8_t size_class, void **list, uint32_t *list_count, uint32_t count)
+{
+	mem_pool_t *pool = &mem_pools[size_class];
+
+	pthread_mutex_lock(&pool->mutex);
+	while (count-- > 0 && *list != NULL) {
+		void *block = *list;
+
+		*list		= *(void **)block;
+		*(void **)block	= pool->head;
+		pool->head	= block;
+		pool->count++;
+		(*list_count)--;
+	}
+	pthread_mutex_unlock(&pool->mutex);
+}
+
+
+/**
+ * @brief Give the cached blocks of an exiting thread back to the pools
+ */
+static void mem_cache_destructor(void *param)
+{
+	mem_cache_t *cache = param;
+
+	for (uint_fast8_t size_class = 0; size_class < ACC_OS_LINUX_MEM_CLASS_COUNT; size_class++) {
+		__atomic_fetch_sub(&mem_counts[size_class].cached_count, cache->count[size_class], __ATOMIC_RELAXED);
+		mem_pool_put(size_class, &cache->head[size_class], &cache->count[size_class], UINT32_MAX);
+	}
+}
+
+
+static void mem_init_once(void)
+{
+	for (uint_fast8_t size_class = 0; size_class < ACC_OS_LINUX_MEM_CLASS_COUNT; size_class++) {
+		pthread_mutex_init(&mem_pools[size_class].mutex, NULL);
+	}
+
+	pthread_key_create(&mem_cache_key, mem_cache_destructor);
+}
+
+
+/**
+ * @brief Register the cache of the calling thread, so its blocks go back to the pools when it exits
+ *
+ * Needed before the first block enters the cache, by a free as well as by a refill, since a
+ * thread may free blocks allocated by others without ever allocating itself.
+ */
+static void mem_cache_register(void)
+{
+	if (!mem_cache.registered) {
+		pthread_once(&mem_once, mem_init_once);
+		pthread_setspecific(mem_cache_key, &mem_cache);
+		mem_cache.registered = true;
+	}
+}
+
+
+/**
+ * @brief Fill the cache of the calling thread with half its size of blocks, from the pool or a new slab
+ */
+static bool mem_cache_refill(uint_fast8_t size_class)
+{
+	mem_pool_t	*pool = &mem_pools[size_class];
+	size_t		block_size = mem_block_size(size_class);
+	uint32_t	wanted = mem_cache_max(size_class) / 2;
+
+	mem_cache_register();
+
+	pthread_mutex_lock(&pool->mutex);
+
+	if (pool->count < wanted) {
+		size_t	slab_size = (block_size > MEM_SLAB_SIZE) ? block_size : MEM_SLAB_SIZE;
+		uint8_t	*slab = malloc(slab_size);
+
+		if (slab != NULL) {
+			for (size_t offset = 0; offset + block_size <= slab_size; offset += block_size) {
+				*(void **)(slab + offset)	= pool->head;
+				pool->head			= slab + offset;
+				pool->count++;
+			}
+			__atomic_fetch_add(&mem_slab_bytes, slab_size, __ATOMIC_RELAXED);
+		}
+	}
+
+	while (wanted-- > 0 && pool->head != NULL) {
+		void *block = pool->head;
+
+		pool->head		= *(void **)block;
+		pool->count--;
+		*(void **)block		= mem_cache.head[size_class];
+		mem_cache.head[size_class] = block;
+		mem_cache.count[size_class]++;
+		__atomic_fetch_add(&mem_counts[size_class].cached_count, 1, __ATOMIC_RELAXED);
+	}
+
+	pthread_mutex_unlock(&pool->mutex);
+
+	return mem_cache.head[size_class] != NULL;
+}
+
+
+static mem_header_t *mem_pool_alloc(uint_fast8_t size_class)
+{
+	void *block;
+
+	if (mem_cache.head[size_class] == NULL && !mem_cache_refill(size_class)) {
+		return NULL;
+	}
+
+	block				= mem_cache.head[size_class];
+	mem_cache.head[size_class]	= *(void **)block;
+	mem_cache.count[size_class]--;
+	__atomic_fetch_sub(&mem_counts[size_class].cached_count, 1, __ATOMIC_RELAXED);
+
+	return block;
+}
+
+
+static void mem_pool_free(uint_fast8_t size_class, mem_header_t *header)
+{
+	uint32_t cache_max = mem_cache_max(size_class);
+
+	mem_cache_register();
+
+	*(void **)header		= mem_cache.head[size_class];
+	mem_cache.head[size_class]	= header;
+	mem_cache.count[size_class]++;
+	__atomic_fetch_add(&mem_counts[size_class].cached_count, 1, __ATOMIC_RELAXED);
+
+	if (mem_cache.count[size_class] > cache_max) {
+		uint32_t excess = mem_cache.count[size_class] - cache_max / 2;
+
+		__atomic_fetch_sub(&mem_counts[size_class].cached_count, excess, __ATOMIC_RELAXED);
+		mem_pool_put(size_class, &mem_cache.head[size_class], &mem_cache.count[size_class], excess);
+	}
+}
+
+
+static mem_header_t *mem_arena_alloc(acc_os_linux_mem_arena_t *arena, size_t total_size)
+{
+	mem_arena_chunk_t	*chunk;
+	mem_header_t		*header = NULL;
+	size_t			chunk_header_size = (sizeof(mem_arena_chunk_t) + MEM_HEADER_SIZE - 1) & ~(size_t)(MEM_HEADER_SIZE - 1);
+
+	total_size = (total_size + MEM_HEADER_SIZE - 1) & ~(size_t)(MEM_HEADER_SIZE - 1);
+
+	pthread_mutex_lock(&arena->mutex);
+
+	chunk = arena->chunks;
+	if (chunk == NULL || chunk->size - chunk->used < total_size) {
+		size_t size = chunk_header_size + ((total_size > arena->chunk_size) ? total_size : arena->chunk_size);
+
+		chunk = malloc(size);
+		if (chunk != NULL) {
+			chunk->next	= arena->chunks;
+			chunk->size	= size;
+			chunk->used	= chunk_header_size;
+			arena->chunks	= chunk;
+			__atomic_fetch_add(&mem_arena_bytes, size, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (chunk != NULL) {
+		header		= (mem_header_t *)((uint8_t *)chunk + chunk->used);
+		chunk->used	+= total_size;
+	}
+
+	pthread_mutex_unlock(&arena->mutex);
+
+	return header;
+}
+
+
 /**
  * @brief Allocate dynamic memory
  *
@@ -174,10 +595,45 @@ void acc_os_sleep_us(uint32_t time_usec)
  */
 void *acc_os_mem_alloc(size_t size)
 {
-	if (!size)
+	acc_os_linux_mem_mode_t	mode = __atomic_load_n(&mem_mode, __ATOMIC_RELAXED);
+	mem_header_t		*header = NULL;
+	mem_owner_t		owner;
+	uint_fast8_t		size_class;
+	size_t			total_size;
+
+	if (!size || size > UINT32_MAX - MEM_HEADER_SIZE)
+		return NULL;
+
+	total_size	= size + MEM_HEADER_SIZE;
+	size_class	= mem_class_of(total_size);
+
+	if (mode == ACC_OS_LINUX_MEM_MODE_ARENA && mem_thread_arena != NULL) {
+		owner	= MEM_OWNER_ARENA;
+		header	= mem_arena_alloc(mem_thread_arena, total_size);
+	} else if (mode != ACC_OS_LINUX_MEM_MODE_MALLOC && size_class != MEM_CLASS_LARGE) {
+		owner	= MEM_OWNER_POOL;
+		header	= mem_pool_alloc(size_class);
+	} else {
+		owner	= MEM_OWNER_MALLOC;
+		header	= malloc(total_size);
+	}
+
+	if (header == NULL)
 		return NULL;
 
-	return malloc(size);
+	header->info.size	= size;
+	header->info.magic	= MEM_MAGIC;
+	header->info.owner	= owner;
+	header->info.size_class	= size_class;
+
+	size_t live = __atomic_add_fetch(&mem_live_bytes, size, __ATOMIC_RELAXED);
+	size_t peak = __atomic_load_n(&mem_peak_bytes, __ATOMIC_RELAXED);
+
+	while (live > peak && !__atomic_compare_exchange_n(&mem_peak_bytes, &peak, live, true, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+	}
+	__atomic_fetch_add(&mem_counts[size_class].alloc_count, 1, __ATOMIC_RELAXED);
+
+	return (uint8_t *)header + MEM_HEADER_SIZE;
 }
 
 
@@ -194,102 +650,798 @@ void *acc_os_mem_alloc(size_t size)
  */
 void acc_os_mem_free(void *ptr)
 {
-	free(ptr);
+	mem_header_t *header;
+
+	if (ptr == NULL)
+		return;
+
+	header = (mem_header_t *)((uint8_t *)ptr - MEM_HEADER_SIZE);
+
+	if (header->info.magic != MEM_MAGIC) {
+		ACC_LOG_ERROR("%s: %p was not allocated with acc_os_mem_alloc or is already freed", __func__, ptr);
+		return;
+	}
+
+	header->info.magic = 0;
+	__atomic_fetch_sub(&mem_live_bytes, header->info.size, __ATOMIC_RELAXED);
+	__atomic_fetch_add(&mem_counts[header->info.size_class].free_count, 1, __ATOMIC_RELAXED);
+
+	switch (header->info.owner) {
+		case MEM_OWNER_POOL:
+			mem_pool_free(header->info.size_class, header);
+			break;
+		case MEM_OWNER_MALLOC:
+			free(header);
+			break;
+		default:
+			// Released with the arena
+			break;
+	}
 }
 
 
 /**
- * @brief Return the unique thread ID for the current thread
+ * @brief Select where acc_os_mem_alloc() takes memory from
+ *
+ * @param mode The mode
  */
-acc_os_thread_id_t acc_os_get_thread_id(void)
+void acc_os_linux_mem_mode_set(acc_os_linux_mem_mode_t mode)
 {
-	return syscall(SYS_gettid);
+	__atomic_store_n(&mem_mode, mode, __ATOMIC_RELAXED);
+	mem_mode_selected = true;
 }
 
 
 /**
- * @brief Calculate current time and return in a struct tm, and optionally with microseconds
- *
- * @param time_tm	The local time, as struct tm, is returned here
- * @param time_usec	If not NULL, the microsecond part of the time is returned here
+ * @brief Select the mode named by ACC_OS_MEM, unless one is selected already
  */
-void acc_os_localtime(struct tm *time_tm, uint32_t *time_usec)
+static void mem_mode_init(void)
 {
-	struct timeval	time_tv;
+	const char *name = getenv("ACC_OS_MEM");
 
-	int result = gettimeofday(&time_tv, NULL);
-	if (result != 0) {
-		ACC_LOG_ERROR("gettimeofday returned %d %d %s", result, errno, strerror(errno));
+	if (mem_mode_selected || name == NULL) {
+		return;
 	}
-	if (localtime_r(&time_tv.tv_sec, time_tm) == NULL) {
-		ACC_LOG_ERROR("localtime_r return NULL");
+
+	if (strcmp(name, "pool") == 0) {
+		acc_os_linux_mem_mode_set(ACC_OS_LINUX_MEM_MODE_POOL);
+	} else if (strcmp(name, "arena") == 0) {
+		acc_os_linux_mem_mode_set(ACC_OS_LINUX_MEM_MODE_ARENA);
+	} else if (strcmp(name, "malloc") == 0) {
+		acc_os_linux_mem_mode_set(ACC_OS_LINUX_MEM_MODE_MALLOC);
+	} else {
+		fprintf(stderr, "Unknown ACC_OS_MEM \"%s\", using malloc\n", name);
 	}
-	if (time_usec)
-		*time_usec = time_tv.tv_usec;
 }
 
 
 /**
- * @brief Initialize a mutex
- *
- * If a pointer to a mutex type is given, that mutex is initialized. If NULL is given, a new
- * mutex is dynamically allocated and initialized.
- *
- * If the pointer to an already initialized mutex is given, nothing is done and the mutex is
- * left in its current state. Care must therefore be taken that the mutex variable is zeroed
- * before being passed to acc_os_mutex_init() so it can be detected to be initialized or not.
+ * @brief Get the memory use through acc_os_mem_alloc()
  *
- * @param mutex Pointer to mutex or NULL
- * @return Newly initialized mutex
+ * @param[out] stats The memory use
  */
-acc_os_mutex_t *acc_os_mutex_init(acc_os_mutex_t *mutex)
+void acc_os_linux_mem_get_stats(acc_os_linux_mem_stats_t *stats)
 {
-	pthread_mutex_lock(&acc_os_mutex);
-
-	if (mutex && mutex->is_initialized) {
-		pthread_mutex_unlock(&acc_os_mutex);
-		return mutex;
-	}
-
-	if (!mutex && !(mutex = acc_os_mem_alloc(sizeof(*mutex)))) {
-		pthread_mutex_unlock(&acc_os_mutex);
-		return NULL;
+	memset(stats, 0, sizeof(*stats));
+
+	stats->mode		= __atomic_load_n(&mem_mode, __ATOMIC_RELAXED);
+	stats->live_bytes	= __atomic_load_n(&mem_live_bytes, __ATOMIC_RELAXED);
+	stats->peak_bytes	= __atomic_load_n(&mem_peak_bytes, __ATOMIC_RELAXED);
+	stats->slab_bytes	= __atomic_load_n(&mem_slab_bytes, __ATOMIC_RELAXED);
+	stats->arena_bytes	= __atomic_load_n(&mem_arena_bytes, __ATOMIC_RELAXED);
+
+	for (uint_fast8_t size_class = 0; size_class <= MEM_CLASS_LARGE; size_class++) {
+		acc_os_linux_mem_class_stats_t *class_stats = &stats->classes[size_class];
+
+		class_stats->block_size		= (size_class < MEM_CLASS_LARGE) ? mem_block_size(size_class) : 0;
+		class_stats->alloc_count	= __atomic_load_n(&mem_counts[size_class].alloc_count, __ATOMIC_RELAXED);
+		class_stats->free_count		= __atomic_load_n(&mem_counts[size_class].free_count, __ATOMIC_RELAXED);
+		class_stats->live_count		= class_stats->alloc_count - class_stats->free_count;
+		class_stats->pool_count		= __atomic_load_n(&mem_counts[size_class].cached_count, __ATOMIC_RELAXED);
+
+		if (size_class < MEM_CLASS_LARGE) {
+			pthread_once(&mem_once, mem_init_once);
+			pthread_mutex_lock(&mem_pools[size_class].mutex);
+			class_stats->pool_count += mem_pools[size_class].count;
+			pthread_mutex_unlock(&mem_pools[size_class].mutex);
+		}
 	}
+}
 
-	pthread_mutex_init(&mutex->mutex, NULL);
-	mutex->is_initialized = 1;
-
-	pthread_mutex_unlock(&acc_os_mutex);
 
-	return mutex;
+/**
+ * @brief Restart the peak at the current live bytes
+ */
+void acc_os_linux_mem_reset_peak(void)
+{
+	__atomic_store_n(&mem_peak_bytes, __atomic_load_n(&mem_live_bytes, __ATOMIC_RELAXED), __ATOMIC_RELAXED);
 }
 
 
 /**
- * @brief Mutex lock
+ * @brief Create an arena
  *
- * @param mutex Mutex to be locked
+ * @param chunk_size Bytes taken from the system each time the arena runs out
+ * @return The arena, NULL if out of memory
  */
-void acc_os_mutex_lock(acc_os_mutex_t *mutex)
+acc_os_linux_mem_arena_t *acc_os_linux_mem_arena_create(size_t chunk_size)
 {
-	pthread_mutex_lock(&mutex->mutex);
+	acc_os_linux_mem_arena_t *arena = malloc(sizeof(*arena));
+
+	if (arena == NULL)
+		return NULL;
+
+	pthread_mutex_init(&arena->mutex, NULL);
+	arena->chunks		= NULL;
+	arena->chunk_size	= chunk_size;
+
+	return arena;
 }
 
 
 /**
- * @brief Mutex unlock
+ * @brief Take the allocations of the calling thread from an arena
  *
- * @param mutex Mutex to be unlocked
+ * @param arena The arena, NULL to leave the arena entered
  */
-void acc_os_mutex_unlock(acc_os_mutex_t *mutex)
+void acc_os_linux_mem_arena_enter(acc_os_linux_mem_arena_t *arena)
 {
-	pthread_mutex_unlock(&mutex->mutex);
+	mem_thread_arena = arena;
+}
+
+
+/**
+ * @brief Destroy an arena and everything allocated from it
+ *
+ * @param arena The arena
+ */
+void acc_os_linux_mem_arena_destroy(acc_os_linux_mem_arena_t *arena)
+{
+	if (arena == NULL)
+		return;
+
+	while (arena->chunks != NULL) {
+		mem_arena_chunk_t *chunk = arena->chunks;
+
+		arena->chunks = chunk->next;
+		__atomic_fetch_sub(&mem_arena_bytes, chunk->size, __ATOMIC_RELAXED);
+		free(chunk);
+	}
+
+	pthread_mutex_destroy(&arena->mutex);
+	free(arena);
+}
+
+
+/**
+ * @brief Return the unique thread ID for the current thread
+ */
+acc_os_thread_id_t acc_os_get_thread_id(void)
+{
+	return syscall(SYS_gettid);
+}
+
+
+/**
+ * @brief Calculate current time and return in a struct tm, and optionally with microseconds
+ *
+ * @param time_tm	The local time, as struct tm, is returned here
+ * @param time_usec	If not NULL, the microsecond part of the time is returned here
+ */
+void acc_os_localtime(struct tm *time_tm, uint32_t *time_usec)
+{
+	struct timeval	time_tv;
+
+	int result = gettimeofday(&time_tv, NULL);
+	if (result != 0) {
+		ACC_LOG_ERROR("gettimeofday returned %d %d %s", result, errno, strerror(errno));
+	}
+	if (localtime_r(&time_tv.tv_sec, time_tm) == NULL) {
+		ACC_LOG_ERROR("localtime_r return NULL");
+	}
+	if (time_usec)
+		*time_usec = time_tv.tv_usec;
+}
+
+
+/**
+ * @brief Get a monotonic time in nanoseconds
+ *
+ * @return Monotonic time in nanoseconds
+ */
+uint64_t acc_os_monotonic_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return timespec_to_ns(&now);
+}
+
+
+/**
+ * @brief Number of tries acc_os_time_pair_capture() makes to read both clocks with little in between
+ */
+#define TIME_PAIR_TRIES	3
+
+/**
+ * @brief Read the monotonic time and the wall clock time at the same moment
+ *
+ * The wall clock is read between two reads of the monotonic clock, and paired with their
+ * midpoint. The tightest of a few tries is kept, in case the thread was preempted.
+ *
+ * @param[out] pair The times
+ */
+void acc_os_time_pair_capture(acc_os_time_pair_t *pair)
+{
+	pair->uncertainty_ns = UINT32_MAX;
+
+	for (uint_fast8_t try = 0; try < TIME_PAIR_TRIES; try++) {
+		struct timespec	before;
+		struct timespec	realtime;
+		struct timespec	after;
+
+		clock_gettime(CLOCK_MONOTONIC, &before);
+		clock_gettime(CLOCK_REALTIME, &realtime);
+		clock_gettime(CLOCK_MONOTONIC, &after);
+
+		uint64_t half_ns = (timespec_to_ns(&after) - timespec_to_ns(&before)) / 2;
+
+		if (half_ns < pair->uncertainty_ns) {
+			pair->monotonic_ns	= timespec_to_ns(&before) + half_ns;
+			pair->realtime_ns	= timespec_to_ns(&realtime);
+			pair->uncertainty_ns	= half_ns;
+		}
+	}
+}
+
+
+/**
+ * @brief Most spins of a contended lock before it parks
+ */
+#define MUTEX_SPIN_MAX		1000
+
+/**
+ * @brief Number of mutexes with contention counts
+ */
+#define MUTEX_STATS_MAX		128
+
+
+/**
+ * @brief Contention counts of a mutex, only changed by the thread holding it
+ */
+typedef struct {
+	const acc_os_mutex_t	*mutex;
+	const char		*name;
+	uint64_t		lock_count;
+	uint64_t		contended_count;
+	uint64_t		wait_ns;
+	uint64_t		max_wait_ns;
+	uint64_t		max_hold_ns;
+	uint64_t		locked_at_ns;
+} mutex_stats_entry_t;
+
+
+static mutex_stats_entry_t	mutex_stats[MUTEX_STATS_MAX];
+static uint32_t			mutex_stats_count;
+static bool			mutex_stats_enabled;
+static bool			mutex_stats_selected;
+static int			mutex_spin_max = -1;
+
+
+static inline void cpu_relax(void)
+{
+#if defined(__arm__) || defined(__aarch64__)
+	__asm__ __volatile__("yield" ::: "memory");
+#elif defined(__i386__) || defined(__x86_64__)
+	__asm__ __volatile__("pause" ::: "memory");
+#else
+	__asm__ __volatile__("" ::: "memory");
+#endif
+}
+
+
+static long futex(uint32_t *address, int op, uint32_t value)
+{
+	return syscall(SYS_futex, address, op, value, NULL, NULL, 0);
+}
+
+
+/**
+ * @brief Spins allowed before parking, none on a single CPU where the holder cannot run meanwhile
+ */
+static uint_fast16_t mutex_spin_limit(void)
+{
+	int spin_max = __atomic_load_n(&mutex_spin_max, __ATOMIC_RELAXED);
+
+	if (spin_max < 0) {
+		spin_max = (sysconf(_SC_NPROCESSORS_ONLN) > 1) ? MUTEX_SPIN_MAX : 0;
+		__atomic_store_n(&mutex_spin_max, spin_max, __ATOMIC_RELAXED);
+	}
+
+	return spin_max;
+}
+
+
+/**
+ * @brief Take an entry of the contention counts for a mutex, 0 when all are taken
+ */
+static uint16_t mutex_stats_register(const acc_os_mutex_t *mutex)
+{
+	uint32_t index = __atomic_fetch_add(&mutex_stats_count, 1, __ATOMIC_RELAXED);
+
+	if (index >= MUTEX_STATS_MAX) {
+		return 0;
+	}
+
+	__atomic_store_n(&mutex_stats[index].mutex, mutex, __ATOMIC_RELEASE);
+
+	return index + 1;
+}
+
+
+static mutex_stats_entry_t *mutex_stats_get(const acc_os_mutex_t *mutex)
+{
+	uint16_t index = __atomic_load_n(&mutex->u.futex.stats_index, __ATOMIC_RELAXED);
+
+	return (index != 0) ? &mutex_stats[index - 1] : NULL;
+}
+
+
+// The counts are stored atomically so acc_os_linux_mutex_get_stats() may read them at any time
+static void mutex_stats_locked(mutex_stats_entry_t *entry, bool contended, uint64_t wait_ns, uint64_t now_ns)
+{
+	__atomic_store_n(&entry->lock_count, entry->lock_count + 1, __ATOMIC_RELAXED);
+
+	if (contended) {
+		__atomic_store_n(&entry->contended_count, entry->contended_count + 1, __ATOMIC_RELAXED);
+		__atomic_store_n(&entry->wait_ns, entry->wait_ns + wait_ns, __ATOMIC_RELAXED);
+		if (wait_ns > entry->max_wait_ns) {
+			__atomic_store_n(&entry->max_wait_ns, wait_ns, __ATOMIC_RELAXED);
+		}
+	}
+
+	entry->locked_at_ns = now_ns;
+}
+
+
+static void mutex_stats_unlocking(mutex_stats_entry_t *entry)
+{
+	// Zero when the mutex was locked without counting
+	if (entry->locked_at_ns != 0) {
+		uint64_t hold_ns = acc_os_monotonic_ns() - entry->locked_at_ns;
+
+		if (hold_ns > entry->max_hold_ns) {
+			__atomic_store_n(&entry->max_hold_ns, hold_ns, __ATOMIC_RELAXED);
+		}
+		entry->locked_at_ns = 0;
+	}
+}
+
+
+/**
+ * @brief Enable the contention counts if ACC_OS_MUTEX_STATS is set, unless enabled or disabled already
+ */
+static void mutex_stats_init(void)
+{
+	if (!mutex_stats_selected && getenv("ACC_OS_MUTEX_STATS") != NULL) {
+		acc_os_linux_mutex_stats_enable(true);
+	}
+}
+
+
+/**
+ * @brief Initialize a mutex
+ *
+ * If a pointer to a mutex type is given, that mutex is initialized. If NULL is given, a new
+ * mutex is dynamically allocated and initialized.
+ *
+ * If the pointer to an already initialized mutex is given, nothing is done and the mutex is
+ * left in its current state. Care must therefore be taken that the mutex variable is zeroed
+ * before being passed to acc_os_mutex_init() so it can be detected to be initialized or not.
+ *
+ * A zeroed mutex is a valid unlocked mutex, so the first caller only takes an entry of the
+ * contention counts for it and no lock is needed against concurrent calls.
+ *
+ * @param mutex Pointer to mutex or NULL
+ * @return Newly initialized mutex
+ */
+acc_os_mutex_t *acc_os_mutex_init(acc_os_mutex_t *mutex)
+{
+	uint_fast8_t not_initialized = 0;
+
+	if (!mutex) {
+		mutex = acc_os_mem_alloc(sizeof(*mutex));
+		if (!mutex) {
+			return NULL;
+		}
+		memset(mutex, 0, sizeof(*mutex));
+	}
+
+	if (__atomic_compare_exchange_n(&mutex->is_initialized, &not_initialized, 1, false,
+	                                __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)) {
+		__atomic_store_n(&mutex->u.futex.stats_index, mutex_stats_register(mutex), __ATOMIC_RELAXED);
+	}
+
+	return mutex;
+}
+
+
+/**
+ * @brief Wait for a mutex found held, first spinning and then parked in the kernel
+ *
+ * The mutex of "Futexes Are Tricky" by Ulrich Drepper. The spin is adapted to how long the
+ * mutex has been held recently, so short sections are waited for without system calls and
+ * long ones without burning the CPU.
+ */
+static void mutex_lock_contended(acc_os_mutex_t *mutex, uint32_t state)
+{
+	uint32_t	*address = &mutex->u.futex.state;
+	int_fast32_t	estimate = __atomic_load_n(&mutex->u.futex.spin_estimate, __ATOMIC_RELAXED);
+	uint_fast16_t	spin_limit = mutex_spin_limit();
+	uint_fast16_t	spin_count;
+	bool		locked = false;
+
+	if ((uint_fast32_t)estimate * 2 + 10 < spin_limit) {
+		spin_limit = estimate * 2 + 10;
+	}
+
+	for (spin_count = 0; spin_count < spin_limit && !locked; spin_count++) {
+		cpu_relax();
+		state = __atomic_load_n(address, __ATOMIC_RELAXED);
+		if (state == 0) {
+			locked = __atomic_compare_exchange_n(address, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+		}
+	}
+
+	if (spin_limit != 0) {
+		estimate += ((int_fast32_t)spin_count - estimate) / 8;
+		__atomic_store_n(&mutex->u.futex.spin_estimate, estimate, __ATOMIC_RELAXED);
+	}
+
+	if (locked) {
+		return;
+	}
+
+	// 2 tells the holder that a thread must be woken when it unlocks
+	if (state != 2) {
+		state = __atomic_exchange_n(address, 2, __ATOMIC_ACQUIRE);
+	}
+
+	while (state != 0) {
+		futex(address, FUTEX_WAIT_PRIVATE, 2);
+		state = __atomic_exchange_n(address, 2, __ATOMIC_ACQUIRE);
+	}
+}
+
+
+/**
+ * @brief Mutex lock
+ *
+ * @param mutex Mutex to be locked
+ */
+void acc_os_mutex_lock(acc_os_mutex_t *mutex)
+{
+	mutex_stats_entry_t	*entry = NULL;
+	uint32_t		state = 0;
+
+	if (__atomic_load_n(&mutex_stats_enabled, __ATOMIC_RELAXED)) {
+		entry = mutex_stats_get(mutex);
+	}
+
+	if (__atomic_compare_exchange_n(&mutex->u.futex.state, &state, 1, false, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+		if (entry) {
+			mutex_stats_locked(entry, false, 0, acc_os_monotonic_ns());
+		}
+		return;
+	}
+
+	uint64_t start_ns = entry ? acc_os_monotonic_ns() : 0;
+
+	mutex_lock_contended(mutex, state);
+
+	if (entry) {
+		uint64_t now_ns = acc_os_monotonic_ns();
+
+		mutex_stats_locked(entry, true, now_ns - start_ns, now_ns);
+	}
+}
+
+
+/**
+ * @brief Mutex unlock
+ *
+ * @param mutex Mutex to be unlocked
+ */
+void acc_os_mutex_unlock(acc_os_mutex_t *mutex)
+{
+	// Also when counting was disabled while the mutex was held, so the lock time is not left behind
+	mutex_stats_entry_t *entry = mutex_stats_get(mutex);
+
+	if (entry) {
+		mutex_stats_unlocking(entry);
+	}
+
+	if (__atomic_fetch_sub(&mutex->u.futex.state, 1, __ATOMIC_RELEASE) != 1) {
+		__atomic_store_n(&mutex->u.futex.state, 0, __ATOMIC_RELEASE);
+		futex(&mutex->u.futex.state, FUTEX_WAKE_PRIVATE, 1);
+	}
+}
+
+
+/**
+ * @brief Initialize a counting semaphore
+ *
+ * @param semaphore The semaphore
+ * @param count Posts available from the start
+ */
+void acc_os_semaphore_init(acc_os_semaphore_t *semaphore, uint32_t count)
+{
+	__atomic_store_n(&semaphore->count, count, __ATOMIC_RELAXED);
+	__atomic_store_n(&semaphore->waiter_count, 0, __ATOMIC_RELEASE);
+}
+
+
+/**
+ * @brief Post a semaphore, waking a thread waiting for it
+ *
+ * The count is raised before waiter_count is read, and a waiter is counted before it reads
+ * the count, so either the post is seen by the waiter or the waiter is woken here.
+ *
+ * @param semaphore The semaphore
+ */
+void acc_os_semaphore_post(acc_os_semaphore_t *semaphore)
+{
+	__atomic_fetch_add(&semaphore->count, 1, __ATOMIC_SEQ_CST);
+
+	if (__atomic_load_n(&semaphore->waiter_count, __ATOMIC_SEQ_CST) > 0) {
+		futex(&semaphore->count, FUTEX_WAKE_PRIVATE, 1);
+	}
+}
+
+
+static bool semaphore_try_take(acc_os_semaphore_t *semaphore)
+{
+	uint32_t count = __atomic_load_n(&semaphore->count, __ATOMIC_SEQ_CST);
+
+	while (count > 0) {
+		if (__atomic_compare_exchange_n(&semaphore->count, &count, count - 1, true,
+		                                __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+			return true;
+		}
+	}
+
+	return false;
+}
+
+
+/**
+ * @brief Take a post of a semaphore, sleeping until there is one
+ *
+ * The deadline is absolute on CLOCK_MONOTONIC, so wake-ups by other waiters and signals do
+ * not stretch the timeout.
+ *
+ * @param semaphore The semaphore
+ * @param timeout_us Microseconds to wait at most, 0 to wait until posted
+ * @return True if a post was taken, false on timeout
+ */
+bool acc_os_semaphore_wait(acc_os_semaphore_t *semaphore, uint32_t timeout_us)
+{
+	struct timespec	deadline;
+	bool		taken;
+
+	if (semaphore_try_take(semaphore)) {
+		return true;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	timespec_add_ns(&deadline, (uint64_t)timeout_us * 1000);
+
+	__atomic_fetch_add(&semaphore->waiter_count, 1, __ATOMIC_SEQ_CST);
+
+	while (!(taken = semaphore_try_take(semaphore))) {
+		// Sleeps only while the count is still 0, a post after the check above returns at once
+		if (syscall(SYS_futex, &semaphore->count, FUTEX_WAIT_BITSET_PRIVATE, 0, timeout_us > 0 ? &deadline : NULL,
+		            NULL, FUTEX_BITSET_MATCH_ANY) != 0 && errno == ETIMEDOUT) {
+			taken = semaphore_try_take(semaphore);
+			break;
+		}
+	}
+
+	__atomic_fetch_sub(&semaphore->waiter_count, 1, __ATOMIC_RELAXED);
+
+	return taken;
+}
+
+
+/**
+ * @brief Count contention of the mutexes of acc_os_mutex_init()
+ *
+ * @param enable True to count, false to stop counting and keep the counts so far
+ */
+void acc_os_linux_mutex_stats_enable(bool enable)
+{
+	__atomic_store_n(&mutex_stats_enabled, enable, __ATOMIC_RELAXED);
+	mutex_stats_selected = true;
+}
+
+
+/**
+ * @brief Name a mutex in the contention counts
+ *
+ * @param mutex A mutex initialized with acc_os_mutex_init()
+ * @param name The name, must stay valid, e.g. a string literal
+ */
+void acc_os_linux_mutex_set_name(acc_os_mutex_t *mutex, const char *name)
+{
+	uint16_t index = __atomic_load_n(&mutex->u.futex.stats_index, __ATOMIC_RELAXED);
+
+	if (index != 0) {
+		__atomic_store_n(&mutex_stats[index - 1].name, name, __ATOMIC_RELAXED);
+	}
+}
+
+
+static int compare_mutex_wait(const void *a, const void *b)
+{
+	const acc_os_linux_mutex_stats_t *stats_a = a;
+	const acc_os_linux_mutex_stats_t *stats_b = b;
+
+	return (stats_a->wait_ns < stats_b->wait_ns) - (stats_a->wait_ns > stats_b->wait_ns);
+}
+
+
+/**
+ * @brief Get the contention counts of the mutexes, most waited for first
+ *
+ * @param[out] stats Array for the counts
+ * @param max_count Number of entries in the array
+ * @return Number of entries filled in
+ */
+uint32_t acc_os_linux_mutex_get_stats(acc_os_linux_mutex_stats_t *stats, uint32_t max_count)
+{
+	acc_os_linux_mutex_stats_t	all[MUTEX_STATS_MAX];
+	uint32_t			count = 0;
+	uint32_t			entry_count = __atomic_load_n(&mutex_stats_count, __ATOMIC_RELAXED);
+
+	if (entry_count > MUTEX_STATS_MAX) {
+		entry_count = MUTEX_STATS_MAX;
+	}
+
+	for (uint32_t index = 0; index < entry_count; index++) {
+		mutex_stats_entry_t *entry = &mutex_stats[index];
+
+		all[count].mutex		= __atomic_load_n(&entry->mutex, __ATOMIC_ACQUIRE);
+		all[count].name			= __atomic_load_n(&entry->name, __ATOMIC_RELAXED);
+		all[count].lock_count		= __atomic_load_n(&entry->lock_count, __ATOMIC_RELAXED);
+		all[count].contended_count	= __atomic_load_n(&entry->contended_count, __ATOMIC_RELAXED);
+		all[count].wait_ns		= __atomic_load_n(&entry->wait_ns, __ATOMIC_RELAXED);
+		all[count].max_wait_ns		= __atomic_load_n(&entry->max_wait_ns, __ATOMIC_RELAXED);
+		all[count].max_hold_ns		= __atomic_load_n(&entry->max_hold_ns, __ATOMIC_RELAXED);
+
+		// Registered by a thread that has not yet stored the mutex
+		if (all[count].mutex != NULL) {
+			count++;
+		}
+	}
+
+	qsort(all, count, sizeof(all[0]), compare_mutex_wait);
+
+	if (count > max_count) {
+		count = max_count;
+	}
+
+	memcpy(stats, all, count * sizeof(all[0]));
+
+	return count;
+}
+
+
+/**
+ * @brief Print the contention counts of the mutexes that have been locked, most waited for first
+ *
+ * @param file Where to print, e.g. stderr
+ */
+void acc_os_linux_mutex_stats_dump(FILE *file)
+{
+	acc_os_linux_mutex_stats_t	stats[MUTEX_STATS_MAX];
+	uint32_t			count = acc_os_linux_mutex_get_stats(stats, MUTEX_STATS_MAX);
+
+	fprintf(file, "%-20s %-18s %10s %10s %12s %12s %12s\n", "mutex", "address", "locks", "contended",
+	        "wait us", "max wait us", "max hold us");
+
+	for (uint32_t index = 0; index < count; index++) {
+		if (stats[index].lock_count == 0) {
+			continue;
+		}
+
+		fprintf(file, "%-20s %-18p %10llu %10llu %12.1f %12.1f %12.1f\n",
+		        stats[index].name ? stats[index].name : "-", (const void *)stats[index].mutex,
+		        (unsigned long long)stats[index].lock_count, (unsigned long long)stats[index].contended_count,
+		        stats[index].wait_ns / 1000.0, stats[index].max_wait_ns / 1000.0, stats[index].max_hold_ns / 1000.0);
+	}
+}
+
+
+/**
+ * @brief Touch the stack the thread is going to use so it is faulted in before the first sweep
+ */
+static void __attribute__((noinline)) prefault_stack(size_t size)
+{
+	uint8_t stack_filler[size];
+
+	memset(stack_filler, 0, size);
+
+	/* Prevent compiler from optimizing away stack_filler[] */
+	__asm__ __volatile__("" :: "m" (stack_filler));
+}
+
+
+/**
+ * @brief Entry point of threads created with acc_os_thread_create()
+ */
+static void *thread_start(void *param)
+{
+	thread_start_t start = *(thread_start_t *)param;
+
+	free(param);
+
+	if (start.stack_prefault) {
+		prefault_stack(start.stack_prefault);
+	}
+
+	start.func(start.param);
+
+	return NULL;
+}
+
+
+/**
+ * @brief Set the profile of threads created from now on
+ *
+ * @param profile The profile to use, NULL to restore normal scheduling on any CPU
+ */
+void acc_os_linux_thread_profile_set(const acc_os_linux_thread_profile_t *profile)
+{
+	pthread_mutex_lock(&acc_os_mutex);
+
+	if (profile) {
+		acc_os_thread_profile = *profile;
+	} else {
+		acc_os_thread_profile.priority		= 0;
+		acc_os_thread_profile.cpu		= -1;
+		acc_os_thread_profile.stack_prefault	= 0;
+	}
+
+	pthread_mutex_unlock(&acc_os_mutex);
+}
+
+
+/**
+ * @brief Lock all current and future memory of the process in RAM
+ *
+ * @return Status
+ */
+acc_status_t acc_os_linux_memory_lock(void)
+{
+	// Keep freed memory in the heap, and serve large blocks from it instead of fresh mappings
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) < 0) {
+		ACC_LOG_WARNING("%s: mlockall(): (%u) %s", __func__, errno, strerror(errno));
+		return ACC_STATUS_FAILURE;
+	}
+
+	return ACC_STATUS_SUCCESS;
 }
 
 
 /**
  * @brief Create new thread
  *
+ * The thread gets the profile set with acc_os_linux_thread_profile_set().
+ *
  * @param func	Function implementing the thread code
  * @param param	Parameter to be passed to the thread function
  * @param[out] handle OS specific thread handle
@@ -297,16 +1449,61 @@ void acc_os_mutex_unlock(acc_os_mutex_t *mutex)
  */
 acc_status_t acc_os_thread_create(void (*func)(void *param), void *param, acc_os_thread_handle_t *handle)
 {
-	int	ret;
+	acc_os_linux_thread_profile_t	profile;
+	pthread_attr_t			attr;
+	thread_start_t			*start;
+	int				ret;
+
+	pthread_mutex_lock(&acc_os_mutex);
+	profile = acc_os_thread_profile;
+	pthread_mutex_unlock(&acc_os_mutex);
+
+	start = malloc(sizeof(*start));
+	if (start == NULL) {
+		ACC_LOG_ERROR("%s: Out of memory", __func__);
+		return ACC_STATUS_FAILURE;
+	}
+
+	start->func		= func;
+	start->param		= param;
+	start->stack_prefault	= profile.stack_prefault;
+
+	pthread_attr_init(&attr);
+
+	if (profile.cpu >= 0) {
+		cpu_set_t cpus;
+
+		CPU_ZERO(&cpus);
+		CPU_SET(profile.cpu, &cpus);
+		pthread_attr_setaffinity_np(&attr, sizeof(cpus), &cpus);
+	}
+
+	if (profile.priority > 0) {
+		struct sched_param sched = { .sched_priority = profile.priority };
+
+		pthread_attr_setinheritsched(&attr, PTHREAD_EXPLICIT_SCHED);
+		pthread_attr_setschedpolicy(&attr, SCHED_FIFO);
+		pthread_attr_setschedparam(&attr, &sched);
+	}
+
+	ret = pthread_create((pthread_t *)handle, &attr, thread_start, start);
+
+	if (ret == EPERM && profile.priority > 0) {
+		ACC_LOG_WARNING("%s: SCHED_FIFO priority %d not permitted, using normal scheduling", __func__, profile.priority);
+		pthread_attr_setinheritsched(&attr, PTHREAD_INHERIT_SCHED);
+		ret = pthread_create((pthread_t *)handle, &attr, thread_start, start);
+	}
+
+	pthread_attr_destroy(&attr);
 
-	// TODO the function cast should be replaced by something safer
-	ret = pthread_create((pthread_t *)handle, NULL, (void* (*)(void*))func, param);
 	if (ret != 0) {
 		ACC_LOG_ERROR("%s: Error %d, %s", __func__, ret, strerror(ret));
+		free(start);
 		return ACC_STATUS_FAILURE;
 	}
 
-	ACC_LOG_VERBOSE("%s: created thread_handle=%lu", __func__, (unsigned long)*handle);
+	ACC_LOG_VERBOSE("%s: created thread_handle=%lu priority=%d cpu=%d", __func__, (unsigned long)*handle,
+	                profile.priority, profile.cpu);
 	return ACC_STATUS_SUCCESS;
 }
 
@@ -0,0 +1,316 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// The distance detector of libacc_detector_distance.a for host builds, so programs using it
+// run on the synthetic envelopes of acc_sim_service_envelope.c
+//
+// A reflection is a local maximum of the envelope above the threshold. An estimated threshold
+// is the largest amplitude seen at each point during estimation, raised by up to 50 % as the
+// sensitivity goes down.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "acc_os.h"
+#include "acc_types.h"
+#include "acconeer_detector_distance.h"
+
+
+#define REFLECTION_MAX		64
+#define DEFAULT_SENSITIVITY	0.5f
+#define THRESHOLD_MAGIC		0x44545341	// "ASTD" in memory
+
+
+/**
+ * @brief Header of the data from acc_detector_distance_threshold_estimation_get_data()
+ */
+typedef struct {
+	uint32_t	magic;
+	uint16_t	length;
+	uint16_t	reserved;
+} threshold_header_t;
+
+
+/**
+ * @brief A detector
+ *
+ * @param fixed_threshold Threshold at every point when threshold is NULL
+ * @param threshold Estimated threshold, or the one being estimated
+ * @param threshold_length Number of points of threshold
+ * @param estimating True while the threshold is being estimated
+ */
+typedef struct {
+	uint16_t				fixed_threshold;
+	uint16_t				*threshold;
+	uint16_t				threshold_length;
+	bool					estimating;
+	float					sensitivity;
+	bool					absolute_amplitude;
+	acc_detector_distance_reflection_t	reflections[REFLECTION_MAX];
+	uint16_t				reflection_count;
+} sim_detector_t;
+
+
+static sim_detector_t *create(void)
+{
+	sim_detector_t *detector = acc_os_mem_alloc(sizeof(*detector));
+
+	if (detector != NULL) {
+		memset(detector, 0, sizeof(*detector));
+		detector->sensitivity = DEFAULT_SENSITIVITY;
+	}
+
+	return detector;
+}
+
+
+static uint16_t threshold_at(const sim_detector_t *detector, uint16_t index, uint16_t data_size)
+{
+	if (detector->threshold == NULL) {
+		return detector->fixed_threshold;
+	}
+
+	uint32_t	point = (uint32_t)index * detector->threshold_length / data_size;
+	float		threshold = detector->threshold[point] * (1.0f + (1.0f - detector->sensitivity) * 0.5f);
+
+	return (threshold > UINT16_MAX) ? UINT16_MAX : (uint16_t)threshold;
+}
+
+
+void *acc_detector_distance_create_empty(void)
+{
+	sim_detector_t *detector = create();
+
+	if (detector != NULL) {
+		detector->estimating = true;
+	}
+
+	return detector;
+}
+
+
+void *acc_detector_distance_create_fixed(uint16_t fix_threshold_value)
+{
+	sim_detector_t *detector = create();
+
+	if (detector != NULL) {
+		detector->fixed_threshold = fix_threshold_value;
+	}
+
+	return detector;
+}
+
+
+void *acc_detector_distance_create_with_threshold(size_t threshold_context_size, void *threshold_context_data)
+{
+	threshold_header_t	header;
+	sim_detector_t		*detector;
+
+	if (threshold_context_data == NULL || threshold_context_size < sizeof(header)) {
+		return NULL;
+	}
+
+	memcpy(&header, threshold_context_data, sizeof(header));
+
+	if (header.magic != THRESHOLD_MAGIC || header.length == 0 ||
+	    threshold_context_size != sizeof(header) + header.length * sizeof(uint16_t)) {
+		return NULL;
+	}
+
+	detector = create();
+	if (detector == NULL) {
+		return NULL;
+	}
+
+	detector->threshold = acc_os_mem_alloc(header.length * sizeof(uint16_t));
+	if (detector->threshold == NULL) {
+		acc_os_mem_free(detector);
+		return NULL;
+	}
+
+	memcpy(detector->threshold, (uint8_t *)threshold_context_data + sizeof(header), header.length * sizeof(uint16_t));
+	detector->threshold_length = header.length;
+
+	return detector;
+}
+
+
+void acc_detector_distance_destroy(void *detector)
+{
+	sim_detector_t *sim_detector = detector;
+
+	if (sim_detector == NULL) {
+		return;
+	}
+
+	acc_os_mem_free(sim_detector->threshold);
+	acc_os_mem_free(sim_detector);
+}
+
+
+acc_status_t acc_detector_distance_set_sensitivity(void *detector, float sensitivity)
+{
+	sim_detector_t *sim_detector = detector;
+
+	if (sim_detector == NULL || sensitivity < 0.0f || sensitivity > 1.0f) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	sim_detector->sensitivity = sensitivity;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_set_absolute_amplitude(void *detector, bool set_absolute)
+{
+	sim_detector_t *sim_detector = detector;
+
+	if (sim_detector == NULL) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	sim_detector->absolute_amplitude = set_absolute;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_threshold_estimation_update(void *detector, float distance_start_m, float distance_end_m, uint16_t data_size, uint16_t *data)
+{
+	sim_detector_t *sim_detector = detector;
+
+	ACC_UNUSED(distance_start_m);
+	ACC_UNUSED(distance_end_m);
+
+	if (sim_detector == NULL || data == NULL || data_size == 0 || !sim_detector->estimating) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (sim_detector->threshold_length != data_size) {
+		acc_os_mem_free(sim_detector->threshold);
+		sim_detector->threshold_length	= 0;
+		sim_detector->threshold		= acc_os_mem_alloc(data_size * sizeof(uint16_t));
+		if (sim_detector->threshold == NULL) {
+			return ACC_STATUS_OUT_OF_MEMORY;
+		}
+		memset(sim_detector->threshold, 0, data_size * sizeof(uint16_t));
+		sim_detector->threshold_length = data_size;
+	}
+
+	for (uint_fast16_t index = 0; index < data_size; index++) {
+		if (data[index] > sim_detector->threshold[index]) {
+			sim_detector->threshold[index] = data[index];
+		}
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_threshold_estimation_reset(void *detector)
+{
+	sim_detector_t *sim_detector = detector;
+
+	if (sim_detector == NULL || !sim_detector->estimating) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (sim_detector->threshold != NULL) {
+		memset(sim_detector->threshold, 0, sim_detector->threshold_length * sizeof(uint16_t));
+	}
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_threshold_estimation_get_size(void *detector, size_t *threshold_data_size)
+{
+	sim_detector_t *sim_detector = detector;
+
+	if (sim_detector == NULL || threshold_data_size == NULL || sim_detector->threshold == NULL) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	*threshold_data_size = sizeof(threshold_header_t) + sim_detector->threshold_length * sizeof(uint16_t);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_threshold_estimation_get_data(void *detector, size_t threshold_data_size, uint8_t *threshold_data)
+{
+	sim_detector_t		*sim_detector = detector;
+	threshold_header_t	header = { .magic = THRESHOLD_MAGIC };
+
+	if (sim_detector == NULL || threshold_data == NULL || sim_detector->threshold == NULL ||
+	    threshold_data_size < sizeof(header) + sim_detector->threshold_length * sizeof(uint16_t)) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	header.length = sim_detector->threshold_length;
+	memcpy(threshold_data, &header, sizeof(header));
+	memcpy(threshold_data + sizeof(header), sim_detector->threshold, header.length * sizeof(uint16_t));
+
+	// The estimated threshold is used from now on
+	sim_detector->estimating = false;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_detect(void *detector, float distance_start_m, float distance_end_m, uint16_t data_size, uint16_t *data, uint16_t *reflection_count)
+{
+	sim_detector_t	*sim_detector = detector;
+	float		step_m;
+
+	if (sim_detector == NULL || data == NULL || data_size == 0 || reflection_count == NULL) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (sim_detector->estimating) {
+		return ACC_STATUS_FAILURE;
+	}
+
+	step_m				= (distance_end_m - distance_start_m) / data_size;
+	sim_detector->reflection_count	= 0;
+
+	for (uint_fast16_t index = 0; index < data_size && sim_detector->reflection_count < REFLECTION_MAX; index++) {
+		uint16_t threshold = threshold_at(sim_detector, index, data_size);
+
+		if (data[index] <= threshold ||
+		    (index > 0 && data[index] < data[index - 1]) ||
+		    (index + 1 < data_size && data[index] <= data[index + 1])) {
+			continue;
+		}
+
+		acc_detector_distance_reflection_t *reflection = &sim_detector->reflections[sim_detector->reflection_count++];
+
+		reflection->distance	= distance_start_m + index * step_m;
+		reflection->amplitude	= sim_detector->absolute_amplitude ? data[index] : data[index] - threshold;
+	}
+
+	*reflection_count = sim_detector->reflection_count;
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_detector_distance_get_reflections(void *detector, uint16_t reflections_length, acc_detector_distance_reflection_t *reflections)
+{
+	sim_detector_t *sim_detector = detector;
+
+	if (sim_detector == NULL || reflections == NULL) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	if (reflections_length > sim_detector->reflection_count) {
+		reflections_length = sim_detector->reflection_count;
+	}
+
+	memcpy(reflections, sim_detector->reflections, reflections_length * sizeof(*reflections));
+
+	return ACC_STATUS_SUCCESS;
+}
@@ -0,0 +1,203 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// The acc_device layer that libacconeer provides on the target, for host builds
+//
+// libacconeer is only delivered for the target, so "make host" links this instead. Each
+// function forwards to the function pointer a driver registered, as libacconeer does. Only
+// acc_device_gpio_wait_edge() and acc_device_spi_transfer_segments() are not here, they are
+// in libcustomer on every target.
+
+#include <pthread.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "acc_device_gpio.h"
+#include "acc_device_i2c.h"
+#include "acc_device_memory.h"
+#include "acc_device_spi.h"
+#include "acc_types.h"
+
+
+acc_status_t	(*acc_device_gpio_init_func)(void) = NULL;
+acc_status_t	(*acc_device_gpio_set_initial_pull_func)(uint_fast8_t pin, uint_fast8_t level) = NULL;
+acc_status_t	(*acc_device_gpio_input_func)(uint_fast8_t pin) = NULL;
+acc_status_t	(*acc_device_gpio_read_func)(uint_fast8_t pin, uint_fast8_t *level) = NULL;
+acc_status_t	(*acc_device_gpio_write_func)(uint_fast8_t pin, uint_fast8_t level) = NULL;
+
+acc_status_t	(*acc_device_i2c_init_func)(void) = NULL;
+acc_status_t	(*acc_device_i2c_write_to_address_8_func)(uint8_t device_id, uint8_t address, const uint8_t *buffer, size_t buffer_size) = NULL;
+acc_status_t	(*acc_device_i2c_write_to_address_16_func)(uint8_t device_id, uint16_t address, const uint8_t *buffer, size_t buffer_size) = NULL;
+acc_status_t	(*acc_device_i2c_read_from_address_8_func)(uint8_t device_id, uint8_t address, uint8_t *buffer, size_t buffer_size) = NULL;
+acc_status_t	(*acc_device_i2c_read_from_address_16_func)(uint8_t device_id, uint16_t address, uint8_t *buffer, size_t buffer_size) = NULL;
+acc_status_t	(*acc_device_i2c_read_func)(uint8_t device_id, uint8_t *buffer, size_t buffer_size) = NULL;
+
+acc_status_t	(*acc_device_memory_init_func)(void) = NULL;
+acc_status_t	(*acc_device_memory_get_size_func)(size_t *memory_size) = NULL;
+acc_status_t	(*acc_device_memory_write_func)(uint32_t address, const void *buffer, size_t size) = NULL;
+acc_status_t	(*acc_device_memory_read_func)(uint32_t address, void *buffer, size_t size) = NULL;
+
+acc_status_t	(*acc_device_spi_init_func)(void) = NULL;
+size_t		(*acc_device_spi_get_max_transfer_size_func)(void) = NULL;
+acc_status_t	(*acc_device_spi_transfer_func)(uint_fast8_t bus, uint_fast8_t device, uint32_t speed, uint8_t *buffer, size_t buffer_size) = NULL;
+
+
+/**
+ * @brief Reservation of each SPI bus, see acc_device_spi_lock()
+ */
+static pthread_mutex_t spi_bus_mutex[ACC_DEVICE_SPI_BUS_MAX] = {
+	PTHREAD_MUTEX_INITIALIZER,
+	PTHREAD_MUTEX_INITIALIZER
+};
+
+
+acc_status_t acc_device_gpio_init(void)
+{
+	return acc_device_gpio_init_func ? acc_device_gpio_init_func() : ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_device_gpio_set_initial_pull(uint_fast8_t pin, uint_fast8_t level)
+{
+	return acc_device_gpio_set_initial_pull_func ? acc_device_gpio_set_initial_pull_func(pin, level) : ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_device_gpio_input(uint_fast8_t pin)
+{
+	return acc_device_gpio_input_func ? acc_device_gpio_input_func(pin) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_gpio_read(uint_fast8_t pin, uint_fast8_t *level)
+{
+	return acc_device_gpio_read_func ? acc_device_gpio_read_func(pin, level) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_gpio_write(uint_fast8_t pin, uint_fast8_t level)
+{
+	return acc_device_gpio_write_func ? acc_device_gpio_write_func(pin, level) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_i2c_init(void)
+{
+	return acc_device_i2c_init_func ? acc_device_i2c_init_func() : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_i2c_write_to_address_8(uint8_t device_id, uint8_t address, const uint8_t *buffer, size_t buffer_size)
+{
+	if (acc_device_i2c_write_to_address_8_func == NULL) {
+		return ACC_STATUS_UNSUPPORTED;
+	}
+
+	return acc_device_i2c_write_to_address_8_func(device_id, address, buffer, buffer_size);
+}
+
+
+acc_status_t acc_device_i2c_write_to_address_16(uint8_t device_id, uint16_t address, const uint8_t *buffer, size_t buffer_size)
+{
+	if (acc_device_i2c_write_to_address_16_func == NULL) {
+		return ACC_STATUS_UNSUPPORTED;
+	}
+
+	return acc_device_i2c_write_to_address_16_func(device_id, address, buffer, buffer_size);
+}
+
+
+acc_status_t acc_device_i2c_read_from_address_8(uint8_t device_id, uint8_t address, uint8_t *buffer, size_t buffer_size)
+{
+	if (acc_device_i2c_read_from_address_8_func == NULL) {
+		return ACC_STATUS_UNSUPPORTED;
+	}
+
+	return acc_device_i2c_read_from_address_8_func(device_id, address, buffer, buffer_size);
+}
+
+
+acc_status_t acc_device_i2c_read_from_address_16(uint8_t device_id, uint16_t address, uint8_t *buffer, size_t buffer_size)
+{
+	if (acc_device_i2c_read_from_address_16_func == NULL) {
+		return ACC_STATUS_UNSUPPORTED;
+	}
+
+	return acc_device_i2c_read_from_address_16_func(device_id, address, buffer, buffer_size);
+}
+
+
+acc_status_t acc_device_i2c_read(uint8_t device_id, uint8_t *buffer, size_t buffer_size)
+{
+	return acc_device_i2c_read_func ? acc_device_i2c_read_func(device_id, buffer, buffer_size) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_memory_init(void)
+{
+	return acc_device_memory_init_func ? acc_device_memory_init_func() : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_memory_get_size(size_t *memory_size)
+{
+	return acc_device_memory_get_size_func ? acc_device_memory_get_size_func(memory_size) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_memory_write(uint32_t address, const void *buffer, size_t size)
+{
+	return acc_device_memory_write_func ? acc_device_memory_write_func(address, buffer, size) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_memory_read(uint32_t address, void *buffer, size_t size)
+{
+	return acc_device_memory_read_func ? acc_device_memory_read_func(address, buffer, size) : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_spi_init(void)
+{
+	return acc_device_spi_init_func ? acc_device_spi_init_func() : ACC_STATUS_UNSUPPORTED;
+}
+
+
+acc_status_t acc_device_spi_lock(uint_fast8_t bus)
+{
+	if (bus >= ACC_DEVICE_SPI_BUS_MAX) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	pthread_mutex_lock(&spi_bus_mutex[bus]);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+acc_status_t acc_device_spi_unlock(uint_fast8_t bus)
+{
+	if (bus >= ACC_DEVICE_SPI_BUS_MAX) {
+		return ACC_STATUS_BAD_PARAM;
+	}
+
+	pthread_mutex_unlock(&spi_bus_mutex[bus]);
+
+	return ACC_STATUS_SUCCESS;
+}
+
+
+size_t acc_device_spi_get_max_transfer_size(void)
+{
+	return acc_device_spi_get_max_transfer_size_func ? acc_device_spi_get_max_transfer_size_func() : 0;
+}
+
+
+acc_status_t acc_device_spi_transfer(uint_fast8_t bus, uint_fast8_t device, uint32_t speed, uint8_t *buffer, size_t buffer_size)
+{
+	if (acc_device_spi_transfer_func == NULL) {
+		return ACC_STATUS_UNSUPPORTED;
+	}
+
+	return acc_device_spi_transfer_func(bus, device, speed, buffer, buffer_size);
+}
@@ -0,0 +1,128 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// The logging that libacconeer provides on the target, for host builds, see acc_sim_device.c
+
+// needed for flockfile
+#define _POSIX_C_SOURCE 199506L
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "acc_log.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+/**
+ * @brief Number of modules that can have a level of their own
+ */
+#define MODULE_LEVEL_MAX	16
+
+
+/**
+ * @brief Level of a module set with acc_log_set_level()
+ */
+typedef struct {
+	char		*module;
+	acc_log_level_t	level;
+} module_level_t;
+
+
+static acc_log_level_t		log_level = ACC_LOG_LEVEL_INFO;
+static module_level_t		module_levels[MODULE_LEVEL_MAX];
+static uint_fast8_t		module_level_count;
+static pthread_mutex_t		log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static char			*status_names[ACC_STATUS_MAX] = {
+	"SUCCESS",
+	"BAD_PARAM",
+	"INVALID_DRIVER",
+	"INVALID_NODE",
+	"INVALID_SENSOR",
+	"INVALID_REQUEST_ID",
+	"FAILURE",
+	"NO_RESPONSE",
+	"OUT_OF_MEMORY",
+	"TIMEOUT",
+	"UNSUPPORTED"
+};
+
+static const char		level_letters[ACC_LOG_LEVEL_MAX] = { 'F', 'E', 'W', 'I', 'V', 'D' };
+
+
+char *acc_log_status_name(acc_status_t status)
+{
+	if (status >= ACC_STATUS_MAX) {
+		return "UNKNOWN";
+	}
+
+	return status_names[status];
+}
+
+
+void acc_log_set_level(acc_log_level_t level, char *module)
+{
+	pthread_mutex_lock(&log_mutex);
+
+	if (module == NULL) {
+		log_level		= level;
+		module_level_count	= 0;
+		pthread_mutex_unlock(&log_mutex);
+		return;
+	}
+
+	for (uint_fast8_t index = 0; index < module_level_count; index++) {
+		if (strcmp(module_levels[index].module, module) == 0) {
+			module_levels[index].level = level;
+			pthread_mutex_unlock(&log_mutex);
+			return;
+		}
+	}
+
+	if (module_level_count < MODULE_LEVEL_MAX) {
+		module_levels[module_level_count].module	= module;
+		module_levels[module_level_count].level		= level;
+		module_level_count++;
+	}
+
+	pthread_mutex_unlock(&log_mutex);
+}
+
+
+void acc_log(acc_log_level_t level, char *module, char *format, ...)
+{
+	acc_log_level_t	enabled_level;
+	struct tm	time_tm;
+	uint32_t	time_usec;
+	va_list		ap;
+
+	pthread_mutex_lock(&log_mutex);
+	enabled_level = log_level;
+	for (uint_fast8_t index = 0; index < module_level_count; index++) {
+		if (strcmp(module_levels[index].module, module) == 0) {
+			enabled_level = module_levels[index].level;
+			break;
+		}
+	}
+	pthread_mutex_unlock(&log_mutex);
+
+	if (level > enabled_level) {
+		return;
+	}
+
+	acc_os_localtime(&time_tm, &time_usec);
+
+	flockfile(stdout);
+	printf("%02d:%02d:%02d.%03u (%c) (%s) ", time_tm.tm_hour, time_tm.tm_min, time_tm.tm_sec,
+	       (unsigned int)(time_usec / 1000), level < ACC_LOG_LEVEL_MAX ? level_letters[level] : '?', module);
+	va_start(ap, format);
+	vprintf(format, ap);
+	va_end(ap);
+	putchar('\n');
+	funlockfile(stdout);
+}
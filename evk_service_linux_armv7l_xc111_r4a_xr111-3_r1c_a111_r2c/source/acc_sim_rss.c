@@ -0,0 +1,58 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Activation of the radar services for host builds, see acc_sim_service_envelope.h
+
+#include <stdbool.h>
+
+#include "acc_board.h"
+#include "acc_log.h"
+#include "acc_os.h"
+#include "acc_rss.h"
+#include "acc_sim_service_envelope.h"
+
+
+/**
+ * @brief The module name
+ *
+ * Must exist if acc_log.h is used.
+ */
+#define MODULE		"sim_rss"
+
+
+bool acc_rss_activate(void)
+{
+	acc_sim_service_envelope_scene_t	scene;
+	acc_status_t				status;
+
+	acc_os_init();
+
+	status = acc_board_init();
+	if (status != ACC_STATUS_SUCCESS) {
+		ACC_LOG_ERROR("acc_board_init failed with %s", acc_log_status_name(status));
+		return false;
+	}
+
+	acc_sim_service_envelope_scene_default(&scene);
+	if (!acc_sim_service_envelope_scene_from_environment(&scene)) {
+		ACC_LOG_ERROR("Could not parse the ACC_SIM_* environment variables");
+		return false;
+	}
+	acc_sim_service_envelope_scene_set(&scene);
+
+	ACC_LOG_INFO("Simulated sensors, %u targets, noise %u, %s", (unsigned int)scene.target_count,
+	             (unsigned int)scene.noise_amplitude, scene.unthrottled ? "unthrottled" : "streaming");
+
+	return true;
+}
+
+
+void acc_rss_deactivate(void)
+{
+}
+
+
+const char *acc_rss_version(void)
+{
+	return "sim";
+}
@@ -0,0 +1,722 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// The envelope service of libacc_service.a and libacc_envelope.a for host builds, producing
+// synthetic sweeps, see acc_sim_service_envelope.h
+
+// needed for clock_nanosleep
+#define _POSIX_C_SOURCE 200112L
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "acc_log.h"
+#include "acc_os.h"
+#include "acc_service.h"
+#include "acc_service_envelope.h"
+#include "acc_sim_service_envelope.h"
+#include "acc_sweep_configuration.h"
+
+
+/**
+ * @brief The module name
+ *
+ * Must exist if acc_log.h is used.
+ */
+#define MODULE		"sim_service_envelope"
+
+
+/**
+ * @brief Distance between envelope points, as with the sensor
+ */
+#define STEP_M			0.000484f
+
+/**
+ * @brief Longest range that can be swept
+ */
+#define LENGTH_MAX_M		7.0f
+
+/**
+ * @brief Width (standard deviation) of a reflection for each profile
+ */
+/**@{*/
+#define PULSE_SIGMA_LONG_M	0.05f
+#define PULSE_SIGMA_SHORT_M	0.025f
+/**@}*/
+
+/**
+ * @brief A reflection is drawn out to this many standard deviations from its peak
+ */
+#define PULSE_SIGMAS		4
+
+/**
+ * @brief Sweep configuration before anything is set
+ */
+/**@{*/
+#define DEFAULT_SENSOR_ID	1
+#define DEFAULT_START_M		0.2f
+#define DEFAULT_LENGTH_M	0.5f
+#define DEFAULT_FREQUENCY_HZ	100.0f
+/**@}*/
+
+/**
+ * @brief Sensor ids that can have a service, 1 to SENSOR_ID_MAX
+ */
+#define SENSOR_ID_MAX		31
+
+
+/**
+ * @brief Sweep configuration, part of every service configuration
+ */
+struct acc_sweep_configuration {
+	acc_sensor_id_t	sensor_id;
+	float		start_m;
+	float		length_m;
+	float		frequency_hz;
+};
+
+
+/**
+ * @brief Envelope service configuration
+ */
+struct acc_service_configuration {
+	struct acc_sweep_configuration	sweep;
+	acc_service_envelope_profile_t	profile;
+	acc_envelope_callback_t		*callback;
+	void				*client_reference;
+};
+
+
+/**
+ * @brief Envelope service
+ *
+ * The generator thread of callback mode and acc_service_deactivate() share mutex, cond and
+ * stop, everything else is only changed when the service is not active.
+ */
+struct acc_service_handle {
+	acc_sim_service_envelope_scene_t	scene;
+	acc_sensor_id_t				sensor_id;
+	acc_envelope_callback_t			*callback;
+	void					*client_reference;
+	acc_service_envelope_metadata_t		metadata;
+
+	uint64_t				period_ns;
+	float					time_base_hz;
+
+	float					*pulse;
+	uint16_t				pulse_half_width;
+	uint32_t				*accumulator;
+	uint16_t				*callback_data;
+
+	bool					active;
+	uint32_t				sequence_number;
+	uint64_t				start_ns;
+
+	pthread_mutex_t				mutex;
+	pthread_cond_t				cond;
+	bool					stop;
+	acc_os_thread_handle_t			thread;
+};
+
+
+static pthread_mutex_t			sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static acc_sim_service_envelope_scene_t	sim_scene;
+static bool				sim_scene_set;
+static uint32_t				sensors_in_use;
+
+static char				*status_names[ACC_SERVICE_STATUS_MAX] = {
+	"OK",
+	"FAILURE_UNSPECIFIED",
+	"INVALID_CONFIGURATION",
+	"INVALID_HANDLE",
+	"INVALID_PARAMETER",
+	"INVALID_STATE",
+	"OUT_OF_MEMORY",
+	"TIMEOUT"
+};
+
+
+static struct timespec to_timespec(uint64_t time_ns)
+{
+	struct timespec time = { .tv_sec = time_ns / 1000000000, .tv_nsec = time_ns % 1000000000 };
+
+	return time;
+}
+
+
+/**
+ * @brief Noise state of a sweep, the same for the same seed, sensor and sweep
+ */
+static uint32_t noise_seed(uint32_t seed, acc_sensor_id_t sensor_id, uint32_t sequence_number)
+{
+	uint32_t state = seed ^ (sensor_id * 0x9e3779b9) ^ (sequence_number * 0x85ebca6b);
+
+	state ^= state >> 16;
+	state *= 0x7feb352d;
+	state ^= state >> 15;
+	state *= 0x846ca68b;
+	state ^= state >> 16;
+
+	return state != 0 ? state : 1;
+}
+
+
+static uint32_t noise_next(uint32_t *state)
+{
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+
+/**
+ * @brief Distance of a target at a time, turning at the ends of the range
+ */
+static float target_distance(const acc_sim_service_envelope_target_t *target, float start_m, float length_m, float time_s)
+{
+	if (target->speed_mps == 0.0f || length_m <= 0.0f) {
+		return target->distance_m;
+	}
+
+	float position = fmodf(target->distance_m - start_m + target->speed_mps * time_s, 2 * length_m);
+
+	if (position < 0.0f) {
+		position += 2 * length_m;
+	}
+	if (position > length_m) {
+		position = 2 * length_m - position;
+	}
+
+	return start_m + position;
+}
+
+
+/**
+ * @brief Compute sweep sequence_number of a service
+ */
+static void generate_sweep(struct acc_service_handle *handle, uint32_t sequence_number, uint16_t *envelope_data)
+{
+	const acc_sim_service_envelope_scene_t	*scene = &handle->scene;
+	uint16_t				length = handle->metadata.data_length;
+	uint32_t				*accumulator = handle->accumulator;
+	uint32_t				noise = noise_seed(scene->seed, handle->sensor_id, sequence_number);
+	float					time_s = sequence_number / handle->time_base_hz;
+
+	for (uint_fast16_t index = 0; index < length; index++) {
+		accumulator[index] = scene->background;
+	}
+
+	if (scene->noise_amplitude > 0) {
+		for (uint_fast16_t index = 0; index < length; index++) {
+			accumulator[index] += noise_next(&noise) % (scene->noise_amplitude + 1u);
+		}
+	}
+
+	for (uint_fast8_t target = 0; target < scene->target_count; target++) {
+		float		distance_m = target_distance(&scene->targets[target], handle->metadata.actual_start_m,
+		                                             handle->metadata.actual_length_m, time_s);
+		int_fast32_t	peak = lroundf((distance_m - handle->metadata.actual_start_m) / STEP_M);
+		int_fast32_t	first = peak - handle->pulse_half_width;
+		int_fast32_t	last = peak + handle->pulse_half_width;
+
+		first	= (first < 0) ? 0 : first;
+		last	= (last >= length) ? length - 1 : last;
+
+		for (int_fast32_t index = first; index <= last; index++) {
+			accumulator[index] += scene->targets[target].amplitude * handle->pulse[index - peak + handle->pulse_half_width];
+		}
+	}
+
+	for (uint_fast16_t index = 0; index < length; index++) {
+		envelope_data[index] = (accumulator[index] > UINT16_MAX) ? UINT16_MAX : accumulator[index];
+	}
+}
+
+
+/**
+ * @brief Sweep to deliver next, skipping the sweeps the application was too late for
+ */
+static uint32_t next_sequence_number(const struct acc_service_handle *handle, uint64_t now_ns)
+{
+	if (handle->period_ns == 0 || now_ns < handle->start_ns) {
+		return handle->sequence_number;
+	}
+
+	uint64_t latest = (now_ns - handle->start_ns) / handle->period_ns;
+
+	return (latest > handle->sequence_number) ? (uint32_t)latest : handle->sequence_number;
+}
+
+
+static void generator_thread(void *param)
+{
+	struct acc_service_handle	*handle = param;
+	acc_envelope_metadata_t		metadata;
+
+	pthread_mutex_lock(&handle->mutex);
+
+	while (!handle->stop) {
+		uint32_t	sequence_number = next_sequence_number(handle, acc_os_monotonic_ns());
+		struct timespec	deadline = to_timespec(handle->start_ns + sequence_number * handle->period_ns);
+
+		if (handle->period_ns > 0 &&
+		    pthread_cond_timedwait(&handle->cond, &handle->mutex, &deadline) != ETIMEDOUT) {
+			continue;
+		}
+
+		pthread_mutex_unlock(&handle->mutex);
+
+		generate_sweep(handle, sequence_number, handle->callback_data);
+		metadata.sequence_number = sequence_number;
+		handle->callback(handle, handle->callback_data, &metadata, handle->client_reference);
+
+		pthread_mutex_lock(&handle->mutex);
+		handle->sequence_number = sequence_number + 1;
+	}
+
+	pthread_mutex_unlock(&handle->mutex);
+}
+
+
+void acc_sim_service_envelope_scene_default(acc_sim_service_envelope_scene_t *scene)
+{
+	memset(scene, 0, sizeof(*scene));
+
+	scene->targets[0].distance_m	= 0.35f;
+	scene->targets[0].amplitude	= 2000;
+	scene->targets[1].distance_m	= 0.6f;
+	scene->targets[1].amplitude	= 800;
+	scene->target_count		= 2;
+	scene->background		= 100;
+	scene->noise_amplitude		= 100;
+	scene->seed			= 1;
+}
+
+
+bool acc_sim_service_envelope_scene_from_environment(acc_sim_service_envelope_scene_t *scene)
+{
+	acc_sim_service_envelope_scene_t	result = *scene;
+	const char				*value;
+	char					*end;
+
+	if ((value = getenv("ACC_SIM_TARGETS")) != NULL) {
+		result.target_count = 0;
+
+		while (*value != '\0') {
+			acc_sim_service_envelope_target_t *target = &result.targets[result.target_count];
+
+			if (result.target_count == ACC_SIM_SERVICE_ENVELOPE_TARGET_MAX) {
+				return false;
+			}
+
+			target->distance_m = strtof(value, &end);
+			if (end == value || *end != ':') {
+				return false;
+			}
+			value = end + 1;
+
+			target->amplitude = strtoul(value, &end, 10);
+			if (end == value) {
+				return false;
+			}
+			value = end;
+
+			target->speed_mps = 0.0f;
+			if (*value == ':') {
+				target->speed_mps = strtof(value + 1, &end);
+				if (end == value + 1) {
+					return false;
+				}
+				value = end;
+			}
+
+			result.target_count++;
+
+			if (*value == ',') {
+				value++;
+			} else if (*value != '\0') {
+				return false;
+			}
+		}
+	}
+
+	if ((value = getenv("ACC_SIM_NOISE")) != NULL) {
+		result.noise_amplitude = strtoul(value, &end, 10);
+		if (end == value || *end != '\0') {
+			return false;
+		}
+	}
+
+	if ((value = getenv("ACC_SIM_SEED")) != NULL) {
+		result.seed = strtoul(value, &end, 0);
+		if (end == value || *end != '\0') {
+			return false;
+		}
+	}
+
+	if ((value = getenv("ACC_SIM_SWEEP_RATE")) != NULL) {
+		result.sweep_rate_hz = strtof(value, &end);
+		if (end == value || *end != '\0' || result.sweep_rate_hz < 0.0f) {
+			return false;
+		}
+		result.unthrottled = (result.sweep_rate_hz == 0.0f);
+	}
+
+	*scene = result;
+
+	return true;
+}
+
+
+void acc_sim_service_envelope_scene_set(const acc_sim_service_envelope_scene_t *scene)
+{
+	pthread_mutex_lock(&sim_mutex);
+	sim_scene	= *scene;
+	sim_scene_set	= true;
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+
+char *acc_service_status_name_get(acc_service_status_t status)
+{
+	if (status >= ACC_SERVICE_STATUS_MAX) {
+		return "UNKNOWN";
+	}
+
+	return status_names[status];
+}
+
+
+acc_service_configuration_t acc_service_envelope_configuration_create(void)
+{
+	struct acc_service_configuration *configuration = acc_os_mem_alloc(sizeof(*configuration));
+
+	if (configuration == NULL) {
+		return NULL;
+	}
+
+	memset(configuration, 0, sizeof(*configuration));
+	configuration->sweep.sensor_id		= DEFAULT_SENSOR_ID;
+	configuration->sweep.start_m		= DEFAULT_START_M;
+	configuration->sweep.length_m		= DEFAULT_LENGTH_M;
+	configuration->sweep.frequency_hz	= DEFAULT_FREQUENCY_HZ;
+	configuration->profile			= ACC_SERVICE_ENVELOPE_PROFILE_DEFAULT;
+
+	return configuration;
+}
+
+
+void acc_service_envelope_configuration_destroy(acc_service_configuration_t *service_configuration)
+{
+	if (service_configuration == NULL) {
+		return;
+	}
+
+	acc_os_mem_free(*service_configuration);
+	*service_configuration = NULL;
+}
+
+
+void acc_service_envelope_profile_set(acc_service_configuration_t service_configuration, acc_service_envelope_profile_t profile)
+{
+	if (service_configuration != NULL && profile <= ACC_SERVICE_ENVELOPE_PROFILE_MAX) {
+		service_configuration->profile = profile;
+	}
+}
+
+
+void acc_service_envelope_envelope_callback_set(acc_service_configuration_t service_configuration, acc_envelope_callback_t *envelope_callback, void *client_reference)
+{
+	if (service_configuration != NULL) {
+		service_configuration->callback		= envelope_callback;
+		service_configuration->client_reference	= client_reference;
+	}
+}
+
+
+acc_sweep_configuration_t acc_sweep_configuration_get(acc_service_configuration_t service_configuration)
+{
+	return (service_configuration != NULL) ? &service_configuration->sweep : NULL;
+}
+
+
+acc_sensor_id_t acc_sweep_configuration_sensor_get(acc_sweep_configuration_t configuration)
+{
+	return configuration->sensor_id;
+}
+
+
+void acc_sweep_configuration_sensor_set(acc_sweep_configuration_t configuration, acc_sensor_id_t sensor_id)
+{
+	configuration->sensor_id = sensor_id;
+}
+
+
+float acc_sweep_configuration_requested_start_get(acc_sweep_configuration_t configuration)
+{
+	return configuration->start_m;
+}
+
+
+void acc_sweep_configuration_requested_start_set(acc_sweep_configuration_t configuration, float start_m)
+{
+	configuration->start_m = start_m;
+}
+
+
+float acc_sweep_configuration_requested_length_get(acc_sweep_configuration_t configuration)
+{
+	return configuration->length_m;
+}
+
+
+void acc_sweep_configuration_requested_length_set(acc_sweep_configuration_t configuration, float length_m)
+{
+	configuration->length_m = length_m;
+}
+
+
+void acc_sweep_configuration_requested_range_set(acc_sweep_configuration_t configuration, float start_m, float length_m)
+{
+	configuration->start_m	= start_m;
+	configuration->length_m	= length_m;
+}
+
+
+void acc_sweep_configuration_repetition_mode_streaming_set(acc_sweep_configuration_t configuration, float sensor_sweep_frequency_hz)
+{
+	configuration->frequency_hz = sensor_sweep_frequency_hz;
+}
+
+
+acc_service_handle_t acc_service_create(acc_service_configuration_t configuration)
+{
+	struct acc_service_handle	*handle;
+	uint_fast32_t			first_point;
+	uint_fast32_t			data_length;
+	float				sigma_m;
+	float				frequency_hz;
+
+	if (configuration == NULL) {
+		return NULL;
+	}
+
+	first_point	= lroundf(configuration->sweep.start_m / STEP_M);
+	data_length	= lroundf(configuration->sweep.length_m / STEP_M);
+
+	if (configuration->sweep.sensor_id < 1 || configuration->sweep.sensor_id > SENSOR_ID_MAX ||
+	    configuration->sweep.start_m < 0.0f || data_length == 0 || configuration->sweep.length_m > LENGTH_MAX_M ||
+	    configuration->sweep.frequency_hz < 0.0f) {
+		ACC_LOG_ERROR("Invalid configuration, sensor %u range %.3f m to %.3f m at %.1f Hz",
+		              (unsigned int)configuration->sweep.sensor_id, configuration->sweep.start_m,
+		              configuration->sweep.start_m + configuration->sweep.length_m, configuration->sweep.frequency_hz);
+		return NULL;
+	}
+
+	pthread_mutex_lock(&sim_mutex);
+
+	if (sensors_in_use & (1u << configuration->sweep.sensor_id)) {
+		pthread_mutex_unlock(&sim_mutex);
+		ACC_LOG_ERROR("Sensor %u already has a service", (unsigned int)configuration->sweep.sensor_id);
+		return NULL;
+	}
+
+	handle = acc_os_mem_alloc(sizeof(*handle));
+	if (handle == NULL) {
+		pthread_mutex_unlock(&sim_mutex);
+		return NULL;
+	}
+
+	memset(handle, 0, sizeof(*handle));
+
+	if (!sim_scene_set) {
+		acc_sim_service_envelope_scene_default(&sim_scene);
+		sim_scene_set = true;
+	}
+	handle->scene = sim_scene;
+
+	sigma_m				= (configuration->profile == ACC_SERVICE_ENVELOPE_PROFILE_LONG_RANGE) ?
+	                                  PULSE_SIGMA_LONG_M : PULSE_SIGMA_SHORT_M;
+	handle->pulse_half_width	= lroundf(PULSE_SIGMAS * sigma_m / STEP_M);
+	handle->pulse			= acc_os_mem_alloc((2 * handle->pulse_half_width + 1) * sizeof(*handle->pulse));
+	handle->accumulator		= acc_os_mem_alloc(data_length * sizeof(*handle->accumulator));
+	handle->callback_data		= acc_os_mem_alloc(data_length * sizeof(*handle->callback_data));
+
+	if (handle->pulse == NULL || handle->accumulator == NULL || handle->callback_data == NULL) {
+		pthread_mutex_unlock(&sim_mutex);
+		acc_os_mem_free(handle->pulse);
+		acc_os_mem_free(handle->accumulator);
+		acc_os_mem_free(handle->callback_data);
+		acc_os_mem_free(handle);
+		return NULL;
+	}
+
+	for (int_fast32_t offset = -handle->pulse_half_width; offset <= handle->pulse_half_width; offset++) {
+		float distance_m = offset * STEP_M;
+
+		handle->pulse[offset + handle->pulse_half_width] = expf(-distance_m * distance_m / (2 * sigma_m * sigma_m));
+	}
+
+	handle->sensor_id				= configuration->sweep.sensor_id;
+	handle->callback				= configuration->callback;
+	handle->client_reference			= configuration->client_reference;
+	handle->metadata.free_space_absolute_offset	= 0.0f;
+	handle->metadata.actual_start_m			= first_point * STEP_M;
+	handle->metadata.actual_length_m		= data_length * STEP_M;
+	handle->metadata.data_length			= data_length;
+
+	frequency_hz = (handle->scene.sweep_rate_hz > 0.0f) ? handle->scene.sweep_rate_hz : configuration->sweep.frequency_hz;
+	if (frequency_hz <= 0.0f) {
+		frequency_hz = DEFAULT_FREQUENCY_HZ;
+	}
+	handle->period_ns	= handle->scene.unthrottled ? 0 : (uint64_t)(1e9f / frequency_hz);
+	handle->time_base_hz	= frequency_hz;
+
+	pthread_mutex_init(&handle->mutex, NULL);
+
+	sensors_in_use |= 1u << handle->sensor_id;
+
+	pthread_mutex_unlock(&sim_mutex);
+
+	return handle;
+}
+
+
+acc_service_status_t acc_service_activate(acc_service_handle_t service_handle)
+{
+	pthread_condattr_t attr;
+
+	if (service_handle == NULL) {
+		return ACC_SERVICE_STATUS_INVALID_HANDLE;
+	}
+
+	if (service_handle->active) {
+		return ACC_SERVICE_STATUS_INVALID_STATE;
+	}
+
+	service_handle->sequence_number	= 0;
+	service_handle->start_ns	= acc_os_monotonic_ns() + service_handle->period_ns;
+	service_handle->stop		= false;
+
+	if (service_handle->callback != NULL) {
+		pthread_condattr_init(&attr);
+		pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+		pthread_cond_init(&service_handle->cond, &attr);
+		pthread_condattr_destroy(&attr);
+
+		if (acc_os_thread_create(generator_thread, service_handle, &service_handle->thread) != ACC_STATUS_SUCCESS) {
+			pthread_cond_destroy(&service_handle->cond);
+			return ACC_SERVICE_STATUS_FAILURE_UNSPECIFIED;
+		}
+	}
+
+	service_handle->active = true;
+
+	return ACC_SERVICE_STATUS_OK;
+}
+
+
+acc_service_status_t acc_service_deactivate(acc_service_handle_t service_handle)
+{
+	if (service_handle == NULL) {
+		return ACC_SERVICE_STATUS_INVALID_HANDLE;
+	}
+
+	if (!service_handle->active) {
+		return ACC_SERVICE_STATUS_INVALID_STATE;
+	}
+
+	if (service_handle->callback != NULL) {
+		pthread_mutex_lock(&service_handle->mutex);
+		service_handle->stop = true;
+		pthread_cond_signal(&service_handle->cond);
+		pthread_mutex_unlock(&service_handle->mutex);
+
+		acc_os_thread_cleanup(service_handle->thread);
+		pthread_cond_destroy(&service_handle->cond);
+	}
+
+	service_handle->active = false;
+
+	return ACC_SERVICE_STATUS_OK;
+}
+
+
+void acc_service_destroy(acc_service_handle_t *service_handle)
+{
+	struct acc_service_handle *handle;
+
+	if (service_handle == NULL || *service_handle == NULL) {
+		return;
+	}
+
+	handle = *service_handle;
+
+	if (handle->active) {
+		acc_service_deactivate(handle);
+	}
+
+	pthread_mutex_lock(&sim_mutex);
+	sensors_in_use &= ~(1u << handle->sensor_id);
+	pthread_mutex_unlock(&sim_mutex);
+
+	pthread_mutex_destroy(&handle->mutex);
+
+	acc_os_mem_free(handle->pulse);
+	acc_os_mem_free(handle->accumulator);
+	acc_os_mem_free(handle->callback_data);
+	acc_os_mem_free(handle);
+
+	*service_handle = NULL;
+}
+
+
+void acc_service_envelope_get_metadata(acc_service_handle_t handle, acc_service_envelope_metadata_t *metadata)
+{
+	if (handle == NULL) {
+		memset(metadata, 0, sizeof(*metadata));
+		return;
+	}
+
+	*metadata = handle->metadata;
+}
+
+
+acc_service_status_t acc_service_envelope_get_next(acc_service_handle_t handle, uint16_t *envelope_data, uint16_t envelope_data_length)
+{
+	uint32_t sequence_number;
+
+	if (handle == NULL) {
+		return ACC_SERVICE_STATUS_INVALID_HANDLE;
+	}
+
+	if (!handle->active || handle->callback != NULL) {
+		return ACC_SERVICE_STATUS_INVALID_STATE;
+	}
+
+	if (envelope_data == NULL || envelope_data_length < handle->metadata.data_length) {
+		return ACC_SERVICE_STATUS_INVALID_PARAMETER;
+	}
+
+	sequence_number = next_sequence_number(handle, acc_os_monotonic_ns());
+
+	if (handle->period_ns > 0) {
+		struct timespec deadline = to_timespec(handle->start_ns + sequence_number * handle->period_ns);
+
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &deadline, NULL) == EINTR) {
+		}
+	}
+
+	generate_sweep(handle, sequence_number, envelope_data);
+	handle->sequence_number = sequence_number + 1;
+
+	return ACC_SERVICE_STATUS_OK;
+}
@@ -22,11 +22,18 @@ static void envelope_callback(const acc_service_handle_t service_handle, const u
 static void reconfigure_sweeps(acc_service_configuration_t envelope_configuration);
 
 
+/**
+ * @brief Microseconds to wait for the callbacks of all sweeps
+ */
+#define CALLBACK_TIMEOUT_US 2000000
+
+
 typedef struct
 {
 	struct acc_service_handle  *handle;
 	uint16_t                   data_length;
 	uint_fast8_t               sweep_count;
+	acc_os_semaphore_t         sweeps_done;
 } envelope_callback_control_t;
 
 
@@ -163,12 +170,14 @@ acc_service_status_t execute_envelope_with_callback(acc_service_configuration_t
 	callback_control.handle = handle;
 	callback_control.sweep_count = 2;
 	callback_control.data_length = envelope_metadata.data_length;
+	acc_os_semaphore_init(&callback_control.sweeps_done, 0);
 
 	acc_service_status_t service_status = acc_service_activate(handle);
 
 	if (service_status == ACC_SERVICE_STATUS_OK) {
-		while (callback_control.sweep_count > 0) {
-			acc_os_sleep_us(200);
+		// Posted by the callback of the last sweep, so there is nothing to poll
+		if (!acc_os_semaphore_wait(&callback_control.sweeps_done, CALLBACK_TIMEOUT_US)) {
+			printf("\nEnvelope callbacks timed out");
 		}
 
 		service_status = acc_service_deactivate(handle);
@@ -203,6 +212,10 @@ void envelope_callback(const acc_service_handle_t service_handle, const uint16_t
 			printf("\n");
 
 			callback_control->sweep_count--;
+
+			if (callback_control->sweep_count == 0) {
+				acc_os_semaphore_post(&callback_control->sweeps_done);
+			}
 		}
 	}
 }
@@ -0,0 +1,174 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost of the board operations around a sweep on the simulated board: board init, selecting
+// a sensor and reading a sweep from it, and waking up on the sensor interrupt
+//
+// Built for the build host by "make host" as out_host/peh_bench_board. Everything below the
+// acc_board API runs the Pi drivers against their in-memory devices, see
+// acc_board_sim_xc111_r4a_xr111-3_r1c.c.
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <semaphore.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acc_board.h"
+#include "acc_board_sim.h"
+#include "acc_device_spi.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+#define DEFAULT_READ_COUNT	10000
+#define DEFAULT_WAKE_COUNT	1000
+#define SWEEP_SIZE		(16 * 1024)
+#define CHUNK_SIZE		4096
+#define RAISE_DELAY_US		200
+#define SENSOR			1
+
+
+/**
+ * @brief Raises the sensor interrupt for the main thread to wake up on
+ */
+typedef struct {
+	sem_t			go;
+	uint32_t		round_count;
+	volatile uint64_t	raise_ns;
+} raiser_t;
+
+
+static void raiser_thread(void *param)
+{
+	raiser_t *raiser = param;
+
+	for (uint32_t round = 0; round < raiser->round_count; round++) {
+		sem_wait(&raiser->go);
+		acc_os_sleep_us(RAISE_DELAY_US);
+		raiser->raise_ns = acc_os_monotonic_ns();
+		acc_board_sim_set_sensor_interrupt(SENSOR, 1);
+	}
+}
+
+
+static bool bench_read(uint32_t read_count)
+{
+	static uint8_t	sweep[SWEEP_SIZE];
+	uint_fast8_t	bus;
+	uint_fast8_t	cs;
+	uint32_t	speed;
+
+	acc_board_get_spi_bus_cs(SENSOR, &bus, &cs);
+	speed = acc_board_get_spi_speed(bus);
+
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t read = 0; read < read_count; read++) {
+		if (acc_board_chip_select(SENSOR, 1) != ACC_STATUS_SUCCESS ||
+		    acc_device_spi_lock(bus) != ACC_STATUS_SUCCESS) {
+			return false;
+		}
+		for (size_t offset = 0; offset < SWEEP_SIZE; offset += CHUNK_SIZE) {
+			if (acc_device_spi_transfer(bus, cs, speed, sweep + offset, CHUNK_SIZE) != ACC_STATUS_SUCCESS) {
+				acc_device_spi_unlock(bus);
+				return false;
+			}
+		}
+		acc_device_spi_unlock(bus);
+	}
+
+	printf("%-24s %8.3f us/read\n", "select and read", (acc_os_monotonic_ns() - start_ns) / 1000.0 / read_count);
+
+	return true;
+}
+
+
+static bool bench_wake(uint32_t wake_count)
+{
+	raiser_t		raiser = { .round_count = wake_count };
+	acc_os_thread_handle_t	thread;
+	uint64_t		total_ns = 0;
+	uint64_t		worst_ns = 0;
+	uint32_t		timeouts = 0;
+
+	sem_init(&raiser.go, 0, 0);
+
+	if (acc_os_thread_create(raiser_thread, &raiser, &thread) != ACC_STATUS_SUCCESS) {
+		return false;
+	}
+
+	for (uint32_t round = 0; round < wake_count; round++) {
+		acc_board_sim_set_sensor_interrupt(SENSOR, 0);
+		sem_post(&raiser.go);
+
+		if (acc_board_wait_for_sensor_interrupt(SENSOR, 1000) != ACC_STATUS_SUCCESS) {
+			timeouts++;
+			continue;
+		}
+
+		uint64_t latency_ns = acc_os_monotonic_ns() - raiser.raise_ns;
+
+		total_ns += latency_ns;
+		if (latency_ns > worst_ns) {
+			worst_ns = latency_ns;
+		}
+	}
+
+	acc_os_thread_cleanup(thread);
+	sem_destroy(&raiser.go);
+
+	if (timeouts < wake_count) {
+		printf("%-24s %8.3f us average, %.3f us worst, %u timeouts\n", "interrupt wake-up",
+		       total_ns / 1000.0 / (wake_count - timeouts), worst_ns / 1000.0, (unsigned int)timeouts);
+	}
+
+	return timeouts == 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint32_t	read_count = DEFAULT_READ_COUNT;
+	uint32_t	wake_count = DEFAULT_WAKE_COUNT;
+	int		opt;
+
+	while ((opt = getopt(argc, argv, "r:w:")) != -1) {
+		switch (opt) {
+			case 'r':
+				read_count = atoi(optarg);
+				break;
+			case 'w':
+				wake_count = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-r read count] [-w interrupt wake-up count]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	if (acc_board_init() != ACC_STATUS_SUCCESS || acc_device_spi_init() != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%-24s %8.3f us\n", "board init", (acc_os_monotonic_ns() - start_ns) / 1000.0);
+
+	if (acc_board_start_sensor(SENSOR) != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	if ((read_count > 0 && !bench_read(read_count)) ||
+	    (wake_count > 0 && !bench_wake(wake_count))) {
+		return EXIT_FAILURE;
+	}
+
+	acc_board_stop_sensor(SENSOR);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,177 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost and resolution of the clocks a sweep can be stamped with
+//
+// Built for the Pi by "make" as out/peh_bench_clock, and for the build host by "make host".
+// Each clock is read in a tight loop. The cost is the mean time per read, the step is the
+// smallest non-zero difference between two reads in a row. On the Pi, clocks read through the
+// vDSO cost well under a microsecond, clocks that need a system call cost several.
+
+// needed for getopt and the clock ids of Linux
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "acc_os.h"
+
+
+#define DEFAULT_READ_COUNT	1000000
+
+
+typedef struct {
+	const char	*name;
+	clockid_t	clock_id;
+} clock_source_t;
+
+
+static const clock_source_t clock_sources[] = {
+	{ "CLOCK_MONOTONIC", CLOCK_MONOTONIC },
+	{ "CLOCK_MONOTONIC_RAW", CLOCK_MONOTONIC_RAW },
+	{ "CLOCK_MONOTONIC_COARSE", CLOCK_MONOTONIC_COARSE },
+	{ "CLOCK_BOOTTIME", CLOCK_BOOTTIME },
+	{ "CLOCK_REALTIME", CLOCK_REALTIME },
+	{ "CLOCK_REALTIME_COARSE", CLOCK_REALTIME_COARSE },
+};
+
+
+static uint64_t read_monotonic_ns(clockid_t clock_id)
+{
+	ACC_UNUSED(clock_id);
+
+	return acc_os_monotonic_ns();
+}
+
+
+static uint64_t read_clock(clockid_t clock_id)
+{
+	struct timespec now;
+
+	clock_gettime(clock_id, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+static uint64_t read_gettimeofday(clockid_t clock_id)
+{
+	struct timeval now;
+
+	ACC_UNUSED(clock_id);
+
+	gettimeofday(&now, NULL);
+
+	return ((uint64_t)now.tv_sec * 1000000 + now.tv_usec) * 1000;
+}
+
+
+static uint64_t read_localtime(clockid_t clock_id)
+{
+	struct tm	time_tm;
+	uint32_t	time_usec;
+
+	ACC_UNUSED(clock_id);
+
+	acc_os_localtime(&time_tm, &time_usec);
+
+	return ((uint64_t)time_tm.tm_sec * 1000000 + time_usec) * 1000;
+}
+
+
+static uint64_t read_time_pair(clockid_t clock_id)
+{
+	acc_os_time_pair_t pair;
+
+	ACC_UNUSED(clock_id);
+
+	acc_os_time_pair_capture(&pair);
+
+	return pair.monotonic_ns;
+}
+
+
+static void report(const char *name, uint64_t elapsed_ns, uint64_t step_ns, uint32_t read_count)
+{
+	printf("%-24s %8.1f ns/read", name, (double)elapsed_ns / read_count);
+	if (step_ns != UINT64_MAX) {
+		printf(", step %9.3f us", step_ns / 1000.0);
+	}
+	printf("\n");
+}
+
+
+// Reads a clock read_count times, the elapsed time is measured with CLOCK_MONOTONIC around the loop
+static void bench(const char *name, uint64_t (*read)(clockid_t clock_id), clockid_t clock_id, uint32_t read_count)
+{
+	uint64_t	step_ns = UINT64_MAX;
+	uint64_t	previous = read(clock_id);
+	uint64_t	start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t index = 0; index < read_count; index++) {
+		uint64_t now = read(clock_id);
+
+		if (now != previous && now - previous < step_ns) {
+			step_ns = now - previous;
+		}
+		previous = now;
+	}
+
+	report(name, acc_os_monotonic_ns() - start_ns, step_ns, read_count);
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint32_t	read_count = DEFAULT_READ_COUNT;
+	int		option;
+
+	while ((option = getopt(argc, argv, "n:")) != -1) {
+		switch (option) {
+			case 'n':
+				read_count = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n read count]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (read_count == 0) {
+		fprintf(stderr, "Read count must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_os_init();
+
+	printf("%u reads of each clock\n", (unsigned int)read_count);
+
+	for (size_t index = 0; index < sizeof(clock_sources) / sizeof(clock_sources[0]); index++) {
+		struct timespec resolution;
+
+		if (clock_getres(clock_sources[index].clock_id, &resolution) != 0) {
+			printf("%-24s not available\n", clock_sources[index].name);
+			continue;
+		}
+
+		bench(clock_sources[index].name, read_clock, clock_sources[index].clock_id, read_count);
+	}
+
+	bench("gettimeofday", read_gettimeofday, CLOCK_REALTIME, read_count);
+	bench("acc_os_monotonic_ns", read_monotonic_ns, CLOCK_MONOTONIC, read_count);
+	bench("acc_os_time_pair_capture", read_time_pair, CLOCK_MONOTONIC, read_count);
+	// Mostly the time zone conversion, the step is wrong once a minute when the seconds wrap
+	bench("acc_os_localtime", read_localtime, CLOCK_REALTIME, read_count);
+
+	acc_os_time_pair_t pair;
+
+	acc_os_time_pair_capture(&pair);
+	printf("Time pair uncertainty %.3f us\n", pair.uncertainty_ns / 1000.0);
+
+	return EXIT_SUCCESS;
+}
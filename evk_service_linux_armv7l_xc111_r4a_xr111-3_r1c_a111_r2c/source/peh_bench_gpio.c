@@ -0,0 +1,158 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost of selecting a sensor through CE_A and CE_B with the GPIO character device driver
+//
+// Built for the Pi by "make" as out/peh_bench_gpio. Runs against an in-memory chip unless
+// a chip is given with -d, so it does not need the sensor board. With -d the CE pins of the
+// board are toggled, nothing else may use the board meanwhile.
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acc_device_gpio.h"
+#include "acc_driver_gpio_linux_chardev.h"
+#include "acc_driver_gpio_linux_chardev_fake.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+#define DEFAULT_SELECT_COUNT	100000
+#define FAKE_LINE_COUNT		28
+#define CE_A_PIN		16
+#define CE_B_PIN		19
+
+
+static bool fake_chip;
+
+
+// Same levels as acc_board_chip_select()
+static void ce_levels(uint_fast8_t sensor, uint_fast8_t *levels)
+{
+	levels[0] = (sensor == 1 || sensor == 2) ? 0 : 1;
+	levels[1] = (sensor == 1 || sensor == 3) ? 0 : 1;
+}
+
+
+// Counts selects that left the fake chip with other levels than asked for
+static uint32_t check_levels(const uint_fast8_t *levels)
+{
+	uint_fast8_t ce_a;
+	uint_fast8_t ce_b;
+
+	if (!fake_chip) {
+		return 0;
+	}
+
+	if (!acc_driver_gpio_linux_chardev_fake_get_output(CE_A_PIN, &ce_a) ||
+	    !acc_driver_gpio_linux_chardev_fake_get_output(CE_B_PIN, &ce_b)) {
+		return 1;
+	}
+
+	return (ce_a != levels[0] || ce_b != levels[1]) ? 1 : 0;
+}
+
+
+static void report(const char *name, uint64_t start_ns, uint32_t ioctl_start, uint32_t select_count, uint32_t errors)
+{
+	uint64_t elapsed_ns = acc_os_monotonic_ns() - start_ns;
+
+	printf("%-24s %8.3f us/select", name, elapsed_ns / 1000.0 / select_count);
+	if (fake_chip) {
+		uint32_t ioctls = acc_driver_gpio_linux_chardev_fake_get_ioctl_count() - ioctl_start;
+
+		printf(", %.2f ioctl/select, %u wrong levels", (double)ioctls / select_count, (unsigned int)errors);
+	}
+	printf("\n");
+}
+
+
+static uint32_t ioctl_count(void)
+{
+	return fake_chip ? acc_driver_gpio_linux_chardev_fake_get_ioctl_count() : 0;
+}
+
+
+int main(int argc, char *argv[])
+{
+	const char	*chip_path = NULL;
+	uint32_t	select_count = DEFAULT_SELECT_COUNT;
+	uint_fast8_t	pins[] = { CE_A_PIN, CE_B_PIN };
+	uint_fast8_t	levels[2];
+	uint_fast8_t	group;
+	uint32_t	errors = 0;
+	int		option;
+
+	while ((option = getopt(argc, argv, "c:d:")) != -1) {
+		switch (option) {
+			case 'c':
+				select_count = atoi(optarg);
+				break;
+			case 'd':
+				chip_path = optarg;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-c select count] [-d gpio chip, e.g. /dev/gpiochip0]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (select_count == 0) {
+		fprintf(stderr, "Select count must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	fake_chip = (chip_path == NULL);
+	if (fake_chip) {
+		acc_driver_gpio_linux_chardev_fake_reset(FAKE_LINE_COUNT);
+		acc_driver_gpio_linux_chardev_register("fake", &acc_driver_gpio_linux_chardev_fake_ops);
+	} else {
+		acc_driver_gpio_linux_chardev_register(chip_path, NULL);
+	}
+
+	if (acc_device_gpio_init() != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%u selects on %s\n", (unsigned int)select_count, fake_chip ? "fake chip" : chip_path);
+
+	// One write per pin, as with the sysfs driver
+	uint32_t ioctl_start = ioctl_count();
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t select = 0; select < select_count; select++) {
+		ce_levels(select % 4 + 1, levels);
+		if (acc_device_gpio_write(CE_A_PIN, levels[0]) != ACC_STATUS_SUCCESS ||
+		    acc_device_gpio_write(CE_B_PIN, levels[1]) != ACC_STATUS_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		errors += check_levels(levels);
+	}
+	report("single line writes", start_ns, ioctl_start, select_count, errors);
+
+	if (acc_driver_gpio_linux_chardev_group_create(pins, 2, &group) != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	// Both pins in one write
+	errors		= 0;
+	ioctl_start	= ioctl_count();
+	start_ns	= acc_os_monotonic_ns();
+
+	for (uint32_t select = 0; select < select_count; select++) {
+		ce_levels(select % 4 + 1, levels);
+		if (acc_driver_gpio_linux_chardev_group_write(group, levels) != ACC_STATUS_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		errors += check_levels(levels);
+	}
+	report("group write", start_ns, ioctl_start, select_count, errors);
+
+	return EXIT_SUCCESS;
+}
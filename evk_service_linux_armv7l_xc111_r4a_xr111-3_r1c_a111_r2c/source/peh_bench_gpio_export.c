@@ -0,0 +1,420 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Time until exported sysfs GPIOs can be opened, against a directory that imitates /sys/class/gpio
+//
+// Built for the Pi by "make" as out/peh_bench_gpio_export, and for the build host by "make host".
+// A thread plays the kernel and udev in a temporary directory. For each write to export it
+// creates gpio# after -d us, the direction and value files without permissions after -f us, and
+// makes them writable after -c us plus -s us for each pin before it, as udev does. The pins are
+// opened together with acc_driver_gpio_linux_sysfs_open(), and the time each was ready is
+// compared with the time its files became writable. Then two more pins are opened, one whose
+// files never become writable and one that is never created, which must time out.
+
+// needed for getopt, mkdtemp and the inotify names
+#define _GNU_SOURCE
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/inotify.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "acc_driver_gpio_linux_sysfs.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+#define DEFAULT_PIN_COUNT	4
+#define DEFAULT_DIR_DELAY_US	2000
+#define DEFAULT_FILE_DELAY_US	4000
+#define DEFAULT_CHMOD_DELAY_US	30000
+#define DEFAULT_STAGGER_US	5000
+#define PIN_MAX			16
+#define GPIO_PIN_COUNT		28
+#define FIRST_PIN		4
+#define TIMEOUT_US		1000000
+#define SLACK_US		500
+
+
+/**
+ * @brief How far a simulated pin has come since it was exported
+ */
+typedef enum {
+	PIN_STAGE_IDLE,
+	PIN_STAGE_EXPORTED,
+	PIN_STAGE_DIR,
+	PIN_STAGE_FILES,
+	PIN_STAGE_WRITABLE
+} pin_stage_t;
+
+
+/**
+ * @brief A simulated pin
+ *
+ * @param pin The pin number
+ * @param stage How far it has come
+ * @param last_stage The stage it stops at
+ * @param exported_ns When export was written for it
+ * @param writable_ns When its files became writable
+ */
+typedef struct {
+	uint_fast8_t	pin;
+	pin_stage_t	stage;
+	pin_stage_t	last_stage;
+	uint64_t	exported_ns;
+	uint64_t	writable_ns;
+} sim_pin_t;
+
+
+static char		root[] = "/tmp/peh_bench_gpio_export.XXXXXX";
+static sim_pin_t	sim_pins[PIN_MAX + 2];
+static uint_fast8_t	sim_pin_count;
+static uint_fast8_t	export_count;
+static uint32_t		dir_delay_us = DEFAULT_DIR_DELAY_US;
+static uint32_t		file_delay_us = DEFAULT_FILE_DELAY_US;
+static uint32_t		chmod_delay_us = DEFAULT_CHMOD_DELAY_US;
+static uint32_t		stagger_us = DEFAULT_STAGGER_US;
+static pthread_mutex_t	sim_mutex = PTHREAD_MUTEX_INITIALIZER;
+static volatile bool	sim_stop;
+
+
+static void make_path(char *path, size_t size, uint_fast8_t pin, const char *file)
+{
+	if (file != NULL) {
+		snprintf(path, size, "%s/gpio%u/%s", root, (unsigned int)pin, file);
+	} else {
+		snprintf(path, size, "%s/gpio%u", root, (unsigned int)pin);
+	}
+}
+
+
+static void create_file(const char *path, mode_t mode)
+{
+	int fd = open(path, O_CREAT | O_WRONLY, mode);
+
+	if (fd < 0) {
+		fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+		exit(EXIT_FAILURE);
+	}
+	close(fd);
+}
+
+
+// Next step of a pin once it is due, returns the time of the step after it
+static uint64_t advance_pin(sim_pin_t *sim_pin, uint64_t now_ns)
+{
+	char		path[PATH_MAX];
+	uint_fast8_t	order = sim_pin - sim_pins;
+	// Time from export to leaving each stage
+	uint32_t	delays_us[] = {
+		[PIN_STAGE_EXPORTED]	= dir_delay_us,
+		[PIN_STAGE_DIR]		= file_delay_us,
+		[PIN_STAGE_FILES]	= chmod_delay_us + order * stagger_us
+	};
+
+	while (sim_pin->stage >= PIN_STAGE_EXPORTED && sim_pin->stage < sim_pin->last_stage) {
+		uint64_t due_ns = sim_pin->exported_ns + (uint64_t)delays_us[sim_pin->stage] * 1000;
+
+		if (now_ns < due_ns) {
+			return due_ns;
+		}
+
+		switch (sim_pin->stage) {
+			case PIN_STAGE_EXPORTED:
+				make_path(path, sizeof(path), sim_pin->pin, NULL);
+				if (mkdir(path, 0755) != 0) {
+					fprintf(stderr, "Could not create %s: %s\n", path, strerror(errno));
+					exit(EXIT_FAILURE);
+				}
+				break;
+			case PIN_STAGE_DIR:
+				// The kernel creates the files owned by root, udev then hands them to the gpio group
+				make_path(path, sizeof(path), sim_pin->pin, "direction");
+				create_file(path, 0);
+				make_path(path, sizeof(path), sim_pin->pin, "value");
+				create_file(path, 0);
+				break;
+			case PIN_STAGE_FILES:
+				make_path(path, sizeof(path), sim_pin->pin, "direction");
+				chmod(path, 0660);
+				make_path(path, sizeof(path), sim_pin->pin, "value");
+				sim_pin->writable_ns = acc_os_monotonic_ns();
+				chmod(path, 0660);
+				break;
+			default:
+				break;
+		}
+
+		sim_pin->stage++;
+	}
+
+	return UINT64_MAX;
+}
+
+
+// Counts closes of export after writing, the driver exports the pins in the order they are given
+static void *sim_thread(void *param)
+{
+	int	inotify_fd = *(int *)param;
+	char	events[sizeof(struct inotify_event) * 16 + NAME_MAX + 1];
+
+	while (!sim_stop) {
+		struct pollfd	fd = { .fd = inotify_fd, .events = POLLIN };
+		uint64_t	next_ns = UINT64_MAX;
+		uint64_t	now_ns = acc_os_monotonic_ns();
+		int		timeout_ms = 10;
+		ssize_t		length;
+
+		pthread_mutex_lock(&sim_mutex);
+		for (uint_fast8_t index = 0; index < sim_pin_count; index++) {
+			uint64_t due_ns = advance_pin(&sim_pins[index], now_ns);
+
+			if (due_ns < next_ns) {
+				next_ns = due_ns;
+			}
+		}
+		pthread_mutex_unlock(&sim_mutex);
+
+		if (next_ns != UINT64_MAX) {
+			now_ns		= acc_os_monotonic_ns();
+			timeout_ms	= (next_ns > now_ns) ? (int)((next_ns - now_ns + 999999) / 1000000) : 0;
+			if (timeout_ms > 10) {
+				timeout_ms = 10;
+			}
+		}
+
+		if (poll(&fd, 1, timeout_ms) <= 0) {
+			continue;
+		}
+
+		now_ns = acc_os_monotonic_ns();
+
+		while ((length = read(inotify_fd, events, sizeof(events))) > 0) {
+			for (char *event_ptr = events; event_ptr < events + length;) {
+				const struct inotify_event *event = (const struct inotify_event *)event_ptr;
+
+				if ((event->mask & IN_CLOSE_WRITE) && event->len > 0 && strcmp(event->name, "export") == 0) {
+					pthread_mutex_lock(&sim_mutex);
+					if (export_count < sim_pin_count) {
+						sim_pins[export_count].stage		= PIN_STAGE_EXPORTED;
+						sim_pins[export_count].exported_ns	= now_ns;
+					}
+					export_count++;
+					pthread_mutex_unlock(&sim_mutex);
+				}
+
+				event_ptr += sizeof(struct inotify_event) + event->len;
+			}
+		}
+	}
+
+	close(inotify_fd);
+
+	return NULL;
+}
+
+
+// Runs after the driver has unexported its pins at exit, exit handlers run last registered first
+static void remove_root(void)
+{
+	char path[PATH_MAX];
+
+	for (uint_fast8_t index = 0; index < sim_pin_count; index++) {
+		make_path(path, sizeof(path), sim_pins[index].pin, "direction");
+		unlink(path);
+		make_path(path, sizeof(path), sim_pins[index].pin, "value");
+		unlink(path);
+		make_path(path, sizeof(path), sim_pins[index].pin, NULL);
+		rmdir(path);
+	}
+
+	snprintf(path, sizeof(path), "%s/export", root);
+	unlink(path);
+	snprintf(path, sizeof(path), "%s/unexport", root);
+	unlink(path);
+	rmdir(root);
+}
+
+
+static void add_pins(uint_fast8_t first_pin, uint_fast8_t count, pin_stage_t last_stage)
+{
+	pthread_mutex_lock(&sim_mutex);
+	for (uint_fast8_t index = 0; index < count; index++) {
+		sim_pin_t *sim_pin = &sim_pins[sim_pin_count++];
+
+		sim_pin->pin		= first_pin + index;
+		sim_pin->stage		= PIN_STAGE_IDLE;
+		sim_pin->last_stage	= last_stage;
+	}
+	pthread_mutex_unlock(&sim_mutex);
+}
+
+
+static bool bench_ready(uint_fast8_t pin_count)
+{
+	uint_fast8_t	pins[PIN_MAX];
+	uint32_t	ready_us[PIN_MAX];
+	uint64_t	start_ns;
+	uint64_t	elapsed_ns;
+	uint32_t	sum_us = 0;
+	bool		success = true;
+
+	add_pins(FIRST_PIN, pin_count, PIN_STAGE_WRITABLE);
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		pins[index] = sim_pins[index].pin;
+	}
+
+	start_ns = acc_os_monotonic_ns();
+	if (acc_driver_gpio_linux_sysfs_open(pins, pin_count, ready_us) != ACC_STATUS_SUCCESS) {
+		fprintf(stderr, "Opening the exported pins failed\n");
+		return false;
+	}
+	elapsed_ns = acc_os_monotonic_ns() - start_ns;
+
+	printf("pin   ready us  writable us   late us\n");
+	for (uint_fast8_t index = 0; index < pin_count; index++) {
+		sim_pin_t	*sim_pin = &sim_pins[index];
+		int64_t		writable_us = (int64_t)(sim_pin->writable_ns - start_ns) / 1000;
+
+		// The driver counts from a little after start_ns. Ready well before the files were writable
+		// means the wait did not check the permissions.
+		if (sim_pin->stage != PIN_STAGE_WRITABLE || (int64_t)ready_us[index] + SLACK_US < writable_us) {
+			success = false;
+		}
+
+		printf("%3u %10u %12lld %9lld\n", (unsigned int)sim_pin->pin, (unsigned int)ready_us[index],
+		       (long long)writable_us, (long long)ready_us[index] - writable_us);
+		sum_us += ready_us[index];
+	}
+
+	printf("Opened %u pins in %u us, %u us if waited for one at a time\n", (unsigned int)pin_count,
+	       (unsigned int)(elapsed_ns / 1000), (unsigned int)sum_us);
+
+	return success;
+}
+
+
+static bool bench_timeout(uint_fast8_t first_pin)
+{
+	uint_fast8_t	pins[] = { first_pin, first_pin + 1 };
+	uint64_t	start_ns;
+	uint64_t	elapsed_ns;
+	acc_status_t	status;
+
+	// One pin stays without permissions, the other is never created
+	add_pins(first_pin, 1, PIN_STAGE_FILES);
+	add_pins(first_pin + 1, 1, PIN_STAGE_IDLE);
+
+	printf("Opening gpio%u without permissions and gpio%u that is never created, expecting a timeout\n",
+	       (unsigned int)pins[0], (unsigned int)pins[1]);
+
+	start_ns	= acc_os_monotonic_ns();
+	status		= acc_driver_gpio_linux_sysfs_open(pins, 2, NULL);
+	elapsed_ns	= acc_os_monotonic_ns() - start_ns;
+
+	printf("Timed out after %u us\n", (unsigned int)(elapsed_ns / 1000));
+
+	return status != ACC_STATUS_SUCCESS && elapsed_ns >= (uint64_t)TIMEOUT_US * 1000;
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint32_t	pin_count = DEFAULT_PIN_COUNT;
+	pthread_t	thread;
+	int		inotify_fd;
+	char		path[PATH_MAX];
+	bool		success;
+	int		option;
+
+	while ((option = getopt(argc, argv, "n:d:f:c:s:")) != -1) {
+		switch (option) {
+			case 'n':
+				pin_count = atoi(optarg);
+				break;
+			case 'd':
+				dir_delay_us = atoi(optarg);
+				break;
+			case 'f':
+				file_delay_us = atoi(optarg);
+				break;
+			case 'c':
+				chmod_delay_us = atoi(optarg);
+				break;
+			case 's':
+				stagger_us = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n pins] [-d us to gpio#] [-f us to files] [-c us to writable] [-s us between pins]\n",
+				        argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (pin_count == 0 || pin_count > PIN_MAX) {
+		fprintf(stderr, "Pin count must be 1 to %u\n", PIN_MAX);
+		return EXIT_FAILURE;
+	}
+
+	if (dir_delay_us > file_delay_us || file_delay_us > chmod_delay_us) {
+		fprintf(stderr, "The delays must be in the order gpio#, files, writable\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_os_init();
+
+	if (mkdtemp(root) == NULL) {
+		fprintf(stderr, "Could not create a temporary directory: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	snprintf(path, sizeof(path), "%s/export", root);
+	create_file(path, 0600);
+	snprintf(path, sizeof(path), "%s/unexport", root);
+	create_file(path, 0600);
+	atexit(remove_root);
+
+	// Watched before anything is exported. IN_OPEN between the closes keeps the kernel from
+	// merging them into one event.
+	inotify_fd = inotify_init1(IN_NONBLOCK);
+	if (inotify_fd < 0 || inotify_add_watch(inotify_fd, root, IN_OPEN | IN_CLOSE_WRITE) < 0) {
+		fprintf(stderr, "inotify not available: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	if (pthread_create(&thread, NULL, sim_thread, &inotify_fd) != 0) {
+		fprintf(stderr, "Could not create thread\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_driver_gpio_linux_sysfs_register(GPIO_PIN_COUNT);
+	acc_driver_gpio_linux_sysfs_set_root(root);
+
+	printf("%u pins in %s, gpio# after %u us, files after %u us, writable after %u us + %u us per pin\n",
+	       (unsigned int)pin_count, root, (unsigned int)dir_delay_us, (unsigned int)file_delay_us,
+	       (unsigned int)chmod_delay_us, (unsigned int)stagger_us);
+
+	success = bench_ready(pin_count);
+	if (!success) {
+		fprintf(stderr, "A pin was reported ready before its files were writable\n");
+	}
+
+	if (!bench_timeout(FIRST_PIN + pin_count)) {
+		fprintf(stderr, "Opening pins that never become ready did not time out\n");
+		success = false;
+	}
+
+	sim_stop = true;
+	pthread_join(thread, NULL);
+
+	return success ? EXIT_SUCCESS : EXIT_FAILURE;
+}
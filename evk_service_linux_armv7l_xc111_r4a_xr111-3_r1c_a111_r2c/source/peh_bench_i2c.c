@@ -0,0 +1,132 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost of reading registers over I2C, one read per register against batched reads
+//
+// Built for the Pi by "make" as out/peh_bench_i2c. Runs the i2c-dev driver against an
+// in-memory bus, so it needs no I2C hardware. With -l the bus refuses combined transfers
+// and the driver falls back to read() and write().
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acc_device_i2c.h"
+#include "acc_driver_i2c_linux.h"
+#include "acc_driver_i2c_linux_fake.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+#define DEFAULT_ROUND_COUNT	100000
+#define DEVICE_ID		0x50
+#define REGISTER_COUNT		8
+
+
+static void report(const char *name, uint64_t start_ns, uint32_t round_count, uint32_t errors)
+{
+	acc_driver_i2c_linux_fake_stats_t	stats;
+	uint64_t				elapsed_ns = acc_os_monotonic_ns() - start_ns;
+	uint32_t				register_count = round_count * REGISTER_COUNT;
+
+	acc_driver_i2c_linux_fake_get_stats(&stats);
+
+	printf("%-24s %8.3f us/register, %.2f syscalls/register, %u wrong values\n", name,
+	       elapsed_ns / 1000.0 / register_count,
+	       (double)(stats.ioctl_count + stats.read_count + stats.write_count) / register_count,
+	       (unsigned int)errors);
+}
+
+
+static void reset_stats(bool rdwr)
+{
+	acc_driver_i2c_linux_fake_reset(rdwr);
+	acc_driver_i2c_linux_fake_add_device(DEVICE_ID, 2);
+
+	for (uint16_t address = 0; address < REGISTER_COUNT; address++) {
+		acc_driver_i2c_linux_fake_set_register(DEVICE_ID, address * 16, address + 1);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	acc_driver_i2c_linux_register_read_t	reads[REGISTER_COUNT];
+	uint8_t					values[REGISTER_COUNT];
+	uint32_t				round_count = DEFAULT_ROUND_COUNT;
+	uint32_t				errors = 0;
+	bool					rdwr = true;
+	int					option;
+
+	while ((option = getopt(argc, argv, "c:l")) != -1) {
+		switch (option) {
+			case 'c':
+				round_count = atoi(optarg);
+				break;
+			case 'l':
+				rdwr = false;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-c rounds of %u registers] [-l no combined transfers]\n", argv[0], REGISTER_COUNT);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (round_count == 0) {
+		fprintf(stderr, "Round count must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	reset_stats(rdwr);
+	acc_driver_i2c_linux_register_with_ops(&acc_driver_i2c_linux_fake_ops);
+
+	if (acc_device_i2c_init() != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	printf("%u rounds of %u register reads, %s\n", (unsigned int)round_count, REGISTER_COUNT,
+	       rdwr ? "combined transfers" : "read() and write()");
+
+	// One call per register
+	reset_stats(rdwr);
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t round = 0; round < round_count; round++) {
+		for (uint16_t reg = 0; reg < REGISTER_COUNT; reg++) {
+			if (acc_device_i2c_read_from_address_16(DEVICE_ID, reg * 16, &values[reg], 1) != ACC_STATUS_SUCCESS) {
+				return EXIT_FAILURE;
+			}
+			errors += (values[reg] != reg + 1);
+		}
+	}
+	report("single reads", start_ns, round_count, errors);
+
+	// All registers in one call
+	for (uint16_t reg = 0; reg < REGISTER_COUNT; reg++) {
+		reads[reg].address	= reg * 16;
+		reads[reg].address_size	= 2;
+		reads[reg].buffer	= &values[reg];
+		reads[reg].buffer_size	= 1;
+	}
+
+	errors = 0;
+	reset_stats(rdwr);
+	start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t round = 0; round < round_count; round++) {
+		if (acc_driver_i2c_linux_read_registers(DEVICE_ID, reads, REGISTER_COUNT) != ACC_STATUS_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		for (uint16_t reg = 0; reg < REGISTER_COUNT; reg++) {
+			errors += (values[reg] != reg + 1);
+		}
+	}
+	report("batched reads", start_ns, round_count, errors);
+
+	return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -0,0 +1,133 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Time a thread spends in a verbose log message, with acc_log() and with acc_log_async()
+//
+// Built for the Pi by "make" as out/peh_bench_log, and for the build host by "make host".
+// The messages are logged at a fixed rate, as a driver logging on every transfer would. They
+// are written to stdout and the results to stderr, so run with stdout redirected to where the
+// log goes in production, e.g. "out/peh_bench_log > /var/log/peh.log".
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acc_log.h"
+#include "acc_log_async.h"
+#include "acc_os.h"
+
+
+#define MODULE			"bench_log"
+#define DEFAULT_MESSAGE_COUNT	10000
+#define DEFAULT_PERIOD_US	100
+
+
+static int compare_ns(const void *a, const void *b)
+{
+	uint64_t value_a = *(const uint64_t *)a;
+	uint64_t value_b = *(const uint64_t *)b;
+
+	return (value_a > value_b) - (value_a < value_b);
+}
+
+
+static void report(const char *name, uint64_t *samples_ns, uint32_t count)
+{
+	uint64_t total_ns = 0;
+
+	for (uint32_t index = 0; index < count; index++) {
+		total_ns += samples_ns[index];
+	}
+
+	qsort(samples_ns, count, sizeof(*samples_ns), compare_ns);
+
+	fprintf(stderr, "%-12s mean %8.3f us, p50 %8.3f us, p99 %8.3f us, max %9.3f us\n", name,
+	        total_ns / 1000.0 / count, samples_ns[count / 2] / 1000.0,
+	        samples_ns[(uint64_t)count * 99 / 100] / 1000.0, samples_ns[count - 1] / 1000.0);
+}
+
+
+static void bench(bool async, uint32_t message_count, uint32_t period_us, uint64_t *samples_ns)
+{
+	acc_os_timer_t timer;
+
+	acc_os_timer_start(&timer, period_us);
+
+	for (uint32_t index = 0; index < message_count; index++) {
+		uint64_t start_ns = acc_os_monotonic_ns();
+
+		// Like the messages of the drivers
+		if (async) {
+			acc_log_async(ACC_LOG_LEVEL_VERBOSE, MODULE, "%s: transfer of %u bytes on bus %u took %.1f us", "spidev_transfer",
+			              (unsigned int)(index % 4096), (unsigned int)(index % 2), index * 0.5);
+		} else {
+			acc_log(ACC_LOG_LEVEL_VERBOSE, MODULE, "%s: transfer of %u bytes on bus %u took %.1f us", "spidev_transfer",
+			        (unsigned int)(index % 4096), (unsigned int)(index % 2), index * 0.5);
+		}
+
+		samples_ns[index] = acc_os_monotonic_ns() - start_ns;
+		acc_os_timer_wait(&timer);
+	}
+}
+
+
+int main(int argc, char *argv[])
+{
+	acc_log_async_stats_t	stats;
+	uint32_t		message_count = DEFAULT_MESSAGE_COUNT;
+	uint32_t		period_us = DEFAULT_PERIOD_US;
+	uint64_t		*samples_ns;
+	int			option;
+
+	while ((option = getopt(argc, argv, "n:p:")) != -1) {
+		switch (option) {
+			case 'n':
+				message_count = atoi(optarg);
+				break;
+			case 'p':
+				period_us = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n message count] [-p us between messages]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (message_count == 0) {
+		fprintf(stderr, "Message count must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_os_init();
+
+	samples_ns = malloc(message_count * sizeof(*samples_ns));
+	if (samples_ns == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_log_async_set_level(ACC_LOG_LEVEL_VERBOSE);
+	acc_log_async_start();
+
+	fprintf(stderr, "%u verbose messages, one every %u us\n", (unsigned int)message_count, (unsigned int)period_us);
+
+	bench(false, message_count, period_us, samples_ns);
+	report("acc_log", samples_ns, message_count);
+
+	bench(true, message_count, period_us, samples_ns);
+	report("acc_log_async", samples_ns, message_count);
+
+	acc_log_async_stop();
+	acc_log_async_get_stats(&stats);
+	fprintf(stderr, "%u messages written by the background thread, %u dropped\n",
+	        (unsigned int)stats.written_count, (unsigned int)stats.dropped_count);
+
+	free(samples_ns);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,285 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost of acc_os_mem_alloc() and acc_os_mem_free() with malloc, the size-class pools and arenas
+//
+// Built for the Pi by "make" as out/peh_bench_mem, and for the build host by "make host".
+// The first part allocates and frees one block at a time. The second part runs threads that
+// each allocate what a service allocates when it is created, and free it again, as when
+// services are created and destroyed to change their configuration. Latencies are per
+// allocation, averaged over batches of 100, and per create/destroy cycle.
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acc_os.h"
+
+
+#define DEFAULT_ALLOC_COUNT	100000
+#define DEFAULT_CYCLE_COUNT	2000
+#define DEFAULT_THREAD_COUNT	4
+#define SINGLE_BATCH_SIZE	100
+#define ARENA_CHUNK_SIZE	(64 * 1024)
+
+
+/**
+ * @brief Sizes a service allocates when it is created: the service, its configuration,
+ *        sweep buffers and processing state, and one buffer larger than every size class
+ */
+static const size_t service_sizes[] = { 312, 96, 48, 4096, 4096, 8192, 2800, 2800, 1536, 640, 96 * 1024 };
+
+#define SERVICE_ALLOC_COUNT	(sizeof(service_sizes) / sizeof(service_sizes[0]))
+
+
+typedef struct {
+	acc_os_linux_mem_mode_t	mode;
+	uint32_t		cycle_count;
+	uint64_t		*cycle_ns;
+	bool			failed;
+} cycle_thread_t;
+
+
+static int compare_ns(const void *a, const void *b)
+{
+	uint64_t value_a = *(const uint64_t *)a;
+	uint64_t value_b = *(const uint64_t *)b;
+
+	return (value_a > value_b) - (value_a < value_b);
+}
+
+
+static void report(const char *name, uint64_t *samples_ns, uint32_t count, uint32_t per_sample)
+{
+	double		scale = 1000.0 * per_sample;
+	uint64_t	total_ns = 0;
+
+	for (uint32_t index = 0; index < count; index++) {
+		total_ns += samples_ns[index];
+	}
+
+	qsort(samples_ns, count, sizeof(*samples_ns), compare_ns);
+
+	printf("  %-22s mean %9.3f us, p50 %9.3f us, p99 %9.3f us, max %9.3f us\n", name,
+	       total_ns / scale / count, samples_ns[count / 2] / scale,
+	       samples_ns[(uint64_t)count * 99 / 100] / scale, samples_ns[count - 1] / scale);
+}
+
+
+static const char *mode_name(acc_os_linux_mem_mode_t mode)
+{
+	switch (mode) {
+		case ACC_OS_LINUX_MEM_MODE_POOL:
+			return "pool";
+		case ACC_OS_LINUX_MEM_MODE_ARENA:
+			return "arena";
+		default:
+			return "malloc";
+	}
+}
+
+
+// Allocation and free of one block, timed in batches since a single one takes about as long as
+// reading the clock. A block is kept allocated so the pool is not emptied each time.
+static bool bench_single(size_t size, uint32_t batch_count, uint64_t *samples_ns)
+{
+	void *keep = acc_os_mem_alloc(size);
+
+	for (uint32_t batch = 0; batch < batch_count; batch++) {
+		uint64_t start_ns = acc_os_monotonic_ns();
+
+		for (uint32_t index = 0; index < SINGLE_BATCH_SIZE; index++) {
+			void *block = acc_os_mem_alloc(size);
+
+			if (block == NULL) {
+				return false;
+			}
+			*(volatile uint8_t *)block = 0;
+			acc_os_mem_free(block);
+		}
+		samples_ns[batch] = acc_os_monotonic_ns() - start_ns;
+	}
+
+	acc_os_mem_free(keep);
+
+	return keep != NULL;
+}
+
+
+static void *cycle_thread(void *param)
+{
+	cycle_thread_t	*thread = param;
+	void		*blocks[SERVICE_ALLOC_COUNT];
+
+	for (uint32_t cycle = 0; cycle < thread->cycle_count; cycle++) {
+		uint64_t			start_ns = acc_os_monotonic_ns();
+		acc_os_linux_mem_arena_t	*arena = NULL;
+
+		if (thread->mode == ACC_OS_LINUX_MEM_MODE_ARENA) {
+			arena = acc_os_linux_mem_arena_create(ARENA_CHUNK_SIZE);
+			acc_os_linux_mem_arena_enter(arena);
+		}
+
+		for (size_t index = 0; index < SERVICE_ALLOC_COUNT; index++) {
+			blocks[index] = acc_os_mem_alloc(service_sizes[index]);
+			if (blocks[index] == NULL) {
+				thread->failed = true;
+				return NULL;
+			}
+			memset(blocks[index], 0, service_sizes[index] < 256 ? service_sizes[index] : 256);
+		}
+
+		acc_os_linux_mem_arena_enter(NULL);
+
+		for (size_t index = 0; index < SERVICE_ALLOC_COUNT; index++) {
+			acc_os_mem_free(blocks[index]);
+		}
+
+		acc_os_linux_mem_arena_destroy(arena);
+
+		thread->cycle_ns[cycle] = acc_os_monotonic_ns() - start_ns;
+	}
+
+	return NULL;
+}
+
+
+static bool bench_cycles(acc_os_linux_mem_mode_t mode, uint32_t thread_count, uint32_t cycle_count, uint64_t *samples_ns)
+{
+	pthread_t	handles[thread_count];
+	cycle_thread_t	threads[thread_count];
+	bool		success = true;
+
+	for (uint32_t index = 0; index < thread_count; index++) {
+		threads[index].mode		= mode;
+		threads[index].cycle_count	= cycle_count;
+		threads[index].cycle_ns		= samples_ns + (size_t)index * cycle_count;
+		threads[index].failed		= false;
+
+		if (pthread_create(&handles[index], NULL, cycle_thread, &threads[index]) != 0) {
+			fprintf(stderr, "Could not create thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (uint32_t index = 0; index < thread_count; index++) {
+		pthread_join(handles[index], NULL);
+		success = success && !threads[index].failed;
+	}
+
+	return success;
+}
+
+
+int main(int argc, char *argv[])
+{
+	static const size_t		single_sizes[] = { 24, 200, 3000, 40000 };
+	static const acc_os_linux_mem_mode_t	modes[] = {
+		ACC_OS_LINUX_MEM_MODE_MALLOC,
+		ACC_OS_LINUX_MEM_MODE_POOL,
+		ACC_OS_LINUX_MEM_MODE_ARENA
+	};
+	uint32_t	alloc_count = DEFAULT_ALLOC_COUNT;
+	uint32_t	cycle_count = DEFAULT_CYCLE_COUNT;
+	uint32_t	thread_count = DEFAULT_THREAD_COUNT;
+	uint64_t	*samples_ns;
+	int		option;
+
+	while ((option = getopt(argc, argv, "c:n:t:")) != -1) {
+		switch (option) {
+			case 'c':
+				cycle_count = atoi(optarg);
+				break;
+			case 'n':
+				alloc_count = atoi(optarg);
+				break;
+			case 't':
+				thread_count = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n allocation count] [-c create/destroy cycles per thread] [-t threads]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (alloc_count == 0 || cycle_count == 0 || thread_count == 0) {
+		fprintf(stderr, "Counts must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_os_init();
+
+	uint32_t	batch_count = (alloc_count + SINGLE_BATCH_SIZE - 1) / SINGLE_BATCH_SIZE;
+	size_t		sample_count = (size_t)cycle_count * thread_count;
+
+	if (sample_count < batch_count) {
+		sample_count = batch_count;
+	}
+
+	samples_ns = malloc(sample_count * sizeof(*samples_ns));
+	if (samples_ns == NULL) {
+		fprintf(stderr, "Out of memory\n");
+		return EXIT_FAILURE;
+	}
+
+	for (size_t mode_index = 0; mode_index < sizeof(modes) / sizeof(modes[0]); mode_index++) {
+		acc_os_linux_mem_mode_t		mode = modes[mode_index];
+		acc_os_linux_mem_stats_t	stats;
+		char				name[32];
+
+		acc_os_linux_mem_mode_set(mode);
+		printf("%s\n", mode_name(mode));
+
+		// Arenas are only entered around service creation, single blocks are the same as in pool mode
+		if (mode != ACC_OS_LINUX_MEM_MODE_ARENA) {
+			for (size_t size_index = 0; size_index < sizeof(single_sizes) / sizeof(single_sizes[0]); size_index++) {
+				if (!bench_single(single_sizes[size_index], batch_count, samples_ns)) {
+					fprintf(stderr, "Allocation failed\n");
+					return EXIT_FAILURE;
+				}
+				snprintf(name, sizeof(name), "alloc+free %zu B", single_sizes[size_index]);
+				report(name, samples_ns, batch_count, SINGLE_BATCH_SIZE);
+			}
+		}
+
+		acc_os_linux_mem_reset_peak();
+
+		if (!bench_cycles(mode, thread_count, cycle_count, samples_ns)) {
+			fprintf(stderr, "Allocation failed\n");
+			return EXIT_FAILURE;
+		}
+		snprintf(name, sizeof(name), "service cycle x%u", (unsigned int)thread_count);
+		report(name, samples_ns, cycle_count * thread_count, 1);
+
+		acc_os_linux_mem_get_stats(&stats);
+		printf("  live %zu B, peak %zu B, slabs %zu B, arenas %zu B\n", stats.live_bytes, stats.peak_bytes,
+		       stats.slab_bytes, stats.arena_bytes);
+	}
+
+	acc_os_linux_mem_stats_t stats;
+
+	acc_os_linux_mem_get_stats(&stats);
+	printf("size class      allocs       frees    live  pooled\n");
+	for (size_t size_class = 0; size_class <= ACC_OS_LINUX_MEM_CLASS_COUNT; size_class++) {
+		acc_os_linux_mem_class_stats_t *class_stats = &stats.classes[size_class];
+
+		if (class_stats->block_size != 0) {
+			printf("%8zu B ", class_stats->block_size);
+		} else {
+			printf("%10s ", "larger");
+		}
+		printf("%11u %11u %7u %7u\n", (unsigned int)class_stats->alloc_count, (unsigned int)class_stats->free_count,
+		       (unsigned int)class_stats->live_count, (unsigned int)class_stats->pool_count);
+	}
+
+	free(samples_ns);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,171 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost of a contended lock with a pthread mutex and with acc_os_mutex_lock()
+//
+// Built for the Pi by "make" as out/peh_bench_mutex, and for the build host by "make host".
+// Threads lock one mutex in a loop, hold it for a short section like an I2C register access
+// from cache, and do some work of their own between locks. The time per lock is the elapsed
+// time divided by all locks. acc_os_mutex_lock() is run with and without contention counts,
+// and the counts are printed at the end.
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acc_os.h"
+
+
+#define DEFAULT_LOCK_COUNT	200000
+#define DEFAULT_THREAD_COUNT	4
+#define DEFAULT_HOLD_LOOPS	50
+#define DEFAULT_WORK_LOOPS	200
+
+
+typedef enum {
+	LOCK_PTHREAD,
+	LOCK_ACC_OS,
+} lock_kind_t;
+
+
+typedef struct {
+	lock_kind_t	kind;
+	uint32_t	lock_count;
+	uint32_t	hold_loops;
+	uint32_t	work_loops;
+} lock_thread_t;
+
+
+static pthread_mutex_t	bench_pthread_mutex = PTHREAD_MUTEX_INITIALIZER;
+static acc_os_mutex_t	bench_mutex;
+static volatile uint32_t	shared_counter;
+
+
+static void spin(uint32_t loops)
+{
+	for (volatile uint32_t index = 0; index < loops; index++) {
+	}
+}
+
+
+static void *lock_thread(void *param)
+{
+	const lock_thread_t *thread = param;
+
+	for (uint32_t index = 0; index < thread->lock_count; index++) {
+		if (thread->kind == LOCK_PTHREAD) {
+			pthread_mutex_lock(&bench_pthread_mutex);
+			shared_counter++;
+			spin(thread->hold_loops);
+			pthread_mutex_unlock(&bench_pthread_mutex);
+		} else {
+			acc_os_mutex_lock(&bench_mutex);
+			shared_counter++;
+			spin(thread->hold_loops);
+			acc_os_mutex_unlock(&bench_mutex);
+		}
+
+		spin(thread->work_loops);
+	}
+
+	return NULL;
+}
+
+
+static void bench(const char *name, lock_kind_t kind, uint32_t thread_count, const lock_thread_t *settings)
+{
+	pthread_t	handles[thread_count];
+	lock_thread_t	thread = *settings;
+	uint64_t	start_ns;
+	uint64_t	elapsed_ns;
+
+	thread.kind	= kind;
+	shared_counter	= 0;
+	start_ns	= acc_os_monotonic_ns();
+
+	for (uint32_t index = 0; index < thread_count; index++) {
+		if (pthread_create(&handles[index], NULL, lock_thread, &thread) != 0) {
+			fprintf(stderr, "Could not create thread\n");
+			exit(EXIT_FAILURE);
+		}
+	}
+
+	for (uint32_t index = 0; index < thread_count; index++) {
+		pthread_join(handles[index], NULL);
+	}
+
+	elapsed_ns = acc_os_monotonic_ns() - start_ns;
+
+	if (shared_counter != (uint64_t)thread_count * thread.lock_count) {
+		fprintf(stderr, "%s: %u locks counted, expected %u\n", name, (unsigned int)shared_counter,
+		        (unsigned int)(thread_count * thread.lock_count));
+		exit(EXIT_FAILURE);
+	}
+
+	printf("%-24s %9.1f ns/lock, %8.3f s\n", name, (double)elapsed_ns / ((uint64_t)thread_count * thread.lock_count),
+	       elapsed_ns / 1e9);
+}
+
+
+int main(int argc, char *argv[])
+{
+	lock_thread_t	settings = {
+		.lock_count	= DEFAULT_LOCK_COUNT,
+		.hold_loops	= DEFAULT_HOLD_LOOPS,
+		.work_loops	= DEFAULT_WORK_LOOPS
+	};
+	uint32_t	thread_count = DEFAULT_THREAD_COUNT;
+	int		option;
+
+	while ((option = getopt(argc, argv, "n:t:h:w:")) != -1) {
+		switch (option) {
+			case 'n':
+				settings.lock_count = atoi(optarg);
+				break;
+			case 't':
+				thread_count = atoi(optarg);
+				break;
+			case 'h':
+				settings.hold_loops = atoi(optarg);
+				break;
+			case 'w':
+				settings.work_loops = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-n locks per thread] [-t threads] [-h loops held] [-w loops between locks]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (settings.lock_count == 0 || thread_count == 0) {
+		fprintf(stderr, "Counts must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	acc_os_init();
+	acc_os_mutex_init(&bench_mutex);
+	acc_os_linux_mutex_set_name(&bench_mutex, "bench");
+
+	printf("%u threads, %u locks each, %u loops held, %u loops between locks, %ld CPUs\n",
+	       (unsigned int)thread_count, (unsigned int)settings.lock_count, (unsigned int)settings.hold_loops,
+	       (unsigned int)settings.work_loops, sysconf(_SC_NPROCESSORS_ONLN));
+
+	bench("pthread_mutex_lock", LOCK_PTHREAD, thread_count, &settings);
+
+	acc_os_linux_mutex_stats_enable(false);
+	bench("acc_os_mutex_lock", LOCK_ACC_OS, thread_count, &settings);
+
+	acc_os_linux_mutex_stats_enable(true);
+	bench("acc_os_mutex_lock stats", LOCK_ACC_OS, thread_count, &settings);
+
+	printf("\n");
+	acc_os_linux_mutex_stats_dump(stdout);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,276 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Cost of reading a sweep in chunks, one transfer per chunk against vectored transfers, and
+// of decoding sweeps after each read against decoding while the next one is transferred
+//
+// Built for the Pi by "make" as out/peh_bench_spi. Runs the spidev driver against an
+// in-memory loopback device, so it needs neither the sensor board nor spidev.
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "acc_device_spi.h"
+#include "acc_driver_spi_linux_spidev.h"
+#include "acc_driver_spi_linux_spidev_async.h"
+#include "acc_driver_spi_linux_spidev_fake.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+#define DEFAULT_READ_COUNT	10000
+#define DEFAULT_SWEEP_SIZE	(16 * 1024)
+#define DEFAULT_CHUNK_SIZE	512
+#define DEFAULT_BUFSIZ		4096
+#define DEFAULT_PIPELINE_COUNT	100
+#define DEFAULT_DECODE_US	5000
+#define MAX_SEGMENTS		1024
+#define SPI_SPEED		10000000
+
+
+static void report(const char *name, uint64_t start_ns, uint32_t read_count)
+{
+	acc_driver_spi_linux_spidev_fake_stats_t	stats;
+	uint64_t					elapsed_ns = acc_os_monotonic_ns() - start_ns;
+
+	acc_driver_spi_linux_spidev_fake_get_stats(&stats);
+
+	printf("%-24s %8.3f us/read, %6.2f ioctl/read, %8.1f us bus time/read\n", name,
+	       elapsed_ns / 1000.0 / read_count,
+	       (double)stats.message_count / read_count,
+	       (double)stats.bus_time_us / read_count);
+}
+
+
+// Checks that the loopback returned the pattern the buffer was filled with
+static uint32_t check_sweep(const uint8_t *sweep, size_t sweep_size)
+{
+	for (size_t index = 0; index < sweep_size; index++) {
+		if (sweep[index] != (uint8_t)index) {
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+
+// Stands in for envelope decoding, keeps the CPU busy for decode_us
+static uint32_t decode_sweep(const uint8_t *sweep, size_t sweep_size, uint32_t decode_us)
+{
+	uint64_t	end_ns = acc_os_monotonic_ns() + (uint64_t)decode_us * 1000;
+	uint32_t	sum = 0;
+
+	do {
+		for (size_t index = 0; index < sweep_size; index += 64) {
+			sum += sweep[index];
+		}
+	} while (acc_os_monotonic_ns() < end_ns);
+
+	return sum;
+}
+
+
+static void report_pipeline(const char *name, uint64_t start_ns, uint32_t read_count)
+{
+	printf("%-24s %8.1f us/read\n", name, (acc_os_monotonic_ns() - start_ns) / 1000.0 / read_count);
+}
+
+
+// Reads and decodes sweeps one after the other, then with the async engine overlapping them
+static bool bench_pipeline(uint8_t *sweep, size_t sweep_size, const acc_device_spi_segment_t *segments, size_t segment_count,
+                           uint32_t read_count, uint32_t decode_us)
+{
+	acc_driver_spi_linux_spidev_async_completion_t	completion;
+	acc_driver_spi_linux_spidev_async_stats_t	stats;
+	volatile uint32_t				sink = 0;
+
+	printf("%u reads decoded for %u us each, with bus time\n", (unsigned int)read_count, (unsigned int)decode_us);
+
+	acc_driver_spi_linux_spidev_fake_set_bus_sleep(true);
+
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t read = 0; read < read_count; read++) {
+		if (acc_device_spi_transfer_segments(0, 0, SPI_SPEED, segments, segment_count) != ACC_STATUS_SUCCESS) {
+			return false;
+		}
+		sink += decode_sweep(sweep, sweep_size, decode_us);
+	}
+	report_pipeline("transfer then decode", start_ns, read_count);
+
+	if (acc_driver_spi_linux_spidev_async_start(2, sweep_size) != ACC_STATUS_SUCCESS) {
+		return false;
+	}
+
+	start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t read = 0; read < read_count + 1; read++) {
+		// Queue sweep N+1 before waiting for sweep N, so the bus is busy while N is decoded
+		if (read < read_count) {
+			uint8_t *buffer = acc_driver_spi_linux_spidev_async_acquire();
+
+			if (buffer == NULL ||
+			    acc_driver_spi_linux_spidev_async_submit(0, 0, SPI_SPEED, buffer, sweep_size, NULL) != ACC_STATUS_SUCCESS) {
+				return false;
+			}
+		}
+
+		if (read == 0) {
+			continue;
+		}
+
+		if (acc_driver_spi_linux_spidev_async_wait(&completion, 1000) != ACC_STATUS_SUCCESS ||
+		    completion.status != ACC_STATUS_SUCCESS) {
+			return false;
+		}
+		sink += decode_sweep(completion.buffer, completion.buffer_size, decode_us);
+		acc_driver_spi_linux_spidev_async_release(completion.buffer);
+	}
+	report_pipeline("async double buffered", start_ns, read_count);
+
+	acc_driver_spi_linux_spidev_async_get_stats(0, 0, &stats);
+	acc_driver_spi_linux_spidev_async_stop();
+	acc_driver_spi_linux_spidev_fake_set_bus_sleep(false);
+
+	printf("%-24s %8.2f MB/s on the bus, latency %.1f us mean %u us max\n", "async engine",
+	       (double)stats.byte_count / stats.busy_us,
+	       (double)stats.latency_total_us / stats.transfer_count,
+	       (unsigned int)stats.latency_max_us);
+
+	(void)sink;
+
+	return true;
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint32_t			read_count = DEFAULT_READ_COUNT;
+	uint32_t			pipeline_count = DEFAULT_PIPELINE_COUNT;
+	uint32_t			decode_us = DEFAULT_DECODE_US;
+	size_t				sweep_size = DEFAULT_SWEEP_SIZE;
+	size_t				chunk_size = DEFAULT_CHUNK_SIZE;
+	size_t				bufsiz = DEFAULT_BUFSIZ;
+	static acc_device_spi_segment_t	segments[MAX_SEGMENTS];
+	uint8_t				*sweep;
+	size_t				segment_count;
+	uint32_t			errors = 0;
+	int				option;
+
+	while ((option = getopt(argc, argv, "b:c:d:n:p:s:")) != -1) {
+		switch (option) {
+			case 'b':
+				bufsiz = atoi(optarg);
+				break;
+			case 'c':
+				chunk_size = atoi(optarg);
+				break;
+			case 'd':
+				decode_us = atoi(optarg);
+				break;
+			case 'n':
+				read_count = atoi(optarg);
+				break;
+			case 'p':
+				pipeline_count = atoi(optarg);
+				break;
+			case 's':
+				sweep_size = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-b spidev bufsiz] [-c chunk size] [-d decode us] [-n read count] "
+				        "[-p pipelined read count, 0 to skip] [-s sweep size]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (read_count == 0 || sweep_size == 0 || chunk_size == 0) {
+		fprintf(stderr, "Counts and sizes must be non-zero\n");
+		return EXIT_FAILURE;
+	}
+
+	segment_count = (sweep_size + chunk_size - 1) / chunk_size;
+	if (segment_count > MAX_SEGMENTS) {
+		fprintf(stderr, "At most %u chunks per sweep\n", MAX_SEGMENTS);
+		return EXIT_FAILURE;
+	}
+
+	sweep = malloc(sweep_size);
+	if (sweep == NULL) {
+		return EXIT_FAILURE;
+	}
+
+	for (size_t index = 0; index < sweep_size; index++) {
+		sweep[index] = (uint8_t)index;
+	}
+
+	acc_driver_spi_linux_spidev_fake_reset(bufsiz);
+	acc_driver_spi_linux_spidev_register_with_ops(&acc_driver_spi_linux_spidev_fake_ops);
+
+	if (acc_device_spi_init() != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	if (chunk_size > acc_device_spi_get_max_transfer_size()) {
+		fprintf(stderr, "Chunk size must be at most the spidev bufsiz\n");
+		return EXIT_FAILURE;
+	}
+
+	// Chip select is released after every bufsiz of chunks, where spidev has to end a message anyway
+	size_t chunks_per_message = acc_device_spi_get_max_transfer_size() / chunk_size;
+
+	for (size_t segment = 0; segment < segment_count; segment++) {
+		size_t offset = segment * chunk_size;
+
+		segments[segment].buffer	= sweep + offset;
+		segments[segment].buffer_size	= (sweep_size - offset < chunk_size) ? sweep_size - offset : chunk_size;
+		segments[segment].cs_deselect	= ((segment + 1) % chunks_per_message == 0) ? 1 : 0;
+	}
+
+	printf("%u reads of %u bytes in %u byte chunks, spidev bufsiz %u\n", (unsigned int)read_count,
+	       (unsigned int)sweep_size, (unsigned int)chunk_size, (unsigned int)acc_device_spi_get_max_transfer_size());
+
+	// One ioctl per chunk
+	acc_driver_spi_linux_spidev_fake_reset(bufsiz);
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t read = 0; read < read_count; read++) {
+		for (size_t segment = 0; segment < segment_count; segment++) {
+			if (acc_device_spi_transfer(0, 0, SPI_SPEED, segments[segment].buffer, segments[segment].buffer_size) != ACC_STATUS_SUCCESS) {
+				return EXIT_FAILURE;
+			}
+		}
+		errors += check_sweep(sweep, sweep_size);
+	}
+	report("single transfers", start_ns, read_count);
+
+	// Chunks packed into as few messages as bufsiz allows
+	acc_driver_spi_linux_spidev_fake_reset(bufsiz);
+	start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t read = 0; read < read_count; read++) {
+		if (acc_device_spi_transfer_segments(0, 0, SPI_SPEED, segments, segment_count) != ACC_STATUS_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+		errors += check_sweep(sweep, sweep_size);
+	}
+	report("vectored transfers", start_ns, read_count);
+
+	printf("%u reads with wrong data\n", (unsigned int)errors);
+
+	if (pipeline_count > 0 && !bench_pipeline(sweep, sweep_size, segments, segment_count, pipeline_count, decode_us)) {
+		return EXIT_FAILURE;
+	}
+
+	free(sweep);
+
+	return errors == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
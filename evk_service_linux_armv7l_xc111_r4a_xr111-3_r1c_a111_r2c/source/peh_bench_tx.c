@@ -0,0 +1,198 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Per-sweep CPU cost of the peh_test transmit paths
+//
+// Built for the Pi by "make" as out/peh_bench_tx, and for the build host by "make host" as
+// out_host/peh_bench_tx. Does not need a sensor.
+
+// needed for getopt and CLOCK_THREAD_CPUTIME_ID
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "peh_frame.h"
+#include "peh_sender.h"
+
+
+#define DEFAULT_DATA_LENGTH	500
+#define DEFAULT_SWEEP_COUNT	20000
+#define LEGACY_BUFLEN		2048
+
+
+static int			sink;
+static int			sock;
+static struct sockaddr_in	sink_address;
+static uint16_t			envelope_data[PEH_SENDER_MAX_DATA_LENGTH];
+
+
+static uint64_t thread_cpu_ns(void)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+	return (uint64_t)now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+
+static void init_header(peh_frame_header_t *header, uint16_t data_length)
+{
+	memset(header, 0, sizeof(*header));
+	header->magic		= PEH_FRAME_MAGIC;
+	header->version		= PEH_FRAME_VERSION;
+	header->type		= PEH_FRAME_TYPE_ENVELOPE;
+	header->header_length	= sizeof(*header);
+	header->sensor_id	= 1;
+	header->data_length	= data_length;
+	header->item_size	= sizeof(uint16_t);
+}
+
+
+// The original loop: float conversion into a fixed buffer, always sending all of it
+static void run_legacy(uint16_t data_length, uint32_t sweep_count)
+{
+	static uint16_t message[LEGACY_BUFLEN];
+
+	for (uint32_t sweep = 0; sweep < sweep_count; sweep++) {
+		for (uint_fast16_t index = 0; index < data_length; index++) {
+			message[index] = (int16_t)envelope_data[index] + 0.5;
+		}
+		sendto(sock, message, sizeof(message), 0, (struct sockaddr *)&sink_address, sizeof(sink_address));
+	}
+}
+
+
+// Header and valid bins copied into one buffer
+static void run_copy(uint16_t data_length, uint32_t sweep_count)
+{
+	static struct __attribute__((packed)) {
+		peh_frame_header_t	header;
+		uint16_t		data[PEH_SENDER_MAX_DATA_LENGTH];
+	} message;
+
+	init_header(&message.header, data_length);
+
+	for (uint32_t sweep = 0; sweep < sweep_count; sweep++) {
+		message.header.sequence_number = sweep;
+		memcpy(message.data, envelope_data, data_length * sizeof(uint16_t));
+		sendto(sock, &message, sizeof(message.header) + data_length * sizeof(uint16_t), 0,
+		       (struct sockaddr *)&sink_address, sizeof(sink_address));
+	}
+}
+
+
+// Header and bins scattered straight from where they are with sendmsg()/sendmmsg()
+static void run_sender(uint16_t data_length, uint32_t sweep_count, uint16_t sweeps_per_datagram, uint16_t datagrams_per_send)
+{
+	static peh_sender_t	sender;
+	peh_sender_config_t	config;
+	peh_frame_header_t	header;
+	char			address[INET_ADDRSTRLEN];
+
+	peh_sender_config_default(&config);
+	config.sweeps_per_datagram	= sweeps_per_datagram;
+	config.datagrams_per_send	= datagrams_per_send;
+	config.max_latency_us		= 0;
+
+	inet_ntop(AF_INET, &sink_address.sin_addr, address, sizeof(address));
+	if (!peh_sender_create(&sender, address, ntohs(sink_address.sin_port), &config)) {
+		exit(EXIT_FAILURE);
+	}
+
+	init_header(&header, data_length);
+
+	for (uint32_t sweep = 0; sweep < sweep_count; sweep++) {
+		header.sequence_number = sweep;
+		peh_sender_add_frame(&sender, &header, envelope_data);
+		peh_sender_take_completed(&sender);
+	}
+
+	peh_sender_destroy(&sender);
+}
+
+
+static void report(const char *name, uint64_t start_ns, uint32_t sweep_count)
+{
+	uint64_t elapsed_ns = thread_cpu_ns() - start_ns;
+
+	printf("%-28s %8.2f us/sweep\n", name, elapsed_ns / 1000.0 / sweep_count);
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint16_t	data_length = DEFAULT_DATA_LENGTH;
+	uint32_t	sweep_count = DEFAULT_SWEEP_COUNT;
+	int		option;
+
+	while ((option = getopt(argc, argv, "b:c:")) != -1) {
+		switch (option) {
+			case 'b':
+				data_length = atoi(optarg);
+				break;
+			case 'c':
+				sweep_count = atoi(optarg);
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-b bins per sweep] [-c sweep count]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (data_length == 0 || data_length > PEH_SENDER_MAX_DATA_LENGTH || sweep_count == 0) {
+		fprintf(stderr, "Bins must be 1-%u and sweep count non-zero\n", PEH_SENDER_MAX_DATA_LENGTH);
+		return EXIT_FAILURE;
+	}
+
+	for (uint_fast16_t index = 0; index < data_length; index++) {
+		envelope_data[index] = (index * 37) & 0x3fff;
+	}
+
+	// Send to a local socket that is never read, the kernel drops what does not fit
+	socklen_t address_size = sizeof(sink_address);
+
+	sink_address.sin_family		= AF_INET;
+	sink_address.sin_addr.s_addr	= htonl(INADDR_LOOPBACK);
+	sink_address.sin_port		= 0;
+
+	if ((sink = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0 ||
+	    bind(sink, (struct sockaddr *)&sink_address, sizeof(sink_address)) < 0 ||
+	    getsockname(sink, (struct sockaddr *)&sink_address, &address_size) < 0 ||
+	    (sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+		perror("socket");
+		return EXIT_FAILURE;
+	}
+
+	printf("%u sweeps of %u bins\n", (unsigned int)sweep_count, (unsigned int)data_length);
+
+	uint64_t start_ns = thread_cpu_ns();
+	run_legacy(data_length, sweep_count);
+	report("legacy convert + sendto", start_ns, sweep_count);
+
+	start_ns = thread_cpu_ns();
+	run_copy(data_length, sweep_count);
+	report("copy + sendto", start_ns, sweep_count);
+
+	start_ns = thread_cpu_ns();
+	run_sender(data_length, sweep_count, 1, 1);
+	report("iovec sendmsg", start_ns, sweep_count);
+
+	start_ns = thread_cpu_ns();
+	run_sender(data_length, sweep_count, 1, 16);
+	report("iovec sendmmsg, 16/call", start_ns, sweep_count);
+
+	close(sock);
+	close(sink);
+
+	return EXIT_SUCCESS;
+}
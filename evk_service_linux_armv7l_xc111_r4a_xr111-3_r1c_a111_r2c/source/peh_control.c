@@ -0,0 +1,110 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <errno.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "peh_control.h"
+
+
+bool peh_control_create(peh_control_t *control, uint16_t port)
+{
+	struct sockaddr_in address;
+
+	memset(control, 0, sizeof(*control));
+
+	control->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+	if (control->socket < 0) {
+		perror("control socket");
+		return false;
+	}
+
+	memset(&address, 0, sizeof(address));
+	address.sin_family	= AF_INET;
+	address.sin_port	= htons(port);
+	address.sin_addr.s_addr	= htonl(INADDR_ANY);
+
+	if (bind(control->socket, (const struct sockaddr *)&address, sizeof(address)) < 0) {
+		perror("control bind");
+		close(control->socket);
+		control->socket = -1;
+		return false;
+	}
+
+	return true;
+}
+
+
+void peh_control_destroy(peh_control_t *control)
+{
+	if (control->socket >= 0) {
+		close(control->socket);
+		control->socket = -1;
+	}
+}
+
+
+bool peh_control_receive(peh_control_t *control, char *command, size_t command_size, uint32_t timeout_ms)
+{
+	struct pollfd	fd = { .fd = control->socket, .events = POLLIN };
+	ssize_t		length;
+
+	if (command_size == 0 || poll(&fd, 1, timeout_ms) <= 0) {
+		return false;
+	}
+
+	control->peer_length = sizeof(control->peer);
+	length = recvfrom(control->socket, command, command_size - 1, 0,
+	                  (struct sockaddr *)&control->peer, &control->peer_length);
+	if (length < 0) {
+		if (errno != EINTR) {
+			perror("control recvfrom");
+		}
+		control->peer_length = 0;
+		return false;
+	}
+
+	while (length > 0 && (command[length - 1] == '\n' || command[length - 1] == '\r')) {
+		length--;
+	}
+	command[length] = '\0';
+
+	return true;
+}
+
+
+void peh_control_reply(peh_control_t *control, const char *format, ...)
+{
+	char	reply[PEH_CONTROL_MAX_COMMAND_LENGTH];
+	va_list	args;
+	int	length;
+
+	if (control->peer_length == 0) {
+		return;
+	}
+
+	va_start(args, format);
+	length = vsnprintf(reply, sizeof(reply) - 1, format, args);
+	va_end(args);
+
+	if (length < 0) {
+		return;
+	}
+	if ((size_t)length > sizeof(reply) - 2) {
+		length = sizeof(reply) - 2;
+	}
+	reply[length++] = '\n';
+
+	// Best effort, a client that went away must not stall acquisition
+	sendto(control->socket, reply, length, MSG_DONTWAIT,
+	       (const struct sockaddr *)&control->peer, control->peer_length);
+}
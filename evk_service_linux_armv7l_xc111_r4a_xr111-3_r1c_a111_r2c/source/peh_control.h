@@ -0,0 +1,82 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef PEH_CONTROL_H_
+#define PEH_CONTROL_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Largest command accepted on the control channel, longer datagrams are truncated
+ */
+#define PEH_CONTROL_MAX_COMMAND_LENGTH	256
+
+
+/**
+ * @brief UDP command channel
+ *
+ * Commands are single datagrams of text. Replies go back to the address the last command
+ * came from, so any tool able to send a datagram, e.g. "echo start=0.3 | nc -u -w1 pi 8889",
+ * can be used as a client.
+ */
+typedef struct {
+	int			socket;
+	struct sockaddr_in	peer;		// sender of the last command
+	socklen_t		peer_length;
+} peh_control_t;
+
+
+/**
+ * @brief Open the control socket
+ *
+ * @param control The control channel to initialize
+ * @param port UDP port to listen on, on all interfaces
+ * @return True if successful
+ */
+extern bool peh_control_create(peh_control_t *control, uint16_t port);
+
+
+/**
+ * @brief Close the control socket
+ *
+ * @param control The control channel to destroy
+ */
+extern void peh_control_destroy(peh_control_t *control);
+
+
+/**
+ * @brief Wait for the next command
+ *
+ * @param control The control channel
+ * @param[out] command Buffer for the command, always null terminated with trailing line
+ *             breaks removed
+ * @param command_size Size of the command buffer
+ * @param timeout_ms Longest time to wait
+ * @return True if a command was received, false on timeout or error
+ */
+extern bool peh_control_receive(peh_control_t *control, char *command, size_t command_size, uint32_t timeout_ms);
+
+
+/**
+ * @brief Send a reply to the sender of the last command
+ *
+ * @param control The control channel
+ * @param format printf style format of the reply
+ */
+extern void peh_control_reply(peh_control_t *control, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
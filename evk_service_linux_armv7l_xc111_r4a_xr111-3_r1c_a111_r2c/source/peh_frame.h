@@ -0,0 +1,92 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef PEH_FRAME_H_
+#define PEH_FRAME_H_
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Wire format of the datagrams sent by peh_test
+ *
+ * Every frame is a peh_frame_header_t followed by header.data_length payload items of
+ * header.item_size bytes each. A datagram carries one or more frames back to back, the next
+ * frame starts right after the payload of the previous one, so frames of unknown type can
+ * be skipped. All fields are little endian, which is native on both the Raspberry Pi and x86.
+ *
+ * Receivers must skip header_length bytes to reach the payload, so fields can be appended
+ * to the header without breaking older receivers. Incompatible changes bump the version.
+ *
+ * Version 2 sends several frames per datagram and replaces the reserved field of version 1
+ * with item_size.
+ */
+#define PEH_FRAME_MAGIC		0x4850	// "PH" on the wire
+#define PEH_FRAME_VERSION	2
+
+
+/**
+ * @brief Frame payload types
+ */
+typedef enum {
+	PEH_FRAME_TYPE_ENVELOPE = 1,	// payload is data_length uint16_t envelope bins
+	PEH_FRAME_TYPE_REFLECTIONS = 2,	// payload is data_length peh_frame_reflection_t
+} peh_frame_type_enum_t;
+typedef uint8_t peh_frame_type_t;
+
+
+/**
+ * @brief Payload item of a PEH_FRAME_TYPE_REFLECTIONS frame
+ *
+ * One reflection found by the distance detector in the sweep described by the header.
+ * A sweep without reflections is sent as a frame with data_length 0.
+ *
+ * @param distance_m Distance to the reflection[m], on the same scale as start_m
+ * @param amplitude Amplitude of the reflection[arbitrary unit]
+ */
+typedef struct __attribute__((packed)) {
+	float		distance_m;
+	uint16_t	amplitude;
+} peh_frame_reflection_t;
+
+
+/**
+ * @brief Header preceding the payload of every frame
+ *
+ * @param magic PEH_FRAME_MAGIC
+ * @param version PEH_FRAME_VERSION
+ * @param type One of peh_frame_type_enum_t
+ * @param header_length Size of the header in bytes, payload starts at this offset
+ * @param sensor_id The sensor the sweep was taken with, first sensor is 1
+ * @param sequence_number Increased by one for every sweep, gaps mean lost sweeps
+ * @param timestamp_us Wall clock time of acquisition in microseconds since the epoch
+ * @param start_m Start of the swept range[m]
+ * @param length_m Length of the swept range[m]
+ * @param data_length Number of payload items following the header
+ * @param item_size Size of one payload item in bytes
+ */
+typedef struct __attribute__((packed)) {
+	uint16_t	magic;
+	uint8_t		version;
+	uint8_t		type;
+	uint16_t	header_length;
+	uint16_t	sensor_id;
+	uint32_t	sequence_number;
+	uint64_t	timestamp_us;
+	float		start_m;
+	float		length_m;
+	uint16_t	data_length;
+	uint8_t		item_size;
+	uint8_t		reserved;
+} peh_frame_header_t;
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
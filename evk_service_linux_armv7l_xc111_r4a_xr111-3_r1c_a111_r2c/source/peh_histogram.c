@@ -0,0 +1,158 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "peh_histogram.h"
+
+
+static uint32_t bucket_index(uint32_t value)
+{
+	if (value < PEH_HISTOGRAM_SUB_BUCKETS) {
+		return value;
+	}
+
+	uint32_t magnitude = 31 - __builtin_clz(value);
+	uint32_t shift     = magnitude - PEH_HISTOGRAM_SUB_BUCKET_BITS;
+
+	return (shift + 1) * PEH_HISTOGRAM_SUB_BUCKETS + (value >> shift) - PEH_HISTOGRAM_SUB_BUCKETS;
+}
+
+
+static uint32_t bucket_lower(uint32_t index)
+{
+	if (index < PEH_HISTOGRAM_SUB_BUCKETS) {
+		return index;
+	}
+
+	uint32_t shift = index / PEH_HISTOGRAM_SUB_BUCKETS - 1;
+
+	return (PEH_HISTOGRAM_SUB_BUCKETS + index % PEH_HISTOGRAM_SUB_BUCKETS) << shift;
+}
+
+
+static uint32_t bucket_upper(uint32_t index)
+{
+	if (index < PEH_HISTOGRAM_SUB_BUCKETS) {
+		return index;
+	}
+
+	uint32_t shift = index / PEH_HISTOGRAM_SUB_BUCKETS - 1;
+
+	return bucket_lower(index) + ((1u << shift) - 1);
+}
+
+
+void peh_histogram_reset(peh_histogram_t *histogram)
+{
+	memset(histogram, 0, sizeof(*histogram));
+}
+
+
+void peh_histogram_add(peh_histogram_t *histogram, uint32_t value)
+{
+	uint32_t index = bucket_index(value);
+
+	// Single writer, the stores only need to be atomic for snapshots taken meanwhile
+	__atomic_store_n(&histogram->buckets[index], histogram->buckets[index] + 1, __ATOMIC_RELAXED);
+	__atomic_store_n(&histogram->sum, histogram->sum + value, __ATOMIC_RELAXED);
+	__atomic_store_n(&histogram->count, histogram->count + 1, __ATOMIC_RELEASE);
+}
+
+
+void peh_histogram_snapshot(const peh_histogram_t *histogram, peh_histogram_t *snapshot)
+{
+	// Buckets are read after count, so they hold at least count samples
+	snapshot->count = __atomic_load_n(&histogram->count, __ATOMIC_ACQUIRE);
+	snapshot->sum   = __atomic_load_n(&histogram->sum, __ATOMIC_RELAXED);
+
+	for (uint32_t index = 0; index < PEH_HISTOGRAM_BUCKETS; index++) {
+		snapshot->buckets[index] = __atomic_load_n(&histogram->buckets[index], __ATOMIC_RELAXED);
+	}
+}
+
+
+void peh_histogram_subtract(peh_histogram_t *histogram, const peh_histogram_t *older)
+{
+	histogram->count -= older->count;
+	histogram->sum   -= older->sum;
+
+	for (uint32_t index = 0; index < PEH_HISTOGRAM_BUCKETS; index++) {
+		histogram->buckets[index] -= older->buckets[index];
+	}
+}
+
+
+uint32_t peh_histogram_percentile(const peh_histogram_t *histogram, double fraction)
+{
+	uint64_t total = 0;
+	uint64_t rank;
+
+	for (uint32_t index = 0; index < PEH_HISTOGRAM_BUCKETS; index++) {
+		total += histogram->buckets[index];
+	}
+
+	if (total == 0) {
+		return 0;
+	}
+
+	rank = (uint64_t)(fraction * total + 0.5);
+	if (rank < 1) {
+		rank = 1;
+	}
+
+	for (uint32_t index = 0; index < PEH_HISTOGRAM_BUCKETS; index++) {
+		if (histogram->buckets[index] >= rank) {
+			return bucket_upper(index);
+		}
+		rank -= histogram->buckets[index];
+	}
+
+	return UINT32_MAX;
+}
+
+
+bool peh_histogram_range(const peh_histogram_t *histogram, uint32_t *min, uint32_t *max)
+{
+	int32_t first = -1;
+	int32_t last  = -1;
+
+	// A snapshot may hold samples in the buckets that were added after count was read
+	if (histogram->count == 0) {
+		return false;
+	}
+
+	for (uint32_t index = 0; index < PEH_HISTOGRAM_BUCKETS; index++) {
+		if (histogram->buckets[index] != 0) {
+			if (first < 0) {
+				first = index;
+			}
+			last = index;
+		}
+	}
+
+	if (first < 0) {
+		return false;
+	}
+
+	*min = bucket_lower(first);
+	*max = bucket_upper(last);
+
+	return true;
+}
+
+
+void peh_histogram_print(const peh_histogram_t *histogram, const char *unit, FILE *stream)
+{
+	for (uint32_t index = 0; index < PEH_HISTOGRAM_BUCKETS; index++) {
+		if (histogram->buckets[index] == 0) {
+			continue;
+		}
+
+		fprintf(stream, "\n  %10u - %10u %s: %u", (unsigned int)bucket_lower(index), (unsigned int)bucket_upper(index),
+		        unit, (unsigned int)histogram->buckets[index]);
+	}
+}
@@ -0,0 +1,117 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef PEH_HISTOGRAM_H_
+#define PEH_HISTOGRAM_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Linear buckets per power of two, relative resolution is 1/16 of the value
+ */
+#define PEH_HISTOGRAM_SUB_BUCKET_BITS	4
+#define PEH_HISTOGRAM_SUB_BUCKETS	(1 << PEH_HISTOGRAM_SUB_BUCKET_BITS)
+
+/**
+ * @brief Number of buckets needed to cover all uint32_t values
+ */
+#define PEH_HISTOGRAM_BUCKETS		(PEH_HISTOGRAM_SUB_BUCKETS * (33 - PEH_HISTOGRAM_SUB_BUCKET_BITS))
+
+
+/**
+ * @brief Log-linear histogram of uint32_t samples
+ *
+ * Values below PEH_HISTOGRAM_SUB_BUCKETS get a bucket each, larger values are split into
+ * powers of two with PEH_HISTOGRAM_SUB_BUCKETS linear buckets each. Recording is a handful
+ * of instructions and never allocates, so it can be done from the service thread.
+ *
+ * One thread records, any thread may take a snapshot. Reports over an interval are made by
+ * subtracting the snapshot taken at the start of the interval.
+ */
+typedef struct {
+	uint32_t	count;
+	uint64_t	sum;
+	uint32_t	buckets[PEH_HISTOGRAM_BUCKETS];
+} peh_histogram_t;
+
+
+/**
+ * @brief Clear a histogram
+ *
+ * Not safe while another thread records into it.
+ *
+ * @param histogram The histogram to clear
+ */
+extern void peh_histogram_reset(peh_histogram_t *histogram);
+
+
+/**
+ * @brief Record one sample
+ *
+ * @param histogram The histogram
+ * @param value The sample
+ */
+extern void peh_histogram_add(peh_histogram_t *histogram, uint32_t value);
+
+
+/**
+ * @brief Copy a histogram that may be recorded into by another thread
+ *
+ * @param histogram The histogram to copy
+ * @param[out] snapshot The copy
+ */
+extern void peh_histogram_snapshot(const peh_histogram_t *histogram, peh_histogram_t *snapshot);
+
+
+/**
+ * @brief Remove the samples of an older snapshot of the same histogram
+ *
+ * @param histogram Newer snapshot, the difference is stored here
+ * @param older Older snapshot
+ */
+extern void peh_histogram_subtract(peh_histogram_t *histogram, const peh_histogram_t *older);
+
+
+/**
+ * @brief Get the value below which a fraction of the samples fall
+ *
+ * @param histogram The histogram
+ * @param fraction Fraction of the samples, 0.5 for the median, 1.0 for the maximum
+ * @return Upper limit of the bucket holding that sample, 0 for an empty histogram
+ */
+extern uint32_t peh_histogram_percentile(const peh_histogram_t *histogram, double fraction);
+
+
+/**
+ * @brief Get the smallest and largest values, to bucket resolution
+ *
+ * @param histogram The histogram
+ * @param[out] min Lower limit of the first non-empty bucket
+ * @param[out] max Upper limit of the last non-empty bucket
+ * @return False if the histogram has no counted samples
+ */
+extern bool peh_histogram_range(const peh_histogram_t *histogram, uint32_t *min, uint32_t *max);
+
+
+/**
+ * @brief Print the non-empty buckets, one line each
+ *
+ * @param histogram The histogram
+ * @param unit Unit of the values, printed after each bucket range
+ * @param stream Where to print
+ */
+extern void peh_histogram_print(const peh_histogram_t *histogram, const char *unit, FILE *stream);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,114 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// needed for posix_memalign
+#define _POSIX_C_SOURCE 200112L
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "peh_ring.h"
+
+
+/**
+ * @brief Return the slot at a ring index
+ */
+static peh_sweep_t *slot_at(peh_ring_t *ring, uint32_t index)
+{
+	return (peh_sweep_t *)(ring->slots + (size_t)(index & ring->slot_mask) * ring->slot_size);
+}
+
+
+bool peh_ring_create(peh_ring_t *ring, uint32_t slot_count, uint16_t max_data_length)
+{
+	uint32_t	count = 1;
+	void		*slots;
+
+	if (slot_count == 0 || slot_count > (1u << 16)) {
+		return false;
+	}
+
+	while (count < slot_count) {
+		count <<= 1;
+	}
+
+	memset(ring, 0, sizeof(*ring));
+
+	// Keep every slot on its own cache lines
+	ring->slot_size		= sizeof(peh_sweep_t) + (size_t)max_data_length * sizeof(uint16_t);
+	ring->slot_size		= (ring->slot_size + PEH_RING_CACHE_LINE - 1) & ~(size_t)(PEH_RING_CACHE_LINE - 1);
+	ring->slot_mask		= count - 1;
+	ring->max_data_length	= max_data_length;
+
+	if (posix_memalign(&slots, PEH_RING_CACHE_LINE, ring->slot_size * count) != 0) {
+		return false;
+	}
+
+	// Touch every slot now rather than in the acquisition path
+	memset(slots, 0, ring->slot_size * count);
+	ring->slots = slots;
+
+	return true;
+}
+
+
+void peh_ring_destroy(peh_ring_t *ring)
+{
+	free(ring->slots);
+	ring->slots = NULL;
+}
+
+
+bool peh_ring_push(peh_ring_t *ring, const peh_sweep_t *sweep, const uint16_t *data)
+{
+	uint32_t head = ring->head;
+
+	if (sweep->data_length > ring->max_data_length) {
+		__atomic_store_n(&ring->stats.dropped_oversize, ring->stats.dropped_oversize + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	if (head - __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE) > ring->slot_mask) {
+		__atomic_store_n(&ring->stats.dropped_full, ring->stats.dropped_full + 1, __ATOMIC_RELAXED);
+		return false;
+	}
+
+	peh_sweep_t *slot = slot_at(ring, head);
+
+	*slot = *sweep;
+	memcpy(slot->data, data, sweep->data_length * sizeof(uint16_t));
+
+	__atomic_store_n(&ring->head, head + 1, __ATOMIC_RELEASE);
+	__atomic_store_n(&ring->stats.published, ring->stats.published + 1, __ATOMIC_RELAXED);
+
+	return true;
+}
+
+
+uint32_t peh_ring_available(peh_ring_t *ring)
+{
+	return __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) - ring->tail;
+}
+
+
+peh_sweep_t *peh_ring_get(peh_ring_t *ring, uint32_t offset)
+{
+	return slot_at(ring, ring->tail + offset);
+}
+
+
+void peh_ring_release(peh_ring_t *ring, uint32_t count)
+{
+	__atomic_store_n(&ring->tail, ring->tail + count, __ATOMIC_RELEASE);
+}
+
+
+void peh_ring_get_stats(peh_ring_t *ring, peh_ring_stats_t *stats)
+{
+	stats->published	= __atomic_load_n(&ring->stats.published, __ATOMIC_RELAXED);
+	stats->dropped_full	= __atomic_load_n(&ring->stats.dropped_full, __ATOMIC_RELAXED);
+	stats->dropped_oversize	= __atomic_load_n(&ring->stats.dropped_oversize, __ATOMIC_RELAXED);
+}
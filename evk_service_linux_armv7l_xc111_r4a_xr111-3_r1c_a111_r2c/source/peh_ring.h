@@ -0,0 +1,161 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef PEH_RING_H_
+#define PEH_RING_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Size of a cache line, ring indices and slots are aligned to this
+ */
+#define PEH_RING_CACHE_LINE	64
+
+
+/**
+ * @brief One sweep stored in a ring slot
+ *
+ * @param sequence_number Sweep sequence number, extended to 32 bits by the producer
+ * @param timestamp_us Wall clock time of acquisition in microseconds since the epoch, ready_us
+ *        moved by a wall clock offset measured with acc_os_time_pair_capture()
+ * @param ready_us CLOCK_MONOTONIC time the service handed the sweep over[us], the start of
+ *        the latency measured for each stage
+ * @param configuration_id Identifies the service the sweep came from, changes every time the
+ *        service is recreated
+ * @param start_m Start of the swept range[m], travels with the sweep so a reconfiguration
+ *        never mislabels sweeps still waiting in the ring
+ * @param length_m Length of the swept range[m]
+ * @param data_length Number of valid bins in data
+ * @param data Envelope bins, room for the max_data_length given to peh_ring_create()
+ */
+typedef struct {
+	uint32_t	sequence_number;
+	uint64_t	timestamp_us;
+	uint64_t	ready_us;
+	uint32_t	configuration_id;
+	float		start_m;
+	float		length_m;
+	uint16_t	data_length;
+	uint16_t	data[];
+} peh_sweep_t;
+
+
+/**
+ * @brief Reasons for a sweep to be dropped before reaching the consumer
+ *
+ * All counters are only written by the producer and may be read by any thread.
+ */
+typedef struct {
+	uint32_t	published;		// sweeps handed over to the consumer
+	uint32_t	dropped_full;		// consumer did not keep up, no free slot
+	uint32_t	dropped_oversize;	// sweep longer than max_data_length
+} peh_ring_stats_t;
+
+
+/**
+ * @brief Single producer, single consumer ring of preallocated sweep slots
+ *
+ * The producer and the consumer indices live on separate cache lines so the two threads
+ * do not bounce a line between them on every sweep. No locks are taken, the producer
+ * never blocks and drops the sweep when the ring is full.
+ */
+typedef struct {
+	uint32_t		head __attribute__((aligned(PEH_RING_CACHE_LINE)));	// next slot to write, producer only
+	peh_ring_stats_t	stats;
+	uint32_t		tail __attribute__((aligned(PEH_RING_CACHE_LINE)));	// next slot to read, consumer only
+	uint32_t		slot_mask __attribute__((aligned(PEH_RING_CACHE_LINE)));
+	size_t			slot_size;
+	uint16_t		max_data_length;
+	uint8_t			*slots;
+} peh_ring_t;
+
+
+/**
+ * @brief Allocate the slots of a ring
+ *
+ * @param ring The ring to initialize
+ * @param slot_count Number of slots, rounded up to a power of two
+ * @param max_data_length Maximum number of bins in one sweep
+ * @return True if successful
+ */
+extern bool peh_ring_create(peh_ring_t *ring, uint32_t slot_count, uint16_t max_data_length);
+
+
+/**
+ * @brief Free the slots of a ring
+ *
+ * Neither the producer nor the consumer may use the ring during or after this call.
+ *
+ * @param ring The ring to destroy
+ */
+extern void peh_ring_destroy(peh_ring_t *ring);
+
+
+/**
+ * @brief Copy a sweep into the next free slot and hand it over to the consumer
+ *
+ * Producer side. Never blocks, the sweep is dropped and counted if it cannot be stored.
+ *
+ * @param ring The ring
+ * @param sweep Sweep description, everything but data is copied into the slot
+ * @param data sweep->data_length envelope bins
+ * @return True if the sweep was stored
+ */
+extern bool peh_ring_push(peh_ring_t *ring, const peh_sweep_t *sweep, const uint16_t *data);
+
+
+/**
+ * @brief Get the number of sweeps published and not yet released
+ *
+ * Consumer side.
+ *
+ * @param ring The ring
+ * @return Number of sweeps available to peh_ring_get()
+ */
+extern uint32_t peh_ring_available(peh_ring_t *ring);
+
+
+/**
+ * @brief Get a sweep not yet released by the consumer
+ *
+ * Consumer side. The sweep stays valid until it is released, which lets the consumer
+ * hand the slot memory straight to the kernel and release it after the send.
+ *
+ * @param ring The ring
+ * @param offset Position counted from the oldest unreleased sweep, must be less than
+ *        peh_ring_available()
+ * @return The sweep
+ */
+extern peh_sweep_t *peh_ring_get(peh_ring_t *ring, uint32_t offset);
+
+
+/**
+ * @brief Give the oldest slots back to the producer
+ *
+ * @param ring The ring
+ * @param count Number of sweeps to release, at most peh_ring_available()
+ */
+extern void peh_ring_release(peh_ring_t *ring, uint32_t count);
+
+
+/**
+ * @brief Read the producer counters
+ *
+ * @param ring The ring
+ * @param[out] stats The counters are copied here
+ */
+extern void peh_ring_get_stats(peh_ring_t *ring, peh_ring_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,317 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// needed for sendmmsg
+#define _GNU_SOURCE
+
+#include <arpa/inet.h>
+#include <errno.h>
+#include <netinet/in.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "acc_os.h"
+#include "peh_frame.h"
+#include "peh_sender.h"
+
+
+/**
+ * @brief IPv4 and UDP header overhead subtracted from the MTU
+ */
+#define IP_UDP_HEADER_SIZE	28
+
+/**
+ * @brief Datagram size used when the path MTU cannot be found
+ */
+#define FALLBACK_MTU		1500
+
+
+static uint64_t monotonic_us(void)
+{
+	return acc_os_monotonic_ns() / 1000;
+}
+
+
+/**
+ * @brief Ask the kernel for the MTU of the route to the destination
+ */
+static size_t path_mtu(const struct sockaddr_in *address)
+{
+	int		mtu = FALLBACK_MTU;
+	socklen_t	mtu_size = sizeof(mtu);
+	int		probe = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+
+	if (probe < 0) {
+		return FALLBACK_MTU;
+	}
+
+	// A connected socket is needed for IP_MTU, use a throwaway one so the sending
+	// socket does not start reporting ICMP errors from a receiver that is not running
+	if (connect(probe, (const struct sockaddr *)address, sizeof(*address)) < 0 ||
+	    getsockopt(probe, IPPROTO_IP, IP_MTU, &mtu, &mtu_size) < 0 ||
+	    mtu <= IP_UDP_HEADER_SIZE) {
+		mtu = FALLBACK_MTU;
+	}
+
+	close(probe);
+
+	return mtu;
+}
+
+
+void peh_sender_config_default(peh_sender_config_t *config)
+{
+	config->sweeps_per_datagram	= 1;
+	config->datagrams_per_send	= 1;
+	config->max_latency_us		= PEH_SENDER_DEFAULT_MAX_LATENCY_US;
+	config->max_datagram_size	= 0;
+}
+
+
+bool peh_sender_create(peh_sender_t *sender, const char *address, uint16_t port, const peh_sender_config_t *config)
+{
+	memset(sender, 0, sizeof(*sender));
+
+	sender->address.sin_family	= AF_INET;
+	sender->address.sin_port	= htons(port);
+
+	if (inet_pton(AF_INET, address, &sender->address.sin_addr) != 1) {
+		fprintf(stderr, "Invalid destination address %s\n", address);
+		return false;
+	}
+
+	if ((sender->socket = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) < 0) {
+		perror("socket");
+		return false;
+	}
+
+	sender->config = *config;
+
+	if (sender->config.sweeps_per_datagram == 0) {
+		sender->config.sweeps_per_datagram = 1;
+	}
+
+	if (sender->config.datagrams_per_send == 0) {
+		sender->config.datagrams_per_send = 1;
+	}
+	else if (sender->config.datagrams_per_send > PEH_SENDER_MAX_DATAGRAMS) {
+		sender->config.datagrams_per_send = PEH_SENDER_MAX_DATAGRAMS;
+	}
+
+	if (sender->config.max_datagram_size == 0) {
+		sender->config.max_datagram_size = path_mtu(&sender->address) - IP_UDP_HEADER_SIZE;
+	}
+
+	// Stay within what a datagram can carry
+	if (sender->config.max_datagram_size > 65507) {
+		sender->config.max_datagram_size = 65507;
+	}
+
+	return true;
+}
+
+
+void peh_sender_destroy(peh_sender_t *sender)
+{
+	peh_sender_flush(sender);
+
+	close(sender->socket);
+	sender->socket = -1;
+}
+
+
+/**
+ * @brief Stop adding frames to the open datagram, flush if the batch is complete
+ */
+static void close_datagram(peh_sender_t *sender)
+{
+	sender->datagram_open = false;
+
+	if (sender->datagram_count >= sender->config.datagrams_per_send) {
+		peh_sender_flush(sender);
+	}
+}
+
+
+void peh_sender_add_frame(peh_sender_t *sender, const peh_frame_header_t *header, const void *data)
+{
+	size_t data_size  = (size_t)header->data_length * header->item_size;
+	size_t frame_size = header->header_length + data_size;
+
+	if (data_size > PEH_SENDER_MAX_DATA_LENGTH * sizeof(uint16_t) || header->header_length != sizeof(*header)) {
+		// Completions are reported in order, so send what is pending before dropping this one
+		peh_sender_flush(sender);
+		__atomic_store_n(&sender->stats.send_failed, sender->stats.send_failed + 1, __ATOMIC_RELAXED);
+		sender->completed++;
+		return;
+	}
+
+	if (sender->datagram_open) {
+		peh_sender_datagram_t *datagram = &sender->datagrams[sender->datagram_count - 1];
+
+		if (datagram->size + frame_size > sender->config.max_datagram_size) {
+			close_datagram(sender);
+		}
+	}
+
+	if (!sender->datagram_open) {
+		if (sender->datagram_count == 0) {
+			sender->oldest_frame_us = monotonic_us();
+		}
+
+		sender->datagrams[sender->datagram_count].size		= 0;
+		sender->datagrams[sender->datagram_count].frame_count	= 0;
+		sender->datagrams[sender->datagram_count].first_iov	= 2 * sender->frame_count;
+		sender->datagram_count++;
+		sender->datagram_open = true;
+	}
+
+	peh_sender_datagram_t	*datagram = &sender->datagrams[sender->datagram_count - 1];
+	struct iovec		*iov = &sender->iov[2 * sender->frame_count];
+
+	sender->headers[sender->frame_count] = *header;
+
+	iov[0].iov_base	= &sender->headers[sender->frame_count];
+	iov[0].iov_len	= sizeof(*header);
+	iov[1].iov_base	= (void *)data;
+	iov[1].iov_len	= data_size;
+
+	sender->frame_count++;
+	datagram->size += frame_size;
+	datagram->frame_count++;
+
+	__atomic_store_n(&sender->stats.frames, sender->stats.frames + 1, __ATOMIC_RELAXED);
+
+	if (sender->frame_count >= PEH_SENDER_MAX_FRAMES) {
+		peh_sender_flush(sender);
+	}
+	else if (datagram->frame_count >= sender->config.sweeps_per_datagram) {
+		close_datagram(sender);
+	}
+}
+
+
+void peh_sender_poll(peh_sender_t *sender)
+{
+	if (sender->datagram_count == 0 || sender->config.max_latency_us == 0) {
+		return;
+	}
+
+	if (monotonic_us() - sender->oldest_frame_us >= sender->config.max_latency_us) {
+		peh_sender_flush(sender);
+	}
+}
+
+
+bool peh_sender_get_poll_wait(const peh_sender_t *sender, uint32_t *wait_us)
+{
+	if (sender->datagram_count == 0 || sender->config.max_latency_us == 0) {
+		return false;
+	}
+
+	uint64_t waited_us = monotonic_us() - sender->oldest_frame_us;
+
+	*wait_us = (waited_us < sender->config.max_latency_us) ? sender->config.max_latency_us - waited_us : 0;
+
+	return true;
+}
+
+
+/**
+ * @brief Count a failed send and log the first one
+ */
+static void send_failed(peh_sender_t *sender, const char *function)
+{
+	if (sender->stats.send_failed == 0) {
+		perror(function);
+	}
+
+	__atomic_store_n(&sender->stats.send_failed, sender->stats.send_failed + 1, __ATOMIC_RELAXED);
+}
+
+
+void peh_sender_flush(peh_sender_t *sender)
+{
+	struct mmsghdr	messages[PEH_SENDER_MAX_DATAGRAMS];
+	uint_fast16_t	count = sender->datagram_count;
+	uint_fast16_t	sent = 0;
+
+	if (count == 0) {
+		return;
+	}
+
+	memset(messages, 0, sizeof(messages[0]) * count);
+
+	for (uint_fast16_t index = 0; index < count; index++) {
+		messages[index].msg_hdr.msg_name	= &sender->address;
+		messages[index].msg_hdr.msg_namelen	= sizeof(sender->address);
+		messages[index].msg_hdr.msg_iov		= &sender->iov[sender->datagrams[index].first_iov];
+		messages[index].msg_hdr.msg_iovlen	= 2 * sender->datagrams[index].frame_count;
+	}
+
+	if (count == 1) {
+		// Plain sendmsg() is cheaper when there is nothing to batch
+		ssize_t result;
+
+		while (((result = sendmsg(sender->socket, &messages[0].msg_hdr, 0)) < 0) && (errno == EINTR)) ;
+
+		__atomic_store_n(&sender->stats.send_calls, sender->stats.send_calls + 1, __ATOMIC_RELAXED);
+
+		if (result < 0) {
+			send_failed(sender, "sendmsg()");
+		}
+		else {
+			__atomic_store_n(&sender->stats.datagrams, sender->stats.datagrams + 1, __ATOMIC_RELAXED);
+		}
+	}
+
+	while (count > 1 && sent < count) {
+		int result = sendmmsg(sender->socket, &messages[sent], count - sent, 0);
+
+		__atomic_store_n(&sender->stats.send_calls, sender->stats.send_calls + 1, __ATOMIC_RELAXED);
+
+		if (result < 0) {
+			if (errno == EINTR) {
+				continue;
+			}
+
+			// Drop the datagram the kernel refused and carry on with the rest
+			send_failed(sender, "sendmmsg()");
+			sent++;
+			continue;
+		}
+
+		sent += result;
+		__atomic_store_n(&sender->stats.datagrams, sender->stats.datagrams + result, __ATOMIC_RELAXED);
+	}
+
+	sender->completed	+= sender->frame_count;
+	sender->frame_count	= 0;
+	sender->datagram_count	= 0;
+	sender->datagram_open	= false;
+}
+
+
+uint32_t peh_sender_take_completed(peh_sender_t *sender)
+{
+	uint32_t completed = sender->completed;
+
+	sender->completed = 0;
+
+	return completed;
+}
+
+
+void peh_sender_get_stats(peh_sender_t *sender, peh_sender_stats_t *stats)
+{
+	stats->frames		= __atomic_load_n(&sender->stats.frames, __ATOMIC_RELAXED);
+	stats->datagrams	= __atomic_load_n(&sender->stats.datagrams, __ATOMIC_RELAXED);
+	stats->send_calls	= __atomic_load_n(&sender->stats.send_calls, __ATOMIC_RELAXED);
+	stats->send_failed	= __atomic_load_n(&sender->stats.send_failed, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,204 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef PEH_SENDER_H_
+#define PEH_SENDER_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <netinet/in.h>
+#include <sys/uio.h>
+
+#include "peh_frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Largest number of envelope bins in one frame
+ */
+#define PEH_SENDER_MAX_DATA_LENGTH	2048
+
+/**
+ * @brief Largest number of datagrams handed to the kernel in one sendmmsg() call
+ */
+#define PEH_SENDER_MAX_DATAGRAMS	32
+
+/**
+ * @brief Largest number of frames in one batch, a batch is flushed when it is reached
+ */
+#define PEH_SENDER_MAX_FRAMES		64
+
+/**
+ * @brief Default latency budget for a frame waiting in a batch
+ */
+#define PEH_SENDER_DEFAULT_MAX_LATENCY_US	10000
+
+
+/**
+ * @brief Batching configuration
+ *
+ * The defaults of one sweep per datagram and one datagram per call send every frame as
+ * soon as it is added. Larger values trade latency for fewer syscalls.
+ *
+ * @param sweeps_per_datagram Frames packed back to back into one datagram, as long as they fit
+ * @param datagrams_per_send Datagrams collected before they are flushed with one sendmmsg()
+ * @param max_latency_us A batch is flushed when its oldest frame has waited this long, 0 to
+ *        only flush full batches
+ * @param max_datagram_size Upper limit for a datagram holding more than one frame, 0 to use
+ *        the path MTU towards the destination. A single frame larger than this is still sent,
+ *        in a datagram of its own.
+ */
+typedef struct {
+	uint16_t	sweeps_per_datagram;
+	uint16_t	datagrams_per_send;
+	uint32_t	max_latency_us;
+	size_t		max_datagram_size;
+} peh_sender_config_t;
+
+
+/**
+ * @brief Sender counters, only written by the thread using the sender
+ */
+typedef struct {
+	uint32_t	frames;
+	uint32_t	datagrams;
+	uint32_t	send_calls;
+	uint32_t	send_failed;	// datagrams the kernel refused
+} peh_sender_stats_t;
+
+
+/**
+ * @brief A datagram being filled, described as a slice of the sender iovec array
+ */
+typedef struct {
+	size_t		size;
+	uint16_t	frame_count;
+	uint16_t	first_iov;
+} peh_sender_datagram_t;
+
+
+/**
+ * @brief UDP frame sender
+ *
+ * Frames are never copied, every frame adds its header and its payload to an iovec scatter
+ * list that is handed to sendmsg() or sendmmsg() when the batch is flushed. The payload must
+ * therefore stay valid until the sender reports the frame as completed.
+ *
+ * Not thread safe, all calls for one sender must be made from the same thread.
+ */
+typedef struct {
+	int			socket;
+	struct sockaddr_in	address;
+	peh_sender_config_t	config;
+	peh_sender_stats_t	stats;
+	uint64_t		oldest_frame_us;
+	uint16_t		frame_count;	// frames in the current batch
+	uint32_t		completed;	// frames flushed since peh_sender_take_completed()
+	uint16_t		datagram_count;	// datagrams in use, the last one may still be open
+	bool			datagram_open;
+	peh_sender_datagram_t	datagrams[PEH_SENDER_MAX_DATAGRAMS];
+	peh_frame_header_t	headers[PEH_SENDER_MAX_FRAMES];
+	struct iovec		iov[2 * PEH_SENDER_MAX_FRAMES];
+} peh_sender_t;
+
+
+/**
+ * @brief Fill in the default configuration
+ *
+ * @param[out] config The configuration to initialize
+ */
+extern void peh_sender_config_default(peh_sender_config_t *config);
+
+
+/**
+ * @brief Open the socket of a sender
+ *
+ * @param sender The sender to initialize
+ * @param address Destination IPv4 address in dotted decimal form
+ * @param port Destination UDP port
+ * @param config Batching configuration, limits are clamped
+ * @return True if successful
+ */
+extern bool peh_sender_create(peh_sender_t *sender, const char *address, uint16_t port, const peh_sender_config_t *config);
+
+
+/**
+ * @brief Flush any pending frames and close the socket
+ *
+ * @param sender The sender to destroy
+ */
+extern void peh_sender_destroy(peh_sender_t *sender);
+
+
+/**
+ * @brief Add a frame to the current batch, flushing the batch if it becomes full
+ *
+ * The header is copied, the payload is referenced until the frame has been sent.
+ *
+ * @param sender The sender
+ * @param header Frame header, header_length, data_length and item_size must be set
+ * @param data Frame payload of header->data_length items, must stay valid until the frame
+ *        is returned by peh_sender_take_completed()
+ */
+extern void peh_sender_add_frame(peh_sender_t *sender, const peh_frame_header_t *header, const void *data);
+
+
+/**
+ * @brief Flush the current batch if its latency budget is spent
+ *
+ * Call regularly while no frames are added.
+ *
+ * @param sender The sender
+ */
+extern void peh_sender_poll(peh_sender_t *sender);
+
+
+/**
+ * @brief Get the time left before peh_sender_poll() flushes the current batch
+ *
+ * @param sender The sender
+ * @param[out] wait_us Microseconds until the latency budget of the oldest frame is spent, 0 if
+ *             it already is
+ * @return False if there is no batch waiting for its latency budget
+ */
+extern bool peh_sender_get_poll_wait(const peh_sender_t *sender, uint32_t *wait_us);
+
+
+/**
+ * @brief Send all pending frames now
+ *
+ * @param sender The sender
+ */
+extern void peh_sender_flush(peh_sender_t *sender);
+
+
+/**
+ * @brief Get the number of frames sent since the last call
+ *
+ * Frames complete in the order they were added, so the caller can release the payload of
+ * that many of its oldest frames.
+ *
+ * @param sender The sender
+ * @return Number of frames whose payload is no longer referenced
+ */
+extern uint32_t peh_sender_take_completed(peh_sender_t *sender);
+
+
+/**
+ * @brief Read the sender counters from any thread
+ *
+ * @param sender The sender
+ * @param[out] stats The counters are copied here
+ */
+extern void peh_sender_get_stats(peh_sender_t *sender, peh_sender_stats_t *stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
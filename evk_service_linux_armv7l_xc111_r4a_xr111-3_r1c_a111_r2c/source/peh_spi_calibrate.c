@@ -0,0 +1,163 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+// Finds the highest SPI speed a bus transfers without errors and records it for acc_board_init(),
+// which uses it when ACC_BOARD_FLAG_SPI_CALIBRATION is set
+//
+// Built for the Pi by "make" as out/peh_spi_calibrate. Runs against an in-memory loopback
+// device that corrupts transfers above the speed given with -f, unless -r is given. With -r
+// spidev is used, MISO must then be looped back to MOSI on the chip select, with no sensor
+// answering. The result is only recorded in memory.bin with -w.
+
+// needed for getopt
+#define _GNU_SOURCE
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "acc_board.h"
+#include "acc_device_memory.h"
+#include "acc_device_spi.h"
+#include "acc_device_spi_calibration.h"
+#include "acc_driver_memory_linux.h"
+#include "acc_driver_spi_linux_spidev.h"
+#include "acc_driver_spi_linux_spidev_fake.h"
+#include "acc_os.h"
+#include "acc_types.h"
+
+
+#define DEFAULT_TRANSFER_COUNT	200
+#define DEFAULT_TRANSFER_SIZE	4096
+#define DEFAULT_FAKE_MAX_SPEED	32000000
+
+
+static const uint32_t speeds[] = {
+	1000000, 2000000, 5000000, 10000000, 15000000, 20000000,
+	25000000, 30000000, 35000000, 40000000, 45000000, 50000000
+};
+
+
+// Time of one transfer at the calibrated speed, the throughput the bus gives in practice
+static void report_throughput(uint_fast8_t bus, uint_fast8_t device, uint32_t speed, size_t transfer_size)
+{
+	uint8_t		*buffer = calloc(1, transfer_size);
+	uint32_t	transfer_count = 100;
+
+	if (buffer == NULL) {
+		return;
+	}
+
+	uint64_t start_ns = acc_os_monotonic_ns();
+
+	for (uint32_t transfer = 0; transfer < transfer_count; transfer++) {
+		acc_device_spi_transfer(bus, device, speed, buffer, transfer_size);
+	}
+
+	uint64_t elapsed_ns = acc_os_monotonic_ns() - start_ns;
+
+	printf("%u Hz: %.3f MB/s, %.1f us per %u byte transfer\n", (unsigned int)speed,
+	       (double)transfer_size * transfer_count * 1000 / elapsed_ns,
+	       elapsed_ns / 1000.0 / transfer_count, (unsigned int)transfer_size);
+
+	free(buffer);
+}
+
+
+int main(int argc, char *argv[])
+{
+	uint_fast8_t	bus = 0;
+	uint_fast8_t	device = 0;
+	bool		real_spidev = false;
+	bool		write_result = false;
+	uint32_t	fake_max_speed = DEFAULT_FAKE_MAX_SPEED;
+	uint32_t	transfer_count = DEFAULT_TRANSFER_COUNT;
+	size_t		transfer_size = DEFAULT_TRANSFER_SIZE;
+	uint32_t	best_speed;
+	uint32_t	recorded_speed;
+	int		option;
+
+	while ((option = getopt(argc, argv, "b:c:d:f:rs:w")) != -1) {
+		switch (option) {
+			case 'b':
+				bus = atoi(optarg);
+				break;
+			case 'c':
+				transfer_count = atoi(optarg);
+				break;
+			case 'd':
+				device = atoi(optarg);
+				break;
+			case 'f':
+				fake_max_speed = atoi(optarg);
+				break;
+			case 'r':
+				real_spidev = true;
+				break;
+			case 's':
+				transfer_size = atoi(optarg);
+				break;
+			case 'w':
+				write_result = true;
+				break;
+			default:
+				fprintf(stderr, "Usage: %s [-b bus] [-d device] [-c transfers per speed] [-s transfer size]\n"
+				        "       [-f fake device max speed] [-r use spidev] [-w record result]\n", argv[0]);
+				return EXIT_FAILURE;
+		}
+	}
+
+	if (bus >= ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_MAX || device >= ACC_DRIVER_SPI_LINUX_SPIDEV_BUS_DEVICE_MAX) {
+		fprintf(stderr, "No such bus or device\n");
+		return EXIT_FAILURE;
+	}
+
+	if (real_spidev) {
+		acc_driver_spi_linux_spidev_register();
+	} else {
+		acc_driver_spi_linux_spidev_fake_reset(0);
+		acc_driver_spi_linux_spidev_fake_set_max_speed(fake_max_speed);
+		acc_driver_spi_linux_spidev_register_with_ops(&acc_driver_spi_linux_spidev_fake_ops);
+	}
+	acc_driver_memory_linux_register();
+
+	if (acc_device_spi_init() != ACC_STATUS_SUCCESS || acc_device_memory_init() != ACC_STATUS_SUCCESS) {
+		return EXIT_FAILURE;
+	}
+
+	if (transfer_size == 0 || transfer_size > acc_device_spi_get_max_transfer_size()) {
+		fprintf(stderr, "Transfer size must be 1-%u\n", (unsigned int)acc_device_spi_get_max_transfer_size());
+		return EXIT_FAILURE;
+	}
+
+	if (acc_device_spi_calibration_load(ACC_BOARD_SPI_CALIBRATION_ADDRESS, bus, &recorded_speed) == ACC_STATUS_SUCCESS) {
+		printf("Bus %u is recorded at %u Hz\n", (unsigned int)bus, (unsigned int)recorded_speed);
+	}
+
+	printf("Calibrating spidev%u.%u on %s, %u transfers of %u bytes per speed\n", (unsigned int)bus, (unsigned int)device,
+	       real_spidev ? "spidev" : "fake device", (unsigned int)transfer_count, (unsigned int)transfer_size);
+
+	if (acc_device_spi_calibration_run(bus, device, speeds, sizeof(speeds) / sizeof(speeds[0]), transfer_count,
+	                                   transfer_size, &best_speed) != ACC_STATUS_SUCCESS) {
+		fprintf(stderr, "No speed passed\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("Highest reliable speed: %u Hz\n", (unsigned int)best_speed);
+	if (!real_spidev) {
+		acc_driver_spi_linux_spidev_fake_set_bus_sleep(true);
+	}
+	report_throughput(bus, device, best_speed, transfer_size);
+
+	if (write_result) {
+		if (acc_device_spi_calibration_store(ACC_BOARD_SPI_CALIBRATION_ADDRESS, bus, best_speed) != ACC_STATUS_SUCCESS) {
+			fprintf(stderr, "Could not record the speed\n");
+			return EXIT_FAILURE;
+		}
+		printf("Recorded for bus %u\n", (unsigned int)bus);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -1,72 +1,291 @@
 // Copyright (c) Acconeer AB, 2015-2018
 // All rights reserved
 
+// needed for getopt
+#define _GNU_SOURCE
+
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/socket.h>
-#include <netinet/in.h>
-#include <arpa/inet.h>
+#include <time.h>
+#include <unistd.h>
 
 
+#include "acc_board.h"
+#include "acconeer_detector_distance.h"
 #include "acc_rss.h"
 #include "acc_service.h"
 #include "acc_service_envelope.h"
 #include "acc_sweep_configuration.h"
 
+#include "acc_log_async.h"
 #include "acc_os.h"
 #include "acc_version.h"
 
-void reconfigure_sweeps(acc_service_configuration_t envelope_configuration);
-static acc_service_status_t execute_envelope_with_blocking_calls(acc_service_configuration_t envelope_configuration);
+#include "peh_control.h"
+#include "peh_frame.h"
+#include "peh_histogram.h"
+#include "peh_ring.h"
+#include "peh_sender.h"
+#include "peh_threshold_cache.h"
+
+// Settings that can be changed at runtime through the control channel
+typedef struct
+{
+  float start_m;
+  float length_m;
+  float frequency_hz;
+  acc_service_envelope_profile_t profile;
+} stream_settings_t;
 
 // UDP
 //#define SERVER "192.168.0.108"
 #define SERVER "127.0.0.1"
-#define BUFLEN 2048  //Max length of buffer
+#define BUFLEN PEH_SENDER_MAX_DATA_LENGTH  //Max number of envelope bins in one frame
 #define PORT 8888   //The port on which to send data
-struct sockaddr_in si_other;
-int s;
-int i;
-int slen=sizeof(si_other);
-uint16_t message[BUFLEN];
+peh_sender_t sender;
+acc_os_semaphore_t sweeps_pushed;  //Posted for every sweep pushed to a ring, and to stop the sender
+
+#define RING_SLOTS 64  //Sweeps buffered between acquisition and sender
+#define STATS_INTERVAL_S 5  //Seconds between overrun reports
+
+#define CONTROL_PORT 8889  //The port on which reconfiguration commands are received
+peh_control_t control_channel;
+
+#define MAX_SENSORS 4  //Sensor ports on the XC111
+
+#define MAX_REFLECTIONS 32  //Reflections sent per sweep in distance detection mode
 
-void die(char *s)
+uint16_t detector_threshold = 0;  //Fixed threshold of the distance detector, 0 to send envelopes only
+uint32_t threshold_estimation_sweeps = 0;  //Sweeps to estimate a threshold from, used instead of a fixed one
+uint32_t envelope_interval = 0;  //With the detector, also send the envelope of every Nth sweep
+
+int64_t wall_clock_offset_us = 0;  //Wall clock minus monotonic time, updated with every stats report
+
+#define STACK_PREFAULT (64 * 1024)  //Stack touched by real-time threads before they start
+
+// Scheduling of the acquisition (RSS service) threads and of the sender thread
+typedef struct
 {
-    perror(s);
-    exit(1);
+  bool enabled;
+  acc_os_linux_thread_profile_t acquisition;
+  acc_os_linux_thread_profile_t sender;
+  bool print_histogram;
+} realtime_config_t;
+realtime_config_t realtime = { false, { 0, -1, 0 }, { 0, -1, 0 }, false };
+
+// One per sensor, shared between its envelope callback (producer) and the sender thread (consumer).
+// The service fields are only written while the service is deactivated.
+typedef struct
+{
+  acc_service_configuration_t configuration;
+  acc_service_handle_t handle;
+  bool active;
+  peh_ring_t ring;
+  uint16_t sensor_id;
+  uint16_t data_length;
+  float start_m;
+  float length_m;
+  acc_service_envelope_profile_t profile;
+  uint32_t configuration_id;  //Increased every time the service is created
+  // Owned by the callback
+  bool have_sequence_number;
+  uint16_t last_service_sequence_number;
+  uint32_t sequence_number;
+  uint32_t lost_in_service;  //Sweeps the service skipped, seen as sequence number gaps
+  uint32_t invalid_handle;
+  uint32_t period_us;  //Expected time between sweeps
+  uint64_t last_arrival_us;  //Monotonic time of the previous callback, 0 after a restart
+  peh_histogram_t arrival_interval;  //Time between callbacks[us]
+  peh_histogram_t arrival_jitter;  //Distance from the expected period[us]
+  peh_histogram_t latency_queued;  //Sweep ready until copied into the ring[us]
+  // Owned by the sender thread
+  peh_histogram_t latency_encoded;  //Sweep ready until its frame was added to a batch[us]
+  peh_histogram_t latency_sent;  //Sweep ready until the send call for its frame returned[us]
+  uint32_t deadline_missed;  //Sweeps not sent before the next one was due
+  void *detector;  //Distance detector run on every sweep, NULL to send envelopes
+  uint32_t detector_configuration_id;  //Service configuration the detector was prepared for
+  peh_threshold_key_t detector_key;
+  uint32_t estimation_remaining;  //Sweeps left before the estimated threshold is complete
+  uint32_t detect_failed;
+  // Owned by the stats report
+  peh_histogram_t arrival_reported;
+  peh_histogram_t jitter_reported;
+  peh_histogram_t queued_reported;
+  peh_histogram_t encoded_reported;
+  peh_histogram_t sent_reported;
+} stream_control_t;
+
+// Frames handed to the sender and not yet sent, in the order they were added
+typedef struct
+{
+  uint8_t stream[PEH_SENDER_MAX_FRAMES];  //Index of the stream the frame belongs to
+  bool last[PEH_SENDER_MAX_FRAMES];  //Last frame of its sweep, the ring slot is released when it is sent
+  peh_frame_reflection_t reflections[PEH_SENDER_MAX_FRAMES][MAX_REFLECTIONS];  //Payload of reflection frames
+  uint32_t first;
+  uint32_t count;
+} frame_queue_t;
+
+// All sensors streamed by this process, drained by one sender thread
+typedef struct
+{
+  stream_control_t streams[MAX_SENSORS];
+  uint16_t stream_count;
+  volatile bool running;
+} stream_set_t;
+
+void reconfigure_sweeps(acc_service_configuration_t envelope_configuration, const stream_settings_t *settings);
+static acc_service_status_t execute_envelope_with_callback(stream_set_t *set, stream_settings_t *settings);
+static void envelope_callback(const acc_service_handle_t service_handle, const uint16_t *envelope_data, const acc_envelope_metadata_t *metadata, void *client_reference);
+static void sender_thread(void *param);
+
+void usage(const char *name)
+{
+  fprintf(stderr, "Usage: %s [-k sweeps per datagram] [-n datagrams per send] [-l max latency ms] [-m max datagram bytes] [-c control port] [-s sensor list, e.g. 1,2,3,4]\n"
+                  "       [-r acquisition SCHED_FIFO priority] [-a acquisition cpu] [-t sender cpu] [-H]\n"
+                  "       [-D distance detector threshold] [-T estimate detector threshold over N sweeps]\n"
+                  "       [-E envelope every Nth sweep with -D or -T] [-g use the GPIO character device]\n", name);
+  exit(1);
+}
+
+
+// Parses a comma separated list of sensor ids, each sensor may appear once
+static bool parse_sensors(const char *list, stream_set_t *set)
+{
+  set->stream_count = 0;
+
+  while (*list != '\0')
+  {
+    char *end = NULL;
+    long sensor_id = strtol(list, &end, 10);
+
+    if (end == list || sensor_id < 1 || sensor_id > MAX_SENSORS || set->stream_count == MAX_SENSORS)
+    {
+      return false;
+    }
+
+    for (uint16_t i = 0; i < set->stream_count; i++)
+    {
+      if (set->streams[i].sensor_id == sensor_id)
+      {
+        return false;
+      }
+    }
+
+    set->streams[set->stream_count++].sensor_id = sensor_id;
+
+    list = (*end == ',') ? end + 1 : end;
+    if (*end != ',' && *end != '\0')
+    {
+      return false;
+    }
+  }
+
+  return set->stream_count > 0;
 }
 
 
 int main(int argc, char *argv[])
 {
-  for (int n = 0; n < BUFLEN; n++)
+  static stream_set_t set;
+  peh_sender_config_t sender_config;
+  stream_settings_t settings = { 0.2, 0.8, 20, ACC_SERVICE_ENVELOPE_PROFILE_DEFAULT };
+  uint16_t control_port = CONTROL_PORT;
+  int option;
+
+  peh_sender_config_default(&sender_config);
+  set.stream_count = 1;
+  set.streams[0].sensor_id = 1;
+
+  while ((option = getopt(argc, argv, "k:n:l:m:c:s:r:a:t:HD:T:E:g")) != -1)
   {
-    message[n] = n;
+    switch (option)
+    {
+      case 'k':
+        sender_config.sweeps_per_datagram = atoi(optarg);
+        break;
+      case 'n':
+        sender_config.datagrams_per_send = atoi(optarg);
+        break;
+      case 'l':
+        sender_config.max_latency_us = atoi(optarg) * 1000;
+        break;
+      case 'm':
+        sender_config.max_datagram_size = atoi(optarg);
+        break;
+      case 'c':
+        control_port = atoi(optarg);
+        break;
+      case 's':
+        if (!parse_sensors(optarg, &set))
+        {
+          usage(argv[0]);
+        }
+        break;
+      case 'r':
+        realtime.enabled = true;
+        realtime.acquisition.priority = atoi(optarg);
+        realtime.acquisition.stack_prefault = STACK_PREFAULT;
+        break;
+      case 'a':
+        realtime.acquisition.cpu = atoi(optarg);
+        break;
+      case 't':
+        realtime.sender.cpu = atoi(optarg);
+        break;
+      case 'H':
+        realtime.print_histogram = true;
+        break;
+      case 'D':
+        detector_threshold = atoi(optarg);
+        break;
+      case 'T':
+        threshold_estimation_sweeps = atoi(optarg);
+        break;
+      case 'E':
+        envelope_interval = atoi(optarg);
+        break;
+      case 'g':
+        acc_board_set_flag(ACC_BOARD_FLAG_GPIO_CHARDEV);
+        break;
+      default:
+        usage(argv[0]);
+    }
   }
-  
+
+  // The memory device holds the threshold cache anyway, so the SPI speeds recorded next to it are used
+  acc_board_set_flag(ACC_BOARD_FLAG_SPI_CALIBRATION);
+
+  // Before anything is allocated, so rings and thread stacks are locked as they are mapped
+  if (realtime.enabled)
+  {
+    if (acc_os_linux_memory_lock() != ACC_STATUS_SUCCESS)
+    {
+      printf("\nCould not lock memory, sweep buffers may be paged");
+    }
+    printf("\nReal-time acquisition: SCHED_FIFO priority %d, acquisition cpu %d, sender cpu %d",
+           realtime.acquisition.priority, realtime.acquisition.cpu, realtime.sender.cpu);
+  }
+
   // UDP Stuff	
-  if ( (s=socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP)) == -1)
+  if (!peh_sender_create(&sender, SERVER, PORT, &sender_config))
   {
-    die("socket");
+    exit(1);
   }
- 
-  memset((char *) &si_other, 0, sizeof(si_other));
-  si_other.sin_family = AF_INET;
-  si_other.sin_port = htons(PORT);
-     
-  if (inet_aton(SERVER , &si_other.sin_addr) == 0) 
+
+  if (!peh_control_create(&control_channel, control_port))
   {
-    fprintf(stderr, "inet_aton() failed\n");
     exit(1);
   }
 
-  ACC_UNUSED(argc);
-  ACC_UNUSED(argv);
+  printf("\nListening for reconfiguration commands on UDP port %u", (unsigned int)control_port);
+
+  printf("\nBatching %u sweeps per datagram, %u datagrams per send, max latency %u ms, max datagram %u bytes",
+         (unsigned int)sender.config.sweeps_per_datagram, (unsigned int)sender.config.datagrams_per_send,
+         (unsigned int)(sender.config.max_latency_us / 1000), (unsigned int)sender.config.max_datagram_size);
 
   printf("\nAcconeer software version %s", ACC_VERSION);
   printf("\nAcconeer RSS version %s", acc_rss_version());
@@ -76,28 +295,50 @@ int main(int argc, char *argv[])
     return EXIT_FAILURE;
   }
 
-  acc_service_configuration_t envelope_configuration = acc_service_envelope_configuration_create();
+  // Estimated thresholds are kept in the memory device, keyed by sensor and range
+  if (threshold_estimation_sweeps > 0 && !peh_threshold_cache_init())
+  {
+    printf("\nThreshold cache not available, thresholds will be estimated on every start");
+  }
 
-  if (envelope_configuration == NULL)
+  for (uint16_t i = 0; i < set.stream_count; i++)
   {
-    printf("\nacc_service_envelope_configuration_create() failed");
-    return EXIT_FAILURE;
+    stream_control_t *control = &set.streams[i];
+
+    control->configuration = acc_service_envelope_configuration_create();
+
+    if (control->configuration == NULL)
+    {
+      printf("\nacc_service_envelope_configuration_create() failed");
+      return EXIT_FAILURE;
+    }
+
+    acc_sweep_configuration_t sweep_configuration = acc_sweep_configuration_get(control->configuration);
+
+    if (sweep_configuration != NULL)
+    {
+      acc_sweep_configuration_sensor_set(sweep_configuration, control->sensor_id);
+    }
+
+    reconfigure_sweeps(control->configuration, &settings);
   }
 
   acc_service_status_t service_status;
-  reconfigure_sweeps(envelope_configuration);
 
-  service_status = execute_envelope_with_blocking_calls(envelope_configuration);
+  service_status = execute_envelope_with_callback(&set, &settings);
   
 
   if (service_status != ACC_SERVICE_STATUS_OK) 
   {
-    printf("\nexecute_envelope_with_blocking_calls() => (%u) %s", (unsigned int)service_status, acc_service_status_name_get(service_status));
+    printf("\nexecute_envelope_with_callback() => (%u) %s", (unsigned int)service_status, acc_service_status_name_get(service_status));
     return EXIT_FAILURE;
   }
 
  
-  acc_service_envelope_configuration_destroy(&envelope_configuration);
+  for (uint16_t i = 0; i < set.stream_count; i++)
+  {
+    acc_service_envelope_configuration_destroy(&set.streams[i].configuration);
+  }
 
   acc_rss_deactivate();
 
@@ -105,64 +346,867 @@ int main(int argc, char *argv[])
 }
 
 
-acc_service_status_t execute_envelope_with_blocking_calls(acc_service_configuration_t envelope_configuration)
+static uint64_t monotonic_us(void)
+{
+  return acc_os_monotonic_ns() / 1000;
+}
+
+
+// Sweeps are stamped with the monotonic time only, their wall clock time is found with an offset
+// measured now and then. A wall clock set while streaming moves the stamps at the next update
+// instead of in the middle of a sweep.
+static void update_wall_clock_offset(void)
 {
-  acc_service_handle_t handle = acc_service_create(envelope_configuration);
+  acc_os_time_pair_t pair;
+
+  acc_os_time_pair_capture(&pair);
+  __atomic_store_n(&wall_clock_offset_us, (int64_t)(pair.realtime_ns / 1000) - (int64_t)(pair.monotonic_ns / 1000), __ATOMIC_RELAXED);
+}
+
+
+// Creates a service for the current configuration of one sensor, everything else stays as it is
+static acc_service_status_t create_service(stream_control_t *control)
+{
+  // Set every time, applying a profile may reset the configuration
+  acc_service_envelope_envelope_callback_set(control->configuration, &envelope_callback, control);
+
+  acc_service_handle_t handle = acc_service_create(control->configuration);
 
   if (handle == NULL) 
   {
-    printf("\nacc_service_create failed");
+    printf("\nSensor %u: acc_service_create failed", (unsigned int)control->sensor_id);
     return ACC_SERVICE_STATUS_FAILURE_UNSPECIFIED;
   }
 
   acc_service_envelope_metadata_t envelope_metadata;
   acc_service_envelope_get_metadata(handle, &envelope_metadata);
 
+  printf("\nSensor %u:", (unsigned int)control->sensor_id);
   printf("\nFree space absolute offset: %u mm", (unsigned int)(envelope_metadata.free_space_absolute_offset * 1000.0 + 0.5));
   printf("\nActual start: %u mm", (unsigned int)(envelope_metadata.actual_start_m * 1000.0 + 0.5));
   printf("\nActual length: %u mm", (unsigned int)(envelope_metadata.actual_length_m * 1000.0 + 0.5));
   printf("\nActual end: %u mm", (unsigned int)((envelope_metadata.actual_start_m + envelope_metadata.actual_length_m) * 1000.0 + 0.5));
   printf("\nData length: %u", (unsigned int)(envelope_metadata.data_length));
 
-  uint16_t envelope_data[envelope_metadata.data_length];
+  if (envelope_metadata.data_length > BUFLEN)
+  {
+    printf("\nData length %u does not fit in a frame of %u bins", (unsigned int)envelope_metadata.data_length, (unsigned int)BUFLEN);
+    acc_service_destroy(&handle);
+    return ACC_SERVICE_STATUS_INVALID_CONFIGURATION;
+  }
+
+  control->handle = handle;
+  control->configuration_id++;
+  control->data_length = envelope_metadata.data_length;
+  control->start_m = envelope_metadata.actual_start_m;
+  control->length_m = envelope_metadata.actual_length_m;
+
+  // The gap while the service was recreated is not jitter
+  control->last_arrival_us = 0;
+
+  // The new service starts its own sequence numbers, continue ours after the last sweep
+  if (control->have_sequence_number)
+  {
+    control->sequence_number++;
+    control->have_sequence_number = false;
+  }
+
+  return ACC_SERVICE_STATUS_OK;
+}
+
+
+static void stop_streams(stream_set_t *set)
+{
+  for (uint16_t i = 0; i < set->stream_count; i++)
+  {
+    stream_control_t *control = &set->streams[i];
+    acc_service_handle_t handle = control->handle;
+
+    if (handle == NULL)
+    {
+      continue;
+    }
+
+    if (control->active)
+    {
+      acc_service_deactivate(handle);
+      control->active = false;
+    }
+    control->handle = NULL;
+    acc_service_destroy(&handle);
+  }
+}
+
+
+// Creates the services of all sensors, then activates them spread evenly over one sweep period.
+// The sensors share one SPI bus and run off the same reference clock, so staggered sensors keep
+// taking turns on the bus instead of all asking for it at the same moment.
+static acc_service_status_t start_streams(stream_set_t *set, const stream_settings_t *settings)
+{
+  acc_service_status_t service_status = ACC_SERVICE_STATUS_OK;
+
+  for (uint16_t i = 0; i < set->stream_count && service_status == ACC_SERVICE_STATUS_OK; i++)
+  {
+    set->streams[i].period_us = 1000000 / settings->frequency_hz;
+    set->streams[i].profile = settings->profile;
+    service_status = create_service(&set->streams[i]);
+  }
+
+  uint32_t stagger_us = 1000000 / (settings->frequency_hz * set->stream_count);
+  uint64_t activate_us = monotonic_us();
+
+  // The service threads are created on activation and get this profile
+  acc_os_linux_thread_profile_set(&realtime.acquisition);
+
+  for (uint16_t i = 0; i < set->stream_count && service_status == ACC_SERVICE_STATUS_OK; i++)
+  {
+    stream_control_t *control = &set->streams[i];
+    uint64_t now_us = monotonic_us();
+
+    if (now_us < activate_us)
+    {
+      acc_os_sleep_us(activate_us - now_us);
+    }
+    activate_us += stagger_us;
+
+    service_status = acc_service_activate(control->handle);
+
+    if (service_status != ACC_SERVICE_STATUS_OK)
+    {
+      printf("\nSensor %u: acc_service_activate() %u => %s", (unsigned int)control->sensor_id,
+             (unsigned int)service_status, acc_service_status_name_get(service_status));
+      break;
+    }
+    control->active = true;
+  }
+
+  acc_os_linux_thread_profile_set(NULL);
+
+  if (service_status != ACC_SERVICE_STATUS_OK)
+  {
+    stop_streams(set);
+  }
+
+  return service_status;
+}
+
+
+static void apply_settings(stream_set_t *set, const stream_settings_t *settings)
+{
+  for (uint16_t i = 0; i < set->stream_count; i++)
+  {
+    reconfigure_sweeps(set->streams[i].configuration, settings);
+  }
+}
+
+
+static const char *profile_name(acc_service_envelope_profile_t profile)
+{
+  return (profile == ACC_SERVICE_ENVELOPE_PROFILE_LONG_RANGE) ? "long" : "short";
+}
+
+
+// Parses "key=value" pairs separated by spaces, keys are start, length, frequency and profile.
+// Settings not mentioned are kept.
+static bool parse_settings(char *command, stream_settings_t *settings, const char **error)
+{
+  char *save = NULL;
+
+  for (char *token = strtok_r(command, " \t,", &save); token != NULL; token = strtok_r(NULL, " \t,", &save))
+  {
+    char *value = strchr(token, '=');
+    char *end = NULL;
+
+    if (value == NULL)
+    {
+      *error = "expected key=value";
+      return false;
+    }
+    *value++ = '\0';
+
+    if (strcmp(token, "profile") == 0)
+    {
+      if (strcmp(value, "long") == 0)
+      {
+        settings->profile = ACC_SERVICE_ENVELOPE_PROFILE_LONG_RANGE;
+      }
+      else if (strcmp(value, "short") == 0)
+      {
+        settings->profile = ACC_SERVICE_ENVELOPE_PROFILE_SHORT_RANGE;
+      }
+      else
+      {
+        *error = "profile must be long or short";
+        return false;
+      }
+      continue;
+    }
+
+    float number = strtof(value, &end);
+
+    if (end == value || *end != '\0')
+    {
+      *error = "value is not a number";
+      return false;
+    }
+
+    if (strcmp(token, "start") == 0 && number >= 0)
+    {
+      settings->start_m = number;
+    }
+    else if (strcmp(token, "length") == 0 && number > 0)
+    {
+      settings->length_m = number;
+    }
+    else if (strcmp(token, "frequency") == 0 && number > 0)
+    {
+      settings->frequency_hz = number;
+    }
+    else
+    {
+      *error = "unknown key or value out of range";
+      return false;
+    }
+  }
+
+  return true;
+}
+
+
+// Applies a command from the control channel by recreating only the service handles,
+// RSS, the sockets, the rings and the sender thread are kept
+static void handle_command(stream_set_t *set, stream_settings_t *settings, char *command)
+{
+  stream_settings_t requested = *settings;
+  const char *error = NULL;
+
+  if (command[0] == '\0' || strcmp(command, "get") == 0)
+  {
+    peh_control_reply(&control_channel, "OK start=%.3f length=%.3f frequency=%.1f profile=%s sensors=%u data_length=%u",
+                      settings->start_m, settings->length_m, settings->frequency_hz,
+                      profile_name(settings->profile), (unsigned int)set->stream_count,
+                      (unsigned int)set->streams[0].data_length);
+    return;
+  }
+
+  if (!parse_settings(command, &requested, &error))
+  {
+    peh_control_reply(&control_channel, "ERROR %s", error);
+    return;
+  }
+
+  printf("\nReconfiguring: start %.3f m, length %.3f m, frequency %.1f Hz, profile %s",
+         requested.start_m, requested.length_m, requested.frequency_hz, profile_name(requested.profile));
+
+  uint64_t begin_us = monotonic_us();
+
+  stop_streams(set);
+  apply_settings(set, &requested);
+
+  acc_service_status_t service_status = start_streams(set, &requested);
+
+  uint64_t elapsed_us = monotonic_us() - begin_us;
+
+  if (service_status == ACC_SERVICE_STATUS_OK)
+  {
+    *settings = requested;
+    printf("\nReconfigured in %.1f ms", elapsed_us / 1000.0);
+    peh_control_reply(&control_channel, "OK reconfigured in %.1f ms start=%.3f length=%.3f data_length=%u",
+                      elapsed_us / 1000.0, set->streams[0].start_m, set->streams[0].length_m,
+                      (unsigned int)set->streams[0].data_length);
+    fflush(stdout);
+    return;
+  }
+
+  // Go back to what was running so a bad command does not stop the stream
+  apply_settings(set, settings);
+  service_status = start_streams(set, settings);
+
+  printf("\nReconfiguration failed after %.1f ms, %s", elapsed_us / 1000.0,
+         (service_status == ACC_SERVICE_STATUS_OK) ? "previous settings restored" : "service stopped");
+  peh_control_reply(&control_channel, "ERROR %s after %.1f ms, %s", "service rejected the settings", elapsed_us / 1000.0,
+                    (service_status == ACC_SERVICE_STATUS_OK) ? "previous settings restored" : "service stopped");
+  fflush(stdout);
+}
+
+
+// Prints the samples recorded since the last report
+static void report_histogram(FILE *stream, uint16_t sensor_id, const char *name, const peh_histogram_t *live, peh_histogram_t *reported)
+{
+  static peh_histogram_t total;
+  static peh_histogram_t interval;
+  uint32_t min_us;
+  uint32_t max_us;
+
+  peh_histogram_snapshot(live, &total);
+  interval = total;
+  peh_histogram_subtract(&interval, reported);
+  *reported = total;
+
+  if (!peh_histogram_range(&interval, &min_us, &max_us))
+  {
+    return;
+  }
+
+  fprintf(stream, "\nSensor %u: %s us min %u p50 %u p99 %u p99.9 %u max %u",
+         (unsigned int)sensor_id, name, (unsigned int)min_us,
+         (unsigned int)peh_histogram_percentile(&interval, 0.5),
+         (unsigned int)peh_histogram_percentile(&interval, 0.99),
+         (unsigned int)peh_histogram_percentile(&interval, 0.999),
+         (unsigned int)max_us);
+  if (interval.count > 0)
+  {
+    fprintf(stream, " mean %u", (unsigned int)(interval.sum / interval.count));
+  }
+
+  if (realtime.print_histogram)
+  {
+    peh_histogram_print(&interval, "us", stream);
+  }
+}
+
+
+static void print_stats(stream_set_t *set, uint32_t *last_published)
+{
+  peh_sender_stats_t sender_stats;
+  uint32_t total_rate = 0;
+
+  peh_sender_get_stats(&sender, &sender_stats);
+
+  printf("\nSent %u frames in %u datagrams with %u calls, send failed %u",
+         (unsigned int)sender_stats.frames, (unsigned int)sender_stats.datagrams,
+         (unsigned int)sender_stats.send_calls, (unsigned int)sender_stats.send_failed);
+
+  for (uint16_t i = 0; i < set->stream_count; i++)
+  {
+    stream_control_t *control = &set->streams[i];
+    peh_ring_stats_t ring_stats;
+
+    peh_ring_get_stats(&control->ring, &ring_stats);
+
+    uint32_t rate = (ring_stats.published - last_published[i]) / STATS_INTERVAL_S;
+
+    last_published[i] = ring_stats.published;
+    total_rate += rate;
+
+    printf("\nSensor %u: %u sweeps/s, dropped: ring full %u, oversize %u, lost in service %u, invalid handle %u",
+           (unsigned int)control->sensor_id, (unsigned int)rate,
+           (unsigned int)ring_stats.dropped_full, (unsigned int)ring_stats.dropped_oversize,
+           (unsigned int)__atomic_load_n(&control->lost_in_service, __ATOMIC_RELAXED),
+           (unsigned int)__atomic_load_n(&control->invalid_handle, __ATOMIC_RELAXED));
 
-  acc_service_status_t service_status = acc_service_activate(handle);
+    report_histogram(stdout, control->sensor_id, "inter-sweep", &control->arrival_interval, &control->arrival_reported);
+    report_histogram(stdout, control->sensor_id, "jitter", &control->arrival_jitter, &control->jitter_reported);
+
+    // Latency of each stage counted from the sweep being ready, on stderr so it can be
+    // followed separately from the rest of the output
+    fprintf(stderr, "\nSensor %u: deadline missed %u, sequence numbers missed %u, detection failed %u",
+            (unsigned int)control->sensor_id,
+            (unsigned int)__atomic_load_n(&control->deadline_missed, __ATOMIC_RELAXED),
+            (unsigned int)__atomic_load_n(&control->lost_in_service, __ATOMIC_RELAXED),
+            (unsigned int)__atomic_load_n(&control->detect_failed, __ATOMIC_RELAXED));
+    report_histogram(stderr, control->sensor_id, "ready->queued", &control->latency_queued, &control->queued_reported);
+    report_histogram(stderr, control->sensor_id, "ready->encoded", &control->latency_encoded, &control->encoded_reported);
+    report_histogram(stderr, control->sensor_id, "ready->sent", &control->latency_sent, &control->sent_reported);
+    fflush(stderr);
+  }
+
+  if (set->stream_count > 1)
+  {
+    printf("\nAll sensors: %u sweeps/s", (unsigned int)total_rate);
+  }
+
+#if defined(ACC_LOG_ASYNC)
+  acc_log_async_stats_t log_stats;
+
+  acc_log_async_get_stats(&log_stats);
+  printf("\nLog: %u messages written, %u dropped, %u threads",
+         (unsigned int)log_stats.written_count, (unsigned int)log_stats.dropped_count, (unsigned int)log_stats.thread_count);
+#endif
+  fflush(stdout);
+
+  // Counted when acc_os_init() found ACC_OS_MUTEX_STATS set
+  if (getenv("ACC_OS_MUTEX_STATS") != NULL)
+  {
+    fprintf(stderr, "\n");
+    acc_os_linux_mutex_stats_dump(stderr);
+    fflush(stderr);
+  }
+}
+
+
+acc_service_status_t execute_envelope_with_callback(stream_set_t *set, stream_settings_t *settings)
+{
+  acc_service_status_t service_status = ACC_SERVICE_STATUS_OK;
+  uint16_t ring_count = 0;
+
+  // Sized for the largest sweep a frame can carry so a reconfiguration never reallocates them.
+  // Room for a full batch waiting to be sent on top of the slack for the sender falling behind.
+  for (; ring_count < set->stream_count; ring_count++)
+  {
+    if (!peh_ring_create(&set->streams[ring_count].ring, RING_SLOTS + PEH_SENDER_MAX_FRAMES, BUFLEN))
+    {
+      printf("\nCould not allocate sweep ring");
+      service_status = ACC_SERVICE_STATUS_OUT_OF_MEMORY;
+      break;
+    }
+  }
+
+  if (threshold_estimation_sweeps > 0)
+  {
+    printf("\nStreaming reflections, threshold estimated over %u sweeps, envelope every %u sweeps",
+           (unsigned int)threshold_estimation_sweeps, (unsigned int)envelope_interval);
+  }
+  else if (detector_threshold > 0)
+  {
+    printf("\nStreaming reflections, threshold %u, envelope every %u sweeps", (unsigned int)detector_threshold, (unsigned int)envelope_interval);
+  }
+
+  acc_os_thread_handle_t sender_handle;
+  bool sender_started = false;
+
+  set->running = true;
+  acc_os_semaphore_init(&sweeps_pushed, 0);
 
   if (service_status == ACC_SERVICE_STATUS_OK)
   {
+    // Kept off the acquisition cpu so sending never preempts a sweep
+    acc_os_linux_thread_profile_set(&realtime.sender);
+    sender_started = (acc_os_thread_create(sender_thread, set, &sender_handle) == ACC_STATUS_SUCCESS);
+    acc_os_linux_thread_profile_set(NULL);
+    if (!sender_started)
+    {
+      printf("\nCould not create sender thread");
+      service_status = ACC_SERVICE_STATUS_FAILURE_UNSPECIFIED;
+    }
+  }
+
+  if (service_status == ACC_SERVICE_STATUS_OK)
+  {
+    update_wall_clock_offset();
+    service_status = start_streams(set, settings);
+  }
+
+  if (service_status == ACC_SERVICE_STATUS_OK)
+  {
+    uint32_t last_published[MAX_SENSORS] = { 0 };
+    uint64_t next_stats_us = monotonic_us() + STATS_INTERVAL_S * 1000000;
+
     while (1) 
     {
-      service_status = acc_service_envelope_get_next(handle, envelope_data, envelope_metadata.data_length);
-      if (service_status == ACC_SERVICE_STATUS_OK) 
+      char command[PEH_CONTROL_MAX_COMMAND_LENGTH];
+      uint64_t now_us = monotonic_us();
+
+      if (now_us < next_stats_us)
       {
-	for (uint_fast16_t index = 0; index < envelope_metadata.data_length; index++) 
-        {
-          message[index] = (int16_t)envelope_data[index] + 0.5;
-	}
-        if (sendto(s, message, sizeof(message) , 0 , (struct sockaddr *) &si_other, slen)==-1)
+        if (peh_control_receive(&control_channel, command, sizeof(command), (next_stats_us - now_us + 999) / 1000))
         {
-          die("sendto()");
+          handle_command(set, settings, command);
         }
+        continue;
       }
-      else
-      {
-	printf("\nEnvelope data not properly retrieved");
-      }
+      next_stats_us += STATS_INTERVAL_S * 1000000;
+
+      update_wall_clock_offset();
+      print_stats(set, last_published);
     }
-    service_status = acc_service_deactivate(handle);
   }
-  else 
+
+  stop_streams(set);
+
+  set->running = false;
+  acc_os_semaphore_post(&sweeps_pushed);
+  if (sender_started)
   {
-    printf("\nacc_service_activate() %u => %s", (unsigned int)service_status, acc_service_status_name_get(service_status));
+    acc_os_thread_cleanup(sender_handle);
   }
 
-  acc_service_destroy(&handle);
-  close(s);
+  for (uint16_t i = 0; i < ring_count; i++)
+  {
+    peh_ring_destroy(&set->streams[i].ring);
+  }
+  for (uint16_t i = 0; i < set->stream_count; i++)
+  {
+    if (set->streams[i].detector != NULL)
+    {
+      acc_detector_distance_destroy(set->streams[i].detector);
+    }
+  }
+  peh_sender_destroy(&sender);
+  peh_control_destroy(&control_channel);
 
   return service_status;
 }
 
-void reconfigure_sweeps(acc_service_configuration_t envelope_configuration)
+
+// Runs in the service thread of one sensor, only copies the sweep into its ring
+void envelope_callback(const acc_service_handle_t service_handle, const uint16_t *envelope_data, const acc_envelope_metadata_t *metadata, void *client_reference)
+{
+  stream_control_t *control = client_reference;
+  uint64_t arrival_us = monotonic_us();
+
+  if (service_handle != control->handle)
+  {
+    __atomic_store_n(&control->invalid_handle, control->invalid_handle + 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  if (control->have_sequence_number)
+  {
+    uint16_t step = metadata->sequence_number - control->last_service_sequence_number;
+
+    // A repeated sequence number would make step - 1 wrap, it is counted as the next sweep
+    if (step == 0)
+    {
+      step = 1;
+    }
+
+    __atomic_store_n(&control->lost_in_service, control->lost_in_service + step - 1, __ATOMIC_RELAXED);
+    control->sequence_number += step;
+  }
+  control->have_sequence_number = true;
+  control->last_service_sequence_number = metadata->sequence_number;
+
+  if (control->last_arrival_us != 0)
+  {
+    uint32_t interval_us = arrival_us - control->last_arrival_us;
+
+    peh_histogram_add(&control->arrival_interval, interval_us);
+    peh_histogram_add(&control->arrival_jitter, (interval_us > control->period_us) ? interval_us - control->period_us : control->period_us - interval_us);
+  }
+  control->last_arrival_us = arrival_us;
+
+  peh_sweep_t sweep = {
+    .sequence_number = control->sequence_number,
+    .timestamp_us = arrival_us + __atomic_load_n(&wall_clock_offset_us, __ATOMIC_RELAXED),
+    .ready_us = arrival_us,
+    .configuration_id = control->configuration_id,
+    .start_m = control->start_m,
+    .length_m = control->length_m,
+    .data_length = control->data_length,
+  };
+
+  if (peh_ring_push(&control->ring, &sweep, envelope_data))
+  {
+    peh_histogram_add(&control->latency_queued, monotonic_us() - arrival_us);
+    acc_os_semaphore_post(&sweeps_pushed);
+  }
+}
+
+
+// Records the latency of a sweep whose frames have all been sent and gives its slot back
+static void complete_sweep(stream_control_t *control, uint64_t sent_us)
+{
+  // Completed sweeps are the oldest unreleased slots of their ring
+  uint32_t latency_us = sent_us - peh_ring_get(&control->ring, 0)->ready_us;
+
+  peh_histogram_add(&control->latency_sent, latency_us);
+  if (latency_us > control->period_us)
+  {
+    __atomic_store_n(&control->deadline_missed, control->deadline_missed + 1, __ATOMIC_RELAXED);
+  }
+
+  peh_ring_release(&control->ring, 1);
+}
+
+
+// Releases the sweeps of all frames the sender is done with
+static void take_completed(stream_set_t *set, frame_queue_t *frames, uint32_t *queued)
+{
+  uint32_t completed = peh_sender_take_completed(&sender);
+  uint64_t sent_us = (completed > 0) ? monotonic_us() : 0;
+
+  for (; completed > 0; completed--)
+  {
+    uint8_t index = frames->stream[frames->first];
+
+    if (frames->last[frames->first])
+    {
+      complete_sweep(&set->streams[index], sent_us);
+      queued[index]--;
+    }
+
+    frames->first = (frames->first + 1) % PEH_SENDER_MAX_FRAMES;
+    frames->count--;
+  }
+}
+
+
+static void queue_frame(stream_set_t *set, frame_queue_t *frames, uint32_t *queued, uint8_t index, bool last,
+                        const peh_frame_header_t *header, const void *data)
+{
+  uint32_t position = (frames->first + frames->count) % PEH_SENDER_MAX_FRAMES;
+
+  frames->stream[position] = index;
+  frames->last[position] = last;
+  frames->count++;
+
+  peh_sender_add_frame(&sender, header, data);
+
+  // Keeps the queue from holding more than the sender, which flushes at PEH_SENDER_MAX_FRAMES
+  take_completed(set, frames, queued);
+}
+
+
+// Gets a detector ready for the configuration a sweep was taken with. An estimated threshold
+// only fits the range it was estimated for, so it is looked up again after every reconfiguration.
+static void prepare_detector(stream_control_t *control, const peh_sweep_t *sweep)
+{
+  control->detector_configuration_id = sweep->configuration_id;
+
+  if (threshold_estimation_sweeps == 0)
+  {
+    if (control->detector == NULL)
+    {
+      control->detector = acc_detector_distance_create_fixed(detector_threshold);
+    }
+    if (control->detector == NULL)
+    {
+      printf("\nSensor %u: could not create distance detector", (unsigned int)control->sensor_id);
+    }
+    return;
+  }
+
+  if (control->detector != NULL)
+  {
+    acc_detector_distance_destroy(control->detector);
+    control->detector = NULL;
+  }
+
+  control->detector_key.sensor_id = control->sensor_id;
+  control->detector_key.data_length = sweep->data_length;
+  control->detector_key.profile = control->profile;
+  control->detector_key.start_mm = (int32_t)(sweep->start_m * 1000.0f + 0.5f);
+  control->detector_key.length_mm = (int32_t)(sweep->length_m * 1000.0f + 0.5f);
+  control->estimation_remaining = 0;
+
+  void *threshold_data;
+  size_t threshold_size;
+
+  if (peh_threshold_cache_load(&control->detector_key, &threshold_data, &threshold_size))
+  {
+    control->detector = acc_detector_distance_create_with_threshold(threshold_size, threshold_data);
+    free(threshold_data);
+
+    if (control->detector != NULL)
+    {
+      printf("\nSensor %u: threshold for %d-%d mm loaded from cache", (unsigned int)control->sensor_id,
+             (int)control->detector_key.start_mm, (int)(control->detector_key.start_mm + control->detector_key.length_mm));
+      return;
+    }
+  }
+
+  control->detector = acc_detector_distance_create_empty();
+
+  if (control->detector == NULL)
+  {
+    printf("\nSensor %u: could not create distance detector", (unsigned int)control->sensor_id);
+    return;
+  }
+
+  control->estimation_remaining = threshold_estimation_sweeps;
+  printf("\nSensor %u: estimating threshold for %d-%d mm over %u sweeps, keep the range clear", (unsigned int)control->sensor_id,
+         (int)control->detector_key.start_mm, (int)(control->detector_key.start_mm + control->detector_key.length_mm),
+         (unsigned int)threshold_estimation_sweeps);
+}
+
+
+// Feeds one sweep to the threshold estimation and stores the threshold once it is complete
+static void estimate_threshold(stream_control_t *control, const peh_sweep_t *sweep)
+{
+  static uint16_t data[BUFLEN];
+
+  memcpy(data, sweep->data, sweep->data_length * sizeof(uint16_t));
+
+  if (acc_detector_distance_threshold_estimation_update(control->detector, sweep->start_m, sweep->start_m + sweep->length_m,
+                                                        sweep->data_length, data) != ACC_STATUS_SUCCESS)
+  {
+    __atomic_store_n(&control->detect_failed, control->detect_failed + 1, __ATOMIC_RELAXED);
+    return;
+  }
+
+  if (--control->estimation_remaining > 0)
+  {
+    return;
+  }
+
+  size_t threshold_size = 0;
+  uint8_t *threshold_data = NULL;
+
+  if (acc_detector_distance_threshold_estimation_get_size(control->detector, &threshold_size) == ACC_STATUS_SUCCESS &&
+      (threshold_data = malloc(threshold_size)) != NULL &&
+      acc_detector_distance_threshold_estimation_get_data(control->detector, threshold_size, threshold_data) == ACC_STATUS_SUCCESS &&
+      peh_threshold_cache_store(&control->detector_key, threshold_data, threshold_size))
+  {
+    printf("\nSensor %u: threshold estimated, %u bytes stored in cache", (unsigned int)control->sensor_id, (unsigned int)threshold_size);
+  }
+  else
+  {
+    printf("\nSensor %u: threshold estimated, could not be stored", (unsigned int)control->sensor_id);
+  }
+
+  free(threshold_data);
+}
+
+
+// Runs the distance detector on a copy of the sweep, the slot may still be sent as an envelope
+static uint16_t detect_reflections(stream_control_t *control, const peh_sweep_t *sweep, peh_frame_reflection_t *reflections)
+{
+  static uint16_t data[BUFLEN];
+  static acc_detector_distance_reflection_t found[BUFLEN];
+  uint16_t reflection_count = 0;
+  acc_status_t status;
+
+  memcpy(data, sweep->data, sweep->data_length * sizeof(uint16_t));
+
+  status = acc_detector_distance_detect(control->detector, sweep->start_m, sweep->start_m + sweep->length_m,
+                                        sweep->data_length, data, &reflection_count);
+
+  if (status == ACC_STATUS_SUCCESS && reflection_count > 0)
+  {
+    status = acc_detector_distance_get_reflections(control->detector, reflection_count, found);
+  }
+
+  if (status != ACC_STATUS_SUCCESS)
+  {
+    __atomic_store_n(&control->detect_failed, control->detect_failed + 1, __ATOMIC_RELAXED);
+    return 0;
+  }
+
+  if (reflection_count > MAX_REFLECTIONS)
+  {
+    reflection_count = MAX_REFLECTIONS;
+  }
+
+  for (uint16_t i = 0; i < reflection_count; i++)
+  {
+    reflections[i].distance_m = found[i].distance;
+    reflections[i].amplitude = found[i].amplitude;
+  }
+
+  return reflection_count;
+}
+
+
+// Drains the rings of all sensors so a stalled send never holds up acquisition.
+// Sweeps are sent oldest first across sensors.
+void sender_thread(void *param)
+{
+  stream_set_t *set = param;
+  static frame_queue_t frames;
+  peh_frame_header_t header;
+
+  memset(&header, 0, sizeof(header));
+  header.magic = PEH_FRAME_MAGIC;
+  header.version = PEH_FRAME_VERSION;
+  header.header_length = sizeof(header);
+
+  // Sweeps handed to the sender, their slots are released once all their frames are sent
+  uint32_t queued[MAX_SENSORS] = { 0 };
+
+  while (set->running)
+  {
+    stream_control_t *next = NULL;
+    peh_sweep_t *sweep = NULL;
+    uint16_t next_index = 0;
+
+    for (uint16_t i = 0; i < set->stream_count; i++)
+    {
+      stream_control_t *control = &set->streams[i];
+
+      if (peh_ring_available(&control->ring) == queued[i])
+      {
+        continue;
+      }
+
+      peh_sweep_t *candidate = peh_ring_get(&control->ring, queued[i]);
+
+      if (sweep == NULL || candidate->timestamp_us < sweep->timestamp_us)
+      {
+        next = control;
+        next_index = i;
+        sweep = candidate;
+      }
+    }
+
+    if (next == NULL)
+    {
+      uint32_t wait_us;
+
+      peh_sender_poll(&sender);
+      take_completed(set, &frames, queued);
+
+      // Sleeps until the next sweep is pushed, or until a partial batch is due, 0 waits without a timeout
+      if (!peh_sender_get_poll_wait(&sender, &wait_us))
+      {
+        wait_us = 0;
+      }
+      else if (wait_us == 0)
+      {
+        continue;
+      }
+
+      acc_os_semaphore_wait(&sweeps_pushed, wait_us);
+      continue;
+    }
+
+    if ((detector_threshold > 0 || threshold_estimation_sweeps > 0) && sweep->configuration_id != next->detector_configuration_id)
+    {
+      prepare_detector(next, sweep);
+    }
+
+    // Envelopes are sent while the threshold is being estimated
+    bool estimating = (next->estimation_remaining > 0);
+    bool detect = (next->detector != NULL && !estimating);
+    bool send_envelope = !detect || (envelope_interval > 0 && sweep->sequence_number % envelope_interval == 0);
+
+    header.sensor_id = next->sensor_id;
+    header.sequence_number = sweep->sequence_number;
+    header.timestamp_us = sweep->timestamp_us;
+    header.start_m = sweep->start_m;
+    header.length_m = sweep->length_m;
+
+    queued[next_index]++;
+
+    if (estimating)
+    {
+      estimate_threshold(next, sweep);
+    }
+
+    if (send_envelope)
+    {
+      header.type = PEH_FRAME_TYPE_ENVELOPE;
+      header.item_size = sizeof(uint16_t);
+      header.data_length = sweep->data_length;
+
+      peh_histogram_add(&next->latency_encoded, monotonic_us() - sweep->ready_us);
+
+      // The slot itself is sent, no copy of the bins
+      queue_frame(set, &frames, queued, next_index, !detect, &header, sweep->data);
+    }
+
+    if (detect)
+    {
+      // The reflections stay in the queue entry of their frame until it has been sent
+      uint32_t position = (frames.first + frames.count) % PEH_SENDER_MAX_FRAMES;
+
+      header.type = PEH_FRAME_TYPE_REFLECTIONS;
+      header.item_size = sizeof(peh_frame_reflection_t);
+      header.data_length = detect_reflections(next, sweep, frames.reflections[position]);
+
+      if (!send_envelope)
+      {
+        peh_histogram_add(&next->latency_encoded, monotonic_us() - sweep->ready_us);
+      }
+
+      queue_frame(set, &frames, queued, next_index, true, &header, frames.reflections[position]);
+    }
+  }
+
+  peh_sender_flush(&sender);
+}
+
+void reconfigure_sweeps(acc_service_configuration_t envelope_configuration, const stream_settings_t *settings)
 {
   acc_sweep_configuration_t sweep_configuration = acc_sweep_configuration_get(envelope_configuration);
   if (sweep_configuration == NULL) 
@@ -171,13 +1215,14 @@ void reconfigure_sweeps(acc_service_configuration_t envelope_configuration)
   }
   else 
   {
-    float start_m = 0.2;
-    float length_m = 1.0 - start_m;
-    float sweep_frequency_hz = 20;
+    // The profile resets the sweep setup, so it goes first and the sensor is set again after it
+    acc_sensor_id_t sensor_id = acc_sweep_configuration_sensor_get(sweep_configuration);
+
+    acc_service_envelope_profile_set(envelope_configuration, settings->profile);
 
-    acc_sweep_configuration_requested_start_set(sweep_configuration, start_m);
-    acc_sweep_configuration_requested_length_set(sweep_configuration, length_m);
-    acc_sweep_configuration_repetition_mode_streaming_set(sweep_configuration, sweep_frequency_hz);
+    acc_sweep_configuration_sensor_set(sweep_configuration, sensor_id);
+    acc_sweep_configuration_requested_start_set(sweep_configuration, settings->start_m);
+    acc_sweep_configuration_requested_length_set(sweep_configuration, settings->length_m);
+    acc_sweep_configuration_repetition_mode_streaming_set(sweep_configuration, settings->frequency_hz);
   }
 }
-
@@ -0,0 +1,211 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "acc_device_memory.h"
+#include "acc_types.h"
+#include "peh_threshold_cache.h"
+
+
+#define ENTRY_MAGIC	0x43544850	// "PHTC" in memory
+#define ENTRY_VERSION	1
+
+
+/**
+ * @brief Directory entry, as stored in memory
+ *
+ * @param magic ENTRY_MAGIC when the entry is in use
+ * @param version ENTRY_VERSION
+ * @param generation Increased by one for every store, the lowest one is replaced first
+ * @param size Size of the threshold data
+ * @param crc CRC-32 of the threshold data
+ */
+typedef struct {
+	uint32_t		magic;
+	uint32_t		version;
+	peh_threshold_key_t	key;
+	uint32_t		generation;
+	uint32_t		size;
+	uint32_t		crc;
+} cache_entry_t;
+
+
+static uint32_t entry_address(uint32_t index)
+{
+	return PEH_THRESHOLD_CACHE_ADDRESS + index * sizeof(cache_entry_t);
+}
+
+
+static uint32_t slot_address(uint32_t index)
+{
+	uint32_t directory_size = PEH_THRESHOLD_CACHE_ENTRIES * sizeof(cache_entry_t);
+
+	return PEH_THRESHOLD_CACHE_ADDRESS + directory_size + index * PEH_THRESHOLD_CACHE_SLOT_SIZE;
+}
+
+
+static uint32_t crc32(const uint8_t *data, size_t size)
+{
+	uint32_t crc = 0xffffffff;
+
+	for (size_t i = 0; i < size; i++) {
+		crc ^= data[i];
+		for (uint_fast8_t bit = 0; bit < 8; bit++) {
+			crc = (crc >> 1) ^ (0xedb88320 & -(crc & 1));
+		}
+	}
+
+	return ~crc;
+}
+
+
+static bool read_directory(cache_entry_t *entries)
+{
+	if (acc_device_memory_read(entry_address(0), entries, PEH_THRESHOLD_CACHE_ENTRIES * sizeof(*entries)) != ACC_STATUS_SUCCESS) {
+		fprintf(stderr, "Threshold cache: could not read directory\n");
+		return false;
+	}
+
+	return true;
+}
+
+
+static bool entry_in_use(const cache_entry_t *entry)
+{
+	return entry->magic == ENTRY_MAGIC && entry->version == ENTRY_VERSION;
+}
+
+
+static bool key_equal(const peh_threshold_key_t *a, const peh_threshold_key_t *b)
+{
+	return a->sensor_id == b->sensor_id && a->data_length == b->data_length && a->profile == b->profile &&
+	       a->start_mm == b->start_mm && a->length_mm == b->length_mm;
+}
+
+
+bool peh_threshold_cache_init(void)
+{
+	if (acc_device_memory_init() != ACC_STATUS_SUCCESS) {
+		fprintf(stderr, "Threshold cache: could not initialize memory\n");
+		return false;
+	}
+
+	return true;
+}
+
+
+bool peh_threshold_cache_load(const peh_threshold_key_t *key, void **data, size_t *size)
+{
+	cache_entry_t entries[PEH_THRESHOLD_CACHE_ENTRIES];
+
+	if (!read_directory(entries)) {
+		return false;
+	}
+
+	for (uint32_t index = 0; index < PEH_THRESHOLD_CACHE_ENTRIES; index++) {
+		cache_entry_t *entry = &entries[index];
+
+		if (!entry_in_use(entry) || !key_equal(&entry->key, key)) {
+			continue;
+		}
+
+		if (entry->size == 0 || entry->size > PEH_THRESHOLD_CACHE_SLOT_SIZE) {
+			return false;
+		}
+
+		uint8_t *buffer = malloc(entry->size);
+
+		if (buffer == NULL) {
+			return false;
+		}
+
+		if (acc_device_memory_read(slot_address(index), buffer, entry->size) != ACC_STATUS_SUCCESS ||
+		    crc32(buffer, entry->size) != entry->crc) {
+			fprintf(stderr, "Threshold cache: entry %u is damaged, ignored\n", (unsigned int)index);
+			free(buffer);
+			return false;
+		}
+
+		*data = buffer;
+		*size = entry->size;
+
+		return true;
+	}
+
+	return false;
+}
+
+
+bool peh_threshold_cache_store(const peh_threshold_key_t *key, const void *data, size_t size)
+{
+	cache_entry_t	entries[PEH_THRESHOLD_CACHE_ENTRIES];
+	cache_entry_t	entry;
+	uint32_t	generation = 0;
+	int32_t		target = -1;
+
+	if (size == 0 || size > PEH_THRESHOLD_CACHE_SLOT_SIZE) {
+		fprintf(stderr, "Threshold cache: %u bytes do not fit in a slot\n", (unsigned int)size);
+		return false;
+	}
+
+	if (!read_directory(entries)) {
+		return false;
+	}
+
+	// Same key first, then a free entry, then the least recently stored one
+	for (uint32_t index = 0; index < PEH_THRESHOLD_CACHE_ENTRIES; index++) {
+		if (entry_in_use(&entries[index]) && entries[index].generation >= generation) {
+			generation = entries[index].generation + 1;
+		}
+	}
+
+	for (uint32_t index = 0; index < PEH_THRESHOLD_CACHE_ENTRIES && target < 0; index++) {
+		if (entry_in_use(&entries[index]) && key_equal(&entries[index].key, key)) {
+			target = index;
+		}
+	}
+
+	for (uint32_t index = 0; index < PEH_THRESHOLD_CACHE_ENTRIES && target < 0; index++) {
+		if (!entry_in_use(&entries[index])) {
+			target = index;
+		}
+	}
+
+	if (target < 0) {
+		target = 0;
+		for (uint32_t index = 1; index < PEH_THRESHOLD_CACHE_ENTRIES; index++) {
+			if (entries[index].generation < entries[target].generation) {
+				target = index;
+			}
+		}
+	}
+
+	// Invalidate the entry before its slot is overwritten, so an interrupted store
+	// leaves a free entry rather than one pointing at half written data
+	memset(&entry, 0, sizeof(entry));
+	if (acc_device_memory_write(entry_address(target), &entry, sizeof(entry)) != ACC_STATUS_SUCCESS ||
+	    acc_device_memory_write(slot_address(target), data, size) != ACC_STATUS_SUCCESS) {
+		fprintf(stderr, "Threshold cache: could not write slot %u\n", (unsigned int)target);
+		return false;
+	}
+
+	entry.magic		= ENTRY_MAGIC;
+	entry.version		= ENTRY_VERSION;
+	entry.key		= *key;
+	entry.generation	= generation;
+	entry.size		= size;
+	entry.crc		= crc32(data, size);
+
+	if (acc_device_memory_write(entry_address(target), &entry, sizeof(entry)) != ACC_STATUS_SUCCESS) {
+		fprintf(stderr, "Threshold cache: could not write entry %u\n", (unsigned int)target);
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,83 @@
+// Copyright (c) Acconeer AB, 2018
+// All rights reserved
+
+#ifndef PEH_THRESHOLD_CACHE_H_
+#define PEH_THRESHOLD_CACHE_H_
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+
+/**
+ * @brief Layout of the cache in the non-volatile memory
+ *
+ * A directory of PEH_THRESHOLD_CACHE_ENTRIES entries starts at PEH_THRESHOLD_CACHE_ADDRESS,
+ * followed by one region of PEH_THRESHOLD_CACHE_SLOT_SIZE bytes per entry for the threshold
+ * data. When all entries are in use the least recently stored one is replaced.
+ */
+#define PEH_THRESHOLD_CACHE_ADDRESS	0
+#define PEH_THRESHOLD_CACHE_ENTRIES	16
+#define PEH_THRESHOLD_CACHE_SLOT_SIZE	(64 * 1024)
+
+
+/**
+ * @brief What a threshold was estimated for, a threshold is only valid for the same key
+ *
+ * Distances are kept in whole millimetres so a range read back from the service metadata
+ * matches the one the threshold was stored with.
+ *
+ * @param sensor_id The sensor
+ * @param data_length Number of points in a sweep
+ * @param profile Envelope profile
+ * @param start_mm Start of the swept range[mm]
+ * @param length_mm Length of the swept range[mm]
+ */
+typedef struct {
+	uint16_t	sensor_id;
+	uint16_t	data_length;
+	uint32_t	profile;
+	int32_t		start_mm;
+	int32_t		length_mm;
+} peh_threshold_key_t;
+
+
+/**
+ * @brief Initialize the memory device holding the cache
+ *
+ * @return True if successful
+ */
+extern bool peh_threshold_cache_init(void);
+
+
+/**
+ * @brief Read the threshold stored for a key
+ *
+ * @param key What the threshold is needed for
+ * @param[out] data Threshold data allocated with malloc(), to be freed by the caller
+ * @param[out] size Size of the threshold data
+ * @return True if a valid threshold was found
+ */
+extern bool peh_threshold_cache_load(const peh_threshold_key_t *key, void **data, size_t *size);
+
+
+/**
+ * @brief Store the threshold for a key, replacing any threshold stored for it before
+ *
+ * @param key What the threshold was estimated for
+ * @param data Threshold data from acc_detector_distance_threshold_estimation_get_data()
+ * @param size Size of the threshold data, at most PEH_THRESHOLD_CACHE_SLOT_SIZE
+ * @return True if successful
+ */
+extern bool peh_threshold_cache_store(const peh_threshold_key_t *key, const void *data, size_t size);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif